@@ -624,6 +624,8 @@ void t_msg(const char *file, int line, int64_t level, const char *fmt,...);
 #define REPLACE_IFNEWER  'w'
 #define REPLACE_NEVER    'n'
 #define REPLACE_IFOLDER  'o'
+#define REPLACE_IFCHANGED 'c'      /* write what differs, skip same size and mtime */
+#define REPLACE_IFDIFFERENT 'd'    /* write what differs */
 
 /** This probably should be done on a machine by machine basis, but it works */
 /** This is critical for the smartalloc routines to properly align memory */
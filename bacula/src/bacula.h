@@ -91,6 +91,11 @@
 #define O_NOATIME 0
 #endif
 
+/* O_DIRECT is defined at fcntl.h when supported */
+#ifndef O_DIRECT
+#define O_DIRECT 0
+#endif
+
 #if defined(_MSC_VER)
 extern "C" {
 #include "getopt.h"
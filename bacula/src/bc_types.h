@@ -239,7 +239,8 @@ enum {
    CF_ERROR,                      /* error creating file */
    CF_EXTRACT,                    /* file created, data to extract */
    CF_CREATED,                    /* file created, no data to extract */
-   CF_CORE                        /* let bacula core handle the file creation */
+   CF_CORE,                       /* let bacula core handle the file creation */
+   CF_DELTA                       /* file exists, write only the data that differs */
 };
 
 #ifndef MAX
@@ -699,6 +699,19 @@ const char *sql_media_order_most_recently_written[] =
    "ORDER BY LastWritten IS NULL,LastWritten DESC, MediaId"
 }; 
  
+/* Order of the accurate file list merged with the walk of the FD,
+ * the names must be compared byte by byte
+ */
+const char *sql_file_list_path_order[] =
+{
+   /* MySQL */
+   "ORDER BY Path.Path, T1.Filename",
+   /* PostgreSQL */
+   "ORDER BY Path.Path COLLATE \"C\", T1.Filename COLLATE \"C\"",
+   /* SQLite */
+   "ORDER BY Path.Path, T1.Filename"
+};
+
 const char *sql_get_max_connections[] =
 {
    /* MySQL */
@@ -60,6 +60,7 @@ extern const char CATS_IMP_EXP *sql_bvfs_list_files[];
 extern const char CATS_IMP_EXP *sql_bvfs_select[];
 extern const char CATS_IMP_EXP *sql_get_max_connections[];
 extern const char CATS_IMP_EXP *sql_media_order_most_recently_written[];
+extern const char CATS_IMP_EXP *sql_file_list_path_order[];
 extern const char CATS_IMP_EXP *uap_upgrade_copies_oldest_job[];
 extern const char CATS_IMP_EXP *uar_count_files;
 extern const char CATS_IMP_EXP *uar_count_files;
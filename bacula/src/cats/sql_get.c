@@ -1406,13 +1406,17 @@ bool BDB::bdb_get_file_list(JCR *jcr, char *jobids, int opts,
     * them ordered by date. JobTDate and JobId can be mixed if using Copy
     * or Migration
     */
+   const char *order = "ORDER BY T1.JobTDate, FileIndex ASC"; /* FileIndex for restore code */
+   if (opts & DBL_SORT_PATH) {
+      /* The accurate merge of the FD walks the directories in this order */
+      order = sql_file_list_path_order[bdb_get_type_index()];
+   }
    Mmsg(buf,
 "SELECT Path.Path, T1.Filename, T1.FileIndex, T1.JobId, LStat, DeltaSeq, MD5 "
  "FROM ( %s ) AS T1 "
  "JOIN Path ON (Path.PathId = T1.PathId) %s "
-"ORDER BY T1.JobTDate, FileIndex ASC",/* Return sorted by JobTDate */
-                                      /* FileIndex for restore code */
-        buf2.c_str(), type);
+"%s",
+        buf2.c_str(), type, order);
 
    if (!(opts & DBL_USE_MD5)) {
       strip_md5(buf.c_str());
@@ -31,6 +31,8 @@
 #define COMPRESS_NONE  0x4e4f4e45  /* used for incompressible block */
 #define COMPRESS_GZIP  0x475a4950
 #define COMPRESS_LZO1X 0x4c5a4f58
+#define COMPRESS_ZSTD  0x5a535444
+#define COMPRESS_LZ4   0x4c5a3442  /* LZ4B: uncompressed length + lz4 block */
 
 /*
  * Compression header version
@@ -40,7 +42,7 @@
 /* Compressed data stream header */
 typedef struct {
    uint32_t magic;      /* compression algo used in this compressed data stream */
-   uint16_t level;      /* compression level used */
+   uint16_t level;      /* compression level used (int16_t with zstd) */
    uint16_t version;    /* for futur evolution */
    uint32_t size;       /* compressed size of the original data */
 } comp_stream_header;
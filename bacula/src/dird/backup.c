@@ -43,6 +43,7 @@ static char storaddr[]  = "storage address=%s port=%d ssl=%d\n";
 /* Responses received from File daemon */
 static char OKbackup[]   = "2000 OK backup\n";
 static char OKstore[]    = "2000 OK storage\n";
+static char OKcache[]    = "2000 OK cacheaccurate jobids=";
 /* After 17 Aug 2013 */
 static char newEndJob[]  = "2800 End Job TermCode=%d JobFiles=%u "
                            "ReadBytes=%llu JobBytes=%llu Errors=%u "
@@ -155,6 +156,49 @@ static bool get_base_jobids(JCR *jcr, db_list_ctx *jobids)
    return jobids->count > 0;
 }
 
+/* Files of the accurate list sent to the FD */
+class accurate_list_ctx {
+public:
+   JCR *jcr;
+   accbatch *batch;                   /* NULL with the text format */
+
+   accurate_list_ctx(JCR *ajcr, bool use_batch) {
+      jcr = ajcr;
+      batch = use_batch ? New(accbatch()) : NULL;
+   };
+   ~accurate_list_ctx() {
+      if (batch) {
+         delete batch;
+      }
+   };
+   /* Send the last files of the batch */
+   bool flush() {
+      return !batch || batch->send(jcr->file_bsock);
+   };
+};
+
+/*
+ * Send one file of the accurate list, a deleted file has an empty LStat
+ */
+static int accurate_send_file(accurate_list_ctx *ctx, const char *path,
+                              const char *fname, const char *lstat,
+                              const char *chksum, const char *delta_seq)
+{
+   BSOCK *fd = ctx->jcr->file_bsock;
+
+   if (ctx->batch) {
+      ctx->batch->add(path, fname, lstat, chksum, str_to_int32((char *)delta_seq));
+      if (ctx->batch->full() && !ctx->batch->send(fd)) {
+         return 1;
+      }
+   } else if (*lstat) {
+      fd->fsend("%s%s%c%s%c%s%c%s", path, fname, 0, lstat, 0, chksum, 0, delta_seq);
+   } else {
+      fd->fsend("%s%s%c", path, fname, 0);
+   }
+   return 0;
+}
+
 /*
  * Foreach files in currrent list, send "/path/fname\0LStat\0MD5\0Delta" to FD
  *      row[0]=Path, row[1]=Filename, row[2]=FileIndex
@@ -162,7 +206,9 @@ static bool get_base_jobids(JCR *jcr, db_list_ctx *jobids)
  */
 static int accurate_list_handler(void *ctx, int num_fields, char **row)
 {
-   JCR *jcr = (JCR *)ctx;
+   accurate_list_ctx *actx = (accurate_list_ctx *)ctx;
+   JCR *jcr = actx->jcr;
+   const char *chksum = "";
 
    if (job_canceled(jcr)) {
       return 1;
@@ -178,13 +224,60 @@ static int accurate_list_handler(void *ctx, int num_fields, char **row)
        && row[6][0] /* skip checksum = '0' */
        && row[6][1])
    {
-      jcr->file_bsock->fsend("%s%s%c%s%c%s%c%s",
-                             row[0], row[1], 0, row[4], 0, row[6], 0, row[5]);
-   } else {
-      jcr->file_bsock->fsend("%s%s%c%s%c%c%s",
-                             row[0], row[1], 0, row[4], 0, 0, row[5]);
+      chksum = row[6];
    }
-   return 0;
+   return accurate_send_file(actx, row[0], row[1], row[4], chksum, row[5]);
+}
+
+/*
+ * Same as accurate_list_handler() for the files of the jobs done since
+ *  the list cached by the FD, a deleted file is sent without LStat.
+ */
+static int accurate_delta_handler(void *ctx, int num_fields, char **row)
+{
+   accurate_list_ctx *actx = (accurate_list_ctx *)ctx;
+
+   if (job_canceled(actx->jcr)) {
+      return 1;
+   }
+
+   if (row[2][0] == '0' || row[2][0] == '-') {
+      return accurate_send_file(actx, row[0], row[1], "", "", "0");
+   }
+   return accurate_list_handler(ctx, num_fields, row);
+}
+
+/*
+ * Ask the FD for the JobIds of the accurate list it has kept from
+ *  the previous job. When they are the first ones of the current list,
+ *  return the JobIds of the jobs done since, maybe an empty list.
+ *    DIR -> FD : cacheaccurate name=<job>
+ *    FD -> DIR : 2000 OK cacheaccurate jobids=<JobIds>
+ */
+static bool get_accurate_cache_delta(JCR *jcr, char *jobids, POOLMEM *&delta)
+{
+   BSOCK *fd = jcr->file_bsock;
+   POOL_MEM name(PM_NAME);
+   char *cached;
+   int len;
+
+   pm_strcpy(name, jcr->job->name());
+   bash_spaces(name);
+   fd->fsend("cacheaccurate name=%s\n", name.c_str());
+   if (fd->recv() <= 0 || strncmp(fd->msg, OKcache, strlen(OKcache)) != 0) {
+      Jmsg(jcr, M_WARNING, 0, _("Unable to get the accurate cache of the Client.\n"));
+      return false;
+   }
+   cached = fd->msg + strlen(OKcache);
+   strip_trailing_junk(cached);
+   len = strlen(cached);
+   Dmsg2(200, "cached jobids=%s jobids=%s\n", cached, jobids);
+   if (len == 0 || strncmp(jobids, cached, len) != 0 ||
+       (jobids[len] != 0 && jobids[len] != ',')) {
+      return false;
+   }
+   pm_strcpy(delta, jobids[len] ? jobids + len + 1 : "");
+   return true;
 }
 
 /* In this procedure, we check if the current fileset is using checksum
@@ -249,18 +342,26 @@ static bool is_checksum_needed_by_fileset(JCR *jcr)
 
 /*
  * Send current file list to FD
- *    DIR -> FD : accurate files=xxxx
+ *    DIR -> FD : accurate files=xxxx sorted=0|1 [batch=1] [cache=0|1 jobids=xxx]
  *    DIR -> FD : /path/to/file\0Lstat\0MD5\0Delta
  *    DIR -> FD : /path/to/dir/\0Lstat\0MD5\0Delta
  *    ...
  *    DIR -> FD : EOD
+ *
+ * With cache=1, only the files of the jobs done since the list cached
+ *  by the FD are sent, a deleted file is sent as /path/to/file\0
+ *
+ * With batch=1, the files are packed in the binary format of accbatch.h
  */
 bool send_accurate_current_files(JCR *jcr)
 {
    POOL_MEM buf;
    db_list_ctx jobids;
    db_list_ctx nb;
+   POOL_MEM delta;
+   POOL_MEM opt;
    char ed1[50];
+   bool sorted, cache, use_cache = false;
 
    /* In base level, no previous job is used and no restart incomplete jobs */
    if (jcr->is_canceled() || jcr->is_JobLevel(L_BASE)) {
@@ -307,11 +408,70 @@ bool send_accurate_current_files(JCR *jcr)
       Jmsg(jcr, M_INFO, 0, _("Sending Accurate information to the FD.\n"));
    }
 
+   /* The FD can merge its walk with the list sorted by path
+    * instead of loading it in memory
+    */
+   sorted = (jcr->job->accurate_merge || jcr->job->accurate_cache) && !jcr->HasBase;
+
+   /* The FD can keep the sorted list of an Incremental or Differential
+    * job, the next one gets only the changes of the jobs done since
+    */
+   cache = sorted && jcr->job->accurate_cache && jcr->FDVersion >= 15 &&
+      !jcr->rerunning && jcr->getJobType() == JT_BACKUP &&
+      (jcr->is_JobLevel(L_INCREMENTAL) || jcr->is_JobLevel(L_DIFFERENTIAL));
+   if (cache) {
+      use_cache = get_accurate_cache_delta(jcr, jobids.list, delta.addr());
+   }
+
    /* to be able to allocate the right size for htable */
    Mmsg(buf, "SELECT sum(JobFiles) FROM Job WHERE JobId IN (%s)", jobids.list);
    db_sql_query(jcr->db, buf.c_str(), db_list_handler, &nb);
    Dmsg2(200, "jobids=%s nb=%s\n", jobids.list, nb.list);
-   jcr->file_bsock->fsend("accurate files=%s\n", nb.list);
+
+   /* Recent FDs get the files packed in a few large messages */
+   accurate_list_ctx ctx(jcr, jcr->FDVersion >= 16);
+
+   Mmsg(buf, "accurate files=%s sorted=%d", nb.list, sorted);
+   if (ctx.batch) {
+      pm_strcat(buf, " batch=1");
+   }
+   if (cache) {
+      Dmsg2(200, "cache=%d delta=%s\n", use_cache, delta.c_str());
+      Mmsg(opt, " cache=%d jobids=%s", use_cache, jobids.list);
+      pm_strcat(buf, opt);
+   }
+   jcr->file_bsock->fsend("%s\n", buf.c_str());
+
+   if (use_cache) {
+      if (jcr->JobId && *delta.c_str()) {
+         Jmsg(jcr, M_INFO, 0, _("Using the accurate list cached by the FD, sending JobId(s): %s\n"),
+              delta.c_str());
+      } else if (jcr->JobId) {
+         Jmsg(jcr, M_INFO, 0, _("Using the accurate list cached by the FD, nothing to send.\n"));
+      }
+      if (*delta.c_str()) {
+         int opts = DBL_ALL_FILES | DBL_SORT_PATH;
+         if (jcr->use_accurate_chksum) {
+            opts |= DBL_USE_MD5;
+         }
+         if (!db_open_batch_connexion(jcr, jcr->db)) {
+            Jmsg0(jcr, M_FATAL, 0, "Can't get batch sql connexion");
+            return false;  /* Fail */
+         }
+         if (!db_get_file_list(jcr, jcr->db_batch, delta.c_str(), opts,
+                               accurate_delta_handler, (void *)&ctx)) {
+            Jmsg1(jcr, M_FATAL, 0, "%s", db_strerror(jcr->db_batch));
+            return false;
+         }
+      }
+      if (!ctx.flush()) {
+         Jmsg1(jcr, M_FATAL, 0, _("Network error sending the accurate list to the FD. ERR=%s\n"),
+               jcr->file_bsock->bstrerror());
+         return false;
+      }
+      jcr->file_bsock->signal(BNET_EOD);
+      return true;
+   }
 
    if (!db_open_batch_connexion(jcr, jcr->db)) {
       Jmsg0(jcr, M_FATAL, 0, "Can't get batch sql connexion");
@@ -325,22 +485,30 @@ bool send_accurate_current_files(JCR *jcr)
          return false;
       }
       if (!db_get_base_file_list(jcr, jcr->db, jcr->use_accurate_chksum,
-                            accurate_list_handler, (void *)jcr)) {
+                            accurate_list_handler, (void *)&ctx)) {
          Jmsg1(jcr, M_FATAL, 0, "%s", db_strerror(jcr->db));
          return false;
       }
 
    } else {
       int opts = jcr->use_accurate_chksum ? DBL_USE_MD5 : DBL_NONE;
+      if (sorted) {
+         opts |= DBL_SORT_PATH;
+      }
       if (!db_get_file_list(jcr, jcr->db_batch,
                        jobids.list, opts,
-                       accurate_list_handler, (void *)jcr)) {
+                       accurate_list_handler, (void *)&ctx)) {
          Jmsg1(jcr, M_FATAL, 0, "%s", db_strerror(jcr->db_batch));
          return false;
       }
    }
 
    /* TODO: close the batch connection ? (can be used very soon) */
+   if (!ctx.flush()) {
+      Jmsg1(jcr, M_FATAL, 0, _("Network error sending the accurate list to the FD. ERR=%s\n"),
+            jcr->file_bsock->bstrerror());
+      return false;
+   }
    jcr->file_bsock->signal(BNET_EOD);
    return true;
 }
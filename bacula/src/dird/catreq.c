@@ -695,6 +695,14 @@ static void update_attribute(JCR *jcr, char *msg, int32_t msglen)
          len = CRYPTO_DIGEST_SHA512_SIZE;
          type = CRYPTO_DIGEST_SHA512;
          break;
+      case STREAM_XXH128_DIGEST:
+         len = CRYPTO_DIGEST_XXH128_SIZE;
+         type = CRYPTO_DIGEST_XXH128;
+         break;
+      case STREAM_BLAKE3_DIGEST:
+         len = CRYPTO_DIGEST_BLAKE3_SIZE;
+         type = CRYPTO_DIGEST_BLAKE3;
+         break;
       default:
          /* Never reached ... */
          Jmsg(jcr, M_ERROR, 0, _("Catalog error updating file digest. Unsupported digest stream type: %d"),
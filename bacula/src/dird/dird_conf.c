@@ -661,6 +661,8 @@ RES_ITEM job_items[] = {
    {"SelectionPattern",   store_str, ITEM(res_job.selection_pattern), 0, 0, 0},
    {"SelectionType",      store_migtype, ITEM(res_job.selection_type), 0, 0, 0},
    {"Accurate",           store_bool, ITEM(res_job.accurate), 0,0,0},
+   {"AccurateMerge",      store_bool, ITEM(res_job.accurate_merge), 0, ITEM_DEFAULT, false},
+   {"AccurateCache",      store_bool, ITEM(res_job.accurate_cache), 0, ITEM_DEFAULT, false},
    {"AllowDuplicateJobs", store_bool, ITEM(res_job.AllowDuplicateJobs), 0, ITEM_DEFAULT, true},
    {"allowhigherduplicates",   store_bool, ITEM(res_job.AllowHigherDuplicates), 0, ITEM_DEFAULT, true},
    {"CancelLowerLevelDuplicates", store_bool, ITEM(res_job.CancelLowerLevelDuplicates), 0, ITEM_DEFAULT, false},
@@ -862,6 +864,8 @@ s_kw ReplaceOptions[] = {
    {"Always",         REPLACE_ALWAYS},
    {"IfNewer",        REPLACE_IFNEWER},
    {"IfOlder",        REPLACE_IFOLDER},
+   {"IfChanged",      REPLACE_IFCHANGED},
+   {"IfDifferent",    REPLACE_IFDIFFERENT},
    {"Never",          REPLACE_NEVER},
    {NULL,               0}
 };
@@ -1095,7 +1099,9 @@ void dump_resource(int type, RES *ares, void sendit(void *sock, const char *fmt,
          sendit(sock, _("     SpoolSize=%s\n"),        edit_uint64(res->res_job.spool_size, ed1));
       }
       if (res->res_job.JobType == JT_BACKUP) {
-         sendit(sock, _("     Accurate=%d\n"), res->res_job.accurate);
+         sendit(sock, _("     Accurate=%d AccurateMerge=%d AccurateCache=%d\n"),
+                res->res_job.accurate, res->res_job.accurate_merge,
+                res->res_job.accurate_cache);
       }
       if (res->res_job.max_bandwidth) {
          sendit(sock, _("     MaximumBandwidth=%lld\n"),
@@ -506,6 +506,8 @@ public:
    bool write_part_after_job;         /* Set to write part after job in SD */
    bool Enabled;                      /* Set if job enabled */
    bool accurate;                     /* Set if it is an accurate backup job */
+   bool accurate_merge;               /* Send the accurate list sorted to the FD */
+   bool accurate_cache;               /* The FD keeps the accurate list between jobs */
    bool AllowDuplicateJobs;           /* Allow duplicate jobs */
    bool AllowHigherDuplicates;        /* Permit Higher Level */
    bool CancelLowerLevelDuplicates;   /* Cancel lower level backup jobs */
@@ -557,6 +559,12 @@ enum {
    INC_KW_HONOR_NODUMP,
    INC_KW_XATTR,
    INC_KW_DEDUP,
+   INC_KW_WALKERTHREADS,
+   INC_KW_INODEORDER,
+   INC_KW_READAHEAD,
+   INC_KW_READAHEADSIZE,
+   INC_KW_PREFETCHFILES,
+   INC_KW_DIRECTIO,
    INC_KW_MAX                   /* Keep this last */
 };
 
@@ -512,11 +512,18 @@ static bool send_fileset(JCR *jcr)
             if (strip_compress || jcr->FDVersion >= 11) {
                int j = 0;
                for (k=0; fo->opts[k]!='\0'; k++) {
-                  /* Z compress option is followed by the single-digit compress level or 'o' */
+                  /* Z compress option is followed by the single-digit compress level or 'o',
+                   *  or by s[l]<level>: for zstd, or by l<acceleration>: for lz4
+                   */
                   if (strip_compress && fo->opts[k]=='Z') {
                      stripped_opts = true;
                      compress_disabled = true;
                      k++;                /* skip level */
+                     if (fo->opts[k] == 's' || fo->opts[k] == 'l') {
+                        while (fo->opts[k+1] && fo->opts[k] != ':') {
+                           k++;
+                        }
+                     }
                   } else if (jcr->FDVersion < 11 && fo->opts[k]=='d') {
                      stripped_opts = true;
                      k++;              /* skip level */
@@ -114,10 +114,16 @@ RES_ITEM options_items[] = {
    {"HonorNoDumpFlag", store_opts,    {0},   0, INC_KW_HONOR_NODUMP, 0},
    {"XattrSupport",    store_opts,    {0},   0, INC_KW_XATTR,        0},
    {"ReadFifo",        store_opts,    {0},   0, INC_KW_READFIFO,     0},
+   {"InodeOrder",      store_opts,    {0},   0, INC_KW_INODEORDER,   0},
+   {"DirectIO",        store_opts,    {0},   0, INC_KW_DIRECTIO,     0},
    {"BaseJob",         store_lopts,   {0}, 'J', INC_KW_BASEJOB,      0},
    {"Accurate",        store_lopts,   {0}, 'C', INC_KW_ACCURATE,     0},
    {"Verify",          store_lopts,   {0}, 'V', INC_KW_VERIFY,       0},
    {"StripPath",       store_lopts,   {0}, 'P', INC_KW_STRIPPATH,    0},
+   {"WalkerThreads",   store_lopts,   {0}, 'T', INC_KW_WALKERTHREADS, 0},
+   {"ReadAhead",       store_lopts,   {0}, 'Q', INC_KW_READAHEAD,    0},
+   {"ReadAheadSize",   store_lopts,   {0}, 'G', INC_KW_READAHEADSIZE, 0},
+   {"PrefetchFiles",   store_lopts,   {0}, 'F', INC_KW_PREFETCHFILES, 0},
    {"Regex",           store_regex,   {0},   0, 0, 0},
    {"RegexDir",        store_regex,   {0},   1, 0, 0},
    {"RegexFile",       store_regex,   {0},   2, 0, 0},
@@ -166,6 +172,12 @@ s_kw FS_option_kw[] = {
    {"StripPath",   INC_KW_STRIPPATH},
    {"HonorNoDumpFlag", INC_KW_HONOR_NODUMP},
    {"XattrSupport", INC_KW_XATTR},
+   {"WalkerThreads", INC_KW_WALKERTHREADS},
+   {"InodeOrder",  INC_KW_INODEORDER},
+   {"ReadAhead",   INC_KW_READAHEAD},
+   {"ReadAheadSize", INC_KW_READAHEADSIZE},
+   {"PrefetchFiles", INC_KW_PREFETCHFILES},
+   {"DirectIO",    INC_KW_DIRECTIO},
    {NULL,          0}
 };
 
@@ -183,6 +195,10 @@ s_kw FS_option_kw[] = {
  *   C = Accurate
  *   J = BaseJob
  *   P = StripPath
+ *   T = WalkerThreads
+ *   Q = ReadAhead
+ *   G = ReadAheadSize
+ *   F = PrefetchFiles
  *
  *   name       keyword             option
  */
@@ -190,6 +206,8 @@ struct s_fs_opt FS_options[] = {
    {"Md5",      INC_KW_DIGEST,        "M"},
    {"Sha256",   INC_KW_DIGEST,       "S2"},
    {"Sha512",   INC_KW_DIGEST,       "S3"},
+   {"Xxh128",   INC_KW_DIGEST,       "S4"},
+   {"Blake3",   INC_KW_DIGEST,       "S5"},
    {"Sha1",     INC_KW_DIGEST,        "S"},
    {"Gzip",     INC_KW_COMPRESSION,  "Z6"},
    {"Gzip1",    INC_KW_COMPRESSION,  "Z1"},
@@ -244,6 +262,10 @@ struct s_fs_opt FS_options[] = {
    {"No",       INC_KW_HONOR_NODUMP,  "0"},
    {"Yes",      INC_KW_XATTR,         "X"},
    {"No",       INC_KW_XATTR,         "0"},
+   {"Yes",      INC_KW_INODEORDER,    "I"},
+   {"No",       INC_KW_INODEORDER,    "0"},
+   {"Yes",      INC_KW_DIRECTIO,      "D"},
+   {"No",       INC_KW_DIRECTIO,      "0"},
    {NULL,       0,                      0}
 };
 
@@ -258,6 +280,72 @@ struct s_fs_opt FS_options[] = {
  * This function returns true for a long option (terminates with :)
  *   and false for a normal 1 or 2 character option.
  */
+/*
+ * Scan a zstd Compression option:
+ *   Zstd          level 3
+ *   Zstd1..Zstd22
+ *   ZstdFast1..ZstdFast100   negative (fast) levels
+ *  optionally followed by Long to enable long distance matching,
+ *  e.g. Zstd19Long. The option is sent to the FD as Zs[l]<level>:
+ */
+static bool scan_zstd_option(const char *str, char *opts, int optlen)
+{
+   const char *p = str + 4;           /* skip Zstd */
+   bool fast = false, is_long = false;
+   int level = 3;
+   char buf[50];
+
+   if (strncasecmp(p, "Fast", 4) == 0) {
+      fast = true;
+      level = 1;
+      p += 4;
+   }
+   if (B_ISDIGIT(*p)) {
+      level = 0;
+      while (B_ISDIGIT(*p) && level <= 1000) {
+         level = level * 10 + (*p++ - '0');
+      }
+   }
+   if (strcasecmp(p, "Long") == 0) {
+      is_long = true;
+   } else if (*p) {
+      return false;
+   }
+   if (level < 1 || level > (fast ? 100 : 22)) {
+      return false;
+   }
+   bsnprintf(buf, sizeof(buf), "Zs%s%d:", is_long ? "l" : "", fast ? -level : level);
+   bstrncat(opts, buf, optlen);
+   return true;
+}
+
+/*
+ * Scan a lz4 Compression option:
+ *   Lz4           default speed
+ *   Lz4Fast2..Lz4Fast100   faster, with a lower ratio
+ *  The option is sent to the FD as Zl<acceleration>:
+ */
+static bool scan_lz4_option(const char *str, char *opts, int optlen)
+{
+   const char *p = str + 3;           /* skip Lz4 */
+   int accel = 1;
+   char buf[50];
+
+   if (strncasecmp(p, "Fast", 4) == 0) {
+      p += 4;
+      accel = 0;
+      while (B_ISDIGIT(*p) && accel <= 1000) {
+         accel = accel * 10 + (*p++ - '0');
+      }
+   }
+   if (*p || accel < 1 || accel > 100) {
+      return false;
+   }
+   bsnprintf(buf, sizeof(buf), "Zl%d:", accel);
+   bstrncat(opts, buf, optlen);
+   return true;
+}
+
 static void scan_include_options(LEX *lc, int keyword, char *opts, int optlen)
 {
    int i;
@@ -325,6 +413,50 @@ static void scan_include_options(LEX *lc, int keyword, char *opts, int optlen)
       bstrncat(opts, lc->str, optlen);
       bstrncat(opts, ":", optlen);         /* terminate it */
       Dmsg3(900, "Catopts=%s option=%s optlen=%d\n", opts, option,optlen);
+   } else if (keyword == INC_KW_WALKERTHREADS) {
+      if (!is_an_integer(lc->str)) {
+         scan_err1(lc, _("Expected a walker threads positive integer, got:%s:"), lc->str);
+      }
+      bstrncat(opts, "T", optlen);         /* indicate walker threads */
+      bstrncat(opts, lc->str, optlen);
+      bstrncat(opts, ":", optlen);         /* terminate it */
+      Dmsg3(900, "Catopts=%s option=%s optlen=%d\n", opts, option,optlen);
+   } else if (keyword == INC_KW_READAHEAD) {
+      if (!is_an_integer(lc->str)) {
+         scan_err1(lc, _("Expected a read ahead positive integer, got:%s:"), lc->str);
+      }
+      bstrncat(opts, "Q", optlen);         /* indicate read ahead depth */
+      bstrncat(opts, lc->str, optlen);
+      bstrncat(opts, ":", optlen);         /* terminate it */
+      Dmsg3(900, "Catopts=%s option=%s optlen=%d\n", opts, option,optlen);
+   } else if (keyword == INC_KW_READAHEADSIZE) {
+      uint64_t size;
+      char buf[50];
+      if (!size_to_uint64(lc->str, lc->str_len, &size) || size == 0 ||
+          size > 64 * 1024 * 1024) {
+         scan_err1(lc, _("Expected a read ahead size up to 64MB, got:%s:"), lc->str);
+      }
+      bsnprintf(buf, sizeof(buf), "G%lld:", (long long)size); /* indicate read ahead size */
+      bstrncat(opts, buf, optlen);
+      Dmsg3(900, "Catopts=%s option=%s optlen=%d\n", opts, option,optlen);
+   } else if (keyword == INC_KW_PREFETCHFILES) {
+      if (!is_an_integer(lc->str)) {
+         scan_err1(lc, _("Expected a prefetch files positive integer, got:%s:"), lc->str);
+      }
+      bstrncat(opts, "F", optlen);         /* indicate files to prefetch */
+      bstrncat(opts, lc->str, optlen);
+      bstrncat(opts, ":", optlen);         /* terminate it */
+      Dmsg3(900, "Catopts=%s option=%s optlen=%d\n", opts, option,optlen);
+   } else if (keyword == INC_KW_COMPRESSION && strncasecmp(lc->str, "Lz4", 3) == 0) {
+      if (!scan_lz4_option(lc->str, opts, optlen)) {
+         scan_err1(lc, _("Expected a lz4 compression option, got:%s:"), lc->str);
+      }
+      Dmsg3(900, "Catopts=%s option=%s optlen=%d\n", opts, option,optlen);
+   } else if (keyword == INC_KW_COMPRESSION && strncasecmp(lc->str, "Zstd", 4) == 0) {
+      if (!scan_zstd_option(lc->str, opts, optlen)) {
+         scan_err1(lc, _("Expected a zstd compression level, got:%s:"), lc->str);
+      }
+      Dmsg3(900, "Catopts=%s option=%s optlen=%d\n", opts, option,optlen);
    /*
     * Standard keyword options for Include/Exclude
     */
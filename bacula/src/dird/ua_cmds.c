@@ -118,7 +118,8 @@ static struct cmdstruct commands[] = {                                      /* C
  { NT_("disable"),    disable_cmd,   _("Disable a job, attributes batch process"), NT_("job=<name> | client=<name> | schedule=<name> | storage=<name> | batch"),  true},
  { NT_("enable"),     enable_cmd,    _("Enable a job, attributes batch process"), NT_("job=<name> | client=<name> | schedule=<name> | storage=<name> | batch"),   true},
  { NT_("estimate"),   estimate_cmd,  _("Performs FileSet estimate, listing gives full listing"),
-   NT_("fileset=<fs> client=<cli> level=<level> accurate=<yes/no> job=<job> listing"), true},
+   NT_("fileset=<fs> client=<cli> level=<level> accurate=<yes/no> job=<job> listing\n"
+       "\tsample=<nn> progress=<seconds>"), true},
 
  { NT_("exit"),       quit_cmd,      _("Terminate Bconsole session"), NT_(""),         false},
  { NT_("gui"),        gui_cmd,       _("Non-interactive gui mode"),   NT_("on | off"), false},
@@ -1362,6 +1363,15 @@ static int var_cmd(UAContext *ua, const char *cmd)
    return 1;
 }
 
+/* Seconds between two progress lines of an estimate */
+#define ESTIMATE_PROGRESS 30
+
+/*
+ * Estimate the files of a job on the Client
+ *
+ *  sample=K extrapolates from one directory in K, progress=N
+ *  prints the counts found every N seconds (0 for none).
+ */
 static int estimate_cmd(UAContext *ua, const char *cmd)
 {
    JOB *job = NULL;
@@ -1369,6 +1379,8 @@ static int estimate_cmd(UAContext *ua, const char *cmd)
    FILESET *fileset = NULL;
    POOL_MEM buf;
    int listing = 0;
+   int sample = 0;
+   int progress = ESTIMATE_PROGRESS;
    char since[MAXSTRING];
    JCR *jcr = ua->jcr;
    int accurate=-1;
@@ -1435,6 +1447,24 @@ static int estimate_cmd(UAContext *ua, const char *cmd)
          listing = 1;
          continue;
       }
+      if (strcasecmp(ua->argk[i], NT_("sample")) == 0) {
+         if (ua->argv[i] && is_a_number(ua->argv[i]) && atoi(ua->argv[i]) > 0) {
+            sample = atoi(ua->argv[i]);
+            continue;
+         } else {
+            ua->error_msg(_("Invalid sample value, it must be a positive number.\n"));
+            return 1;
+         }
+      }
+      if (strcasecmp(ua->argk[i], NT_("progress")) == 0) {
+         if (ua->argv[i] && is_a_number(ua->argv[i])) {
+            progress = atoi(ua->argv[i]);
+            continue;
+         } else {
+            ua->error_msg(_("Invalid progress value, it must be a number of seconds.\n"));
+            return 1;
+         }
+      }
       if (strcasecmp(ua->argk[i], NT_("level")) == 0) {
          if (ua->argv[i]) {
             if (!get_level_from_name(ua->jcr, ua->argv[i])) {
@@ -1461,6 +1491,10 @@ static int estimate_cmd(UAContext *ua, const char *cmd)
          }
       }
    }
+   if (listing && sample > 1) {
+      ua->error_msg(_("A listing cannot be done with a sample.\n"));
+      return 1;
+   }
    if (!job && !(client && fileset)) {
       if (!(job = select_job_resource(ua))) {
          return 1;
@@ -1545,7 +1579,8 @@ static int estimate_cmd(UAContext *ua, const char *cmd)
       goto bail_out;
    }
 
-   jcr->file_bsock->fsend("estimate listing=%d\n", listing);
+   jcr->file_bsock->fsend("estimate listing=%d sample=%d progress=%d\n",
+                          listing, sample, progress);
    while (jcr->file_bsock->recv() >= 0) {
       ua->send_msg("%s", jcr->file_bsock->msg);
    }
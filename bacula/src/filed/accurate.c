@@ -23,24 +23,51 @@
 
 static int dbglvl=100;
 
-typedef struct PrivateCurFile {
-   hlink link;
-   char *fname;
-   char *lstat;
-   char *chksum;
-   int32_t delta_seq;
-   bool seen;
-} CurFile;
+/*
+ * The list of the previous jobs is kept in memory in the file_list,
+ *  or when the Director sends it sorted, in the file_spool that is
+ *  merged with a walk done in the same order.
+ */
+static bool accurate_has_list(JCR *jcr)
+{
+   return jcr->file_list || jcr->file_spool;
+}
+
+static bool accurate_mark_file_as_seen(JCR *jcr, acc_file *elt)
+{
+   if (jcr->file_spool) {
+      jcr->file_spool->set_seen(elt->id);
+   } else {
+      jcr->file_list->set_seen(elt->id);
+   }
+   return true;
+}
+
+static bool accurate_lookup(JCR *jcr, char *fname, acc_file *ret)
+{
+   bool found=false;
+
+   if (jcr->file_spool) {
+      found = jcr->file_spool->lookup(fname, ret);
+   } else {
+      found = jcr->file_list->lookup(fname, ret);
+   }
+   if (found) {
+      Dmsg1(dbglvl, "lookup <%s> ok\n", fname);
+   }
+
+   return found;
+}
 
 bool accurate_mark_file_as_seen(JCR *jcr, char *fname)
 {
-   if (!jcr->accurate || !jcr->file_list) {
+   acc_file elt;
+
+   if (!jcr->accurate || !accurate_has_list(jcr)) {
       return false;
    }
-   /* TODO: just use elt->seen = 1 */
-   CurFile *temp = (CurFile *)jcr->file_list->lookup(fname);
-   if (temp) {
-      temp->seen = 1;              /* records are in memory */
+   if (accurate_lookup(jcr, fname, &elt)) {
+      accurate_mark_file_as_seen(jcr, &elt);
       Dmsg1(dbglvl, "marked <%s> as seen\n", fname);
    } else {
       Dmsg1(dbglvl, "<%s> not found to be marked as seen\n", fname);
@@ -48,44 +75,207 @@ bool accurate_mark_file_as_seen(JCR *jcr, char *fname)
    return true;
 }
 
-static bool accurate_mark_file_as_seen(JCR *jcr, CurFile *elt)
+/* Walk the list of the previous jobs */
+static bool accurate_first(JCR *jcr, acc_file *elt)
 {
-   /* TODO: just use elt->seen = 1 */
-   CurFile *temp = (CurFile *)jcr->file_list->lookup(elt->fname);
-   if (temp) {
-      temp->seen = 1;              /* records are in memory */
+   if (jcr->file_spool) {
+      return jcr->file_spool->first(elt);
    }
+   return jcr->file_list->first(elt);
+}
+
+static bool accurate_next(JCR *jcr, acc_file *elt)
+{
+   if (jcr->file_spool) {
+      return jcr->file_spool->next(elt);
+   }
+   return jcr->file_list->next(elt);
+}
+
+#define foreach_accurate_file(elt, jcr) \
+        for (bool _acc_more = accurate_first(jcr, elt); \
+             _acc_more; \
+             _acc_more = accurate_next(jcr, elt))
+
+static bool accurate_init(JCR *jcr, int nbfile)
+{
+   jcr->file_list = New(acclist(nbfile));
    return true;
 }
 
-static bool accurate_lookup(JCR *jcr, char *fname, CurFile *ret)
+/*
+ * The list is sorted by path, spool it in the working directory,
+ *  the directories will be read in the same order.
+ */
+static bool accurate_init_spool(JCR *jcr)
 {
-   bool found=false;
-   ret->seen = 0;
+   POOL_MEM fname(PM_FNAME);
+   POOLMEM *errmsg = get_pool_memory(PM_MESSAGE);
+   bool ret = true;
 
-   CurFile *temp = (CurFile *)jcr->file_list->lookup(fname);
-   if (temp) {
-      memcpy(ret, temp, sizeof(CurFile));
-      found=true;
-      Dmsg1(dbglvl, "lookup <%s> ok\n", fname);
+   Mmsg(fname, "%s/%s.accurate", me->working_directory, jcr->Job);
+   jcr->file_spool = New(accspool());
+   if (!jcr->file_spool->open(fname.c_str(), errmsg)) {
+      /* The list will be loaded in memory */
+      Jmsg(jcr, M_WARNING, 0, "%s", errmsg);
+      delete jcr->file_spool;
+      jcr->file_spool = NULL;
+      ret = false;
    }
+   free_pool_memory(errmsg);
+   return ret;
+}
 
-   return found;
+/*
+ * All the list is spooled. If it was not sorted as expected,
+ *  load it in memory.
+ */
+static void accurate_end_spool(JCR *jcr, int nbfile)
+{
+   acc_file elt;
+
+   if (jcr->file_spool->end_add() && jcr->file_spool->is_sorted()) {
+      return;
+   }
+   Jmsg(jcr, M_INFO, 0, _("Accurate file list not sorted, loading it in memory.\n"));
+   accurate_init(jcr, nbfile);
+   foreach_acclist(&elt, jcr->file_spool) {
+      jcr->file_list->add(elt.fname, &elt.statp, elt.delta_seq,
+                          (const char *)elt.chksum);
+   }
+   delete jcr->file_spool;
+   jcr->file_spool = NULL;
 }
 
-static bool accurate_init(JCR *jcr, int nbfile)
+/*
+ * The sorted list of an Incremental or Differential job can be kept in
+ *  the working directory with the JobIds used to build it. The Director
+ *  of the next job then sends only the files of the jobs done since.
+ *    DIR -> FD : cacheaccurate name=<job>
+ *    FD -> DIR : 2000 OK cacheaccurate jobids=<JobIds>
+ */
+int accurate_cache_cmd(JCR *jcr)
 {
-   CurFile *elt = NULL;
-   jcr->file_list = (htable *)malloc(sizeof(htable));
-   jcr->file_list->init(elt, &elt->link, nbfile);
+   BSOCK *dir = jcr->dir_bsock;
+   POOL_MEM name(PM_NAME), fname(PM_FNAME);
+   POOLMEM *jobids = get_pool_memory(PM_NAME);
+   FILE *fp;
+
+   *jobids = 0;
+   name.check_size(dir->msglen + 1);
+   if (sscanf(dir->msg, "cacheaccurate name=%s", name.c_str()) != 1) {
+      dir->fsend(_("2991 Bad cacheaccurate command\n"));
+      free_pool_memory(jobids);
+      return false;
+   }
+#ifdef HAVE_DIR_READER
+   /* One list per Director and Job */
+   unbash_spaces(name);
+   Mmsg(fname, "%s-%s", jcr->director ? jcr->director->hdr.name : "", name.c_str());
+   for (char *p = fname.c_str(); *p; p++) {
+      if (!B_ISALPHA(*p) && !B_ISDIGIT(*p) && *p != '-' && *p != '_' && *p != '.') {
+         *p = '_';
+      }
+   }
+   Mmsg(name, "%s/%s", me->working_directory, fname.c_str());
+   bfree_and_null(jcr->accurate_cache);
+   jcr->accurate_cache = bstrdup(name.c_str());
+
+   /* The JobIds are written after the list */
+   Mmsg(fname, "%s.acache", jcr->accurate_cache);
+   if (access(fname.c_str(), F_OK) == 0) {
+      Mmsg(fname, "%s.acache.jobids", jcr->accurate_cache);
+      if ((fp = bfopen(fname.c_str(), "r")) != NULL) {
+         if (!bfgets(jobids, fp)) {
+            *jobids = 0;
+         }
+         strip_trailing_junk(jobids);
+         fclose(fp);
+      }
+   }
+#endif
+   Dmsg2(dbglvl, "accurate cache=%s jobids=%s\n", NPRT(jcr->accurate_cache), jobids);
+   dir->fsend("2000 OK cacheaccurate jobids=%s\n", jobids);
+   free_pool_memory(jobids);
    return true;
 }
 
+/* Add a file of the list kept by the previous job */
+static bool accurate_add_cached_file(JCR *jcr, acc_file *elt)
+{
+   if (jcr->file_spool) {
+      return jcr->file_spool->add(elt->fname, &elt->statp, elt->delta_seq,
+                                  (const char *)elt->chksum);
+   }
+   return jcr->file_list->add(elt->fname, &elt->statp, elt->delta_seq,
+                              (const char *)elt->chksum);
+}
+
+/*
+ * The files sent by the Director are merged with the cached list, add
+ *  the cached files sorted before fname, or all of them if fname is NULL.
+ *  A cached file with the same name is replaced or deleted.
+ */
+static void accurate_merge_cache(JCR *jcr, accspool *cache, acc_file *elt,
+                                 bool *more, const char *fname)
+{
+   int cmp = -1;
+
+   while (*more && (!fname || (cmp = acc_name_cmp(elt->fname, fname)) < 0)) {
+      accurate_add_cached_file(jcr, elt);
+      *more = cache->next(elt);
+   }
+   if (*more && cmp == 0) {
+      *more = cache->next(elt);
+   }
+}
+
+/*
+ * Keep the spool file of the job for the next one, the JobIds are
+ *  written last, they are removed when the list is received.
+ */
+static void accurate_save_cache(JCR *jcr)
+{
+   POOL_MEM fname(PM_FNAME), tmp(PM_FNAME);
+   POOLMEM *errmsg;
+   FILE *fp;
+
+   if (!jcr->accurate_cache || !jcr->accurate_cache_jobids ||
+       !jcr->file_spool || !jcr->file_spool->is_sorted()) {
+      return;
+   }
+   errmsg = get_pool_memory(PM_MESSAGE);
+   Mmsg(fname, "%s.acache", jcr->accurate_cache);
+   if (!jcr->file_spool->save_as(fname.c_str(), errmsg)) {
+      Jmsg(jcr, M_WARNING, 0, "%s", errmsg);
+      goto bail_out;
+   }
+   Mmsg(tmp, "%s.acache.tmp", jcr->accurate_cache);
+   Mmsg(fname, "%s.acache.jobids", jcr->accurate_cache);
+   if ((fp = bfopen(tmp.c_str(), "w")) == NULL) {
+      berrno be;
+      Jmsg(jcr, M_WARNING, 0, _("Could not create %s. ERR=%s\n"),
+           tmp.c_str(), be.bstrerror());
+      goto bail_out;
+   }
+   fprintf(fp, "%s\n", jcr->accurate_cache_jobids);
+   if (fclose(fp) != 0 || rename(tmp.c_str(), fname.c_str()) != 0) {
+      berrno be;
+      Jmsg(jcr, M_WARNING, 0, _("Could not write %s. ERR=%s\n"),
+           fname.c_str(), be.bstrerror());
+      unlink(tmp.c_str());
+      goto bail_out;
+   }
+   Dmsg2(dbglvl, "accurate list kept in %s.acache jobids=%s\n",
+         jcr->accurate_cache, jcr->accurate_cache_jobids);
+
+bail_out:
+   free_pool_memory(errmsg);
+}
+
 static bool accurate_send_base_file_list(JCR *jcr)
 {
-   CurFile *elt;
-   struct stat statc;
-   int32_t LinkFIc;
+   acc_file elt;
    bctx_t bctx;
 
    memset(&bctx, 0, sizeof(bctx));
@@ -96,22 +286,19 @@ static bool accurate_send_base_file_list(JCR *jcr)
       return true;
    }
 
-   if (jcr->file_list == NULL) {
+   if (!accurate_has_list(jcr)) {
       return true;
    }
 
    bctx.ff_pkt = init_find_files();
    bctx.ff_pkt->type = FT_BASE;
 
-   foreach_htable(elt, jcr->file_list) {
-      if (elt->seen) {
-         Dmsg2(dbglvl, "base file fname=%s seen=%i\n", elt->fname, elt->seen);
-         /* TODO: skip the decode and use directly the lstat field */
-         decode_stat(elt->lstat, &statc, sizeof(statc), &LinkFIc); /* decode catalog stat */
-         bctx.ff_pkt->fname = elt->fname;
-         bctx.ff_pkt->statp = statc;
+   foreach_accurate_file(&elt, jcr) {
+      if (elt.seen) {
+         Dmsg2(dbglvl, "base file fname=%s seen=%i\n", elt.fname, elt.seen);
+         bctx.ff_pkt->fname = elt.fname;
+         bctx.ff_pkt->statp = elt.statp;
          encode_and_send_attributes(bctx);
-//       free(elt->fname);
       }
    }
 
@@ -126,9 +313,7 @@ static bool accurate_send_base_file_list(JCR *jcr)
  */
 static bool accurate_send_deleted_list(JCR *jcr)
 {
-   CurFile *elt;
-   struct stat statc;
-   int32_t LinkFIc;
+   acc_file elt;
    bctx_t bctx;
 
    memset(&bctx, 0, sizeof(bctx));
@@ -139,25 +324,22 @@ static bool accurate_send_deleted_list(JCR *jcr)
       return true;
    }
 
-   if (jcr->file_list == NULL) {
+   if (!accurate_has_list(jcr)) {
       return true;
    }
 
    bctx.ff_pkt = init_find_files();
    bctx.ff_pkt->type = FT_DELETED;
 
-   foreach_htable(elt, jcr->file_list) {
-      if (elt->seen || plugin_check_file(jcr, elt->fname)) {
+   foreach_accurate_file(&elt, jcr) {
+      if (elt.seen || plugin_check_file(jcr, elt.fname)) {
          continue;
       }
-      Dmsg2(dbglvl, "deleted fname=%s seen=%i\n", elt->fname, elt->seen);
-      /* TODO: skip the decode and use directly the lstat field */
-      decode_stat(elt->lstat, &statc, sizeof(statc), &LinkFIc); /* decode catalog stat */
-      bctx.ff_pkt->fname = elt->fname;
-      bctx.ff_pkt->statp.st_mtime = statc.st_mtime;
-      bctx.ff_pkt->statp.st_ctime = statc.st_ctime;
+      Dmsg2(dbglvl, "deleted fname=%s seen=%i\n", elt.fname, elt.seen);
+      bctx.ff_pkt->fname = elt.fname;
+      bctx.ff_pkt->statp.st_mtime = elt.statp.st_mtime;
+      bctx.ff_pkt->statp.st_ctime = elt.statp.st_ctime;
       encode_and_send_attributes(bctx);
-//    free(elt->fname);
    }
 
    term_find_files(bctx.ff_pkt);
@@ -172,36 +354,63 @@ static bool accurate_send_deleted_list(JCR *jcr)
 static bool accurate_check_deleted_list(JCR *jcr)
 {
    bool ret=true;
-   CurFile *elt;
+   acc_file elt;
 
    if (!jcr->accurate) {
       return true;
    }
 
-   if (jcr->file_list == NULL) {
+   if (!accurate_has_list(jcr)) {
       return true;
    }
 
-   foreach_htable(elt, jcr->file_list) {
-      if (elt->seen) {
+   foreach_accurate_file(&elt, jcr) {
+      if (elt.seen) {
          continue;
       }
       if (ret) {
-         Jmsg(jcr, M_INFO, 0, _("The following files were in the Catalog, but not in the Job data:\n"), elt->fname);
+         Jmsg(jcr, M_INFO, 0, _("The following files were in the Catalog, but not in the Job data:\n"), elt.fname);
       }
       ret = false;
-      Jmsg(jcr, M_INFO, 0, _("    %s\n"), elt->fname);
+      Jmsg(jcr, M_INFO, 0, _("    %s\n"), elt.fname);
    }
    return ret;
 }
 
+/*
+ * Count the files of the accurate list not seen by an estimate,
+ *  the backup would send them as deleted. False if the level
+ *  does not send the deleted files.
+ */
+bool accurate_count_deleted(JCR *jcr, uint64_t *nb)
+{
+   acc_file elt;
+
+   *nb = 0;
+   if (!jcr->accurate || jcr->is_JobLevel(L_FULL) || !accurate_has_list(jcr)) {
+      return false;
+   }
+   foreach_accurate_file(&elt, jcr) {
+      if (elt.seen || plugin_check_file(jcr, elt.fname)) {
+         continue;
+      }
+      (*nb)++;
+   }
+   return true;
+}
+
 void accurate_free(JCR *jcr)
 {
    if (jcr->file_list) {
-      jcr->file_list->destroy();
-      free(jcr->file_list);
+      delete jcr->file_list;
       jcr->file_list = NULL;
    }
+   if (jcr->file_spool) {
+      accurate_save_cache(jcr);
+      delete jcr->file_spool;         /* removes the spool file */
+      jcr->file_spool = NULL;
+   }
+   bfree_and_null(jcr->accurate_cache_jobids);
 }
 
 /* Send the deleted or the base file list and cleanup  */
@@ -233,32 +442,20 @@ bool accurate_finish(JCR *jcr)
    return ret;
 }
 
-static bool accurate_add_file(JCR *jcr, uint32_t len,
-                              char *fname, char *lstat, char *chksum,
-                              int32_t delta)
+static bool accurate_add_file(JCR *jcr, char *fname, char *lstat,
+                              char *chksum, int32_t delta)
 {
-   bool ret = true;
-   CurFile *item;
-
-   /* we store CurFile, fname and ctime/mtime in the same chunk
-    * we need one extra byte to handle an empty chksum
-    */
-   item = (CurFile *)jcr->file_list->hash_malloc(sizeof(CurFile)+len+3);
-   item->seen = 0;
-
-   /* TODO: see if we can optimize this part with memcpy instead of strcpy */
-   item->fname  = (char *)item+sizeof(CurFile);
-   strcpy(item->fname, fname);
-
-   item->lstat  = item->fname+strlen(item->fname)+1;
-   strcpy(item->lstat, lstat);
-
-   item->chksum = item->lstat+strlen(item->lstat)+1;
-   strcpy(item->chksum, chksum);
-
-   item->delta_seq = delta;
+   struct stat statc;
+   int32_t LinkFIc;
+   bool ret;
 
-   jcr->file_list->insert(item->fname, item);
+   /* Only the decoded stat fields are kept */
+   decode_stat(lstat, &statc, sizeof(statc), &LinkFIc);
+   if (jcr->file_spool) {
+      ret = jcr->file_spool->add(fname, &statc, delta, chksum);
+   } else {
+      ret = jcr->file_list->add(fname, &statc, delta, chksum);
+   }
 
    Dmsg4(dbglvl, "add fname=<%s> lstat=%s  delta_seq=%i chksum=%s\n",
          fname, lstat, delta, chksum);
@@ -267,17 +464,16 @@ static bool accurate_add_file(JCR *jcr, uint32_t len,
 
 bool accurate_check_file(JCR *jcr, ATTR *attr, char *digest)
 {
-   struct stat statc;
-   int32_t LinkFIc;
+   struct stat *statc;
    bool stat = false;
    char ed1[50], ed2[50];
-   CurFile elt;
+   acc_file elt;
 
    if (!jcr->accurate) {
       goto bail_out;
    }
 
-   if (!jcr->file_list) {
+   if (!accurate_has_list(jcr)) {
       goto bail_out;             /* Not initialized properly */
    }
 
@@ -286,26 +482,27 @@ bool accurate_check_file(JCR *jcr, ATTR *attr, char *digest)
       stat = true;
       goto bail_out;
    }
-   decode_stat(elt.lstat, &statc, sizeof(statc), &LinkFIc); /* decode catalog stat */
+   statc = &elt.statp;                /* catalog stat */
 
    /*
     * Loop over options supplied by user and verify the
     * fields he requests.
     */
-   if (statc.st_size != attr->statp.st_size) {
+   if (statc->st_size != attr->statp.st_size) {
       Dmsg3(50, "%s      st_size  differs. Cat: %s File: %s\n",
             attr->fname,
-            edit_uint64((uint64_t)statc.st_size, ed1),
+            edit_uint64((uint64_t)statc->st_size, ed1),
             edit_uint64((uint64_t)attr->statp.st_size, ed2));
       Jmsg(jcr, M_INFO, 0, "Cat st_size differs: %s\n", attr->fname);
       stat = true;
    }
 
-   if (*elt.chksum && digest && *digest) {
-      if (strcmp(digest, elt.chksum)) {
+   if (elt.chksum_len && digest && *digest) {
+      if (!elt.chksum_equal(digest)) {
+         POOL_MEM buf;
          Dmsg3(50, "%s      chksum  differs. Cat: %s File: %s\n",
                attr->fname,
-               elt.chksum,
+               elt.chksum_str(buf.addr()),
                digest);
          Jmsg(jcr, M_INFO, 0, "Cat checksum differs: %s\n", attr->fname);
          stat = true;
@@ -333,12 +530,11 @@ bool accurate_check_file(JCR *jcr, FF_PKT *ff_pkt)
    int digest_stream = STREAM_NONE;
    DIGEST *digest = NULL;
 
-   struct stat statc;
-   int32_t LinkFIc;
+   struct stat *statc;
    bool stat = false;
    char *opts;
    char *fname;
-   CurFile elt;
+   acc_file elt;
 
    ff_pkt->delta_seq = 0;
    ff_pkt->accurate_found = false;
@@ -347,7 +543,7 @@ bool accurate_check_file(JCR *jcr, FF_PKT *ff_pkt)
       return true;
    }
 
-   if (!jcr->file_list) {
+   if (!accurate_has_list(jcr)) {
       return true;              /* Not initialized properly */
    }
 
@@ -369,8 +565,7 @@ bool accurate_check_file(JCR *jcr, FF_PKT *ff_pkt)
    unstrip_path(ff_pkt);     /* Get full path back */
    ff_pkt->accurate_found = true;
    ff_pkt->delta_seq = elt.delta_seq;
-
-   decode_stat(elt.lstat, &statc, sizeof(statc), &LinkFIc); /* decode catalog stat */
+   statc = &elt.statp;                /* catalog stat */
 
    if (!jcr->rerunning && (jcr->getJobLevel() == L_FULL)) {
       opts = ff_pkt->BaseJobOpts;
@@ -388,10 +583,10 @@ bool accurate_check_file(JCR *jcr, FF_PKT *ff_pkt)
       char ed1[30], ed2[30];
       switch (*p) {
       case 'i':                /* compare INODEs */
-         if (statc.st_ino != ff_pkt->statp.st_ino) {
+         if (statc->st_ino != ff_pkt->statp.st_ino) {
             Dmsg3(dbglvl-1, "%s      st_ino   differ. Cat: %s File: %s\n",
                   fname,
-                  edit_uint64((uint64_t)statc.st_ino, ed1),
+                  edit_uint64((uint64_t)statc->st_ino, ed1),
                   edit_uint64((uint64_t)ff_pkt->statp.st_ino, ed2));
             stat = true;
          }
@@ -400,54 +595,54 @@ bool accurate_check_file(JCR *jcr, FF_PKT *ff_pkt)
          /* TODO: If something change only in perm, user, group
           * Backup only the attribute stream
           */
-         if (statc.st_mode != ff_pkt->statp.st_mode) {
+         if (statc->st_mode != ff_pkt->statp.st_mode) {
             Dmsg3(dbglvl-1, "%s     st_mode  differ. Cat: %x File: %x\n",
                   fname,
-                  (uint32_t)statc.st_mode, (uint32_t)ff_pkt->statp.st_mode);
+                  (uint32_t)statc->st_mode, (uint32_t)ff_pkt->statp.st_mode);
             stat = true;
          }
          break;
       case 'n':                /* number of links */
-         if (statc.st_nlink != ff_pkt->statp.st_nlink) {
+         if (statc->st_nlink != ff_pkt->statp.st_nlink) {
             Dmsg3(dbglvl-1, "%s      st_nlink differ. Cat: %d File: %d\n",
                   fname,
-                  (uint32_t)statc.st_nlink, (uint32_t)ff_pkt->statp.st_nlink);
+                  (uint32_t)statc->st_nlink, (uint32_t)ff_pkt->statp.st_nlink);
             stat = true;
          }
          break;
       case 'u':                /* user id */
-         if (statc.st_uid != ff_pkt->statp.st_uid) {
+         if (statc->st_uid != ff_pkt->statp.st_uid) {
             Dmsg3(dbglvl-1, "%s      st_uid   differ. Cat: %u File: %u\n",
                   fname,
-                  (uint32_t)statc.st_uid, (uint32_t)ff_pkt->statp.st_uid);
+                  (uint32_t)statc->st_uid, (uint32_t)ff_pkt->statp.st_uid);
             stat = true;
          }
          break;
       case 'g':                /* group id */
-         if (statc.st_gid != ff_pkt->statp.st_gid) {
+         if (statc->st_gid != ff_pkt->statp.st_gid) {
             Dmsg3(dbglvl-1, "%s      st_gid   differ. Cat: %u File: %u\n",
                   fname,
-                  (uint32_t)statc.st_gid, (uint32_t)ff_pkt->statp.st_gid);
+                  (uint32_t)statc->st_gid, (uint32_t)ff_pkt->statp.st_gid);
             stat = true;
          }
          break;
       case 's':                /* size */
-         if (statc.st_size != ff_pkt->statp.st_size) {
+         if (statc->st_size != ff_pkt->statp.st_size) {
             Dmsg3(dbglvl-1, "%s      st_size  differ. Cat: %s File: %s\n",
                   fname,
-                  edit_uint64((uint64_t)statc.st_size, ed1),
+                  edit_uint64((uint64_t)statc->st_size, ed1),
                   edit_uint64((uint64_t)ff_pkt->statp.st_size, ed2));
             stat = true;
          }
          break;
       case 'a':                /* access time */
-         if (statc.st_atime != ff_pkt->statp.st_atime) {
+         if (statc->st_atime != ff_pkt->statp.st_atime) {
             Dmsg1(dbglvl-1, "%s      st_atime differs\n", fname);
             stat = true;
          }
          break;
       case 'm':                 /* modification time */
-         if (statc.st_mtime != ff_pkt->statp.st_mtime) {
+         if (statc->st_mtime != ff_pkt->statp.st_mtime) {
             Dmsg1(dbglvl-1, "%s      st_mtime differs\n", fname);
             stat = true;
          }
@@ -463,16 +658,16 @@ bool accurate_check_file(JCR *jcr, FF_PKT *ff_pkt)
          }
          break;
       case 'c':                /* ctime */
-         if (statc.st_ctime != ff_pkt->statp.st_ctime) {
+         if (statc->st_ctime != ff_pkt->statp.st_ctime) {
             Dmsg1(dbglvl-1, "%s      st_ctime differs\n", fname);
             stat = true;
          }
          break;
       case 'd':                /* file size decrease */
-         if (statc.st_size > ff_pkt->statp.st_size) {
+         if (statc->st_size > ff_pkt->statp.st_size) {
             Dmsg3(dbglvl-1, "%s      st_size  decrease. Cat: %s File: %s\n",
                   fname,
-                  edit_uint64((uint64_t)statc.st_size, ed1),
+                  edit_uint64((uint64_t)statc->st_size, ed1),
                   edit_uint64((uint64_t)ff_pkt->statp.st_size, ed2));
             stat = true;
          }
@@ -489,10 +684,10 @@ bool accurate_check_file(JCR *jcr, FF_PKT *ff_pkt)
           */
          if (!stat && ff_pkt->type != FT_LNKSAVED &&
              (S_ISREG(ff_pkt->statp.st_mode) &&
-              ff_pkt->flags & (FO_MD5|FO_SHA1|FO_SHA256|FO_SHA512)))
+              ff_pkt->flags & (FO_MD5|FO_SHA1|FO_SHA256|FO_SHA512|FO_XXH128|FO_BLAKE3)))
          {
 
-            if (!*elt.chksum && !jcr->rerunning) {
+            if (!elt.chksum_len && !jcr->rerunning) {
                Jmsg(jcr, M_WARNING, 0, _("Cannot verify checksum for %s\n"),
                     ff_pkt->fname);
                stat = true;
@@ -518,6 +713,14 @@ bool accurate_check_file(JCR *jcr, FF_PKT *ff_pkt)
             } else if (ff_pkt->flags & FO_SHA512) {
                digest = crypto_digest_new(jcr, CRYPTO_DIGEST_SHA512);
                digest_stream = STREAM_SHA512_DIGEST;
+
+            } else if (ff_pkt->flags & FO_XXH128) {
+               digest = crypto_digest_new(jcr, CRYPTO_DIGEST_XXH128);
+               digest_stream = STREAM_XXH128_DIGEST;
+
+            } else if (ff_pkt->flags & FO_BLAKE3) {
+               digest = crypto_digest_new(jcr, CRYPTO_DIGEST_BLAKE3);
+               digest_stream = STREAM_BLAKE3_DIGEST;
             }
 
             /* Did digest initialization fail? */
@@ -537,24 +740,20 @@ bool accurate_check_file(JCR *jcr, FF_PKT *ff_pkt)
                   jcr->JobErrors++;
 
                } else if (crypto_digest_finalize(digest, (uint8_t *)md, &size)) {
-                  char *digest_buf;
-                  const char *digest_name;
-
-                  digest_buf = (char *)malloc(BASE64_SIZE(size));
-                  digest_name = crypto_digest_name(digest);
-
-                  bin_to_base64(digest_buf, BASE64_SIZE(size), md, size, true);
-
-                  if (strcmp(digest_buf, elt.chksum)) {
-                     Dmsg4(dbglvl,"%s      %s chksum  diff. Cat: %s File: %s\n",
-                           fname,
-                           digest_name,
-                           elt.chksum,
-                           digest_buf);
+                  /* The checksum of the list is kept in binary */
+                  if (!elt.chksum_equal((uint8_t *)md, size)) {
+                     if (chk_dbglvl(dbglvl)) {
+                        POOL_MEM buf;
+                        char digest_buf[BASE64_SIZE(CRYPTO_DIGEST_MAX_SIZE)];
+                        bin_to_base64(digest_buf, sizeof(digest_buf), md, size, true);
+                        Dmsg4(dbglvl,"%s      %s chksum  diff. Cat: %s File: %s\n",
+                              fname,
+                              crypto_digest_name(digest),
+                              elt.chksum_str(buf.addr()),
+                              digest_buf);
+                     }
                      stat = true;
                   }
-
-                  free(digest_buf);
                }
                crypto_digest_free(digest);
             }
@@ -586,36 +785,135 @@ bail_out:
    return stat;
 }
 
+/* Value of an option of the accurate command, 0 when not sent */
+static int accurate_cmd_option(char *cmd, const char *name)
+{
+   char *p = strstr(cmd, name);
+   return p ? str_to_int32(p + strlen(name)) : 0;
+}
+
 /*
- * TODO: use big buffer from htable
+ * Add a file received from the Director, an empty LStat is a file
+ *  deleted since the list kept by the previous job
+ */
+static void accurate_recv_file(JCR *jcr, accspool *cache, acc_file *elt,
+                               bool *more, char *fname, char *lstat,
+                               char *chksum, int32_t delta_seq)
+{
+   if (cache) {
+      accurate_merge_cache(jcr, cache, elt, more, fname);
+   }
+   if (*lstat) {
+      accurate_add_file(jcr, fname, lstat, chksum, delta_seq);
+   }
+}
+
+/*
+ * Receive the list of the files of the previous jobs
+ *
+ * With cache=1, the Director sends only the files of the jobs done
+ *  since the list kept by accurate_save_cache(), the two sorted lists
+ *  are merged.
+ *
+ * With batch=1, each message holds many files in the format of
+ *  accbatch.h instead of one file.
  */
 int accurate_cmd(JCR *jcr)
 {
    BSOCK *dir = jcr->dir_bsock;
+   POOL_MEM fname(PM_FNAME);
+   POOLMEM *errmsg;
+   accspool *cache = NULL;
+   acc_file elt;
+   acc_batch_file file;
+   bool more = false, malformed = false;
    int lstat_pos, chksum_pos;
-   int32_t nb;
+   int32_t nb, pos;
+   int sorted, batch, use_cache, ret;
    uint16_t delta_seq;
+   char *p;
 
    if (job_canceled(jcr)) {
       return true;
    }
+   /* The options are not sent by old Directors, jobids= ends the line */
    if (sscanf(dir->msg, "accurate files=%ld", &nb) != 1) {
       dir->fsend(_("2991 Bad accurate command\n"));
       return false;
    }
+   sorted = accurate_cmd_option(dir->msg, " sorted=");
+   batch = accurate_cmd_option(dir->msg, " batch=");
+   use_cache = accurate_cmd_option(dir->msg, " cache=");
 
    jcr->accurate = true;
 
-   accurate_init(jcr, nb);
+#ifdef HAVE_DIR_READER
+   /* We can walk the directories in the order of the list */
+   if (sorted) {
+      accurate_init_spool(jcr);
+   }
+#endif
+   if (!jcr->file_spool) {
+      accurate_init(jcr, nb);
+   }
+
+   /* The list will be kept with the JobIds, the previous one is not valid anymore */
+   bfree_and_null(jcr->accurate_cache_jobids);
+   if (jcr->accurate_cache && (p = strstr(dir->msg, " jobids=")) != NULL) {
+      jcr->accurate_cache_jobids = bstrdup(p + strlen(" jobids="));
+      strip_trailing_junk(jcr->accurate_cache_jobids);
+      Mmsg(fname, "%s.acache.jobids", jcr->accurate_cache);
+      unlink(fname.c_str());
+   }
+   if (use_cache) {
+      errmsg = get_pool_memory(PM_MESSAGE);
+      pm_strcpy(errmsg, _("No list was kept.\n"));
+      cache = New(accspool());
+      Mmsg(fname, "%s.acache", NPRTB(jcr->accurate_cache));
+      if (!jcr->accurate_cache || !cache->open_existing(fname.c_str(), errmsg)) {
+         Jmsg(jcr, M_FATAL, 0, _("Unable to use the accurate list kept by the previous job. %s"),
+              errmsg);
+         delete cache;
+         cache = NULL;
+      }
+      free_pool_memory(errmsg);
+      if (!cache) {
+         bfree_and_null(jcr->accurate_cache_jobids);
+         while (dir->recv() >= 0) {
+            /* discard the list */
+         }
+         return false;
+      }
+      more = cache->first(&elt);
+   }
 
    /*
-    * buffer = sizeof(CurFile) + dirmsg
     * dirmsg = fname + \0 + lstat + \0 + checksum + \0 + delta_seq + \0
     */
    /* get current files */
    while (dir->recv() >= 0) {
+      if (malformed) {
+         continue;                    /* discard the end of the list */
+      }
+      if (batch) {
+         pos = 0;
+         while ((ret = acc_batch_next(dir->msg, dir->msglen, &pos, &file)) > 0) {
+            accurate_recv_file(jcr, cache, &elt, &more, file.fname, file.lstat,
+                               file.chksum, file.delta_seq);
+         }
+         if (ret < 0) {
+            Jmsg(jcr, M_FATAL, 0, _("Malformed accurate file list received from the Director.\n"));
+            malformed = true;
+         }
+         continue;
+      }
       lstat_pos = strlen(dir->msg) + 1;
-      if (lstat_pos < dir->msglen) {
+      if (lstat_pos >= dir->msglen) {
+         lstat_pos--;                 /* deleted file, point to the last \0 */
+         chksum_pos = lstat_pos;
+         delta_seq = 0;
+
+      } else {
          chksum_pos = lstat_pos + strlen(dir->msg + lstat_pos) + 1;
 
          if (chksum_pos >= dir->msglen) {
@@ -626,15 +924,38 @@ int accurate_cmd(JCR *jcr)
                                      chksum_pos +
                                      strlen(dir->msg + chksum_pos) + 1);
          }
-
-         accurate_add_file(jcr, dir->msglen,
-                           dir->msg,               /* Path */
-                           dir->msg + lstat_pos,   /* LStat */
-                           dir->msg + chksum_pos,  /* CheckSum */
-                           delta_seq);             /* Delta Sequence */
       }
+      accurate_recv_file(jcr, cache, &elt, &more,
+                         dir->msg,               /* Path */
+                         dir->msg + lstat_pos,   /* LStat */
+                         dir->msg + chksum_pos,  /* CheckSum */
+                         delta_seq);             /* Delta Sequence */
+   }
+   if (cache) {
+      if (!malformed) {
+         accurate_merge_cache(jcr, cache, &elt, &more, NULL);
+      }
+      delete cache;
+   }
+   if (malformed) {
+      bfree_and_null(jcr->accurate_cache_jobids);   /* do not keep the list */
+      accurate_free(jcr);
+      return false;
+   }
+   if (dir->is_error() || job_canceled(jcr)) {
+      bfree_and_null(jcr->accurate_cache_jobids);      /* the list is not complete */
    }
 
+   if (jcr->file_spool) {
+      accurate_end_spool(jcr, nb);
+   }
+   if (chk_dbglvl(dbglvl)) {
+      if (jcr->file_spool) {
+         jcr->file_spool->stats();
+      } else {
+         jcr->file_list->stats();
+      }
+   }
 #ifdef DEBUG
    char b1[50], b2[50], b3[50], b4[50], b5[50];
    Dmsg5(dbglvl," Heap: heap=%s smbytes=%s max_bytes=%s bufs=%s max_bufs=%s\n",
@@ -167,6 +167,7 @@ bool FDAuthenticateSD::authenticate_storagedaemon()
 {
    BSOCK *sd = jcr->store_bsock;
    int sd_version = 0;
+   int sd_comm = 0;
 
    /* Timeout authentication after 10 mins */
    StartAuthTimeout();
@@ -186,9 +187,11 @@ bool FDAuthenticateSD::authenticate_storagedaemon()
       auth_success = false;
       goto auth_fatal;
    }
-   sscanf(sd->msg, "3000 OK Hello %d", &sd_version);
+   sscanf(sd->msg, "3000 OK Hello %d comm=%d", &sd_version, &sd_comm);
+   jcr->SDVersion = sd_version;
    if (sd_version >= 1 && me->comm_compression) {
       sd->set_compress();
+      set_sd_compress_stream(sd, sd_comm);
    } else {
       sd->clear_compress();
       Dmsg0(050, "*** No FD compression with SD\n");
@@ -33,6 +33,12 @@ const bool have_lzo = true;
 const bool have_lzo = false;
 #endif
 
+#ifdef HAVE_ZSTD
+const bool have_zstd = true;
+#else
+const bool have_zstd = false;
+#endif
+
 #ifdef HAVE_LIBZ
 const bool have_libz = true;
 #else
@@ -48,6 +54,8 @@ static bool send_resource_fork(bctx_t &bctx);
 #endif
 static bool setup_compression(bctx_t &bctx);
 static bool do_lzo_compression(bctx_t &bctx);
+static bool do_zstd_compression(bctx_t &bctx);
+static bool do_lz4_compression(bctx_t &bctx);
 static bool do_libz_compression(bctx_t &bctx);
 
 /**
@@ -105,14 +113,22 @@ bool blast_data_to_storage_daemon(JCR *jcr, char *addr)
     *  was successful.
     *
     *  For the same reason, lzo compression is initialized here.
+    *
+    *  For zstd and lz4, the output buffer must hold the compress bound
+    *  of the input plus the comp_stream_header (and the lz4 length).
     */
    if (have_lzo) {
       jcr->compress_buf_size = MAX(jcr->buf_size + (jcr->buf_size / 16) + 67 + (int)sizeof(comp_stream_header), jcr->buf_size + ((jcr->buf_size+999) / 1000) + 30);
-      jcr->compress_buf = get_memory(jcr->compress_buf_size);
    } else {
       jcr->compress_buf_size = jcr->buf_size + ((jcr->buf_size+999) / 1000) + 30;
-      jcr->compress_buf = get_memory(jcr->compress_buf_size);
    }
+#ifdef HAVE_ZSTD
+   jcr->compress_buf_size = MAX(jcr->compress_buf_size,
+      (int32_t)(ZSTD_compressBound(jcr->buf_size) + sizeof(comp_stream_header)));
+#endif
+   jcr->compress_buf_size = MAX(jcr->compress_buf_size,
+      LZ4_compressBound(jcr->buf_size) + (int)sizeof(comp_stream_header) + 4);
+   jcr->compress_buf = get_memory(jcr->compress_buf_size);
 
 #ifdef HAVE_LIBZ
    z_stream *pZlibStream = (z_stream*)malloc(sizeof(z_stream));
@@ -141,6 +157,11 @@ bool blast_data_to_storage_daemon(JCR *jcr, char *addr)
    }
 #endif
 
+#ifdef HAVE_ZSTD
+   jcr->ZSTD_compress_workset = ZSTD_createCCtx();
+#endif
+   jcr->LZ4_compress_workset = malloc(LZ4_sizeofState());
+
    if (!crypto_session_start(jcr)) {
       return false;
    }
@@ -151,6 +172,8 @@ bool blast_data_to_storage_daemon(JCR *jcr, char *addr)
    /** in accurate mode, we overload the find_one check function */
    if (jcr->accurate) {
       set_find_changed_function((FF_PKT *)jcr->ff, accurate_check_file);
+      /* A sorted list is merged with the walk */
+      ((FF_PKT *)jcr->ff)->name_order = jcr->file_spool != NULL;
    }
    start_heartbeat_monitor(jcr);
 
@@ -165,6 +188,26 @@ bool blast_data_to_storage_daemon(JCR *jcr, char *addr)
       return false;
    }
 
+   /** Send the records of the small files together if the SD can unpack them */
+   if (client && client->small_file_pack_size > 0) {
+      if (jcr->SDVersion >= SD_VERSION_PACKED) {
+         sd->set_packing(client->small_file_pack_size);
+      } else {
+         Jmsg(jcr, M_INFO, 0, _("The Storage daemon cannot unpack the small files, "
+                                "SmallFilePackSize is ignored.\n"));
+      }
+   }
+
+   /** Write the messages sent to the SD together, the stream is not changed */
+   if (client && client->send_coalesce_size > 0) {
+      sd->set_coalescing(client->send_coalesce_size);
+   }
+
+   /** Spread the data processing over several threads if requested */
+   if (client && client->max_pipeline_threads > 0) {
+      start_backup_pipeline(jcr, client->max_pipeline_threads);
+   }
+
    /** Subroutine save_file() is called for each file */
    if (!find_files(jcr, (FF_PKT *)jcr->ff, save_file, plugin_save)) {
       ok = false;                     /* error */
@@ -192,7 +235,19 @@ bool blast_data_to_storage_daemon(JCR *jcr, char *addr)
    dedup_release_storage_bsock(jcr, sd);
 
    stop_heartbeat_monitor(jcr);
+   if (sd->is_packing()) {
+      char ed1[50], ed2[50];
+      sd->clear_packing();
+      Jmsg(jcr, M_INFO, 0, _("Small file records: %s messages sent in %s packs\n"),
+           edit_uint64_with_commas(sd->PackedMsgs(), ed1),
+           edit_uint64_with_commas(sd->Packs(), ed2));
+   }
    sd->signal(BNET_EOD);            /* end of sending data */
+   if (sd->is_coalescing()) {
+      sd->clear_coalescing();
+   }
+
+   stop_backup_pipeline(jcr);
 
 #ifdef HAVE_ACL
    if (jcr->bacl) {
@@ -222,6 +277,15 @@ bool blast_data_to_storage_daemon(JCR *jcr, char *addr)
    if (jcr->LZO_compress_workset) {
       bfree_and_null(jcr->LZO_compress_workset);
    }
+#ifdef HAVE_ZSTD
+   if (jcr->ZSTD_compress_workset) {
+      ZSTD_freeCCtx((ZSTD_CCtx *)jcr->ZSTD_compress_workset);
+      jcr->ZSTD_compress_workset = NULL;
+   }
+#endif
+   if (jcr->LZ4_compress_workset) {
+      bfree_and_null(jcr->LZ4_compress_workset);
+   }
 
    crypto_session_end(jcr);
 
@@ -274,6 +338,15 @@ int save_file(JCR *jcr, FF_PKT *ff_pkt, bool top_level)
       return 0;
    }
 
+   /* Do not keep the records of the previous files waiting */
+   if (!sd->flush_delayed()) {
+      if (!jcr->is_job_canceled()) {
+         Jmsg1(jcr, M_FATAL, 0, _("Network send error to SD. ERR=%s\n"),
+               sd->bstrerror());
+      }
+      return 0;
+   }
+
    jcr->num_files_examined++;         /* bump total file count */
 
    switch (ff_pkt->type) {
@@ -487,10 +560,13 @@ int save_file(JCR *jcr, FF_PKT *ff_pkt, bool top_level)
          tid = NULL;
       }
       int noatime = ff_pkt->flags & FO_NOATIME ? O_NOATIME : 0;
+      /* Keep the regular files out of the page cache if requested */
+      int directio = (ff_pkt->flags & FO_DIRECTIO) &&
+         (ff_pkt->type == FT_REG || ff_pkt->type == FT_REGE) ? O_DIRECT : 0;
       ff_pkt->bfd.reparse_point = (ff_pkt->type == FT_REPARSE ||
                                    ff_pkt->type == FT_JUNCTION);
       set_fattrs(&ff_pkt->bfd, &ff_pkt->statp);
-      if (bopen(&ff_pkt->bfd, ff_pkt->snap_fname, O_RDONLY | O_BINARY | noatime, 0) < 0) {
+      if (bopen(&ff_pkt->bfd, ff_pkt->snap_fname, O_RDONLY | O_BINARY | noatime | directio, 0) < 0) {
          ff_pkt->ff_errno = errno;
          berrno be;
          Jmsg(jcr, M_NOTSAVED, 0, _("     Cannot open \"%s\": ERR=%s.\n"), ff_pkt->snap_fname,
@@ -506,6 +582,10 @@ int save_file(JCR *jcr, FF_PKT *ff_pkt, bool top_level)
          stop_thread_timer(tid);
          tid = NULL;
       }
+      /* Start the asynchronous reads of a regular file if requested */
+      if (ff_pkt->ra && (ff_pkt->type == FT_REG || ff_pkt->type == FT_REGE)) {
+         bread_ahead_attach(&ff_pkt->bfd, ff_pkt->ra, ff_pkt->statp.st_size);
+      }
 
       stat = send_data(bctx, bctx.data_stream);
 
@@ -588,7 +668,12 @@ static int send_data(bctx_t &bctx, int stream)
 
    bctx.rsize = jcr->buf_size;
    bctx.fileAddr = 0;
+   bctx.sparse_extents = (bctx.ff_pkt->flags & FO_SPARSE) &&
+      S_ISREG(bctx.ff_pkt->statp.st_mode) && bctx.ff_pkt->type != FT_RAW;
+   bctx.data_start = bctx.data_end = 0;
    bctx.cipher_ctx = NULL;
+   bctx.aead = bctx.sealed = false;
+   bctx.dedup_client_side = false;
    bctx.msgsave = sd->msg;
    bctx.rbuf = sd->msg;                    /* read buffer */
    bctx.wbuf = sd->msg;                    /* write buffer */
@@ -674,6 +759,13 @@ static int send_data(bctx_t &bctx, int stream)
 #endif
    }
 
+#ifndef HAVE_WIN32
+   /** O_DIRECT reads are done by blocks of DIO_ALIGN bytes */
+   if (bctx.ff_pkt->bfd.m_flags & O_DIRECT) {
+      bctx.rsize = (bctx.rsize/DIO_ALIGN) * DIO_ALIGN;
+   }
+#endif
+
    /** a RAW device read on win32 only works if the buffer is a multiple of 512 */
 #ifdef HAVE_WIN32
    if (S_ISBLK(bctx.ff_pkt->statp.st_mode)) {
@@ -696,14 +788,40 @@ static int send_data(bctx_t &bctx, int stream)
    /* Fall through to standard bread() loop */
 #endif
 
+   /*
+    * With a backup pipeline, the digest, compression, encryption and
+    *  network work is handed to the pipeline threads, and we only read.
+    */
+   if (jcr->pipeline && !bctx.dedup_client_side) {
+      if (!pipeline_send_data(bctx)) {
+         goto err;
+      }
+      goto finish_sending;
+   }
+
    /*
     * Normal read the file data in a loop and send it to SD
     */
-   while ((sd->msglen=(uint32_t)bread(&bctx.ff_pkt->bfd, bctx.rbuf, bctx.rsize)) > 0) {
+   for ( ;; ) {
+      if (!sparse_skip_holes(bctx)) {
+         sd->msglen = -1;              /* seek error */
+         break;
+      }
+      /* The read may block, send what waits since a while */
+      if (!sd->flush_delayed()) {
+         if (!jcr->is_job_canceled()) {
+            Jmsg1(jcr, M_FATAL, 0, _("Network send error to SD. ERR=%s\n"),
+                  sd->bstrerror());
+         }
+         goto err;
+      }
+      if ((sd->msglen=(uint32_t)bread(&bctx.ff_pkt->bfd, bctx.rbuf, bctx.rsize)) <= 0) {
+         break;
+      }
       if (!process_and_send_data(bctx)) {
          goto err;
       }
-   } /* end while read file data */
+   } /* end for read file data */
    goto finish_sending;
 
 finish_sending:
@@ -714,10 +832,10 @@ finish_sending:
       if (jcr->JobErrors++ > 1000) {       /* insanity check */
          Jmsg(jcr, M_FATAL, 0, _("Too many errors. JobErrors=%d.\n"), jcr->JobErrors);
       }
-   } else if (bctx.ff_pkt->flags & FO_ENCRYPT) {
+   } else if ((bctx.ff_pkt->flags & FO_ENCRYPT) && !bctx.aead) {
       /**
        * For encryption, we must call finalize to push out any
-       *  buffered data.
+       *  buffered data. The sealed records have nothing buffered.
        */
       if (!crypto_cipher_finalize(bctx.cipher_ctx, (uint8_t *)jcr->crypto.crypto_buf,
            &bctx.encrypted_len)) {
@@ -743,6 +861,9 @@ finish_sending:
       }
    }
 
+   if (!dedup_end_client_side(bctx)) {
+      goto err;
+   }
    jcr->dedup->TransferJobBytes(&jcr->JobBytes); // transfer byte from
 
    if (!sd->signal(BNET_EOD)) {        /* indicate end of file data */
@@ -771,6 +892,59 @@ err:
 }
 
 
+/*
+ * With FO_SPARSE, skip the blocks of the file that are in a hole
+ *  without reading them. The filesystem tells us where the data is,
+ *  so a large thin provisioned file costs only the reads of its
+ *  allocated extents.
+ *
+ * The blocks are the same as the ones of the bread() loop, and only
+ *  a block that is_buf_zero() would have dropped is skipped: a full
+ *  block that is not the last one of the file. The records sent to
+ *  the SD are unchanged.
+ *
+ * Returns false on a seek error, the errno is in the bfd.
+ */
+bool sparse_skip_holes(bctx_t &bctx)
+{
+   BFILE *bfd = &bctx.ff_pkt->bfd;
+   boffset_t addr = (boffset_t)bctx.fileAddr;
+   boffset_t size = (boffset_t)bctx.ff_pkt->statp.st_size;
+   boffset_t len, nb;
+   bool query = false;
+
+   if (!bctx.sparse_extents) {
+      return true;
+   }
+   if (addr >= bctx.data_end) {
+      switch (bget_data_extent(bfd, addr, &bctx.data_start, &bctx.data_end)) {
+      case 1:
+         break;
+      case 0:                   /* a hole up to the end of the file */
+         bctx.data_start = bctx.data_end = MAX(size, addr);
+         break;
+      default:                  /* not supported, read everything */
+         bctx.sparse_extents = false;
+         bctx.data_start = bctx.data_end = 0;
+         break;
+      }
+      query = true;
+   }
+   /* Number of full blocks before the data, keeping the last block */
+   len = MIN(bctx.data_start - addr, size - 1 - addr);
+   nb = len > 0 ? len / bctx.rsize : 0;
+   if (nb > 0) {
+      Dmsg3(400, "Skip hole %lld-%lld of %s\n", (long long)addr,
+            (long long)(addr + nb * bctx.rsize), bctx.ff_pkt->fname);
+      bctx.fileAddr += nb * bctx.rsize;
+   }
+   /* bget_data_extent() moves the file position */
+   if ((query || nb > 0) && blseek(bfd, (boffset_t)bctx.fileAddr, SEEK_SET) < 0) {
+      return false;
+   }
+   return true;
+}
+
 /*
  * Apply processing (sparse, compression, encryption, and
  *   send to the SD.
@@ -829,8 +1003,8 @@ bool process_and_send_data(bctx_t &bctx)
       crypto_digest_update(bctx.digest, (uint8_t *)bctx.rbuf, sd->msglen);
    }
 
-   /** Update signing digest if requested */
-   if (bctx.signing_digest) {
+   /** Update signing digest if requested, see encrypt_and_send_data() for AEAD */
+   if (bctx.signing_digest && !bctx.aead) {
       crypto_digest_update(bctx.signing_digest, (uint8_t *)bctx.rbuf, sd->msglen);
    }
 
@@ -842,6 +1016,31 @@ bool process_and_send_data(bctx_t &bctx)
       goto err;
    }
 
+   if (have_zstd && !do_zstd_compression(bctx)) {
+      goto err;
+   }
+
+   if (!do_lz4_compression(bctx)) {
+      goto err;
+   }
+
+   ret = encrypt_and_send_data(bctx);
+
+err:
+   return ret;
+}
+
+/*
+ * Encrypt the (possibly compressed) block found at bctx.cipher_input
+ *   and send the result to the SD. On entry sd->msglen holds the
+ *   length of the data block without the file address.
+ */
+bool encrypt_and_send_data(bctx_t &bctx)
+{
+   bool  ret = false;
+   BSOCK *sd = bctx.sd;
+   JCR *jcr = bctx.jcr;
+
    /**
     * Note, here we prepend the current record length to the beginning
     *  of the encrypted data. This is because both sparse and compression
@@ -854,8 +1053,35 @@ bool process_and_send_data(bctx_t &bctx)
     *  out in subsequent crypto_cipher_update() calls or at least
     *  when crypto_cipher_finalize() is called.  Unfortunately, this
     *  "feature" of encryption enormously complicates the restore code.
+    *
+    * With an AEAD cipher (AES-GCM), each record is sealed on its own
+    *  with the next record number of the session. The restore gets the
+    *  records back as they were, so there is neither a length nor any
+    *  buffered data, and the records may be sealed in any order by the
+    *  workers of the backup pipeline. The signature covers the tags of
+    *  the records, in file order, rather than the data.
     */
-   if (bctx.ff_pkt->flags & FO_ENCRYPT) {
+   if ((bctx.ff_pkt->flags & FO_ENCRYPT) && bctx.aead) {
+      if (!bctx.sealed) {
+         if (!crypto_cipher_seal(bctx.cipher_ctx, jcr->crypto.pki_record++,
+                bctx.cipher_input, bctx.cipher_input_len,
+                (uint8_t *)jcr->crypto.crypto_buf, &bctx.encrypted_len)) {
+            /** Encryption failed. Shouldn't happen. */
+            Jmsg(jcr, M_FATAL, 0, _("Encryption error\n"));
+            goto err;
+         }
+         bctx.wbuf = jcr->crypto.crypto_buf;
+      }
+      if (bctx.signing_digest) {
+         crypto_digest_update(bctx.signing_digest,
+            (uint8_t *)bctx.wbuf + bctx.encrypted_len - CRYPTO_RECORD_TAG_SIZE,
+            CRYPTO_RECORD_TAG_SIZE);
+      }
+      Dmsg2(400, "sealed len=%d unencrypted len=%d\n", bctx.encrypted_len,
+            sd->msglen);
+      sd->msglen = bctx.encrypted_len;
+
+   } else if (bctx.ff_pkt->flags & FO_ENCRYPT) {
       uint32_t initial_len = 0;
       ser_declare;
 
@@ -895,10 +1121,9 @@ bool process_and_send_data(bctx_t &bctx)
       }
    }
 
+   /* The blocks of the chunks are sent as references */
    if (bctx.dedup_client_side) {
-      if (!do_dedup_client_side(bctx)) {
-         goto err;
-      }
+      return do_dedup_client_side(bctx);
    }
 
    /* Send the buffer to the Storage daemon */
@@ -1097,7 +1322,6 @@ static bool setup_compression(bctx_t &bctx)
 {
    JCR *jcr = bctx.jcr;
 
-#if defined(HAVE_LIBZ) || defined(HAVE_LZO)
    bctx.compress_len = 0;
    bctx.max_compress_len = 0;
    bctx.cbuf = NULL;
@@ -1152,7 +1376,30 @@ static bool setup_compression(bctx_t &bctx)
       bctx.cipher_input = (uint8_t *)jcr->compress_buf; /* encrypt compressed data */
    }
  #endif
-#endif
+ #ifdef HAVE_ZSTD
+   if ((bctx.ff_pkt->flags & FO_COMPRESS) && bctx.ff_pkt->Compress_algo == COMPRESS_ZSTD) {
+      if ((bctx.ff_pkt->flags & FO_SPARSE) || (bctx.ff_pkt->flags & FO_OFFSETS)) {
+         bctx.cbuf = (unsigned char *)jcr->compress_buf + OFFSET_FADDR_SIZE;
+         bctx.max_compress_len = jcr->compress_buf_size - OFFSET_FADDR_SIZE;
+      } else {
+         bctx.cbuf = (unsigned char *)jcr->compress_buf;
+         bctx.max_compress_len = jcr->compress_buf_size; /* set max length */
+      }
+      bctx.wbuf = jcr->compress_buf;    /* compressed output here */
+      bctx.cipher_input = (uint8_t *)jcr->compress_buf; /* encrypt compressed data */
+   }
+ #endif
+   if ((bctx.ff_pkt->flags & FO_COMPRESS) && bctx.ff_pkt->Compress_algo == COMPRESS_LZ4) {
+      if ((bctx.ff_pkt->flags & FO_SPARSE) || (bctx.ff_pkt->flags & FO_OFFSETS)) {
+         bctx.cbuf = (unsigned char *)jcr->compress_buf + OFFSET_FADDR_SIZE;
+         bctx.max_compress_len = jcr->compress_buf_size - OFFSET_FADDR_SIZE;
+      } else {
+         bctx.cbuf = (unsigned char *)jcr->compress_buf;
+         bctx.max_compress_len = jcr->compress_buf_size; /* set max length */
+      }
+      bctx.wbuf = jcr->compress_buf;    /* compressed output here */
+      bctx.cipher_input = (uint8_t *)jcr->compress_buf; /* encrypt compressed data */
+   }
    return true;
 }
 
@@ -1171,7 +1418,7 @@ static bool send_resource_fork(bctx_t &bctx)
    if (ff_pkt->type != FT_LNKSAVED && (S_ISREG(ff_pkt->statp.st_mode) &&
        ff_pkt->flags & FO_HFSPLUS)) {
       if (ff_pkt->hfsinfo.rsrclength > 0) {
-         int flags;
+         uint64_t flags;
          int rsrc_stream;
          if (bopen_rsrc(&ff_pkt->bfd, ff_pkt->fname, O_RDONLY | O_BINARY, 0) < 0) {
             ff_pkt->ff_errno = errno;
@@ -1217,38 +1464,183 @@ static bool send_resource_fork(bctx_t &bctx)
 }
 #endif
 
+/*
+ * Compress one block with zlib using the given deflate stream.
+ *  The stream is reset after each block, so that any thread
+ *  owning a stream can compress any block of a file.
+ */
+bool libz_compress_block(JCR *jcr, void *zlib_workset, const char *in,
+                         uint32_t in_len, unsigned char *cbuf,
+                         uint32_t max_compress_len, uint32_t *compress_len)
+{
+#ifdef HAVE_LIBZ
+   z_stream *strm = (z_stream *)zlib_workset;
+   int zstat;
+
+   Dmsg3(400, "cbuf=0x%x rbuf=0x%x len=%u\n", cbuf, in, in_len);
+
+   strm->next_in   = (unsigned char *)in;
+   strm->avail_in  = in_len;
+   strm->next_out  = cbuf;
+   strm->avail_out = max_compress_len;
+
+   if ((zstat=deflate(strm, Z_FINISH)) != Z_STREAM_END) {
+      Jmsg(jcr, M_FATAL, 0, _("Compression deflate error: %d\n"), zstat);
+      jcr->setJobStatus(JS_ErrorTerminated);
+      return false;
+   }
+   *compress_len = strm->total_out;
+   /** reset zlib stream to be able to begin from scratch again */
+   if ((zstat=deflateReset(strm)) != Z_OK) {
+      Jmsg(jcr, M_FATAL, 0, _("Compression deflateReset error: %d\n"), zstat);
+      jcr->setJobStatus(JS_ErrorTerminated);
+      return false;
+   }
+
+   Dmsg2(400, "GZIP compressed len=%d uncompressed len=%d\n", *compress_len,
+         in_len);
+#endif
+   return true;
+}
+
+/*
+ * Compress one block with LZO. The compressed data is prefixed
+ *  by a comp_stream_header written at cbuf.
+ */
+bool lzo_compress_block(JCR *jcr, void *lzo_workset, const char *in,
+                        uint32_t in_len, unsigned char *cbuf,
+                        uint32_t max_compress_len, uint32_t *compress_len)
+{
+#ifdef HAVE_LZO
+   lzo_uint len;          /* TODO: See with the latest patch how to handle lzo_uint with 64bit */
+   unsigned char *cbuf2 = cbuf + sizeof(comp_stream_header);
+   int lzores;
+
+   ser_declare;
+   ser_begin(cbuf, sizeof(comp_stream_header));
+
+   Dmsg3(400, "cbuf=0x%x rbuf=0x%x len=%u\n", cbuf, in, in_len);
+
+   lzores = lzo1x_1_compress((const unsigned char*)in, in_len, cbuf2,
+                             &len, lzo_workset);
+   if (lzores == LZO_E_OK && len <= max_compress_len) {
+      /* complete header */
+      ser_uint32(COMPRESS_LZO1X);
+      ser_uint32(len);
+      ser_uint16(0);                  /* level, not used with LZO */
+      ser_uint16(COMP_HEAD_VERSION);
+   } else {
+      /** this should NEVER happen */
+      Jmsg(jcr, M_FATAL, 0, _("Compression LZO error: %d\n"), lzores);
+      jcr->setJobStatus(JS_ErrorTerminated);
+      return false;
+   }
+
+   Dmsg2(400, "LZO compressed len=%d uncompressed len=%d\n", len, in_len);
+
+   *compress_len = len + sizeof(comp_stream_header); /* add size of header */
+#endif
+   return true;
+}
+
+/*
+ * Compress one block with zstd. Each block is a complete zstd frame
+ *  prefixed by a comp_stream_header written at cbuf. The level may
+ *  be negative (fast levels), it is kept in the header as an int16.
+ */
+bool zstd_compress_block(JCR *jcr, void *zstd_workset, int level, bool long_mode,
+                         const char *in, uint32_t in_len, unsigned char *cbuf,
+                         uint32_t max_compress_len, uint32_t *compress_len)
+{
+#ifdef HAVE_ZSTD
+   ZSTD_CCtx *cctx = (ZSTD_CCtx *)zstd_workset;
+   unsigned char *cbuf2 = cbuf + sizeof(comp_stream_header);
+   size_t len;
+
+   ser_declare;
+   ser_begin(cbuf, sizeof(comp_stream_header));
+
+   Dmsg3(400, "cbuf=0x%x rbuf=0x%x len=%u\n", cbuf, in, in_len);
+
+   len = ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+   if (!ZSTD_isError(len)) {
+      len = ZSTD_CCtx_setParameter(cctx, ZSTD_c_enableLongDistanceMatching, long_mode ? 1 : 0);
+   }
+   if (!ZSTD_isError(len)) {
+      len = ZSTD_compress2(cctx, cbuf2, max_compress_len - sizeof(comp_stream_header),
+                           in, in_len);
+   }
+   if (ZSTD_isError(len)) {
+      Jmsg(jcr, M_FATAL, 0, _("Compression ZSTD error: %s\n"), ZSTD_getErrorName(len));
+      jcr->setJobStatus(JS_ErrorTerminated);
+      return false;
+   }
+   /* complete header */
+   ser_uint32(COMPRESS_ZSTD);
+   ser_uint32(len);
+   ser_uint16((uint16_t)(int16_t)level);
+   ser_uint16(COMP_HEAD_VERSION);
+
+   Dmsg2(400, "ZSTD compressed len=%d uncompressed len=%d\n", (int)len, in_len);
+
+   *compress_len = len + sizeof(comp_stream_header); /* add size of header */
+#endif
+   return true;
+}
+
+/*
+ * Compress one block with the bundled lz4. The comp_stream_header
+ *  written at cbuf is followed by the uncompressed length, as a lz4
+ *  block does not record it, then by the lz4 block.
+ */
+bool lz4_compress_block(JCR *jcr, void *lz4_workset, int acceleration,
+                        const char *in, uint32_t in_len, unsigned char *cbuf,
+                        uint32_t max_compress_len, uint32_t *compress_len)
+{
+   unsigned char *cbuf2 = cbuf + sizeof(comp_stream_header) + 4;
+   int len;
+
+   ser_declare;
+   ser_begin(cbuf, sizeof(comp_stream_header) + 4);
+
+   Dmsg3(400, "cbuf=0x%x rbuf=0x%x len=%u\n", cbuf, in, in_len);
+
+   len = LZ4_compress_fast_extState(lz4_workset, in, (char *)cbuf2, in_len,
+                                    max_compress_len - sizeof(comp_stream_header) - 4,
+                                    acceleration);
+   if (len <= 0) {
+      /** this should NEVER happen */
+      Jmsg(jcr, M_FATAL, 0, _("Compression LZ4 error: %d\n"), len);
+      jcr->setJobStatus(JS_ErrorTerminated);
+      return false;
+   }
+   /* complete header */
+   ser_uint32(COMPRESS_LZ4);
+   ser_uint32(len + 4);
+   ser_uint16(acceleration);
+   ser_uint16(COMP_HEAD_VERSION);
+   ser_uint32(in_len);
+
+   Dmsg2(400, "LZ4 compressed len=%d uncompressed len=%d\n", len, in_len);
+
+   *compress_len = len + sizeof(comp_stream_header) + 4; /* add size of headers */
+   return true;
+}
+
 static bool do_libz_compression(bctx_t &bctx)
 {
 #ifdef HAVE_LIBZ
    JCR *jcr = bctx.jcr;
    BSOCK *sd = bctx.sd;
-   int zstat;
+   uint32_t len;
 
    /** Do compression if turned on */
    if (bctx.ff_pkt->flags & FO_COMPRESS && bctx.ff_pkt->Compress_algo == COMPRESS_GZIP && jcr->pZLIB_compress_workset) {
-      Dmsg3(400, "cbuf=0x%x rbuf=0x%x len=%u\n", bctx.cbuf, bctx.rbuf, sd->msglen);
-
-      ((z_stream*)jcr->pZLIB_compress_workset)->next_in   = (unsigned char *)bctx.rbuf;
-             ((z_stream*)jcr->pZLIB_compress_workset)->avail_in  = sd->msglen;
-      ((z_stream*)jcr->pZLIB_compress_workset)->next_out  = bctx.cbuf;
-             ((z_stream*)jcr->pZLIB_compress_workset)->avail_out = bctx.max_compress_len;
-
-      if ((zstat=deflate((z_stream*)jcr->pZLIB_compress_workset, Z_FINISH)) != Z_STREAM_END) {
-         Jmsg(jcr, M_FATAL, 0, _("Compression deflate error: %d\n"), zstat);
-         jcr->setJobStatus(JS_ErrorTerminated);
-         return false;
-      }
-      bctx.compress_len = ((z_stream*)jcr->pZLIB_compress_workset)->total_out;
-      /** reset zlib stream to be able to begin from scratch again */
-      if ((zstat=deflateReset((z_stream*)jcr->pZLIB_compress_workset)) != Z_OK) {
-         Jmsg(jcr, M_FATAL, 0, _("Compression deflateReset error: %d\n"), zstat);
-         jcr->setJobStatus(JS_ErrorTerminated);
+      if (!libz_compress_block(jcr, jcr->pZLIB_compress_workset, bctx.rbuf,
+              sd->msglen, bctx.cbuf, bctx.max_compress_len, &len)) {
          return false;
       }
-
-      Dmsg2(400, "GZIP compressed len=%d uncompressed len=%d\n", bctx.compress_len,
-            sd->msglen);
-
+      bctx.compress_len = len;
       sd->msglen = bctx.compress_len;      /* set compressed length */
       bctx.cipher_input_len = bctx.compress_len;
    }
@@ -1261,41 +1653,60 @@ static bool do_lzo_compression(bctx_t &bctx)
 #ifdef HAVE_LZO
    JCR *jcr = bctx.jcr;
    BSOCK *sd = bctx.sd;
-   int lzores;
+   uint32_t len;
 
    /** Do compression if turned on */
    if (bctx.ff_pkt->flags & FO_COMPRESS && bctx.ff_pkt->Compress_algo == COMPRESS_LZO1X && jcr->LZO_compress_workset) {
-      lzo_uint len;          /* TODO: See with the latest patch how to handle lzo_uint with 64bit */
-
-      ser_declare;
-      ser_begin(bctx.cbuf, sizeof(comp_stream_header));
+      if (!lzo_compress_block(jcr, jcr->LZO_compress_workset, bctx.rbuf,
+              sd->msglen, bctx.cbuf, bctx.max_compress_len, &len)) {
+         return false;
+      }
+      bctx.compress_len = len;
+      sd->msglen = bctx.compress_len;      /* set compressed length */
+      bctx.cipher_input_len = bctx.compress_len;
+   }
+#endif
+   return true;
+}
 
-      Dmsg3(400, "cbuf=0x%x rbuf=0x%x len=%u\n", bctx.cbuf, bctx.rbuf, sd->msglen);
+static bool do_zstd_compression(bctx_t &bctx)
+{
+#ifdef HAVE_ZSTD
+   JCR *jcr = bctx.jcr;
+   BSOCK *sd = bctx.sd;
+   uint32_t len;
 
-      lzores = lzo1x_1_compress((const unsigned char*)bctx.rbuf, sd->msglen, bctx.cbuf2,
-                                &len, jcr->LZO_compress_workset);
-      bctx.compress_len = len;
-      if (lzores == LZO_E_OK && bctx.compress_len <= bctx.max_compress_len) {
-         /* complete header */
-         ser_uint32(COMPRESS_LZO1X);
-         ser_uint32(bctx.compress_len);
-         ser_uint16(bctx.ch.level);
-         ser_uint16(bctx.ch.version);
-      } else {
-         /** this should NEVER happen */
-         Jmsg(jcr, M_FATAL, 0, _("Compression LZO error: %d\n"), lzores);
-         jcr->setJobStatus(JS_ErrorTerminated);
+   /** Do compression if turned on */
+   if (bctx.ff_pkt->flags & FO_COMPRESS && bctx.ff_pkt->Compress_algo == COMPRESS_ZSTD && jcr->ZSTD_compress_workset) {
+      if (!zstd_compress_block(jcr, jcr->ZSTD_compress_workset, bctx.ff_pkt->Compress_level,
+              (bctx.ff_pkt->flags & FO_COMPRESS_LONG) != 0, bctx.rbuf,
+              sd->msglen, bctx.cbuf, bctx.max_compress_len, &len)) {
          return false;
       }
+      bctx.compress_len = len;
+      sd->msglen = bctx.compress_len;      /* set compressed length */
+      bctx.cipher_input_len = bctx.compress_len;
+   }
+#endif
+   return true;
+}
 
-      Dmsg2(400, "LZO compressed len=%d uncompressed len=%d\n", bctx.compress_len,
-            sd->msglen);
+static bool do_lz4_compression(bctx_t &bctx)
+{
+   JCR *jcr = bctx.jcr;
+   BSOCK *sd = bctx.sd;
+   uint32_t len;
 
-      bctx.compress_len += sizeof(comp_stream_header); /* add size of header */
+   /** Do compression if turned on */
+   if (bctx.ff_pkt->flags & FO_COMPRESS && bctx.ff_pkt->Compress_algo == COMPRESS_LZ4 && jcr->LZ4_compress_workset) {
+      if (!lz4_compress_block(jcr, jcr->LZ4_compress_workset, bctx.ff_pkt->Compress_level,
+              bctx.rbuf, sd->msglen, bctx.cbuf, bctx.max_compress_len, &len)) {
+         return false;
+      }
+      bctx.compress_len = len;
       sd->msglen = bctx.compress_len;      /* set compressed length */
       bctx.cipher_input_len = bctx.compress_len;
    }
-#endif
    return true;
 }
 
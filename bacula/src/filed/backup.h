@@ -39,6 +39,11 @@ struct bctx_t {
    /* Dedup variables */
    bool dedup_client_side;
 
+   /* Sparse variables */
+   bool sparse_extents;               /* look for the holes with bget_data_extent() */
+   boffset_t data_start;              /* current data extent of the file */
+   boffset_t data_end;
+
    /* Crypto variables */
    DIGEST *digest;
    DIGEST *signing_digest;
@@ -49,6 +54,8 @@ struct bctx_t {
    uint32_t cipher_input_len;
    uint32_t cipher_block_size;
    uint32_t encrypted_len;
+   bool aead;                         /* records sealed by crypto_cipher_seal() */
+   bool sealed;                       /* wbuf holds a record already sealed */
 
    /* Compression variables */
    /* These are the same as used by libz, but I find it very
@@ -81,12 +88,41 @@ void crypto_free(bctx_t &bctx);
 bool encode_and_send_attributes(bctx_t &bctx);
 
 bool process_and_send_data(bctx_t &bctx);
+bool sparse_skip_holes(bctx_t &bctx);
+bool encrypt_and_send_data(bctx_t &bctx);
+bool libz_compress_block(JCR *jcr, void *zlib_workset, const char *in,
+                         uint32_t in_len, unsigned char *cbuf,
+                         uint32_t max_compress_len, uint32_t *compress_len);
+bool lzo_compress_block(JCR *jcr, void *lzo_workset, const char *in,
+                        uint32_t in_len, unsigned char *cbuf,
+                        uint32_t max_compress_len, uint32_t *compress_len);
+bool zstd_compress_block(JCR *jcr, void *zstd_workset, int level, bool long_mode,
+                         const char *in, uint32_t in_len, unsigned char *cbuf,
+                         uint32_t max_compress_len, uint32_t *compress_len);
+bool lz4_compress_block(JCR *jcr, void *lz4_workset, int acceleration,
+                        const char *in, uint32_t in_len, unsigned char *cbuf,
+                        uint32_t max_compress_len, uint32_t *compress_len);
+
+/*
+ * Backup pipeline (backup_pipeline.c)
+ *
+ * The job thread reads the file data into a ring of slots, a pool
+ *  of worker threads compresses the slots in any order, and two
+ *  ordered stages compute the digests and encrypt/send the records
+ *  in the same order as the single threaded code, so that the
+ *  data stream is unchanged.
+ */
+bool start_backup_pipeline(JCR *jcr, int nb_workers);
+void stop_backup_pipeline(JCR *jcr);
+bool pipeline_send_data(bctx_t &bctx);
+int  edit_backup_pipeline_status(JCR *jcr, POOL_MEM &msg);
 
 #ifdef HAVE_WIN32
 DWORD WINAPI read_efs_data_cb(PBYTE pbData, PVOID pvCallbackContext, ULONG ulLength);
 #endif
 
 bool do_dedup_client_side(bctx_t &bctx);
+bool dedup_end_client_side(bctx_t &bctx);
 bool dedup_init_storage_bsock(JCR *jcr, BSOCK *sd);
 void dedup_release_storage_bsock(JCR *jcr, BSOCK *sd);
 
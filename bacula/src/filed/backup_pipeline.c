@@ -0,0 +1,683 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+ */
+/*
+ *  Bacula File Daemon  backup_pipeline.c
+ *
+ *  Multi-threaded processing of the file data during a backup.
+ *
+ *  The job thread reads the file into a ring of slots. Each slot
+ *  is then:
+ *   - compressed by any thread of a pool of workers (the compression
+ *     state is reset for each block, so the blocks are independent)
+ *     and sealed by the same worker with an AEAD cipher (AES-GCM)
+ *   - added to the file digests by the digest thread, in file order
+ *   - encrypted (a CBC cipher is a stream) and sent to the SD by
+ *     the send thread, in file order.
+ *
+ *  A slot is released when it is both digested and sent. The records
+ *  sent to the SD are exactly the ones that process_and_send_data()
+ *  would produce, the pipeline only changes who does the work.
+ *
+ *  The pipeline is drained at the end of each file, the job thread
+ *  then finishes the file (cipher finalization, EOD, digests) as
+ *  usual.
+ */
+
+#include "bacula.h"
+#include "filed.h"
+#include "backup.h"
+
+enum {
+   BPIPE_STAGE_READ,
+   BPIPE_STAGE_DIGEST,
+   BPIPE_STAGE_COMPRESS,
+   BPIPE_STAGE_SEND,
+   BPIPE_STAGE_MAX
+};
+
+static const char *stage_name[BPIPE_STAGE_MAX] = {
+   "Read", "Digest", "Compress", "Send"
+};
+
+/* One block of file data going through the pipeline */
+struct bpipe_slot {
+   POOLMEM *rmsg;                     /* data as read, room for the file address */
+   POOLMEM *cmsg;                     /* compressed data, room for the file address */
+   POOLMEM *emsg;                     /* sealed record, with an AEAD cipher */
+   uint32_t len;                      /* bytes read */
+   uint32_t clen;                     /* compressed length */
+   uint32_t elen;                     /* sealed length */
+   uint64_t recno;                    /* record number in the crypto session */
+   bool claimed;                      /* a compress worker has it */
+   bool compressed;                   /* compressed and sealed or nothing to do */
+   bool digested;                     /* digested or nothing to do */
+   bool sent;                         /* sent or nothing to do */
+};
+
+/* Busy and wait time of a pipeline stage */
+struct bpipe_stat {
+   btime_t busy;
+   btime_t wait;
+   uint64_t count;                    /* blocks processed */
+};
+
+class bpipeline: public SMARTALLOC {
+public:
+   JCR *jcr;
+   pthread_mutex_t mutex;
+   pthread_cond_t slot_free;          /* the reader waits for a free slot */
+   pthread_cond_t work;               /* the stages wait for work */
+   bpipe_slot *slots;
+   int nb_slots;
+   int nb_workers;                    /* compress workers */
+   int nb_threads;                    /* threads started */
+   pthread_t *tids;
+   uint64_t wseq;                     /* next slot to fill */
+   uint64_t dseq;                     /* next slot to digest */
+   uint64_t sseq;                     /* next slot to send */
+   uint64_t fseq;                     /* oldest slot not released */
+   bctx_t *bctx;                      /* file being sent, NULL between files */
+   bctx_t sbctx;                      /* copy of bctx used by the send stage */
+   uint32_t hdr_len;                  /* room for the file address */
+   uint32_t max_compress_len;
+   uint32_t algo;                     /* compression of the current file */
+   int level;
+   bool long_mode;                    /* zstd long distance matching */
+   bool compress;
+   bool seal;                         /* workers seal the records (AES-GCM) */
+   bool quit;
+   bool error;
+   bpipe_stat stats[BPIPE_STAGE_MAX];
+
+   bpipeline(JCR *ajcr, int workers);
+   ~bpipeline();
+   bpipe_slot *slot(uint64_t seq) { return &slots[seq % nb_slots]; };
+   void add_stat(int stage, btime_t busy, btime_t wait);
+   void release_slots();
+};
+
+bpipeline::bpipeline(JCR *ajcr, int workers)
+{
+   jcr = ajcr;
+   nb_workers = workers;
+   nb_slots = 2 * workers + 4;
+   nb_threads = 0;
+   tids = (pthread_t *)malloc((workers + 2) * sizeof(pthread_t));
+   slots = (bpipe_slot *)malloc(nb_slots * sizeof(bpipe_slot));
+   memset(slots, 0, nb_slots * sizeof(bpipe_slot));
+   for (int i=0; i < nb_slots; i++) {
+      slots[i].rmsg = get_memory(jcr->buf_size + OFFSET_FADDR_SIZE + 512);
+      slots[i].cmsg = get_memory(jcr->compress_buf_size);
+      if (jcr->crypto.pki_aead) {
+         slots[i].emsg = get_memory(MAX(jcr->buf_size + OFFSET_FADDR_SIZE + 512,
+                                        jcr->compress_buf_size) + CRYPTO_RECORD_OVERHEAD);
+      }
+   }
+   wseq = dseq = sseq = fseq = 0;
+   bctx = NULL;
+   memset(&sbctx, 0, sizeof(sbctx));
+   hdr_len = 0;
+   max_compress_len = 0;
+   algo = 0;
+   level = 0;
+   long_mode = false;
+   compress = seal = quit = error = false;
+   memset(stats, 0, sizeof(stats));
+   pthread_mutex_init(&mutex, NULL);
+   pthread_cond_init(&slot_free, NULL);
+   pthread_cond_init(&work, NULL);
+}
+
+bpipeline::~bpipeline()
+{
+   for (int i=0; i < nb_slots; i++) {
+      free_pool_memory(slots[i].rmsg);
+      free_pool_memory(slots[i].cmsg);
+      if (slots[i].emsg) {
+         free_pool_memory(slots[i].emsg);
+      }
+   }
+   free(slots);
+   free(tids);
+   pthread_cond_destroy(&work);
+   pthread_cond_destroy(&slot_free);
+   pthread_mutex_destroy(&mutex);
+}
+
+/* Must be called with the mutex locked */
+void bpipeline::add_stat(int stage, btime_t busy, btime_t wait)
+{
+   stats[stage].busy += busy;
+   stats[stage].wait += wait;
+   stats[stage].count++;
+}
+
+/*
+ * Release the slots that are both digested and sent.
+ *  Must be called with the mutex locked.
+ */
+void bpipeline::release_slots()
+{
+   bool released = false;
+   while (fseq < wseq && slot(fseq)->digested && slot(fseq)->sent) {
+      fseq++;
+      released = true;
+   }
+   if (released) {
+      pthread_cond_broadcast(&slot_free);
+   }
+}
+
+/*
+ * Compress and/or seal any slot that is waiting for it
+ */
+extern "C" void *bpipe_compress_thread(void *arg)
+{
+   bpipeline *p = (bpipeline *)arg;
+   JCR *jcr = p->jcr;
+   void *zlib_workset = NULL;
+   void *lzo_workset = NULL;
+   void *zstd_workset = NULL;
+   void *lz4_workset = malloc(LZ4_sizeofState());
+   CIPHER_CONTEXT *cipher_ctx = NULL;  /* created at the first record to seal */
+   int zlib_level = -1;               /* Z_DEFAULT_COMPRESSION */
+   btime_t start, wait = 0;
+
+   set_jcr_in_tsd(jcr);
+#ifdef HAVE_LIBZ
+   z_stream *strm = (z_stream *)malloc(sizeof(z_stream));
+   memset(strm, 0, sizeof(z_stream));
+   if (deflateInit(strm, Z_DEFAULT_COMPRESSION) == Z_OK) {
+      zlib_workset = strm;
+   } else {
+      free(strm);
+   }
+#endif
+#ifdef HAVE_LZO
+   lzo_workset = malloc(LZO1X_1_MEM_COMPRESS);
+#endif
+#ifdef HAVE_ZSTD
+   zstd_workset = ZSTD_createCCtx();
+#endif
+
+   P(p->mutex);
+   for ( ;; ) {
+      bpipe_slot *slot = NULL;
+      start = get_current_btime();
+      while (!p->quit) {
+         for (uint64_t seq = p->fseq; seq < p->wseq; seq++) {
+            if (!p->slot(seq)->compressed && !p->slot(seq)->claimed) {
+               slot = p->slot(seq);
+               break;
+            }
+         }
+         if (slot) {
+            break;
+         }
+         pthread_cond_wait(&p->work, &p->mutex);
+      }
+      if (!slot) {
+         break;                       /* quit */
+      }
+      slot->claimed = true;
+      wait = get_current_btime() - start;
+      uint32_t algo = p->algo;
+      int level = p->level;
+      bool long_mode = p->long_mode;
+      uint32_t hdr = p->hdr_len;
+      uint32_t max_len = p->max_compress_len;
+      bool compress = p->compress;
+      bool seal = p->seal;
+      bool error = p->error;
+      V(p->mutex);
+
+      start = get_current_btime();
+      bool ok = true;
+      if (error || !compress) {
+         /* Nothing to do, the file will be discarded or is not compressed */
+      } else if (algo == COMPRESS_GZIP && zlib_workset) {
+#ifdef HAVE_LIBZ
+         if (zlib_level != level) {
+            int zstat = deflateParams((z_stream *)zlib_workset, level, Z_DEFAULT_STRATEGY);
+            if (zstat != Z_OK) {
+               Jmsg(jcr, M_FATAL, 0, _("Compression deflateParams error: %d\n"), zstat);
+               jcr->setJobStatus(JS_ErrorTerminated);
+               ok = false;
+            }
+            zlib_level = level;
+         }
+#endif
+         ok = ok && libz_compress_block(jcr, zlib_workset, slot->rmsg + hdr, slot->len,
+                       (unsigned char *)slot->cmsg + hdr, max_len, &slot->clen);
+      } else if (algo == COMPRESS_LZO1X && lzo_workset) {
+         ok = lzo_compress_block(jcr, lzo_workset, slot->rmsg + hdr, slot->len,
+                 (unsigned char *)slot->cmsg + hdr, max_len, &slot->clen);
+      } else if (algo == COMPRESS_LZ4 && lz4_workset) {
+         ok = lz4_compress_block(jcr, lz4_workset, level, slot->rmsg + hdr, slot->len,
+                 (unsigned char *)slot->cmsg + hdr, max_len, &slot->clen);
+      } else if (algo == COMPRESS_ZSTD && zstd_workset) {
+         ok = zstd_compress_block(jcr, zstd_workset, level, long_mode, slot->rmsg + hdr,
+                 slot->len, (unsigned char *)slot->cmsg + hdr, max_len, &slot->clen);
+      } else {
+         Jmsg(jcr, M_FATAL, 0, _("Compression algorithm 0x%x not supported by the pipeline.\n"), algo);
+         ok = false;
+      }
+
+      /* The records of an AEAD cipher do not depend on each other */
+      if (ok && !error && seal) {
+         uint32_t block_size;
+         if (!cipher_ctx) {
+            cipher_ctx = crypto_cipher_new(jcr->crypto.pki_session, true, &block_size);
+         }
+         if (!cipher_ctx) {
+            Jmsg0(jcr, M_FATAL, 0, _("Failed to initialize encryption context.\n"));
+            ok = false;
+         } else if (!crypto_cipher_seal(cipher_ctx, slot->recno,
+                       (uint8_t *)(compress ? slot->cmsg : slot->rmsg), compress ? slot->clen : slot->len,
+                       (uint8_t *)slot->emsg, &slot->elen)) {
+            Jmsg(jcr, M_FATAL, 0, _("Encryption error\n"));
+            ok = false;
+         }
+      }
+
+      P(p->mutex);
+      p->add_stat(BPIPE_STAGE_COMPRESS, get_current_btime() - start, wait);
+      if (!ok) {
+         p->error = true;
+      }
+      slot->compressed = true;
+      pthread_cond_broadcast(&p->work);
+   }
+   V(p->mutex);
+
+#ifdef HAVE_LIBZ
+   if (zlib_workset) {
+      deflateEnd((z_stream *)zlib_workset);
+      free(zlib_workset);
+   }
+#endif
+   if (lzo_workset) {
+      free(lzo_workset);
+   }
+   if (lz4_workset) {
+      free(lz4_workset);
+   }
+#ifdef HAVE_ZSTD
+   if (zstd_workset) {
+      ZSTD_freeCCtx((ZSTD_CCtx *)zstd_workset);
+   }
+#endif
+   if (cipher_ctx) {
+      crypto_cipher_free(cipher_ctx);
+   }
+   return NULL;
+}
+
+/*
+ * Update the file digests with the slots, in file order
+ */
+extern "C" void *bpipe_digest_thread(void *arg)
+{
+   bpipeline *p = (bpipeline *)arg;
+   btime_t start, wait;
+
+   set_jcr_in_tsd(p->jcr);
+   P(p->mutex);
+   for ( ;; ) {
+      start = get_current_btime();
+      /* Released slots did not need a digest */
+      if (p->dseq < p->fseq) {
+         p->dseq = p->fseq;
+      }
+      while (!p->quit && p->dseq >= p->wseq) {
+         pthread_cond_wait(&p->work, &p->mutex);
+      }
+      if (p->quit) {
+         break;
+      }
+      bpipe_slot *slot = p->slot(p->dseq);
+      wait = get_current_btime() - start;
+      if (slot->digested) {              /* nothing to do for this file */
+         p->dseq++;
+         continue;
+      }
+      bctx_t *bctx = p->bctx;
+      char *rbuf = slot->rmsg + p->hdr_len;
+      bool error = p->error;
+      V(p->mutex);
+
+      start = get_current_btime();
+      if (!error) {
+         if (bctx->digest) {
+            crypto_digest_update(bctx->digest, (uint8_t *)rbuf, slot->len);
+         }
+         /* With an AEAD cipher, the send stage signs the tags */
+         if (bctx->signing_digest && !bctx->aead) {
+            crypto_digest_update(bctx->signing_digest, (uint8_t *)rbuf, slot->len);
+         }
+      }
+
+      P(p->mutex);
+      p->add_stat(BPIPE_STAGE_DIGEST, get_current_btime() - start, wait);
+      slot->digested = true;
+      p->dseq++;
+      p->release_slots();
+   }
+   V(p->mutex);
+   return NULL;
+}
+
+/*
+ * Encrypt and send the slots to the SD, in file order
+ */
+extern "C" void *bpipe_send_thread(void *arg)
+{
+   bpipeline *p = (bpipeline *)arg;
+   JCR *jcr = p->jcr;
+   btime_t start, wait;
+
+   set_jcr_in_tsd(jcr);
+   P(p->mutex);
+   for ( ;; ) {
+      start = get_current_btime();
+      while (!p->quit && (p->sseq >= p->wseq || !p->slot(p->sseq)->compressed)) {
+         pthread_cond_wait(&p->work, &p->mutex);
+      }
+      if (p->quit) {
+         break;
+      }
+      bpipe_slot *slot = p->slot(p->sseq);
+      wait = get_current_btime() - start;
+      bctx_t &bctx = p->sbctx;
+      BSOCK *sd = bctx.sd;
+      bool error = p->error;
+      if (p->compress) {
+         bctx.cipher_input = (uint8_t *)slot->cmsg;
+         bctx.cipher_input_len = slot->clen;
+      } else {
+         bctx.cipher_input = (uint8_t *)slot->rmsg;
+         bctx.cipher_input_len = slot->len;
+      }
+      if (p->seal) {
+         bctx.wbuf = slot->emsg;
+         bctx.encrypted_len = slot->elen;
+         bctx.sealed = true;
+      } else if (!(bctx.ff_pkt->flags & FO_ENCRYPT)) {
+         bctx.wbuf = (char *)bctx.cipher_input;
+      }
+      V(p->mutex);
+
+      start = get_current_btime();
+      bool ok = true;
+      if (!error) {
+         sd->msglen = bctx.cipher_input_len;
+         ok = encrypt_and_send_data(bctx);
+      }
+
+      P(p->mutex);
+      p->add_stat(BPIPE_STAGE_SEND, get_current_btime() - start, wait);
+      if (!ok) {
+         p->error = true;
+      }
+      slot->sent = true;
+      p->sseq++;
+      p->release_slots();
+   }
+   V(p->mutex);
+   return NULL;
+}
+
+/*
+ * Read the file opened in bctx.ff_pkt->bfd and push the data
+ *  through the pipeline. Called by send_data() in place of the
+ *  bread()/process_and_send_data() loop.
+ *
+ * On return, sd->msglen is the result of the last bread(), as
+ *  with the single threaded loop.
+ */
+bool pipeline_send_data(bctx_t &bctx)
+{
+   JCR *jcr = bctx.jcr;
+   bpipeline *p = jcr->pipeline;
+   BSOCK *sd = bctx.sd;
+   FF_PKT *ff_pkt = bctx.ff_pkt;
+   bool sparse = (ff_pkt->flags & FO_SPARSE) != 0;
+   bool offsets = (ff_pkt->flags & FO_OFFSETS) != 0;
+   bool digest = bctx.digest || (bctx.signing_digest && !bctx.aead);
+   int32_t len = 0;
+   bool ok, hangup = false;
+   btime_t start, wait;
+
+   P(p->mutex);
+   p->bctx = &bctx;
+   p->sbctx = bctx;
+   p->hdr_len = (sparse || offsets) ? OFFSET_FADDR_SIZE : 0;
+   p->max_compress_len = jcr->compress_buf_size - p->hdr_len;
+   p->algo = ff_pkt->Compress_algo;
+   p->level = ff_pkt->Compress_level;
+   p->long_mode = (ff_pkt->flags & FO_COMPRESS_LONG) != 0;
+   p->compress = false;
+   p->seal = bctx.aead;
+   if (ff_pkt->flags & FO_COMPRESS) {
+      p->compress = (p->algo == COMPRESS_GZIP && jcr->pZLIB_compress_workset) ||
+                    (p->algo == COMPRESS_LZO1X && jcr->LZO_compress_workset) ||
+                    (p->algo == COMPRESS_ZSTD && jcr->ZSTD_compress_workset) ||
+                    (p->algo == COMPRESS_LZ4 && jcr->LZ4_compress_workset);
+   }
+   V(p->mutex);
+
+   for ( ;; ) {
+      /* Get the next free slot of the ring */
+      start = get_current_btime();
+      P(p->mutex);
+      while (!p->error && p->wseq - p->fseq >= (uint64_t)p->nb_slots) {
+         pthread_cond_wait(&p->slot_free, &p->mutex);
+      }
+      bpipe_slot *slot = p->slot(p->wseq);
+      bool error = p->error;
+      V(p->mutex);
+      if (error) {
+         break;
+      }
+      wait = get_current_btime() - start;
+
+      start = get_current_btime();
+      char *rbuf = slot->rmsg + p->hdr_len;
+      char *wbuf = p->compress ? slot->cmsg : slot->rmsg;
+      if (!sparse_skip_holes(bctx)) {
+         len = -1;
+         break;
+      }
+      len = (int32_t)bread(&ff_pkt->bfd, rbuf, bctx.rsize);
+      if (len <= 0) {
+         break;
+      }
+
+      /** Check for sparse blocks, see process_and_send_data() */
+      if (sparse) {
+         ser_declare;
+         bool allZeros = false;
+         if (((uint32_t)len == (uint32_t)bctx.rsize &&
+              bctx.fileAddr+len < (uint64_t)ff_pkt->statp.st_size) ||
+             ((ff_pkt->type == FT_RAW || ff_pkt->type == FT_FIFO) &&
+               (uint64_t)ff_pkt->statp.st_size == 0)) {
+            allZeros = is_buf_zero(rbuf, bctx.rsize);
+         }
+         if (!allZeros) {
+            /** Put file address as first data in buffer */
+            ser_begin(wbuf, OFFSET_FADDR_SIZE);
+            ser_uint64(bctx.fileAddr);
+         }
+         bctx.fileAddr += len;
+         if (allZeros) {
+            continue;                 /* skip block of zeros, keep the slot */
+         }
+      } else if (offsets) {
+         ser_declare;
+         ser_begin(wbuf, OFFSET_FADDR_SIZE);
+         ser_uint64(ff_pkt->bfd.offset);
+      }
+
+      jcr->ReadBytes += len;
+
+      /* Debug code: check if we must hangup or blowup */
+      if (handle_hangup_blowup(jcr, 0, jcr->ReadBytes)) {
+         P(p->mutex);
+         p->error = hangup = true;
+         V(p->mutex);
+         break;
+      }
+
+      slot->len = len;
+      slot->clen = 0;
+      slot->elen = 0;
+      if (p->seal) {
+         slot->recno = jcr->crypto.pki_record++;
+      }
+      slot->claimed = false;
+      slot->compressed = !p->compress && !p->seal;
+      slot->digested = !digest;
+      slot->sent = false;
+
+      P(p->mutex);
+      p->add_stat(BPIPE_STAGE_READ, get_current_btime() - start, wait);
+      p->wseq++;
+      pthread_cond_broadcast(&p->work);
+      V(p->mutex);
+   }
+
+   /* Wait for the pipeline to be empty */
+   P(p->mutex);
+   while (p->fseq < p->wseq) {
+      pthread_cond_wait(&p->slot_free, &p->mutex);
+   }
+   ok = !p->error;
+   p->error = false;
+   p->bctx = NULL;
+   V(p->mutex);
+
+   if (hangup) {
+      sd->close();
+   }
+   sd->msg = bctx.msgsave;
+   sd->msglen = len;
+   return ok;
+}
+
+/*
+ * Start the pipeline threads for a backup job. If the threads
+ *  cannot be started, the job runs with the single threaded code.
+ */
+bool start_backup_pipeline(JCR *jcr, int nb_workers)
+{
+   bpipeline *p;
+   int stat;
+
+   if (nb_workers <= 0) {
+      return false;
+   }
+   p = New(bpipeline(jcr, nb_workers));
+   for (int i=0; i < nb_workers + 2; i++) {
+      void *(*fct)(void *);
+      if (i == 0) {
+         fct = bpipe_digest_thread;
+      } else if (i == 1) {
+         fct = bpipe_send_thread;
+      } else {
+         fct = bpipe_compress_thread;
+      }
+      if ((stat = pthread_create(&p->tids[i], NULL, fct, (void *)p)) != 0) {
+         berrno be;
+         Jmsg(jcr, M_WARNING, 0, _("Unable to start backup pipeline thread: ERR=%s\n"),
+              be.bstrerror(stat));
+         break;
+      }
+      p->nb_threads++;
+   }
+   /* We need at least the digest, the send and one compress thread */
+   if (p->nb_threads < 3) {
+      jcr->pipeline = p;
+      stop_backup_pipeline(jcr);
+      return false;
+   }
+   Dmsg2(50, "Backup pipeline started with %d threads and %d slots\n",
+         p->nb_threads, p->nb_slots);
+   jcr->lock();
+   jcr->pipeline = p;
+   jcr->unlock();
+   return true;
+}
+
+/*
+ * Stop the pipeline threads and report the statistics
+ */
+void stop_backup_pipeline(JCR *jcr)
+{
+   bpipeline *p = jcr->pipeline;
+   POOL_MEM msg;
+
+   if (!p) {
+      return;
+   }
+   P(p->mutex);
+   p->quit = true;
+   pthread_cond_broadcast(&p->work);
+   V(p->mutex);
+   for (int i=0; i < p->nb_threads; i++) {
+      pthread_join(p->tids[i], NULL);
+   }
+   if (p->stats[BPIPE_STAGE_READ].count > 0 && edit_backup_pipeline_status(jcr, msg) > 0) {
+      Jmsg(jcr, M_INFO, 0, "%s", msg.c_str());
+   }
+   jcr->lock();
+   jcr->pipeline = NULL;
+   jcr->unlock();
+   delete p;
+}
+
+/*
+ * Edit the busy/wait counters of each stage for "status client"
+ *  and the job report. Returns the length of the message.
+ */
+int edit_backup_pipeline_status(JCR *jcr, POOL_MEM &msg)
+{
+   POOL_MEM tmp;
+   char ed1[50], ed2[50], ed3[50];
+   int len;
+
+   jcr->lock();
+   bpipeline *p = jcr->pipeline;
+   if (!p) {
+      jcr->unlock();
+      return 0;
+   }
+   P(p->mutex);
+   len = Mmsg(msg, _("    Pipeline: Workers=%d Slots=%d\n"), p->nb_workers, p->nb_slots);
+   for (int i=0; i < BPIPE_STAGE_MAX; i++) {
+      bpipe_stat *st = &p->stats[i];
+      Mmsg(tmp, _("      %-8s Blocks=%s Busy=%ss Wait=%ss\n"), stage_name[i],
+           edit_uint64_with_commas(st->count, ed1),
+           edit_uint64_with_commas(st->busy / 1000000, ed2),
+           edit_uint64_with_commas(st->wait / 1000000, ed3));
+      len = pm_strcat(msg, tmp);
+   }
+   V(p->mutex);
+   jcr->unlock();
+   return len;
+}
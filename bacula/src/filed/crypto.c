@@ -46,6 +46,7 @@ bool crypto_allocate_ctx(bctx_t &bctx)
       Jmsg0(jcr, M_FATAL, 0, _("Failed to initialize encryption context.\n"));
       return false;
    }
+   bctx.aead = jcr->crypto.pki_aead;
 
    /**
     * Grow the crypto buffer, if necessary.
@@ -53,10 +54,12 @@ bool crypto_allocate_ctx(bctx_t &bctx)
     * We grow crypto_buf to the maximum number of blocks that
     * could be returned for the given read buffer size.
     * (Using the larger of either rsize or max_compress_len)
+    * A sealed record has a header and a tag around the data.
     */
    jcr->crypto.crypto_buf = check_pool_memory_size(jcr->crypto.crypto_buf,
         (MAX(bctx.rsize + (int)sizeof(uint32_t), (int32_t)bctx.max_compress_len) +
-         bctx.cipher_block_size - 1) / bctx.cipher_block_size * bctx.cipher_block_size);
+         bctx.cipher_block_size - 1) / bctx.cipher_block_size * bctx.cipher_block_size +
+        (jcr->crypto.pki_aead ? CRYPTO_RECORD_OVERHEAD : 0));
 
    bctx.wbuf = jcr->crypto.crypto_buf; /* Encrypted, possibly compressed output here. */
    return true;
@@ -96,6 +99,14 @@ bool crypto_setup_digests(bctx_t &bctx)
    } else if (ff_pkt->flags & FO_SHA512) {
       bctx.digest = crypto_digest_new(jcr, CRYPTO_DIGEST_SHA512);
       bctx.digest_stream = STREAM_SHA512_DIGEST;
+
+   } else if (ff_pkt->flags & FO_XXH128) {
+      bctx.digest = crypto_digest_new(jcr, CRYPTO_DIGEST_XXH128);
+      bctx.digest_stream = STREAM_XXH128_DIGEST;
+
+   } else if (ff_pkt->flags & FO_BLAKE3) {
+      bctx.digest = crypto_digest_new(jcr, CRYPTO_DIGEST_BLAKE3);
+      bctx.digest_stream = STREAM_BLAKE3_DIGEST;
    }
 
    /** Did digest initialization fail? */
@@ -106,7 +117,9 @@ bool crypto_setup_digests(bctx_t &bctx)
 
    /**
     * Set up signature digest handling. If this fails, the signature digest
-    * will be set to NULL and not used.
+    * will be set to NULL and not used. With an AEAD cipher, the signature
+    * digest is computed on the authentication tags of the records rather
+    * than on the file data, see encrypt_and_send_data().
     */
    /* TODO landonf: We should really only calculate the digest once, for
     * both verification and signing.
@@ -149,6 +162,8 @@ bool crypto_session_start(JCR *jcr)
          Jmsg(jcr, M_FATAL, 0, _("Unsupported cipher on this system.\n"));
          return false;
       }
+      jcr->crypto.pki_aead = crypto_session_aead(jcr->crypto.pki_session);
+      jcr->crypto.pki_record = 0;
 
       /** Get the session data size */
       if (!crypto_session_encode(jcr->crypto.pki_session, (uint8_t *)0, &size)) {
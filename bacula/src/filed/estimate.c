@@ -29,39 +29,159 @@
 #include "bacula.h"
 #include "filed.h"
 
+/*
+ * With sample=K, one directory in K is walked at this depth below
+ *  each File, the files found under it are counted K times.
+ */
+#define EST_SAMPLE_DEPTH 2
+
+/* An estimate in progress, jcr->estimate */
+struct est_ctx {
+   int sample;                        /* one directory in sample, 0 for all */
+   uint32_t nb_sample_dirs;           /* directories at EST_SAMPLE_DEPTH */
+   uint32_t nb_walked_dirs;           /* ... that were walked */
+   int progress;                      /* seconds between two progress lines */
+   time_t start;
+   time_t next_progress;
+};
+
 static int tally_file(JCR *jcr, FF_PKT *ff_pkt, bool);
+static void send_estimate_result(JCR *jcr, est_ctx *est);
 
 /*
  * Find all the requested files and count them.
+ *
+ *  The walk is a parallel lstat() of the directories, no file is
+ *  opened. In accurate mode, the files that changed and the files
+ *  deleted since the previous jobs are counted. With a sample, the
+ *  counts are extrapolated from a part of the directories. Every
+ *  progress seconds, the counts are sent to the Director.
  */
-int make_estimate(JCR *jcr)
+int make_estimate(JCR *jcr, int sample, int progress)
 {
+   FF_PKT *ff = (FF_PKT *)jcr->ff;
+   est_ctx est;
    int stat;
 
    jcr->setJobStatus(JS_Running);
 
-   set_find_options((FF_PKT *)jcr->ff, jcr->incremental, jcr->mtime);
+   memset(&est, 0, sizeof(est));
+   est.sample = jcr->listing ? 0 : MAX(sample, 0);  /* list all files */
+   est.progress = MAX(progress, 0);
+   est.start = time(NULL);
+   est.next_progress = est.start + est.progress;
+   jcr->estimate = &est;
+
+   set_find_options(ff, jcr->incremental, jcr->mtime);
+   ff->stat_only = true;
    /* in accurate mode, we overwrite the find_one check function */
    if (jcr->accurate) {
-      set_find_changed_function((FF_PKT *)jcr->ff, accurate_check_file);
+      set_find_changed_function(ff, accurate_check_file);
+      ff->name_order = jcr->file_spool != NULL;
    }
 
-   stat = find_files(jcr, (FF_PKT *)jcr->ff, tally_file, plugin_estimate);
+   stat = find_files(jcr, ff, tally_file, plugin_estimate);
+   if (stat && !job_canceled(jcr)) {
+      send_estimate_result(jcr, &est);
+   }
    accurate_free(jcr);
+   jcr->estimate = NULL;
    return stat;
 }
 
+/*
+ * Depth of a file below the File of the FileSet, the File is 0,
+ *  a file that does not start with it is 0 too.
+ */
+static int get_depth(FF_PKT *ff_pkt)
+{
+   int len = strlen(ff_pkt->top_fname);
+   int depth = 0;
+   char *p;
+
+   if (ff_pkt->cmd_plugin || strncmp(ff_pkt->fname, ff_pkt->top_fname, len) != 0) {
+      return 0;
+   }
+   for (p = ff_pkt->fname + len; IsPathSeparator(*p); p++) { }
+   while (*p) {
+      depth++;
+      while (*p && !IsPathSeparator(*p)) {
+         p++;
+      }
+      while (IsPathSeparator(*p)) {
+         p++;
+      }
+   }
+   return depth;
+}
+
+/* Send the counts found so far */
+static void send_progress(JCR *jcr, est_ctx *est, time_t now)
+{
+   char ed1[50], ed2[50];
+
+   jcr->dir_bsock->fsend(_("Estimate in progress: files=%s bytes=%s elapsed=%ds\n"),
+      edit_uint64_with_commas(jcr->num_files_examined, ed1),
+      edit_uint64_with_commas(jcr->JobBytes, ed2), (int)(now - est->start));
+   est->next_progress = now + est->progress;
+}
+
+/*
+ * Tell how the counts were done, they are sent to the Director
+ *  by the estimate command.
+ */
+static void send_estimate_result(JCR *jcr, est_ctx *est)
+{
+   BSOCK *dir = jcr->dir_bsock;
+   uint64_t nb;
+   char ed1[50];
+
+   if (est->sample > 1) {
+      dir->fsend(_("Estimate extrapolated from %u of %u directories at depth %d\n"),
+                 est->nb_walked_dirs, est->nb_sample_dirs, EST_SAMPLE_DEPTH);
+   }
+   if (accurate_count_deleted(jcr, &nb)) {
+      if (est->sample > 1) {
+         dir->fsend(_("Deleted files not counted with a sample\n"));
+      } else {
+         dir->fsend(_("Estimate deleted files=%s\n"), edit_uint64_with_commas(nb, ed1));
+      }
+   }
+}
+
 /*
  * Called here by find() for each file included.
  *
  */
 static int tally_file(JCR *jcr, FF_PKT *ff_pkt, bool top_level)
 {
+   est_ctx *est = jcr->estimate;
+   uint32_t weight = 1;
    ATTR attr;
 
    if (job_canceled(jcr)) {
       return 0;
    }
+   if (est->progress > 0) {
+      time_t now = time(NULL);
+      if (now >= est->next_progress) {
+         send_progress(jcr, est, now);
+      }
+   }
+   if (est->sample > 1) {
+      int depth = get_depth(ff_pkt);
+      if (ff_pkt->type == FT_DIRBEGIN && depth == EST_SAMPLE_DEPTH) {
+         /* Walk one directory in sample, skip the others */
+         if (est->nb_sample_dirs++ % est->sample != 0) {
+            return -1;
+         }
+         est->nb_walked_dirs++;
+      }
+      if (depth > EST_SAMPLE_DEPTH ||
+          (depth == EST_SAMPLE_DEPTH && ff_pkt->type == FT_DIREND)) {
+         weight = est->sample;
+      }
+   }
    switch (ff_pkt->type) {
    case FT_LNKSAVED:                  /* Hard linked, file already saved */
    case FT_REGE:
@@ -92,19 +212,19 @@ static int tally_file(JCR *jcr, FF_PKT *ff_pkt, bool top_level)
 
    if (ff_pkt->type != FT_LNKSAVED && S_ISREG(ff_pkt->statp.st_mode)) {
       if (ff_pkt->statp.st_size > 0) {
-         jcr->JobBytes += ff_pkt->statp.st_size;
+         jcr->JobBytes += weight * ff_pkt->statp.st_size;
       }
 #ifdef HAVE_DARWIN_OS
       if (ff_pkt->flags & FO_HFSPLUS) {
          if (ff_pkt->hfsinfo.rsrclength > 0) {
-            jcr->JobBytes += ff_pkt->hfsinfo.rsrclength;
+            jcr->JobBytes += weight * ff_pkt->hfsinfo.rsrclength;
          }
-         jcr->JobBytes += 32;    /* Finder info */
+         jcr->JobBytes += weight * 32;    /* Finder info */
       }
 #endif
    }
-   jcr->num_files_examined++;
-   jcr->JobFiles++;                  /* increment number of files seen */
+   jcr->num_files_examined += weight;
+   jcr->JobFiles += weight;          /* increment number of files seen */
    if (jcr->listing) {
       memcpy(&attr.statp, &ff_pkt->statp, sizeof(struct stat));
       attr.type = ff_pkt->type;
@@ -112,6 +232,5 @@ static int tally_file(JCR *jcr, FF_PKT *ff_pkt, bool top_level)
       attr.olname = (POOLMEM *)ff_pkt->link;
       print_ls_output(jcr, &attr, M_INFO);
    }
-   /* TODO: Add loop over jcr->file_list to get Accurate deleted files*/
    return 1;
 }
@@ -53,6 +53,7 @@
 #include  "protos.h"                   /* file daemon prototypes */
 #include  "lib/runscript.h"
 #include  "lib/breg.h"
+#include  "lib/lz4.h"
 #include  "suspend.h"
 #ifdef HAVE_LIBZ
 #include <zlib.h>                     /* compression headers */
@@ -63,6 +64,10 @@
 #include <lzo/lzoconf.h>
 #include <lzo/lzo1x.h>
 #endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#include <zstd_errors.h>
+#endif
 
 extern CLIENT *me;                    /* "Global" Client resource */
 extern bool win32decomp;              /* Use decomposition of BackupRead data */
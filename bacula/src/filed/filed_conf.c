@@ -93,6 +93,11 @@ static RES_ITEM cli_items[] = {
    {"SdConnectTimeout", store_time,ITEM(res_client.SDConnectTimeout), 0, ITEM_DEFAULT, 60 * 30},
    {"HeartbeatInterval", store_time, ITEM(res_client.heartbeat_interval), 0, ITEM_DEFAULT, 5 * 60},
    {"MaximumNetworkBufferSize", store_pint32, ITEM(res_client.max_network_buffer_size), 0, 0, 0},
+   {"MaximumPipelineThreads", store_pint32, ITEM(res_client.max_pipeline_threads), 0, ITEM_DEFAULT, 0},
+   {"SmallFilePackSize", store_size32, ITEM(res_client.small_file_pack_size), 0, ITEM_DEFAULT, 0},
+   {"SendCoalesceSize", store_size32, ITEM(res_client.send_coalesce_size), 0, ITEM_DEFAULT, 0},
+   {"FastRestore", store_bool, ITEM(res_client.fast_restore), 0, ITEM_DEFAULT, 0},
+   {"RestoreFileSync", store_bool, ITEM(res_client.restore_file_sync), 0, ITEM_DEFAULT, 0},
 #if BEEF
    {"FipsRequire", store_bool, ITEM(res_client.require_fips), 0, 0, 0},
 #endif
@@ -116,6 +121,8 @@ static RES_ITEM cli_items[] = {
    {"VerId",                 store_str,     ITEM(res_client.verid), 0, 0, 0},
    {"MaximumBandwidthPerJob",store_speed,   ITEM(res_client.max_bandwidth_per_job), 0, 0, 0},
    {"CommCompression",       store_bool,    ITEM(res_client.comm_compression), 0, ITEM_DEFAULT, true},
+   {"CommCompressionMethod", store_comm_method, ITEM(res_client.comm_method), 0, ITEM_DEFAULT, 0},
+   {"CommCompressionDictionary", store_bool, ITEM(res_client.comm_dictionary), 0, ITEM_DEFAULT, true},
    {"DisableCommand",        store_alist_str, ITEM(res_client.disable_cmds), 0, 0, 0},
 #if BEEF
    {"DedupIndexDirectory",   store_dir,    ITEM(res_client.dedup_index_dir), 0, 0, 0}, /* deprecated */
@@ -217,6 +224,16 @@ struct s_ct ciphertypes[] = {
    {"aes192",        CRYPTO_CIPHER_AES_192_CBC},
    {"aes256",        CRYPTO_CIPHER_AES_256_CBC},
    {"blowfish",      CRYPTO_CIPHER_BLOWFISH_CBC},
+   {"aes128gcm",     CRYPTO_CIPHER_AES_128_GCM},
+   {"aes256gcm",     CRYPTO_CIPHER_AES_256_GCM},
+   {NULL,            0}
+};
+
+/* Comm line compression to the SD, 0 is each message alone */
+struct s_ct commmethods[] = {
+   {"lz4",           0},
+   {"lz4stream",     COMM_STREAM_LZ4},
+   {"zstd",          COMM_STREAM_ZSTD},
    {NULL,            0}
 };
 
@@ -276,6 +293,29 @@ void store_digest_type(LEX *lc, RES_ITEM *item, int index, int pass)
    set_bit(index, res_all.hdr.item_present);
 }
 
+/*
+ * Store comm line compression method
+ *
+ */
+void store_comm_method(LEX *lc, RES_ITEM *item, int index, int pass)
+{
+   int i;
+
+   lex_get_token(lc, T_NAME);
+   for (i=0; commmethods[i].type_name; i++) {
+      if (strcasecmp(lc->str, commmethods[i].type_name) == 0) {
+         *(uint32_t *)(item->value) = commmethods[i].type_value;
+         i = 0;
+         break;
+      }
+   }
+   if (i != 0) {
+      scan_err1(lc, _("Expected a Comm Compression Method keyword, got: %s"), lc->str);
+   }
+   scan_to_eol(lc);
+   set_bit(index, res_all.hdr.item_present);
+}
+
 /* Dump contents of resource */
 void dump_resource(int type, RES *ares, void sendit(void *sock, const char *fmt, ...), void *sock)
 {
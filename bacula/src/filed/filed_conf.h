@@ -135,7 +135,14 @@ struct CLIENT {
    utime_t SDConnectTimeout;          /* timeout in seconds */
    utime_t heartbeat_interval;        /* Interval to send heartbeats */
    uint32_t max_network_buffer_size;  /* max network buf size */
+   uint32_t max_pipeline_threads;     /* data processing threads per job, 0=off */
+   uint32_t small_file_pack_size;     /* pack the small records sent to the SD, 0=off */
+   uint32_t send_coalesce_size;       /* write the messages to the SD together, 0=off */
+   bool fast_restore;                 /* Create the files relative to their directory */
+   bool restore_file_sync;            /* Sync each restored file to disk */
    bool comm_compression;             /* Enable comm line compression */
+   bool comm_dictionary;              /* Start the compression stream with the dictionary */
+   uint32_t comm_method;              /* COMM_STREAM_xxx to the SD, 0=each message alone */
    bool pki_sign;                     /* Enable Data Integrity Verification via Digital Signatures */
    bool pki_encrypt;                  /* Enable Data Encryption */
    bool local_dedup;                  /* Enable Client (local) deduplication */
@@ -128,9 +128,10 @@ void start_heartbeat_monitor(JCR *jcr)
    /*
     * If no signals are set, do not start the heartbeat because
     * it gives a constant stream of TIMEOUT_SIGNAL signals that
-    * make debugging impossible.
+    * make debugging impossible. With a Dedup device, the
+    * thread reads the answers of the SD to the references.
     */
-   if (!no_signals && (me->heartbeat_interval > 0)) {
+   if (!no_signals && (me->heartbeat_interval > 0 || jcr->sd_dedup)) {
       jcr->hb_bsock = NULL;
       jcr->hb_started = false;
       jcr->hb_dir_bsock = NULL;
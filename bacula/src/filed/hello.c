@@ -47,11 +47,12 @@ void *handle_storage_connection(BSOCK *sd)
    char job_name[500];
    char tbuf[150];
    int sd_version = 0;
+   int sd_comm = 0;
    JCR *jcr;
 
    // Don't expect a TLS-PSK header in this "dummy" hello
-   if (sscanf(sd->msg, "Hello FD: Bacula Storage calling Start Job %127s %d",
-       job_name, &sd_version) != 2) {
+   if (sscanf(sd->msg, "Hello FD: Bacula Storage calling Start Job %127s %d comm=%d",
+       job_name, &sd_version, &sd_comm) < 2) {
       Jmsg(NULL, M_FATAL, 0, _("SD connect failed: Bad Hello command\n"));
       return NULL;
    }
@@ -87,9 +88,11 @@ void *handle_storage_connection(BSOCK *sd)
       return NULL;
    }
 
+   jcr->SDVersion = sd_version;
    /* Turn on compression for newer FDs */
    if (sd_version >= 1 && me->comm_compression) {
       sd->set_compress();             /* set compression allowed */
+      set_sd_compress_stream(sd, sd_comm);
    } else {
       sd->clear_compress();
       Dmsg2(050, "******** No FD compression to SD. sd_ver=%d compres=%d\n",
@@ -114,6 +117,26 @@ void *handle_storage_connection(BSOCK *sd)
 }
 
 
+/*
+ * Compress the messages to the SD after the previous ones with the
+ *  CommCompressionMethod, if the SD can decompress them (comm=
+ *  in its Hello). zstd falls back to LZ4.
+ */
+void set_sd_compress_stream(BSOCK *sd, int sd_comm)
+{
+   int method = me->comm_method;
+
+   if (method == COMM_STREAM_ZSTD && !(sd_comm & COMM_STREAM_ZSTD)) {
+      method = COMM_STREAM_LZ4;
+   }
+   if (!(sd_comm & method)) {
+      method = 0;                     /* each message alone */
+   }
+   Dmsg3(050, "Comm stream to SD method=%d dict=%d sd_comm=%d\n", method,
+         me->comm_dictionary, sd_comm);
+   sd->set_compress_stream(method, me->comm_dictionary);
+}
+
 /*
  * Send Hello OK to DIR
  */
@@ -148,22 +171,20 @@ bool send_hello_sd(JCR *jcr, char *Job, int tlspsk)
  */
 bool send_fdcaps(JCR *jcr, BSOCK *sd)
 {
-   int do_dedup=0;
    int rehydration = 0; /* 0 : the SD do rehydration */
 
 #if BEEF
    if (jcr->dedup_use_cache) {
       rehydration = 1; /* 1 : the FD do rehydration */
    }
-   do_dedup=1;
 #endif
 
-   Dmsg3(200, "Send caps to SD dedup=%d rehydration=%d proxy=%d\n",
-         do_dedup, rehydration, jcr->director->remote);
+   /* The FD can always cut the data in chunks (dedup=1) */
+   Dmsg2(200, "Send caps to SD dedup=1 rehydration=%d proxy=%d\n",
+         rehydration, jcr->director->remote);
 
-   return sd->fsend("fdcaps: dedup=%d rehydration=%d proxy=%d\n",
-                    do_dedup, rehydration,
-                    jcr->director->remote);
+   return sd->fsend("fdcaps: dedup=1 rehydration=%d proxy=%d\n",
+                    rehydration, jcr->director->remote);
 }
 
 bool recv_sdcaps(JCR *jcr)
@@ -192,7 +213,6 @@ bool recv_sdcaps(JCR *jcr)
       Dmsg1(050, _("Bad caps from SD: %s\n"), sd->msg);
       return false;
    }
-#if BEEF
    Dmsg5(200, "Recv sdcaps: dedup=%ld hash=%ld dedup_block=%lu min_dedup_block=%lu max_dedup_block=%lu\n",
         dedup, hash, block_size, min_block_size, max_block_size);
    jcr->sd_dedup = dedup;
@@ -201,7 +221,6 @@ bool recv_sdcaps(JCR *jcr)
    jcr->dedup_block_size = block_size;
    jcr->min_dedup_block_size = min_block_size;
    jcr->max_dedup_block_size = max_block_size;
-#endif
    return true;
 }
 
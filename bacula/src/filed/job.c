@@ -65,6 +65,7 @@ extern CLIENT *me;                    /* our client resource */
 extern int status_cmd(JCR *jcr);
 extern int qstatus_cmd(JCR *jcr);
 extern int accurate_cmd(JCR *jcr);
+extern int accurate_cache_cmd(JCR *jcr);
 extern int collect_cmd(JCR *jcr);
 
 /* Forward referenced functions */
@@ -135,6 +136,7 @@ struct s_cmds cmds[] = {
    {"RunAfterJob",  runafter_cmd,  0},
    {"Run",          runscript_cmd, 0},
    {"accurate",     accurate_cmd,  0},
+   {"cacheaccurate", accurate_cache_cmd, 0},
    {"restoreobject", restore_object_cmd, 0},
    {"sm_dump",      sm_dump_cmd, 0},
    {"stop",         cancel_cmd,  ACCESS_REMOTE},
@@ -447,6 +449,7 @@ bail_out:
             if (fo->plugin) {
                free(fo->plugin);
             }
+            free_fopts_matcher(fo);
             for (k=0; k<fo->regex.size(); k++) {
                regfree((regex_t *)fo->regex.get(k));
             }
@@ -470,6 +473,7 @@ bail_out:
          incexe->opts_list.destroy();
          incexe->name_list.destroy();
          incexe->plugin_list.destroy();
+         delete incexe->name_set;
          if (incexe->ignoredir) {
             free(incexe->ignoredir);
          }
@@ -481,6 +485,7 @@ bail_out:
          findINCEXE *incexe = (findINCEXE *)fileset->exclude_list.get(i);
          for (j=0; j<incexe->opts_list.size(); j++) {
             findFOPTS *fo = (findFOPTS *)incexe->opts_list.get(j);
+            free_fopts_matcher(fo);
             fo->regex.destroy();
             fo->regexdir.destroy();
             fo->regexfile.destroy();
@@ -495,6 +500,7 @@ bail_out:
          incexe->opts_list.destroy();
          incexe->name_list.destroy();
          incexe->plugin_list.destroy();
+         delete incexe->name_set;
          if (incexe->ignoredir) {
             free(incexe->ignoredir);
          }
@@ -1579,15 +1585,16 @@ int add_regex_to_fileset(JCR *jcr, const char *item, int type)
 {
    findFOPTS *current_opts = start_options(jcr->ff);
    regex_t *preg;
-   int rc;
+   int rc, cflags;
    char prbuf[500];
 
    preg = (regex_t *)malloc(sizeof(regex_t));
    if (current_opts->flags & FO_IGNORECASE) {
-      rc = regcomp(preg, item, REG_EXTENDED|REG_ICASE);
+      cflags = REG_EXTENDED|REG_ICASE;
    } else {
-      rc = regcomp(preg, item, REG_EXTENDED);
+      cflags = REG_EXTENDED;
    }
+   rc = regcomp(preg, item, cflags);
    if (rc != 0) {
       regerror(rc, preg, prbuf, sizeof(prbuf));
       regfree(preg);
@@ -1604,6 +1611,7 @@ int add_regex_to_fileset(JCR *jcr, const char *item, int type)
    } else {
       return state_error;
    }
+   add_regex_to_matcher(current_opts, type, item, cflags, preg);
    return state_options;
 }
 
@@ -1922,6 +1930,14 @@ static int set_options(findFOPTS *fo, const char *opts)
             p++;
             break;
 #endif
+         case '4':
+            fo->flags |= FO_XXH128;
+            p++;
+            break;
+         case '5':
+            fo->flags |= FO_BLAKE3;
+            p++;
+            break;
          default:
             /*
              * If 2 or 3 is seen here, SHA2 is not configured, so
@@ -1990,6 +2006,58 @@ static int set_options(findFOPTS *fo, const char *opts)
          fo->flags |= FO_STRIPPATH;
          Dmsg2(100, "strip=%s strip_path=%d\n", strip, fo->strip_path);
          break;
+      case 'T':                  /* walker threads */
+         /* Get integer */
+         p++;                    /* skip T */
+         for (j=0; *p && *p != ':'; p++) {
+            strip[j] = *p;
+            if (j < (int)sizeof(strip) - 1) {
+               j++;
+            }
+         }
+         strip[j] = 0;
+         fo->walker_threads = atoi(strip);
+         Dmsg1(100, "walker_threads=%d\n", fo->walker_threads);
+         break;
+      case 'Q':                  /* read ahead depth */
+         /* Get integer */
+         p++;                    /* skip Q */
+         for (j=0; *p && *p != ':'; p++) {
+            strip[j] = *p;
+            if (j < (int)sizeof(strip) - 1) {
+               j++;
+            }
+         }
+         strip[j] = 0;
+         fo->read_ahead_depth = atoi(strip);
+         Dmsg1(100, "read_ahead_depth=%d\n", fo->read_ahead_depth);
+         break;
+      case 'G':                  /* read ahead size */
+         /* Get integer */
+         p++;                    /* skip G */
+         for (j=0; *p && *p != ':'; p++) {
+            strip[j] = *p;
+            if (j < (int)sizeof(strip) - 1) {
+               j++;
+            }
+         }
+         strip[j] = 0;
+         fo->read_ahead_size = str_to_int32(strip);
+         Dmsg1(100, "read_ahead_size=%d\n", fo->read_ahead_size);
+         break;
+      case 'F':                  /* files to prefetch */
+         /* Get integer */
+         p++;                    /* skip F */
+         for (j=0; *p && *p != ':'; p++) {
+            strip[j] = *p;
+            if (j < (int)sizeof(strip) - 1) {
+               j++;
+            }
+         }
+         strip[j] = 0;
+         fo->prefetch_files = atoi(strip);
+         Dmsg1(100, "prefetch_files=%d\n", fo->prefetch_files);
+         break;
       case 'w':
          fo->flags |= FO_IF_NEWER;
          break;
@@ -2008,6 +2076,36 @@ static int set_options(findFOPTS *fo, const char *opts)
             fo->Compress_algo = COMPRESS_LZO1X;
             fo->Compress_level = 1; /* not used with LZO */
          }
+         else if (*p == 'l') {  /* Zl<acceleration>: lz4 */
+            p++;                /* skip l */
+            for (j=0; *p && *p != ':'; p++) {
+               strip[j] = *p;
+               if (j < (int)sizeof(strip) - 1) {
+                  j++;
+               }
+            }
+            strip[j] = 0;
+            fo->flags |= FO_COMPRESS;
+            fo->Compress_algo = COMPRESS_LZ4;
+            fo->Compress_level = atoi(strip);
+         }
+         else if (*p == 's') {  /* Zs[l]<level>: zstd, l=long mode */
+            p++;                /* skip s */
+            if (*p == 'l') {
+               fo->flags |= FO_COMPRESS_LONG;
+               p++;
+            }
+            for (j=0; *p && *p != ':'; p++) {
+               strip[j] = *p;
+               if (j < (int)sizeof(strip) - 1) {
+                  j++;
+               }
+            }
+            strip[j] = 0;
+            fo->flags |= FO_COMPRESS;
+            fo->Compress_algo = COMPRESS_ZSTD;
+            fo->Compress_level = atoi(strip);
+         }
          break;
       case 'd':                 /* Deduplication 0=none 1=Storage 2=Local */
          p++;                   /* skip d */
@@ -2029,6 +2127,12 @@ static int set_options(findFOPTS *fo, const char *opts)
       case 'X':
          fo->flags |= FO_XATTR;
          break;
+      case 'I':
+         fo->flags |= FO_INODE_ORDER;
+         break;
+      case 'D':
+         fo->flags |= FO_DIRECTIO;
+         break;
       default:
          Jmsg1(NULL, M_ERROR, 0, _("Unknown include/exclude option: %c\n"), *p);
          break;
@@ -2353,10 +2457,19 @@ get_win32_driveletters(JCR *jcr, FF_PKT *ff, char* szDrives)
    return nCount;
 }
 
+/*
+ * Estimate the files of the FileSet
+ *
+ *    DIR -> FD : estimate listing=0|1 [sample=K] [progress=seconds]
+ *
+ *  The options are added by newer Directors, an older FD ignores them.
+ */
 static int estimate_cmd(JCR *jcr)
 {
    BSOCK *dir = jcr->dir_bsock;
    char ed1[50], ed2[50];
+   char *p;
+   int sample = 0, progress = 0;
 
    if (sscanf(dir->msg, estimatecmd, &jcr->listing) != 1) {
       pm_strcpy(jcr->errmsg, dir->msg);
@@ -2368,7 +2481,14 @@ static int estimate_cmd(JCR *jcr)
    /* On windows, the fileset can be completed by this function (File=/ => File=C:/ + File=E:/) */
    get_win32_driveletters(jcr, jcr->ff, NULL);
 
-   make_estimate(jcr);
+   if ((p = strstr(dir->msg, " sample=")) != NULL) {
+      sample = str_to_int32(p + 8);
+   }
+   if ((p = strstr(dir->msg, " progress=")) != NULL) {
+      progress = str_to_int32(p + 10);
+   }
+
+   make_estimate(jcr, sample, progress);
    dir->fsend(OKest, edit_uint64_with_commas(jcr->num_files_examined, ed1),
       edit_uint64_with_commas(jcr->JobBytes, ed2));
    dir->signal(BNET_EOD);
@@ -3426,6 +3546,8 @@ void filed_free_jcr(JCR *jcr)
    free_runscripts(jcr->RunScripts);
    delete jcr->RunScripts;
    free_path_list(jcr);
+   bfree_and_null(jcr->accurate_cache);
+   bfree_and_null(jcr->accurate_cache_jobids);
 
    if (jcr->JobId != 0) {
       write_state_file(me->working_directory, "bacula-fd", get_first_port_host_order(me->FDaddrs));
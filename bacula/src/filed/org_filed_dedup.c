@@ -16,6 +16,9 @@
 
    Bacula(R) is a registered trademark of Kern Sibbald.
 */
+/*
+ * Client side deduplication, see org_filed_dedup.h
+ */
 
 #include "bacula.h"
 
@@ -23,11 +26,436 @@
 #include "protos.h"
 #include "backup.h"
 
-bool do_dedup_client_side(bctx_t &bctx)
+static const int dbglvl = DT_DEDUP|200;
+
+/* Time to wait for an answer of the SD before checking the job */
+#define DEDUP_WAIT_TIME 5
+
+/* Time (usec) to wait for the heartbeat thread to start */
+#define DEDUP_HB_START_WAIT 2000000
+
+extern bool no_signals;
+
+DedupFiledInterface::DedupFiledInterface(JCR *jcr, int rec_buf_size, int max_msg_size):
+   m_jcr(jcr),
+   m_quarantine(0),
+   m_max_quarantine((uint64_t)rec_buf_size * max_msg_size),
+   m_sd(NULL),
+   m_hb_running(false),
+   m_hb_done(false),
+   m_error(false),
+   m_job_bytes(0),
+   m_chunker(NULL),
+   m_buf(NULL),
+   m_len(0),
+   m_addr(0),
+   m_offsets(false),
+   m_ref(NULL),
+   m_nb_refs(0), m_ref_bytes(0),
+   m_nb_sent(0), m_sent_bytes(0)
+{
+   dedup_chunk *item = NULL;
+   pthread_mutex_init(&m_mutex, NULL);
+   pthread_mutex_init(&m_send_mutex, NULL);
+   pthread_cond_init(&m_cond, NULL);
+   m_pending = New(dlist(item, &item->link));
+   m_to_send = New(dlist(item, &item->link));
+}
+
+DedupFiledInterface::~DedupFiledInterface()
+{
+   dedup_chunk *c;
+
+   foreach_dlist(c, m_pending) {
+      free(c->data);
+   }
+   foreach_dlist(c, m_to_send) {
+      free(c->data);
+   }
+   m_pending->destroy();
+   m_to_send->destroy();
+   delete m_pending;
+   delete m_to_send;
+   if (m_chunker) {
+      delete m_chunker;
+   }
+   free_and_null_pool_memory(m_buf);
+   free_and_null_pool_memory(m_ref);
+   pthread_cond_destroy(&m_cond);
+   pthread_mutex_destroy(&m_send_mutex);
+   pthread_mutex_destroy(&m_mutex);
+}
+
+void DedupFiledInterface::TransferJobBytes(uint64_t *JobBytes)
+{
+   P(m_mutex);
+   *JobBytes += m_job_bytes;
+   m_job_bytes = 0;
+   V(m_mutex);
+}
+
+/*
+ * Called by the heartbeat thread for a command of the SD
+ *  <cmd><hash>
+ *
+ * Returns: 0 if OK, 1 if the command is unknown, -1 on error
+ */
+int DedupFiledInterface::handle_command(BSOCK *sd)
+{
+   int32_t cmd;
+   dedup_chunk *c;
+   unser_declare;
+
+   if (sd->msglen < (int32_t)(BNET_CMD_SIZE + DEDUP_HASH_SIZE)) {
+      Jmsg1(m_jcr, M_FATAL, 0, _("Malformed dedup command from SD, len=%d\n"), sd->msglen);
+      goto bail_out;
+   }
+   unser_begin(sd->msg, sd->msglen);
+   unser_int32(cmd);
+   if (cmd != BNET_CMD_ACK_HASH && cmd != BNET_CMD_GET_HASH) {
+      return 1;
+   }
+   P(m_mutex);
+   c = (dedup_chunk *)m_pending->first();
+   if (!c || memcmp(c->hash, sd->msg + BNET_CMD_SIZE, DEDUP_HASH_SIZE) != 0) {
+      V(m_mutex);
+      Jmsg1(m_jcr, M_FATAL, 0, _("Dedup answer from SD for an unexpected chunk #%08x\n"),
+            hash2int(sd->msg + BNET_CMD_SIZE));
+      goto bail_out;
+   }
+   m_pending->remove(c);
+   if (cmd == BNET_CMD_GET_HASH) {
+      Dmsg2(dbglvl, "SD asks chunk #%08x size=%d\n", hash2int(c->hash), c->size);
+      m_to_send->append(c);
+   } else {
+      m_quarantine -= c->size;
+      free(c->data);
+      free(c);
+   }
+   pthread_cond_broadcast(&m_cond);
+   V(m_mutex);
+   return 0;
+
+bail_out:
+   P(m_mutex);
+   m_error = true;
+   pthread_cond_broadcast(&m_cond);
+   V(m_mutex);
+   return -1;
+}
+
+/* Send the chunks asked by the SD, <BNET_CMD_STO_BLOCK><hash><data> */
+bool DedupFiledInterface::send_chunks()
+{
+   dedup_chunk *c;
+   bool ok = true;
+   ser_declare;
+
+   P(m_send_mutex);
+   for ( ;; ) {
+      P(m_mutex);
+      c = (dedup_chunk *)m_to_send->first();
+      if (c) {
+         m_to_send->remove(c);
+      }
+      V(m_mutex);
+      if (!c) {
+         break;
+      }
+      if (ok) {
+         m_sd->msg = check_pool_memory_size(m_sd->msg,
+                                            BNET_CMD_SIZE + DEDUP_HASH_SIZE + c->size);
+         ser_begin(m_sd->msg, BNET_CMD_SIZE + DEDUP_HASH_SIZE + c->size);
+         ser_int32(BNET_CMD_STO_BLOCK);
+         ser_bytes(c->hash, DEDUP_HASH_SIZE);
+         ser_bytes(c->data, c->size);
+         m_sd->msglen = ser_length(m_sd->msg);
+         ok = m_sd->send(BNET_IS_CMD);
+      }
+      P(m_mutex);
+      m_quarantine -= c->size;
+      if (ok) {
+         m_nb_sent++;
+         m_sent_bytes += c->size;
+         m_job_bytes += c->size;
+      }
+      V(m_mutex);
+      free(c->data);
+      free(c);
+   }
+   V(m_send_mutex);
+   return ok;
+}
+
+/* Called before each message sent to the SD */
+bool DedupFiledInterface::bsock_send_cb()
+{
+   return send_chunks();
+}
+
+/*
+ * Wait until there is some room in the quarantine
+ *
+ * Returns: false if the job must stop
+ */
+bool DedupFiledInterface::wait_quarantine()
+{
+   bool error, full, hb_done, to_send;
+
+   for ( ;; ) {
+      if (!send_chunks()) {
+         return false;
+      }
+      P(m_mutex);
+      error = m_error;
+      full = m_quarantine > m_max_quarantine;
+      hb_done = m_hb_done;
+      to_send = !m_to_send->empty();
+      V(m_mutex);
+      if (error || m_jcr->is_job_canceled()) {
+         return false;
+      }
+      if (!full) {
+         return true;
+      }
+      if (hb_done) {
+         return false;                /* nobody reads the answers of the SD */
+      }
+      if (to_send) {
+         continue;
+      }
+      /* The SD cannot answer to references that are still packed or buffered */
+      if (!m_jcr->store_bsock->flush()) {
+         return false;
+      }
+      P(m_mutex);
+      if (m_to_send->empty() && !m_error && !m_hb_done &&
+          m_quarantine > m_max_quarantine) {
+         struct timespec timeout;
+         struct timeval tv;
+         gettimeofday(&tv, NULL);
+         timeout.tv_nsec = tv.tv_usec * 1000;
+         timeout.tv_sec = tv.tv_sec + DEDUP_WAIT_TIME;
+         pthread_cond_timedwait(&m_cond, &m_mutex, &timeout);
+      }
+      V(m_mutex);
+   }
+}
+
+void DedupFiledInterface::enter_heartbeat(BSOCK *sd)
+{
+   P(m_mutex);
+   m_hb_running = true;
+   pthread_cond_broadcast(&m_cond);
+   V(m_mutex);
+}
+
+void DedupFiledInterface::leave_heartbeat(BSOCK *sd)
+{
+   P(m_mutex);
+   m_hb_running = false;
+   m_hb_done = true;
+   pthread_cond_broadcast(&m_cond);
+   V(m_mutex);
+}
+
+/* Returns: true if the heartbeat thread reads the answers of the SD */
+int DedupFiledInterface::wait_for_heartbeat_running(int usec)
+{
+   for (int i = 0; i < usec; i += 50000) {
+      P(m_mutex);
+      bool running = m_hb_running;
+      V(m_mutex);
+      if (running) {
+         return true;
+      }
+      bmicrosleep(0, 50000);
+   }
+   return false;
+}
+
+/* Install the hook that sends the chunks asked by the SD */
+bool DedupFiledInterface::start(BSOCK *sd)
+{
+   m_sd = dup_bsock(sd);
+   m_sd->uninstall_send_hook_cb();
+   m_chunker = New(cdc_chunker());
+   m_buf = get_pool_memory(PM_BSOCK);
+   m_ref = get_pool_memory(PM_BSOCK);
+   sd->install_send_hook_cb(this);
+   return true;
+}
+
+/* Wait for the answers to all the references and send the chunks */
+bool DedupFiledInterface::drain(BSOCK *sd)
+{
+   uint64_t max = m_max_quarantine;
+   bool ok;
+
+   if (!m_sd) {
+      return true;
+   }
+   if (!sd->flush()) {
+      return false;
+   }
+   m_max_quarantine = 0;
+   ok = wait_quarantine();
+   m_max_quarantine = max;
+   return ok;
+}
+
+void DedupFiledInterface::stop(BSOCK *sd)
+{
+   if (!m_sd) {
+      return;
+   }
+   sd->uninstall_send_hook_cb();
+   m_sd->close();                     /* destroyed with the master socket */
+   m_sd = NULL;
+}
+
+/* Send the reference of a chunk, [<address>]<ref> */
+bool DedupFiledInterface::send_ref(BSOCK *sd, const char *data, uint32_t len)
+{
+   POOLMEM *msgsave = sd->msg;
+   dedup_chunk *c;
+   int32_t hdr = 0;
+   bool ok;
+
+   if (!wait_quarantine()) {
+      return false;
+   }
+   c = (dedup_chunk *)malloc(sizeof(dedup_chunk));
+   dedup_hash(data, len, c->hash);
+   c->size = len;
+   c->data = (char *)malloc(len);
+   memcpy(c->data, data, len);
+
+   m_ref = check_pool_memory_size(m_ref, OFFSET_FADDR_SIZE + DEDUP_REF_SIZE);
+   if (m_offsets) {
+      ser_declare;
+      ser_begin(m_ref, OFFSET_FADDR_SIZE);
+      ser_uint64(m_addr);
+      hdr = OFFSET_FADDR_SIZE;
+   }
+   P(m_mutex);
+   m_pending->append(c);
+   m_quarantine += len;
+   V(m_mutex);
+
+   sd->msglen = hdr + dedup_encode_ref(m_ref + hdr, len, c->hash);
+   sd->msg = m_ref;
+   ok = sd->send();
+   m_ref = sd->msg;
+   sd->msg = msgsave;
+   if (!ok) {
+      if (!m_jcr->is_job_canceled()) {
+         Jmsg1(m_jcr, M_FATAL, 0, _("Network send error to SD. ERR=%s\n"),
+               sd->bstrerror());
+      }
+      return false;
+   }
+   Dmsg3(dbglvl, "Send ref #%08x size=%d addr=%lld\n", hash2int(c->hash), len, m_addr);
+   m_jcr->JobBytes += hdr + DEDUP_REF_SIZE;
+   m_nb_refs++;
+   m_ref_bytes += len;
+   m_addr += len;
+   return true;
+}
+
+/*
+ * Add the data of the file to the chunker, the chunks that are
+ *  complete are sent. The data of a new address (after a hole)
+ *  starts a new chunk.
+ */
+bool DedupFiledInterface::add_data(BSOCK *sd, const char *data, uint32_t len,
+                                   bool offsets, uint64_t addr)
 {
+   uint32_t n, max = m_chunker->max_size();
+
+   if (offsets && m_len > 0 && addr != m_addr + m_len) {
+      if (!flush_data(sd)) {
+         return false;
+      }
+   }
+   if (m_len == 0) {
+      m_offsets = offsets;
+      m_addr = addr;
+   }
+   m_buf = check_pool_memory_size(m_buf, m_len + len);
+   memcpy(m_buf + m_len, data, len);
+   m_len += len;
+   if (m_len < max) {
+      return true;
+   }
+   for (n = 0; m_len - n >= max; ) {
+      uint32_t size = m_chunker->cut((uint8_t *)m_buf + n, m_len - n);
+      if (!send_ref(sd, m_buf + n, size)) {
+         return false;
+      }
+      n += size;
+   }
+   memmove(m_buf, m_buf + n, m_len - n);
+   m_len -= n;
    return true;
 }
 
+/* Send the last chunks of the file */
+bool DedupFiledInterface::flush_data(BSOCK *sd)
+{
+   uint32_t n, size;
+   bool ok = true;
+
+   for (n = 0; ok && n < m_len; n += size) {
+      size = m_chunker->cut((uint8_t *)m_buf + n, m_len - n);
+      ok = send_ref(sd, m_buf + n, size);
+   }
+   m_len = 0;
+   return ok;
+}
+
+void DedupFiledInterface::report()
+{
+   char ed1[50], ed2[50], ed3[50], ed4[50];
+
+   if (m_nb_refs == 0) {
+      return;
+   }
+   Jmsg(m_jcr, M_INFO, 0, _("Dedup: %s chunks (%s) sent as references, %s chunks (%s) asked by the SD\n"),
+        edit_uint64_with_commas(m_nb_refs, ed1), edit_uint64_with_suffix(m_ref_bytes, ed2),
+        edit_uint64_with_commas(m_nb_sent, ed3), edit_uint64_with_suffix(m_sent_bytes, ed4));
+}
+
+/*
+ * Called for each block of data of a stream that is
+ *  deduplicated by the client, the data is at bctx.rbuf and
+ *  the block is sent as references.
+ */
+bool do_dedup_client_side(bctx_t &bctx)
+{
+   JCR *jcr = bctx.jcr;
+   BSOCK *sd = bctx.sd;
+   bool offsets = (bctx.ff_pkt->flags & (FO_SPARSE|FO_OFFSETS)) != 0;
+   uint64_t addr = 0;
+
+   if (offsets) {
+      unser_declare;
+      unser_begin(bctx.wbuf, OFFSET_FADDR_SIZE);
+      unser_uint64(addr);
+   }
+   return jcr->dedup->add_data(sd, bctx.rbuf, sd->msglen, offsets, addr);
+}
+
+/* End of the data of the stream */
+bool dedup_end_client_side(bctx_t &bctx)
+{
+   if (!bctx.dedup_client_side) {
+      return true;
+   }
+   bctx.dedup_client_side = false;
+   return bctx.jcr->dedup->flush_data(bctx.sd);
+}
+
 GetMsg *get_msg_buffer(JCR *jcr, BSOCK *sd, const char *rec_header)
 {
    return New(GetMsg(jcr, sd, rec_header, DEDUP_MAX_MSG_SIZE));
@@ -35,16 +463,42 @@ GetMsg *get_msg_buffer(JCR *jcr, BSOCK *sd, const char *rec_header)
 
 bool is_dedup_enabled(JCR *jcr, FF_PKT *ff_pkt)
 {
-   return false;
+   return jcr->sd_dedup && (ff_pkt->flags & FO_DEDUPLICATION) &&
+      ff_pkt->Dedup_level == 2;
 }
 
+/*
+ * The answers of the SD are read by the heartbeat thread, without
+ *  it, the SD does the deduplication. The thread is started just
+ *  before by start_heartbeat_monitor() (always with a Dedup device,
+ *  except without signals), it only duplicates the sockets before
+ *  it runs, DEDUP_HB_START_WAIT is for a loaded system.
+ */
 bool dedup_init_storage_bsock(JCR *jcr, BSOCK *sd)
 {
-   return true;
+   if (!jcr->sd_dedup) {
+      return true;
+   }
+   if (no_signals || !jcr->dedup->wait_for_heartbeat_running(DEDUP_HB_START_WAIT)) {
+      Dmsg0(dbglvl, "No heartbeat thread, no client side dedup\n");
+      jcr->sd_dedup = 0;
+      return true;
+   }
+   return jcr->dedup->start(sd);
 }
 
 void dedup_release_storage_bsock(JCR *jcr, BSOCK *sd)
 {
+   if (!jcr->sd_dedup) {
+      return;
+   }
+   if (!jcr->dedup->drain(sd) && !jcr->is_job_canceled()) {
+      Jmsg0(jcr, M_FATAL, 0, _("Dedup chunks asked by the SD were not sent\n"));
+      jcr->setJobStatus(JS_ErrorTerminated);
+   }
+   jcr->dedup->stop(sd);
+   jcr->dedup->TransferJobBytes(&jcr->JobBytes);
+   jcr->dedup->report();
 }
 
 void dedup_init_jcr(JCR *jcr)
@@ -16,6 +16,21 @@
 
    Bacula(R) is a registered trademark of Kern Sibbald.
 */
+/*
+ * Client side deduplication
+ *
+ *  The data of the file is cut in chunks by the cdc_chunker, and only
+ *  the reference (size and hash) of each chunk is sent to the SD. The
+ *  SD answers to each reference, in the same order, on the socket read
+ *  by the heartbeat thread:
+ *
+ *   BNET_CMD_ACK_HASH  the chunk is known, we forget it
+ *   BNET_CMD_GET_HASH  the chunk is unknown, we send it with a
+ *                      BNET_CMD_STO_BLOCK command before the next message
+ *
+ *  The chunks waiting for an answer are kept in memory (the quarantine),
+ *  when it is full, we wait for the answers of the SD.
+ */
 
 #ifndef ORG_FILED_DEDUP_H
 #define ORG_FILED_DEDUP_H
@@ -24,22 +39,66 @@
 
 class DedupFiledInterface: public SMARTALLOC, public BSOCKCallback
 {
+   /* A chunk sent as a reference and not yet acknowledged */
+   struct dedup_chunk {
+      dlink link;
+      unsigned char hash[DEDUP_HASH_SIZE];
+      uint32_t size;
+      char *data;
+   };
+
+   JCR *m_jcr;
+   pthread_mutex_t m_mutex;           /* lists and counters */
+   pthread_mutex_t m_send_mutex;      /* keep the order of the chunks sent */
+   pthread_cond_t m_cond;             /* an answer from the SD */
+   dlist *m_pending;                  /* waiting for the answer of the SD */
+   dlist *m_to_send;                  /* asked by the SD */
+   uint64_t m_quarantine;             /* bytes in m_pending and m_to_send */
+   uint64_t m_max_quarantine;
+   BSOCK *m_sd;                       /* to send the chunks */
+   bool m_hb_running;
+   bool m_hb_done;
+   bool m_error;
+   uint64_t m_job_bytes;              /* chunks sent, see TransferJobBytes() */
+
+   /* Chunking of the current file */
+   cdc_chunker *m_chunker;
+   POOLMEM *m_buf;
+   uint32_t m_len;
+   uint64_t m_addr;                   /* file address of m_buf */
+   bool m_offsets;                    /* the refs start with the address */
+   POOLMEM *m_ref;
+
+   /* Statistics */
+   uint64_t m_nb_refs, m_ref_bytes;
+   uint64_t m_nb_sent, m_sent_bytes;
+
+   bool send_chunks();
+   bool send_ref(BSOCK *sd, const char *data, uint32_t len);
+
 public:
-   DedupFiledInterface(JCR *jcr, int, int) {};
-   virtual ~DedupFiledInterface() {};
+   DedupFiledInterface(JCR *jcr, int rec_buf_size, int max_msg_size);
+   virtual ~DedupFiledInterface();
 
    void activate_flowcontrol_dedup() {};
    bool wait_flowcontrol_dedup(int free_rec_count, int timeoutms);
    bool disable_flowcontrol_dedup(BSOCK *sd) { return true; };
-   void TransferJobBytes(uint64_t *JobBytes) {};
-   int handle_command(BSOCK *sd) { return 0; };
+   void TransferJobBytes(uint64_t *JobBytes);
+   int handle_command(BSOCK *sd);
+
+   bool wait_quarantine();
+   void enter_heartbeat(BSOCK *sd);
+   void leave_heartbeat(BSOCK *sd);
+   int wait_for_heartbeat_running(int usec);
 
-   bool wait_quarantine() { return true;};
-   void enter_heartbeat(BSOCK *sd) {};
-   void leave_heartbeat(BSOCK *sd) {};
-   int wait_for_heartbeat_running(int usec) { return false; };
+   bool start(BSOCK *sd);
+   bool drain(BSOCK *sd);
+   void stop(BSOCK *sd);
+   bool add_data(BSOCK *sd, const char *data, uint32_t len, bool offsets, uint64_t addr);
+   bool flush_data(BSOCK *sd);
+   void report();
 
-   virtual bool bsock_send_cb() { return true;}; // inherited from BSOCKCallback
+   virtual bool bsock_send_cb(); // inherited from BSOCKCallback
 };
 
  #endif /* ORG_FILED_DEDUP_H */
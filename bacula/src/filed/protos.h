@@ -27,7 +27,7 @@
 extern bool blast_data_to_storage_daemon(JCR *jcr, char *addr);
 extern void do_verify_volume(JCR *jcr);
 extern void do_restore(JCR *jcr);
-extern int make_estimate(JCR *jcr);
+extern int make_estimate(JCR *jcr, int sample, int progress);
 
 /* From fdcallsdir.c */
 void fdcallsdir_start_server(int max_clients, void *handle_client_request(void *bsock));
@@ -36,6 +36,8 @@ void store_runres(LEX *lc, RES_ITEM *item, int index, int pass);
 
 /* From restore.c */
 bool decompress_data(JCR *jcr, int32_t stream, char **data, uint32_t *length);
+bool decompress_data_buf(JCR *jcr, int32_t stream, char **data, uint32_t *length,
+                         POOLMEM *&buf, int32_t &buf_size, void *&zstd_workset);
 
 /* From authenticate.c */
 class FDAuthenticateDIR: public AuthenticateBase
@@ -61,6 +63,7 @@ bool send_hello_ok(BSOCK *bs);
 bool send_sorry(BSOCK *bs);
 bool send_hello_sd(JCR *jcr, char *Job, int tlspsk);
 void *handle_storage_connection(BSOCK *sd);
+void set_sd_compress_stream(BSOCK *sd, int sd_comm);
 bool send_fdcaps(JCR *jcr, BSOCK *sd);
 bool recv_sdcaps(JCR *jcr);
 
@@ -73,8 +76,24 @@ BSOCK *connect_director(JCR *jcr, const char *name, DIRINFO *dir, connect_dir_mo
 
 /* From verify.c */
 int digest_file(JCR *jcr, FF_PKT *ff_pkt, DIGEST *digest);
+int digest_file_data(JCR *jcr, const char *fname, const char *snap_fname,
+                     int type, uint64_t flags, int64_t size, read_ahead *ra,
+                     DIGEST *digest, uint64_t *nbytes);
+int edit_verify_digest(DIGEST *digest, int32_t FileIndex, int digest_stream,
+                       POOL_MEM &msg);
 void do_verify(JCR *jcr);
 
+/* From verify_pipeline.c */
+bool start_verify_pipeline(JCR *jcr, int nb_workers);
+void stop_verify_pipeline(JCR *jcr);
+bool pipeline_verify_file(JCR *jcr, FF_PKT *ff_pkt, const char *fname,
+                          const char *attribs, const char *link,
+                          crypto_digest_t digest_type, int digest_stream);
+int  edit_verify_pipeline_status(JCR *jcr, POOL_MEM &msg);
+
+/* From restore_pipeline.c */
+int  edit_restore_pipeline_status(JCR *jcr, POOL_MEM &msg);
+
 /* From heartbeat.c */
 void start_heartbeat_monitor(JCR *jcr);
 void stop_heartbeat_monitor(JCR *jcr);
@@ -86,6 +105,7 @@ bool accurate_finish(JCR *jcr);
 bool accurate_check_file(JCR *jcr, FF_PKT *ff_pkt);
 bool accurate_mark_file_as_seen(JCR *jcr, char *fname);
 void accurate_free(JCR *jcr);
+bool accurate_count_deleted(JCR *jcr, uint64_t *nb);
 bool accurate_check_file(JCR *jcr, ATTR *attr, char *digest);
 
 /* from backup.c */
@@ -117,6 +137,7 @@ VSSClient *VSSInit();
 /* Definition for encyption cipher/digest type  */
 void store_cipher_type(LEX *lc, RES_ITEM *item, int index, int pass);
 void store_digest_type(LEX *lc, RES_ITEM *item, int index, int pass);
+void store_comm_method(LEX *lc, RES_ITEM *item, int index, int pass);
 
 /* from fdcollect.c */
 bool update_permanent_stats(void *data);
@@ -65,14 +65,6 @@ static char rec_header[] = "rechdr %ld %ld %ld %ld %ld";
 /* Forward referenced functions */
 #if   defined(HAVE_LIBZ)
 static const char *zlib_strerror(int stat);
-const bool have_libz = true;
-#else
-const bool have_libz = false;
-#endif
-#ifdef HAVE_LZO
-const bool have_lzo = true;
-#else
-const bool have_lzo = false;
 #endif
 
 static void deallocate_cipher(r_ctx &rctx);
@@ -399,13 +391,23 @@ void do_restore(JCR *jcr)
    }
    jcr->buf_size = sd->msglen;
 
-   /* use the same buffer size to decompress both gzip and lzo */
-   if (have_libz || have_lzo) {
-      uint32_t compress_buf_size = jcr->buf_size + 12 + ((jcr->buf_size+999) / 1000) + 100;
-      jcr->compress_buf = get_memory(compress_buf_size);
-      jcr->compress_buf_size = compress_buf_size;
+   /* use the same buffer size to decompress all the algorithms, lz4 is always there */
+   jcr->compress_buf_size = jcr->buf_size + 12 + ((jcr->buf_size+999) / 1000) + 100;
+   jcr->compress_buf = get_memory(jcr->compress_buf_size);
+
+   /* The data records are decoded and written by a pool of threads */
+   if (client && client->max_pipeline_threads > 0) {
+      start_restore_pipeline(jcr, client->max_pipeline_threads);
    }
 
+#ifdef HAVE_RESTORE_DIRS
+   /* The files are created relative to the fd of their directory */
+   if (client && client->fast_restore) {
+      jcr->rdirs = New(restore_dirs());
+   }
+#endif
+   jcr->sync_restored_files = client && client->restore_file_sync;
+
    GetMsg *fdmsg = get_msg_buffer(jcr, sd, rec_header);
 
    fdmsg->start_read_sock();
@@ -512,6 +514,11 @@ void do_restore(JCR *jcr)
 
       /* If we change streams, close and reset alternate data streams */
       if (rctx.prev_stream != rctx.stream) {
+         /* The data records of the previous stream must be written first */
+         if (!flush_restore_pipeline(rctx)) {
+            rctx.extract = false;
+            bclose(&rctx.bfd);
+         }
          if (is_bopen(&rctx.forkbfd)) {
             deallocate_fork_cipher(rctx);
             bclose_chksize(rctx, &rctx.forkbfd, rctx.fork_size);
@@ -577,6 +584,8 @@ void do_restore(JCR *jcr)
           */
          jcr->num_files_examined++;
          rctx.extract = false;
+         rctx.delta = false;
+         attr->unchanged = false;
          stat = CF_CORE;        /* By default, let Bacula's core handle it */
 
          if (jcr->plugin) {
@@ -596,6 +605,11 @@ void do_restore(JCR *jcr)
          case CF_SKIP:
             jcr->JobFiles++;
             break;
+         case CF_DELTA:        /* File exists, compare and write what differs */
+            rctx.delta = true;
+            rctx.delta_end = 0;
+            rctx.delta_files++;
+            /* FALLTHROUGH WANTED */
          case CF_EXTRACT:      /* File created and we expect file data */
             rctx.extract = true;
 #ifdef HAVE_WIN32
@@ -609,6 +623,9 @@ void do_restore(JCR *jcr)
             /* FALLTHROUGH WANTED */
          case CF_CREATED:      /* File created, but there is no content */
             /* File created, but there is no content */
+            if (attr->unchanged) {
+               rctx.delta_unchanged++;    /* Same size and mtime, not opened */
+            }
             rctx.fileAddr = 0;
             print_ls_output(jcr, attr);
 
@@ -669,13 +686,7 @@ void do_restore(JCR *jcr)
 
          if (jcr->crypto.digest) {
             crypto_digest_free(jcr->crypto.digest);
-         }
-         jcr->crypto.digest = crypto_digest_new(jcr, signing_algorithm);
-         if (!jcr->crypto.digest) {
-            Jmsg0(jcr, M_FATAL, 0, _("Could not create digest.\n"));
-            rctx.extract = false;
-            bclose(&rctx.bfd);
-            break;
+            jcr->crypto.digest = NULL;
          }
 
          /* Decode and save session keys. */
@@ -713,6 +724,21 @@ void do_restore(JCR *jcr)
             continue;
          }
 
+         /*
+          * With an AEAD cipher, the signature is checked with the tags
+          *  of the records, see verify_signature()
+          */
+         if (crypto_session_aead(rctx.cs)) {
+            rctx.tags_len = 0;
+            break;
+         }
+         jcr->crypto.digest = crypto_digest_new(jcr, signing_algorithm);
+         if (!jcr->crypto.digest) {
+            Jmsg0(jcr, M_FATAL, 0, _("Could not create digest.\n"));
+            rctx.extract = false;
+            bclose(&rctx.bfd);
+            break;
+         }
          break;
 
       case STREAM_FILE_DATA:
@@ -790,6 +816,7 @@ void do_restore(JCR *jcr)
                      bclose(&rctx.bfd);
                      continue;
                   }
+                  rctx.cipher_ctx.aead = crypto_session_aead(rctx.cs);
                }
                rctx.flags |= FO_ENCRYPT;
             }
@@ -800,7 +827,12 @@ void do_restore(JCR *jcr)
                rctx.flags |= FO_WIN32DECOMP; /* "decompose" BackupWrite data */
             }
 
-            if (extract_data(rctx, bmsg->rbuf, bmsg->rbuflen) < 0) {
+            if (can_pipeline_extract(rctx)) {
+               stat = pipeline_extract_data(rctx, bmsg->rbuf, bmsg->rbuflen);
+            } else {
+               stat = extract_data(rctx, bmsg->rbuf, bmsg->rbuflen);
+            }
+            if (stat < 0) {
                rctx.extract = false;
                bclose(&rctx.bfd);
                continue;
@@ -837,6 +869,7 @@ void do_restore(JCR *jcr)
                      bclose(&rctx.bfd);
                      continue;
                   }
+                  rctx.fork_cipher_ctx.aead = crypto_session_aead(rctx.cs);
                }
             }
 
@@ -1007,6 +1040,8 @@ void do_restore(JCR *jcr)
       case STREAM_SHA1_DIGEST:
       case STREAM_SHA256_DIGEST:
       case STREAM_SHA512_DIGEST:
+      case STREAM_XXH128_DIGEST:
+      case STREAM_BLAKE3_DIGEST:
          break;
 
       case STREAM_PROGRAM_NAMES:
@@ -1050,6 +1085,10 @@ void do_restore(JCR *jcr)
    if (bget_ret == BNET_EXT_TERMINATE) {
       goto get_out;
    }
+   if (!flush_restore_pipeline(rctx)) {
+      rctx.extract = false;
+      bclose(&rctx.bfd);
+   }
    /*
     * If output file is still open, it was the last one in the
     * archive since we just hit an end of file, so close the file.
@@ -1069,10 +1108,19 @@ get_out:
 
 ok_out:
    Dsm_check(200);
+   flush_restore_pipeline(rctx);
+   stop_restore_pipeline(jcr);
    Dmsg0(DT_DEDUP|215, "wait BufferedMsg\n");
    fdmsg->wait_read_sock(jcr->is_job_canceled());
    delete bmsg;
    free_GetMsg(fdmsg);
+#ifdef HAVE_RESTORE_DIRS
+   if (jcr->rdirs) {
+      jcr->rdirs->set_times(jcr);
+      delete jcr->rdirs;
+      jcr->rdirs = NULL;
+   }
+#endif
    Dsm_check(200);
    /*
     * First output the statistics.
@@ -1110,10 +1158,26 @@ ok_out:
    if (non_suppored_xattr) {
       Jmsg(jcr, M_INFO, 0, _("%d non-supported xattr streams ignored.\n"), non_suppored_xattr);
    }
+   if (rctx.delta_files || rctx.delta_unchanged) {
+      char ec2[50], ec3[50], ec4[50];
+      Jmsg(jcr, M_INFO, 0, _("Delta restore: Files unchanged=%s compared=%s Bytes unchanged=%s rewritten=%s\n"),
+         edit_uint64_with_commas(rctx.delta_unchanged, ec1),
+         edit_uint64_with_commas(rctx.delta_files, ec2),
+         edit_uint64_with_commas(rctx.delta_same_bytes, ec3),
+         edit_uint64_with_commas(rctx.delta_written_bytes, ec4));
+   }
 
    /* Free Signature & Crypto Data */
    free_signature(rctx);
    free_session(rctx);
+   if (rctx.tags) {
+      free_pool_memory(rctx.tags);
+      rctx.tags = NULL;
+   }
+   if (rctx.delta_buf) {
+      free_pool_memory(rctx.delta_buf);
+      rctx.delta_buf = NULL;
+   }
    if (jcr->crypto.digest) {
       crypto_digest_free(jcr->crypto.digest);
       jcr->crypto.digest = NULL;
@@ -1145,6 +1209,12 @@ ok_out:
       jcr->compress_buf = NULL;
       jcr->compress_buf_size = 0;
    }
+#ifdef HAVE_ZSTD
+   if (jcr->ZSTD_decompress_workset) {
+      ZSTD_freeDCtx((ZSTD_DCtx *)jcr->ZSTD_decompress_workset);
+      jcr->ZSTD_decompress_workset = NULL;
+   }
+#endif
 
 #ifdef HAVE_ACL
    if (jcr->bacl) {
@@ -1233,11 +1303,114 @@ bool sparse_data(JCR *jcr, BFILE *bfd, uint64_t *addr, char **data, uint32_t *le
    return true;
 }
 
+#ifdef HAVE_ZSTD
+/*
+ * Decompress a zstd block. Each block is a complete zstd frame
+ *  that records the size of the original data.
+ */
+static bool zstd_decompress_block(JCR *jcr, char **data, uint32_t *length,
+                                  POOLMEM *&buf, int32_t &buf_size, void *&zstd_workset)
+{
+   const char *cbuf = *data + sizeof(comp_stream_header);
+   size_t real_compress_len = *length - sizeof(comp_stream_header);
+   unsigned long long size;
+   size_t ret;
+
+   if (!zstd_workset) {
+      zstd_workset = ZSTD_createDCtx();
+      if (!zstd_workset) {
+         Qmsg(jcr, M_ERROR, 0, _("ZSTD decompression context allocation failed\n"));
+         return false;
+      }
+   }
+   size = ZSTD_getFrameContentSize(cbuf, real_compress_len);
+   if (size == ZSTD_CONTENTSIZE_ERROR) {
+      Qmsg(jcr, M_ERROR, 0, _("ZSTD uncompression error on file %s. ERR=Invalid frame header\n"),
+           jcr->last_fname);
+      return false;
+   }
+   if (size != ZSTD_CONTENTSIZE_UNKNOWN && size > (unsigned long long)buf_size) {
+      if (size > 0x7fffffff) {
+         Qmsg(jcr, M_ERROR, 0, _("ZSTD uncompression error on file %s. ERR=Block too large\n"),
+              jcr->last_fname);
+         return false;
+      }
+      buf_size = size;
+      buf = check_pool_memory_size(buf, size);
+   }
+   while (ZSTD_isError(ret = ZSTD_decompressDCtx((ZSTD_DCtx *)zstd_workset,
+                                 buf, buf_size, cbuf, real_compress_len))
+          && ZSTD_getErrorCode(ret) == ZSTD_error_dstSize_tooSmall)
+   {
+      /* The buffer size is too small, try with a bigger one */
+      buf_size = buf_size + (buf_size >> 1);
+      buf = check_pool_memory_size(buf, buf_size);
+   }
+   if (ZSTD_isError(ret)) {
+      Qmsg(jcr, M_ERROR, 0, _("ZSTD uncompression error on file %s. ERR=%s\n"),
+           jcr->last_fname, ZSTD_getErrorName(ret));
+      return false;
+   }
+   *data = buf;
+   *length = ret;
+   return true;
+}
+#endif
+
+/*
+ * Decompress a lz4 block, it is preceded by the size of the
+ *  original data.
+ */
+static bool lz4_decompress_block(JCR *jcr, char **data, uint32_t *length,
+                                 POOLMEM *&buf, int32_t &buf_size)
+{
+   uint32_t size;
+   int len;
+
+   if (*length < sizeof(comp_stream_header) + 4) {
+      Qmsg(jcr, M_ERROR, 0, _("LZ4 uncompression error on file %s. ERR=Block too short\n"),
+           jcr->last_fname);
+      return false;
+   }
+   unser_declare;
+   unser_begin(*data + sizeof(comp_stream_header), 4);
+   unser_uint32(size);
+   if (size > 0x7e000000) {           /* LZ4_MAX_INPUT_SIZE */
+      Qmsg(jcr, M_ERROR, 0, _("LZ4 uncompression error on file %s. ERR=Block too large\n"),
+           jcr->last_fname);
+      return false;
+   }
+   if (size > (uint32_t)buf_size) {
+      buf_size = size;
+      buf = check_pool_memory_size(buf, size);
+   }
+   len = LZ4_decompress_safe(*data + sizeof(comp_stream_header) + 4, buf,
+                             *length - sizeof(comp_stream_header) - 4, size);
+   if (len < 0 || (uint32_t)len != size) {
+      Qmsg(jcr, M_ERROR, 0, _("LZ4 uncompression error on file %s. ERR=%d\n"),
+           jcr->last_fname, len);
+      return false;
+   }
+   *data = buf;
+   *length = len;
+   return true;
+}
+
 bool decompress_data(JCR *jcr, int32_t stream, char **data, uint32_t *length)
 {
-#if defined(HAVE_LZO) || defined(HAVE_LIBZ)
+   return decompress_data_buf(jcr, stream, data, length, jcr->compress_buf,
+                              jcr->compress_buf_size, jcr->ZSTD_decompress_workset);
+}
+
+/*
+ * Decompress the record in data into buf, that is resized if needed.
+ *  The buffer and the zstd context are given by the caller, so the
+ *  restore pipeline workers can decompress at the same time.
+ */
+bool decompress_data_buf(JCR *jcr, int32_t stream, char **data, uint32_t *length,
+                         POOLMEM *&buf, int32_t &buf_size, void *&zstd_workset)
+{
    char ec1[50];                   /* Buffer printing huge values */
-#endif
 
    Dmsg1(200, "Stream found in decompress_data(): %d\n", stream);
    if(stream == STREAM_COMPRESSED_DATA || stream == STREAM_SPARSE_COMPRESSED_DATA || stream == STREAM_WIN32_COMPRESSED_DATA
@@ -1275,30 +1448,43 @@ bool decompress_data(JCR *jcr, int32_t stream, char **data, uint32_t *length)
       switch(comp_magic) {
 #ifdef HAVE_LZO
          case COMPRESS_LZO1X:
-            compress_len = jcr->compress_buf_size;
+            compress_len = buf_size;
             cbuf = (const unsigned char*)*data + sizeof(comp_stream_header);
             real_compress_len = *length - sizeof(comp_stream_header);
             Dmsg2(200, "Comp_len=%d msglen=%d\n", compress_len, *length);
             while ((r=lzo1x_decompress_safe(cbuf, real_compress_len,
-                                            (unsigned char *)jcr->compress_buf, &compress_len, NULL)) == LZO_E_OUTPUT_OVERRUN)
+                                            (unsigned char *)buf, &compress_len, NULL)) == LZO_E_OUTPUT_OVERRUN)
             {
                /*
                 * The buffer size is too small, try with a bigger one
                 */
-               compress_len = jcr->compress_buf_size = jcr->compress_buf_size + (jcr->compress_buf_size >> 1);
+               compress_len = buf_size = buf_size + (buf_size >> 1);
                Dmsg2(200, "Comp_len=%d msglen=%d\n", compress_len, *length);
-               jcr->compress_buf = check_pool_memory_size(jcr->compress_buf,
-                                                    compress_len);
+               buf = check_pool_memory_size(buf, compress_len);
             }
             if (r != LZO_E_OK) {
                Qmsg(jcr, M_ERROR, 0, _("LZO uncompression error on file %s. ERR=%d\n"),
                     jcr->last_fname, r);
                return false;
             }
-            *data = jcr->compress_buf;
+            *data = buf;
             *length = compress_len;
             Dmsg2(200, "Write uncompressed %d bytes, total before write=%s\n", compress_len, edit_uint64(jcr->JobBytes, ec1));
             return true;
+#endif
+         case COMPRESS_LZ4:
+            if (!lz4_decompress_block(jcr, data, length, buf, buf_size)) {
+               return false;
+            }
+            Dmsg2(200, "Write uncompressed %d bytes, total before write=%s\n", *length, edit_uint64(jcr->JobBytes, ec1));
+            return true;
+#ifdef HAVE_ZSTD
+         case COMPRESS_ZSTD:
+            if (!zstd_decompress_block(jcr, data, length, buf, buf_size, zstd_workset)) {
+               return false;
+            }
+            Dmsg2(200, "Write uncompressed %d bytes, total before write=%s\n", *length, edit_uint64(jcr->JobBytes, ec1));
+            return true;
 #endif
          default:
             Qmsg(jcr, M_ERROR, 0, _("Compression algorithm 0x%x found, but not supported!\n"), comp_magic);
@@ -1314,23 +1500,22 @@ bool decompress_data(JCR *jcr, int32_t stream, char **data, uint32_t *length)
        *  needed by the zlib routines, they should not otherwise
        *  be used in Bacula.
        */
-      compress_len = jcr->compress_buf_size;
+      compress_len = buf_size;
       Dmsg2(200, "Comp_len=%d msglen=%d\n", compress_len, *length);
-      while ((stat=uncompress((Byte *)jcr->compress_buf, &compress_len,
+      while ((stat=uncompress((Byte *)buf, &compress_len,
                               (const Byte *)*data, (uLong)*length)) == Z_BUF_ERROR)
       {
          /* The buffer size is too small, try with a bigger one. */
-         compress_len = jcr->compress_buf_size = jcr->compress_buf_size + (jcr->compress_buf_size >> 1);
+         compress_len = buf_size = buf_size + (buf_size >> 1);
          Dmsg2(200, "Comp_len=%d msglen=%d\n", compress_len, *length);
-         jcr->compress_buf = check_pool_memory_size(jcr->compress_buf,
-                                                    compress_len);
+         buf = check_pool_memory_size(buf, compress_len);
       }
       if (stat != Z_OK) {
          Qmsg(jcr, M_ERROR, 0, _("Uncompression error on file %s. ERR=%s\n"),
               jcr->last_fname, zlib_strerror(stat));
          return false;
       }
-      *data = jcr->compress_buf;
+      *data = buf;
       *length = compress_len;
       Dmsg2(200, "Write uncompressed %d bytes, total before write=%s\n", compress_len, edit_uint64(jcr->JobBytes, ec1));
       return true;
@@ -1351,7 +1536,104 @@ static void unser_crypto_packet_len(RESTORE_CIPHER_CTX *ctx)
    }
 }
 
-static bool store_data(r_ctx &rctx, char *data, const int32_t length, bool win32_decomp)
+#ifndef HAVE_WIN32
+/*
+ * Replace=IfChanged or IfDifferent on an existing file (CF_DELTA).
+ *  Give zeros to the bytes skipped by a seek (the holes of a sparse
+ *  file) that are not zero on the disk.
+ */
+static bool delta_zero_gap(r_ctx &rctx, boffset_t start, boffset_t end)
+{
+   BFILE *bfd = &rctx.bfd;
+
+   while (start < end) {
+      int32_t len = (int32_t)MIN(end - start, (boffset_t)(64 * 1024));
+      rctx.delta_buf = check_pool_memory_size(rctx.delta_buf, len);
+      ssize_t nbytes = pread(bfd->fid, rctx.delta_buf, len, start);
+      if (nbytes <= 0) {
+         break;                 /* End of the old file, nothing to clear */
+      }
+      if (!is_buf_zero(rctx.delta_buf, nbytes)) {
+         memset(rctx.delta_buf, 0, nbytes);
+         if (pwrite(bfd->fid, rctx.delta_buf, nbytes, start) != nbytes) {
+            berrno be;
+            Jmsg2(rctx.jcr, M_ERROR, 0, _("Write error on %s: ERR=%s\n"),
+               rctx.jcr->last_fname, be.bstrerror());
+            return false;
+         }
+         rctx.delta_written_bytes += nbytes;
+      } else {
+         rctx.delta_same_bytes += nbytes;
+      }
+      start += nbytes;
+   }
+   return true;
+}
+
+/*
+ * Compare the record with the data of the file at the same offset,
+ *  write it only if it differs.
+ */
+static bool delta_store_data(r_ctx &rctx, char *data, const int32_t length)
+{
+   JCR *jcr = rctx.jcr;
+   BFILE *bfd = &rctx.bfd;
+   boffset_t pos = blseek(bfd, 0, SEEK_CUR);
+
+   if (pos < 0) {
+      berrno be;
+      Jmsg2(jcr, M_ERROR, 0, _("Seek error on %s: ERR=%s\n"),
+         jcr->last_fname, be.bstrerror());
+      return false;
+   }
+   if (!rctx.delta_buf) {
+      rctx.delta_buf = get_pool_memory(PM_MESSAGE);
+   }
+   if (pos > (boffset_t)rctx.delta_end &&
+       !delta_zero_gap(rctx, (boffset_t)rctx.delta_end, pos)) {
+      return false;
+   }
+   rctx.delta_buf = check_pool_memory_size(rctx.delta_buf, length);
+   if (pread(bfd->fid, rctx.delta_buf, length, pos) == (ssize_t)length &&
+       memcmp(rctx.delta_buf, data, length) == 0) {
+      if (blseek(bfd, pos + length, SEEK_SET) < 0) {
+         berrno be;
+         Jmsg2(jcr, M_ERROR, 0, _("Seek error on %s: ERR=%s\n"),
+            jcr->last_fname, be.bstrerror());
+         return false;
+      }
+      rctx.delta_same_bytes += length;
+
+   } else if (bwrite(bfd, data, length) != (ssize_t)length) {
+      berrno be;
+      Jmsg6(jcr, M_ERROR, 0, _("Write error at byte=%lld block=%d write_len=%d lerror=%d on %s: ERR=%s\n"),
+         bfd->total_bytes, bfd->block, length, bfd->lerror,
+         jcr->last_fname, be.bstrerror(bfd->berrno));
+      return false;
+
+   } else {
+      rctx.delta_written_bytes += length;
+   }
+   rctx.delta_end = pos + length;
+   return true;
+}
+
+/*
+ * Cut what is left of the old file after the last record
+ */
+static void delta_truncate(r_ctx &rctx)
+{
+   BFILE *bfd = &rctx.bfd;
+
+   if (is_bopen(bfd) && ftruncate(bfd->fid, rctx.delta_end) < 0) {
+      berrno be;
+      Jmsg2(rctx.jcr, M_ERROR, 0, _("Unable to truncate %s: ERR=%s\n"),
+         rctx.jcr->last_fname, be.bstrerror());
+   }
+}
+#endif
+
+bool store_data(r_ctx &rctx, char *data, const int32_t length, bool win32_decomp)
 {
    JCR *jcr = rctx.jcr;
    BFILE *bfd = &rctx.bfd;
@@ -1384,6 +1666,10 @@ static bool store_data(r_ctx &rctx, char *data, const int32_t length, bool win32
       }
       return true;
    }
+#else
+   if (rctx.delta) {
+      return delta_store_data(rctx, data, length);
+   }
 #endif
    if (win32_decomp) {
       if (!processWin32BackupAPIBlock(bfd, data, length)) {
@@ -1456,7 +1742,34 @@ int32_t extract_data(r_ctx &rctx, POOLMEM *buf, int32_t buflen)
    wsize = rsize;
    wbuf = buf;
 
-   if (flags & FO_ENCRYPT) {
+   if ((flags & FO_ENCRYPT) && cipher_ctx->aead) {
+      ASSERT(cipher_ctx->cipher);
+
+      /*
+       * With an AEAD cipher, each record is decrypted and authenticated
+       *  on its own, there is no length and nothing to buffer.
+       */
+      cipher_ctx->buf = check_pool_memory_size(cipher_ctx->buf, wsize);
+      if (!crypto_cipher_open(cipher_ctx->cipher, (const u_int8_t *)wbuf, wsize,
+                              (u_int8_t *)cipher_ctx->buf, &decrypted_len)) {
+         Jmsg1(jcr, M_ERROR, 0, _("Decryption error, the encrypted data of %s is corrupted\n"),
+               jcr->last_fname);
+         goto get_out;
+      }
+      if (jcr->crypto.pki_sign) {
+         if (!rctx.tags) {
+            rctx.tags = get_memory(rctx.tags_len + CRYPTO_RECORD_TAG_SIZE);
+         }
+         rctx.tags = check_pool_memory_size(rctx.tags, rctx.tags_len + CRYPTO_RECORD_TAG_SIZE);
+         memcpy(rctx.tags + rctx.tags_len, wbuf + wsize - CRYPTO_RECORD_TAG_SIZE,
+                CRYPTO_RECORD_TAG_SIZE);
+         rctx.tags_len += CRYPTO_RECORD_TAG_SIZE;
+      }
+      Dmsg2(200, "decrypted len=%d sealed len=%d\n", decrypted_len, wsize);
+      wbuf = cipher_ctx->buf;
+      wsize = decrypted_len;
+
+   } else if (flags & FO_ENCRYPT) {
       ASSERT(cipher_ctx->cipher);
 
       /*
@@ -1528,7 +1841,7 @@ int32_t extract_data(r_ctx &rctx, POOLMEM *buf, int32_t buflen)
    Dmsg2(130, "Write %u bytes, JobBytes=%s\n", wsize, edit_uint64(jcr->JobBytes, ec1));
 
    /* Clean up crypto buffers */
-   if (flags & FO_ENCRYPT) {
+   if ((flags & FO_ENCRYPT) && !cipher_ctx->aead) {
       /* Move any remaining data to start of buffer */
       if (cipher_ctx->buf_len > 0) {
          Dmsg1(130, "Moving %u buffered bytes to start of buffer\n", cipher_ctx->buf_len);
@@ -1573,6 +1886,12 @@ static bool close_previous_stream(r_ctx &rctx)
          bclose(&rctx.bfd);
          rctx.count = 0;
       }
+#ifndef HAVE_WIN32
+      if (rctx.delta) {
+         delta_truncate(rctx);
+         rctx.delta = false;
+      }
+#endif
 
       if (rctx.jcr->plugin) {
          plugin_set_attributes(rctx.jcr, rctx.attr, &rctx.bfd);
@@ -1619,6 +1938,11 @@ bool flush_cipher(r_ctx &rctx, BFILE *bfd, uint64_t *addr, int flags, int32_t st
    char ec1[50];                      /* Buffer printing huge values */
    bool second_pass = false;
 
+   /* The sealed records are never buffered */
+   if (cipher_ctx->aead) {
+      return true;
+   }
+
 again:
    /* Write out the remaining block and free the cipher context */
    cipher_ctx->buf = check_pool_memory_size(cipher_ctx->buf,
@@ -1723,6 +2047,7 @@ static void free_session(r_ctx &rctx)
       crypto_session_free(rctx.cs);
       rctx.cs = NULL;
    }
+   rctx.tags_len = 0;
 }
 
 /*
@@ -1776,7 +2101,18 @@ static bool verify_signature(r_ctx &rctx)
                jcr->crypto.digest = NULL;
             }
          }
-         if (jcr->crypto.digest) {
+         if (rctx.cs && crypto_session_aead(rctx.cs)) {
+            /* AES-GCM, the signature covers the tags of the records */
+            if (rctx.tags_len > 0) {
+               crypto_digest_update(digest, (uint8_t *)rctx.tags, rctx.tags_len);
+            }
+            if ((err = crypto_sign_verify(sig, keypair, digest)) != CRYPTO_ERROR_NONE) {
+               Dmsg1(50, "Bad signature on %s\n", jcr->last_fname);
+               Jmsg2(jcr, M_ERROR, 0, _("Signature validation failed for file %s: ERR=%s\n"),
+                     jcr->last_fname, crypto_strerror(err));
+               goto get_out;
+            }
+         } else if (jcr->crypto.digest) {
             /* Use digest computed while writing the file to verify
              *  the signature */
             if ((err = crypto_sign_verify(sig, keypair, jcr->crypto.digest)) != CRYPTO_ERROR_NONE) {
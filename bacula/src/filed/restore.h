@@ -32,6 +32,7 @@ struct RESTORE_DATA_STREAM {
 struct RESTORE_CIPHER_CTX {
    CIPHER_CONTEXT *cipher;
    uint32_t block_size;
+   bool aead;                          /* Records sealed one by one (AES-GCM) */
 
    POOLMEM *buf;                       /* Pointer to descryption buffer */
    int32_t buf_len;                    /* Count of bytes currently in buf */
@@ -58,6 +59,13 @@ struct r_ctx {
    int32_t type;                       /* file type FT_ */
    ATTR *attr;                         /* Pointer to attributes */
    bool extract;                       /* set when extracting */
+   bool delta;                         /* file exists, write only what differs */
+   uint64_t delta_end;                 /* end of the data compared or written */
+   POOLMEM *delta_buf;                 /* data read back from the file */
+   uint64_t delta_files;               /* files compared */
+   uint64_t delta_unchanged;           /* files skipped, same size and mtime */
+   uint64_t delta_same_bytes;          /* bytes already on disk */
+   uint64_t delta_written_bytes;       /* bytes rewritten */
    alist *delayed_streams;             /* streams that should be restored as last */
    worker *efs;                        /* Windows EFS worker thread */
    int32_t count;                      /* Debug count */
@@ -66,8 +74,21 @@ struct r_ctx {
    CRYPTO_SESSION *cs;                 /* Cryptographic session data (if any) for file */
    RESTORE_CIPHER_CTX cipher_ctx;      /* Cryptographic restore context (if any) for file */
    RESTORE_CIPHER_CTX fork_cipher_ctx; /* Cryptographic restore context (if any) for alternative stream */
+   POOLMEM *tags;                      /* Authentication tags of the records, signed with AES-GCM */
+   int32_t tags_len;
 };
 
+bool store_data(r_ctx &rctx, char *data, const int32_t length, bool win32_decomp);
+
+/*
+ * Restore pipeline (restore_pipeline.c)
+ */
+bool start_restore_pipeline(JCR *jcr, int nb_workers);
+void stop_restore_pipeline(JCR *jcr);
+bool can_pipeline_extract(r_ctx &rctx);
+int32_t pipeline_extract_data(r_ctx &rctx, POOLMEM *buf, int32_t buflen);
+bool flush_restore_pipeline(r_ctx &rctx);
+
 #endif
 
 #ifdef TEST_WORKER
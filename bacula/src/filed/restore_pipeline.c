@@ -0,0 +1,698 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+ */
+/*
+ *  Bacula File Daemon  restore_pipeline.c
+ *
+ *  Multi-threaded processing of the file data during a restore.
+ *
+ *  The job thread receives the records from the SD and copies the
+ *  data records of the file into a ring of slots. Each slot is then:
+ *   - opened (AES-GCM records are independent) and decompressed by
+ *     any thread of a pool of workers, the file address of the sparse
+ *     and offsets records is extracted
+ *   - written by the writer thread, in file order. The small records
+ *     are coalesced into large writes, the holes of the sparse files
+ *     are punched in the preallocated files.
+ *
+ *  The pipeline is drained when the stream changes, the job thread
+ *  then handles the other streams and closes the file as usual, so
+ *  the r_ctx is the same as with the single threaded code. The CBC
+ *  ciphers, the plugins and the Windows EFS files are not handled by
+ *  the pipeline, extract_data() is used for them.
+ */
+
+#include "bacula.h"
+#include "filed.h"
+#include "restore.h"
+
+/* Size of the writes of the coalesced records */
+#define RPIPE_WRITE_SIZE (1024 * 1024)
+
+enum {
+   RPIPE_STAGE_RECEIVE,
+   RPIPE_STAGE_DECODE,
+   RPIPE_STAGE_WRITE,
+   RPIPE_STAGE_MAX
+};
+
+static const char *stage_name[RPIPE_STAGE_MAX] = {
+   "Receive", "Decode", "Write"
+};
+
+/* One data record going through the pipeline */
+struct rpipe_slot {
+   POOLMEM *rmsg;                     /* record as received */
+   POOLMEM *dmsg;                     /* opened record (AES-GCM) */
+   POOLMEM *umsg;                     /* decompressed data */
+   int32_t umsg_size;                 /* size given to decompress_data_buf() */
+   char *data;                        /* data to write, in one of the buffers */
+   uint32_t len;                      /* record length */
+   uint32_t dlen;                     /* data length */
+   uint64_t addr;                     /* file address, if has_addr */
+   int32_t stream;
+   int flags;                         /* see rctx.flags */
+   bool has_addr;                     /* sparse or offsets record */
+   bool claimed;                      /* a worker has it */
+   bool decoded;                      /* ready to be written */
+   bool error;
+};
+
+/* Busy and wait time of a pipeline stage */
+struct rpipe_stat {
+   btime_t busy;
+   btime_t wait;
+   uint64_t count;                    /* records processed */
+};
+
+class rpipeline: public SMARTALLOC {
+public:
+   JCR *jcr;
+   pthread_mutex_t mutex;
+   pthread_cond_t slot_free;          /* the job thread waits for a free slot */
+   pthread_cond_t work;               /* the workers and the writer wait for work */
+   rpipe_slot *slots;
+   int nb_slots;
+   int nb_workers;                    /* decode workers */
+   int nb_threads;                    /* threads started */
+   pthread_t *tids;
+   uint64_t wseq;                     /* next slot to fill */
+   uint64_t fseq;                     /* next slot to write, the older ones are free */
+   r_ctx *rctx;                       /* file being restored, NULL between the runs */
+   CRYPTO_SESSION *cs;                /* session of the file, for the AES-GCM records */
+   uint32_t cipher_gen;               /* incremented for each new session */
+   bool flush;                        /* the writer must empty its buffer */
+   bool quit;
+   bool error;
+
+   /* Used by the writer thread during a run */
+   POOLMEM *wbuf;                     /* coalesced records */
+   uint32_t wbuf_len;
+   uint32_t wbuf_size;
+   uint64_t addr;                     /* file address after the data of wbuf */
+   int64_t prealloc_size;             /* to preallocate at the first write */
+   bool prealloc;                     /* the file is preallocated */
+   uint64_t prealloc_end;             /* size given by the preallocation */
+   bool win32_decomp;
+
+   rpipe_stat stats[RPIPE_STAGE_MAX];
+   uint64_t nb_writes;
+   uint64_t nb_prealloc;
+   uint64_t nb_holes;
+
+   rpipeline(JCR *ajcr, int workers);
+   ~rpipeline();
+   rpipe_slot *slot(uint64_t seq) { return &slots[seq % nb_slots]; };
+   void add_stat(int stage, btime_t busy, btime_t wait);
+   bool write_buffer();
+   bool write_slot(rpipe_slot *slot);
+   void preallocate();
+   void punch_hole(uint64_t from, uint64_t to);
+   bool truncate_file();
+};
+
+rpipeline::rpipeline(JCR *ajcr, int workers)
+{
+   jcr = ajcr;
+   nb_workers = workers;
+   nb_slots = 2 * workers + 4;
+   nb_threads = 0;
+   tids = (pthread_t *)malloc((workers + 1) * sizeof(pthread_t));
+   slots = (rpipe_slot *)malloc(nb_slots * sizeof(rpipe_slot));
+   memset(slots, 0, nb_slots * sizeof(rpipe_slot));
+   for (int i=0; i < nb_slots; i++) {
+      slots[i].rmsg = get_memory(jcr->buf_size);
+      slots[i].dmsg = get_memory(jcr->buf_size);
+      slots[i].umsg_size = jcr->compress_buf_size;
+      slots[i].umsg = get_memory(slots[i].umsg_size);
+   }
+   wseq = fseq = 0;
+   rctx = NULL;
+   cs = NULL;
+   cipher_gen = 0;
+   flush = quit = error = false;
+   wbuf_size = MAX(RPIPE_WRITE_SIZE, 2 * jcr->buf_size);
+   wbuf = get_memory(wbuf_size);
+   wbuf_len = 0;
+   addr = 0;
+   prealloc_size = 0;
+   prealloc_end = 0;
+   prealloc = win32_decomp = false;
+   memset(stats, 0, sizeof(stats));
+   nb_writes = nb_prealloc = nb_holes = 0;
+   pthread_mutex_init(&mutex, NULL);
+   pthread_cond_init(&slot_free, NULL);
+   pthread_cond_init(&work, NULL);
+}
+
+rpipeline::~rpipeline()
+{
+   for (int i=0; i < nb_slots; i++) {
+      free_pool_memory(slots[i].rmsg);
+      free_pool_memory(slots[i].dmsg);
+      free_pool_memory(slots[i].umsg);
+   }
+   free_pool_memory(wbuf);
+   free(slots);
+   free(tids);
+   pthread_cond_destroy(&work);
+   pthread_cond_destroy(&slot_free);
+   pthread_mutex_destroy(&mutex);
+}
+
+/* Must be called with the mutex locked */
+void rpipeline::add_stat(int stage, btime_t busy, btime_t wait)
+{
+   stats[stage].busy += busy;
+   stats[stage].wait += wait;
+   stats[stage].count++;
+}
+
+/*
+ * Write the coalesced records, called by the writer thread
+ */
+bool rpipeline::write_buffer()
+{
+   bool ok = true;
+   if (wbuf_len > 0) {
+      ok = store_data(*rctx, wbuf, wbuf_len, win32_decomp);
+      if (ok) {
+         jcr->JobBytes += wbuf_len;
+         nb_writes++;
+      }
+      wbuf_len = 0;
+   }
+   return ok;
+}
+
+/*
+ * Reserve the blocks of the file. The file gets its final size here,
+ *  the holes of a sparse file can be punched only below the end of
+ *  the file, see truncate_file() if less data is restored.
+ */
+void rpipeline::preallocate()
+{
+#if defined(HAVE_FALLOCATE) && !defined(HAVE_WIN32)
+   if (fallocate(rctx->bfd.fid, 0, 0, prealloc_size) == 0) {
+      prealloc = true;
+      prealloc_end = prealloc_size;
+      nb_prealloc++;
+   } else {
+      berrno be;
+      Dmsg2(100, "Cannot preallocate %s: ERR=%s\n", jcr->last_fname, be.bstrerror());
+   }
+#endif
+   prealloc_size = 0;
+}
+
+/*
+ * Free the preallocated blocks of a hole of a sparse file, a seek
+ *  would leave them allocated.
+ */
+void rpipeline::punch_hole(uint64_t from, uint64_t to)
+{
+#if defined(HAVE_FALLOCATE) && defined(FALLOC_FL_PUNCH_HOLE) && !defined(HAVE_WIN32)
+   if (fallocate(rctx->bfd.fid, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                 from, to - from) == 0) {
+      nb_holes++;
+   } else {
+      berrno be;
+      Dmsg2(100, "Cannot punch a hole in %s: ERR=%s\n", jcr->last_fname, be.bstrerror());
+   }
+#endif
+}
+
+/*
+ * The file may have changed during the backup, give to the preallocated
+ *  file the size of the restored data.
+ */
+bool rpipeline::truncate_file()
+{
+   if (!prealloc || addr >= prealloc_end) {
+      return true;
+   }
+   if (ftruncate(rctx->bfd.fid, (off_t)addr) != 0) {
+      berrno be;
+      Jmsg2(jcr, M_ERROR, 0, _("Truncate error on %s: ERR=%s\n"),
+            jcr->last_fname, be.bstrerror());
+      return false;
+   }
+   prealloc_end = addr;
+   return true;
+}
+
+/*
+ * Write a record at its place in the file, see sparse_data() and
+ *  store_data(). Called by the writer thread.
+ */
+bool rpipeline::write_slot(rpipe_slot *slot)
+{
+   char ec1[50];
+
+   if (prealloc_size > 0) {
+      preallocate();
+   }
+   if (slot->has_addr && slot->addr != addr) {
+      if (!write_buffer()) {
+         return false;
+      }
+      if (prealloc && slot->addr > addr) {
+         punch_hole(addr, slot->addr);
+      }
+      addr = slot->addr;
+      if (blseek(&rctx->bfd, (boffset_t)addr, SEEK_SET) < 0) {
+         berrno be;
+         Jmsg3(jcr, M_ERROR, 0, _("Seek to %s error on %s: ERR=%s\n"),
+               edit_uint64(addr, ec1), jcr->last_fname,
+               be.bstrerror(rctx->bfd.berrno));
+         return false;
+      }
+   }
+   if (wbuf_len + slot->dlen > wbuf_size && !write_buffer()) {
+      return false;
+   }
+   if (slot->dlen > wbuf_size) {
+      if (!store_data(*rctx, slot->data, slot->dlen, win32_decomp)) {
+         return false;
+      }
+      jcr->JobBytes += slot->dlen;
+      nb_writes++;
+   } else {
+      memcpy(wbuf + wbuf_len, slot->data, slot->dlen);
+      wbuf_len += slot->dlen;
+   }
+   addr += slot->dlen;
+   return true;
+}
+
+/*
+ * Open and decompress any slot that is waiting for it
+ */
+extern "C" void *rpipe_decode_thread(void *arg)
+{
+   rpipeline *p = (rpipeline *)arg;
+   JCR *jcr = p->jcr;
+   void *zstd_workset = NULL;
+   CIPHER_CONTEXT *cipher_ctx = NULL;  /* created at the first record of a session */
+   uint32_t cipher_gen = 0;
+   btime_t start, wait;
+
+   set_jcr_in_tsd(jcr);
+   P(p->mutex);
+   for ( ;; ) {
+      rpipe_slot *slot = NULL;
+      start = get_current_btime();
+      while (!p->quit) {
+         for (uint64_t seq = p->fseq; seq < p->wseq; seq++) {
+            if (!p->slot(seq)->decoded && !p->slot(seq)->claimed) {
+               slot = p->slot(seq);
+               break;
+            }
+         }
+         if (slot) {
+            break;
+         }
+         pthread_cond_wait(&p->work, &p->mutex);
+      }
+      if (!slot) {
+         break;                       /* quit */
+      }
+      slot->claimed = true;
+      wait = get_current_btime() - start;
+      CRYPTO_SESSION *cs = p->cs;
+      uint32_t gen = p->cipher_gen;
+      bool error = p->error;
+      V(p->mutex);
+
+      start = get_current_btime();
+      char *wbuf = slot->rmsg;
+      uint32_t wsize = slot->len;
+      bool ok = true;
+      if (error) {
+         /* Nothing to do, the file will be discarded */
+
+      } else if (slot->flags & FO_ENCRYPT) {
+         uint32_t block_size, decrypted_len = 0;
+         if (cipher_ctx && cipher_gen != gen) {
+            crypto_cipher_free(cipher_ctx);
+            cipher_ctx = NULL;
+         }
+         if (!cipher_ctx) {
+            cipher_ctx = crypto_cipher_new(cs, false, &block_size);
+            cipher_gen = gen;
+         }
+         slot->dmsg = check_pool_memory_size(slot->dmsg, wsize);
+         if (!cipher_ctx) {
+            Jmsg1(jcr, M_ERROR, 0, _("Failed to initialize decryption context for %s\n"),
+                  jcr->last_fname);
+            ok = false;
+         } else if (!crypto_cipher_open(cipher_ctx, (const u_int8_t *)wbuf, wsize,
+                                        (u_int8_t *)slot->dmsg, &decrypted_len)) {
+            Jmsg1(jcr, M_ERROR, 0, _("Decryption error, the encrypted data of %s is corrupted\n"),
+                  jcr->last_fname);
+            ok = false;
+         }
+         wbuf = slot->dmsg;
+         wsize = decrypted_len;
+      }
+
+      slot->has_addr = false;
+      if (ok && !error && (slot->flags & (FO_SPARSE|FO_OFFSETS))) {
+         unser_declare;
+         unser_begin(wbuf, OFFSET_FADDR_SIZE);
+         unser_uint64(slot->addr);
+         slot->has_addr = true;
+         wbuf += OFFSET_FADDR_SIZE;
+         wsize -= OFFSET_FADDR_SIZE;
+      }
+      if (ok && !error && (slot->flags & FO_COMPRESS)) {
+         ok = decompress_data_buf(jcr, slot->stream, &wbuf, &wsize, slot->umsg,
+                                  slot->umsg_size, zstd_workset);
+      }
+      slot->data = wbuf;
+      slot->dlen = wsize;
+
+      P(p->mutex);
+      p->add_stat(RPIPE_STAGE_DECODE, get_current_btime() - start, wait);
+      slot->error = !ok;
+      slot->decoded = true;
+      pthread_cond_broadcast(&p->work);
+   }
+   V(p->mutex);
+
+#ifdef HAVE_ZSTD
+   if (zstd_workset) {
+      ZSTD_freeDCtx((ZSTD_DCtx *)zstd_workset);
+   }
+#endif
+   if (cipher_ctx) {
+      crypto_cipher_free(cipher_ctx);
+   }
+   return NULL;
+}
+
+/*
+ * Write the slots to the file, in file order
+ */
+extern "C" void *rpipe_write_thread(void *arg)
+{
+   rpipeline *p = (rpipeline *)arg;
+   JCR *jcr = p->jcr;
+   btime_t start, wait;
+
+   set_jcr_in_tsd(jcr);
+   P(p->mutex);
+   for ( ;; ) {
+      start = get_current_btime();
+      while (!p->quit && !(p->fseq < p->wseq && p->slot(p->fseq)->decoded) &&
+             !(p->flush && p->fseq == p->wseq)) {
+         pthread_cond_wait(&p->work, &p->mutex);
+      }
+      if (p->quit) {
+         break;
+      }
+      bool error = p->error || jcr->is_job_canceled();
+
+      /* All the records of the run are written, empty the buffer */
+      if (p->fseq == p->wseq) {
+         V(p->mutex);
+         bool ok = error || (p->write_buffer() && p->truncate_file());
+         P(p->mutex);
+         if (!ok) {
+            p->error = true;
+         }
+         p->wbuf_len = 0;
+         p->flush = false;
+         pthread_cond_broadcast(&p->slot_free);
+         continue;
+      }
+
+      rpipe_slot *slot = p->slot(p->fseq);
+      wait = get_current_btime() - start;
+      V(p->mutex);
+
+      start = get_current_btime();
+      bool ok = error || (!slot->error && p->write_slot(slot));
+
+      P(p->mutex);
+      p->add_stat(RPIPE_STAGE_WRITE, get_current_btime() - start, wait);
+      if (!ok) {
+         p->error = true;
+      }
+      p->fseq++;
+      pthread_cond_broadcast(&p->slot_free);
+   }
+   V(p->mutex);
+   return NULL;
+}
+
+/*
+ * The records of this stream can be handled by the pipeline
+ */
+bool can_pipeline_extract(r_ctx &rctx)
+{
+   if (!rctx.jcr->restore_pipeline) {
+      return false;
+   }
+#ifdef TEST_WORKER
+   return false;
+#endif
+   if (rctx.bfd.cmd_plugin || rctx.efs) {
+      return false;
+   }
+   /* Replace=IfChanged, the writes depend on the data on disk */
+   if (rctx.delta) {
+      return false;
+   }
+   /* The CBC ciphers are streams, the records depend on each other */
+   if ((rctx.flags & FO_ENCRYPT) && !rctx.cipher_ctx.aead) {
+      return false;
+   }
+   return true;
+}
+
+/*
+ * Queue a data record of the file, called by do_restore() in place
+ *  of extract_data(). The data will be written by the writer thread.
+ *
+ *  Returns: the record length or -1 on error, as extract_data()
+ */
+int32_t pipeline_extract_data(r_ctx &rctx, POOLMEM *buf, int32_t buflen)
+{
+   JCR *jcr = rctx.jcr;
+   rpipeline *p = jcr->restore_pipeline;
+   btime_t start, wait;
+
+   start = get_current_btime();
+   P(p->mutex);
+   if (!p->rctx) {
+      /* First record of the run, the writer state is reset */
+      p->rctx = &rctx;
+      p->addr = rctx.fileAddr;
+      p->win32_decomp = (rctx.flags & FO_WIN32DECOMP) != 0;
+      p->prealloc = false;
+      p->prealloc_size = 0;
+      /* The size is known at the first data record of a regular file */
+      if (rctx.fileAddr == 0 && !p->win32_decomp &&
+          (rctx.attr->type == FT_REG || rctx.attr->type == FT_REGE) &&
+          rctx.attr->statp.st_size > (int64_t)p->wbuf_size) {
+         p->prealloc_size = rctx.attr->statp.st_size;
+      }
+      if (rctx.flags & FO_ENCRYPT) {
+         p->cs = rctx.cs;
+         p->cipher_gen++;
+      }
+   }
+   while (!p->error && p->wseq - p->fseq >= (uint64_t)p->nb_slots) {
+      pthread_cond_wait(&p->slot_free, &p->mutex);
+   }
+   rpipe_slot *slot = p->slot(p->wseq);
+   bool error = p->error;
+   V(p->mutex);
+   if (error) {
+      flush_restore_pipeline(rctx);
+      return -1;
+   }
+   wait = get_current_btime() - start;
+
+   start = get_current_btime();
+   jcr->ReadBytes += buflen;
+   slot->rmsg = check_pool_memory_size(slot->rmsg, buflen);
+   memcpy(slot->rmsg, buf, buflen);
+   slot->len = buflen;
+   slot->stream = rctx.stream;
+   slot->flags = rctx.flags;
+   slot->claimed = false;
+   slot->decoded = !(rctx.flags & (FO_ENCRYPT|FO_SPARSE|FO_OFFSETS|FO_COMPRESS));
+   slot->error = false;
+   slot->has_addr = false;
+   slot->data = slot->rmsg;
+   slot->dlen = buflen;
+
+   /* The tags of the records are signed, in file order, see verify_signature() */
+   if ((rctx.flags & FO_ENCRYPT) && jcr->crypto.pki_sign) {
+      if (!rctx.tags) {
+         rctx.tags = get_memory(rctx.tags_len + CRYPTO_RECORD_TAG_SIZE);
+      }
+      rctx.tags = check_pool_memory_size(rctx.tags, rctx.tags_len + CRYPTO_RECORD_TAG_SIZE);
+      memcpy(rctx.tags + rctx.tags_len, buf + buflen - CRYPTO_RECORD_TAG_SIZE,
+             CRYPTO_RECORD_TAG_SIZE);
+      rctx.tags_len += CRYPTO_RECORD_TAG_SIZE;
+   }
+
+   P(p->mutex);
+   p->add_stat(RPIPE_STAGE_RECEIVE, get_current_btime() - start, wait);
+   p->wseq++;
+   pthread_cond_broadcast(&p->work);
+   V(p->mutex);
+   return buflen;
+}
+
+/*
+ * Wait until all the records of the run are written, then give the
+ *  file back to the job thread.
+ *
+ *  Returns: false if a record could not be written
+ */
+bool flush_restore_pipeline(r_ctx &rctx)
+{
+   rpipeline *p = rctx.jcr->restore_pipeline;
+   bool ok;
+
+   if (!p) {
+      return true;
+   }
+   P(p->mutex);
+   if (!p->rctx) {
+      V(p->mutex);
+      return true;
+   }
+   p->flush = true;
+   pthread_cond_broadcast(&p->work);
+   while (p->flush) {
+      pthread_cond_wait(&p->slot_free, &p->mutex);
+   }
+   ok = !p->error;
+   p->error = false;
+   rctx.fileAddr = p->addr;
+   p->rctx = NULL;
+   V(p->mutex);
+   return ok;
+}
+
+/*
+ * Start the pipeline threads for a restore job. If the threads
+ *  cannot be started, the job runs with the single threaded code.
+ */
+bool start_restore_pipeline(JCR *jcr, int nb_workers)
+{
+   rpipeline *p;
+   int stat;
+
+   if (nb_workers <= 0) {
+      return false;
+   }
+   p = New(rpipeline(jcr, nb_workers));
+   for (int i=0; i < nb_workers + 1; i++) {
+      void *(*fct)(void *) = (i == 0) ? rpipe_write_thread : rpipe_decode_thread;
+      if ((stat = pthread_create(&p->tids[i], NULL, fct, (void *)p)) != 0) {
+         berrno be;
+         Jmsg(jcr, M_WARNING, 0, _("Unable to start restore pipeline thread: ERR=%s\n"),
+              be.bstrerror(stat));
+         break;
+      }
+      p->nb_threads++;
+   }
+   /* We need at least the writer and one decode thread */
+   if (p->nb_threads < 2) {
+      jcr->restore_pipeline = p;
+      stop_restore_pipeline(jcr);
+      return false;
+   }
+   Dmsg2(50, "Restore pipeline started with %d threads and %d slots\n",
+         p->nb_threads, p->nb_slots);
+   jcr->lock();
+   jcr->restore_pipeline = p;
+   jcr->unlock();
+   return true;
+}
+
+/*
+ * Stop the pipeline threads and report the statistics. The
+ *  pipeline must be flushed.
+ */
+void stop_restore_pipeline(JCR *jcr)
+{
+   rpipeline *p = jcr->restore_pipeline;
+   POOL_MEM msg;
+
+   if (!p) {
+      return;
+   }
+   P(p->mutex);
+   p->quit = true;
+   pthread_cond_broadcast(&p->work);
+   V(p->mutex);
+   for (int i=0; i < p->nb_threads; i++) {
+      pthread_join(p->tids[i], NULL);
+   }
+   if (p->stats[RPIPE_STAGE_RECEIVE].count > 0 && edit_restore_pipeline_status(jcr, msg) > 0) {
+      Jmsg(jcr, M_INFO, 0, "%s", msg.c_str());
+   }
+   jcr->lock();
+   jcr->restore_pipeline = NULL;
+   jcr->unlock();
+   delete p;
+}
+
+/*
+ * Edit the busy/wait counters of each stage for "status client"
+ *  and the job report. Returns the length of the message.
+ */
+int edit_restore_pipeline_status(JCR *jcr, POOL_MEM &msg)
+{
+   POOL_MEM tmp;
+   char ed1[50], ed2[50], ed3[50];
+   int len;
+
+   jcr->lock();
+   rpipeline *p = jcr->restore_pipeline;
+   if (!p) {
+      jcr->unlock();
+      return 0;
+   }
+   P(p->mutex);
+   len = Mmsg(msg, _("    Restore pipeline: Workers=%d Slots=%d\n"), p->nb_workers,
+              p->nb_slots);
+   for (int i=0; i < RPIPE_STAGE_MAX; i++) {
+      rpipe_stat *st = &p->stats[i];
+      Mmsg(tmp, _("      %-8s Records=%s Busy=%ss Wait=%ss\n"), stage_name[i],
+           edit_uint64_with_commas(st->count, ed1),
+           edit_uint64_with_commas(st->busy / 1000000, ed2),
+           edit_uint64_with_commas(st->wait / 1000000, ed3));
+      len = pm_strcat(msg, tmp);
+   }
+   Mmsg(tmp, _("      Writes=%s Preallocated=%s Holes=%s\n"),
+        edit_uint64_with_commas(p->nb_writes, ed1),
+        edit_uint64_with_commas(p->nb_prealloc, ed2),
+        edit_uint64_with_commas(p->nb_holes, ed3));
+   len = pm_strcat(msg, tmp);
+   V(p->mutex);
+   jcr->unlock();
+   return len;
+}
@@ -25,6 +25,7 @@
 
 #include "bacula.h"
 #include "filed.h"
+#include "backup.h"
 #include "lib/status.h"
 
 extern bool GetWindowsVersionString(char *buf, int maxsiz);
@@ -368,6 +369,19 @@ static void  list_running_jobs_plain(STATUS_PKT *sp)
          sendit(msg.c_str(), len, sp);
       }
 
+      len = edit_backup_pipeline_status(njcr, msg);
+      if (len > 0) {
+         sendit(msg.c_str(), len, sp);
+      }
+      len = edit_verify_pipeline_status(njcr, msg);
+      if (len > 0) {
+         sendit(msg.c_str(), len, sp);
+      }
+      len = edit_restore_pipeline_status(njcr, msg);
+      if (len > 0) {
+         sendit(msg.c_str(), len, sp);
+      }
+
       found = true;
       if (njcr->store_bsock) {
          len = Mmsg(msg, "    SDReadSeqNo=%" lld " fd=%d SDtls=%d\n",
@@ -27,7 +27,9 @@
 #include "filed.h"
 
 static int verify_file(JCR *jcr, FF_PKT *ff_pkt, bool);
-static int read_digest(BFILE *bfd, DIGEST *digest, JCR *jcr);
+static int verify_digest_stream(FF_PKT *ff_pkt, crypto_digest_t *type);
+static int read_digest(BFILE *bfd, DIGEST *digest, JCR *jcr, const char *fname,
+                       int type, uint64_t flags, int64_t size, uint64_t *nbytes);
 
 /*
  * Find all the requested files and send attributes
@@ -53,10 +55,15 @@ void do_verify(JCR *jcr)
          DEFAULT_NETWORK_BUFFER_SIZE);
    }
    set_find_options((FF_PKT *)jcr->ff, jcr->incremental, jcr->mtime);
+   /* The digests are computed by a pool of threads */
+   if (client && client->max_pipeline_threads > 0) {
+      start_verify_pipeline(jcr, client->max_pipeline_threads);
+   }
    Dmsg0(10, "Start find files\n");
    /* Subroutine verify_file() is called for each file */
    find_files(jcr, (FF_PKT *)jcr->ff, verify_file, NULL);
    Dmsg0(10, "End find files\n");
+   stop_verify_pipeline(jcr);
 
    if (jcr->big_buf) {
       free(jcr->big_buf);
@@ -74,7 +81,10 @@ static int verify_file(JCR *jcr, FF_PKT *ff_pkt, bool top_level)
 {
    char attribs[MAXSTRING];
    char attribsEx[MAXSTRING];
+   const char *fname = ff_pkt->fname;
+   const char *link = "";
    int digest_stream = STREAM_NONE;
+   crypto_digest_t digest_type = CRYPTO_DIGEST_NONE;
    int stat;
    DIGEST *digest = NULL;
    BSOCK *dir;
@@ -187,89 +197,65 @@ static int verify_file(JCR *jcr, FF_PKT *ff_pkt, bool top_level)
     * For a directory, link is the same as fname, but with trailing
     * slash. For a linked file, link is the link.
     */
-   /* Send file attributes to Director (note different format than for Storage) */
-   Dmsg2(400, "send ATTR inx=%d fname=%s\n", jcr->JobFiles, ff_pkt->fname);
    if (ff_pkt->type == FT_LNK || ff_pkt->type == FT_LNKSAVED) {
-      stat = dir->fsend("%d %d %s %s%c%s%c%s%c", jcr->JobFiles,
-                        STREAM_UNIX_ATTRIBUTES, ff_pkt->VerifyOpts, ff_pkt->fname,
-                        0, attribs, 0, ff_pkt->link, 0);
+      fname = ff_pkt->fname;
+      link = ff_pkt->link;
    } else if (ff_pkt->type == FT_DIREND || ff_pkt->type == FT_REPARSE ||
               ff_pkt->type == FT_JUNCTION) {
       /* Here link is the canonical filename (i.e. with trailing slash) */
-      stat = dir->fsend("%d %d %s %s%c%s%c%c", jcr->JobFiles,
-                        STREAM_UNIX_ATTRIBUTES, ff_pkt->VerifyOpts, ff_pkt->link,
-                        0, attribs, 0, 0);
-   } else {
-      stat = dir->fsend("%d %d %s %s%c%s%c%c", jcr->JobFiles,
-                        STREAM_UNIX_ATTRIBUTES, ff_pkt->VerifyOpts, ff_pkt->fname,
-                        0, attribs, 0, 0);
+      fname = ff_pkt->link;
    }
+
+   /*
+    * The remainder of the function is all about getting the checksum.
+    * First we initialise, then we read files, other streams and Finder Info.
+    */
+   if (ff_pkt->type != FT_LNKSAVED && S_ISREG(ff_pkt->statp.st_mode)) {
+      digest_stream = verify_digest_stream(ff_pkt, &digest_type);
+   }
+
+   /* The digest will be computed by a worker, the result is sent in order */
+   if (jcr->verify_pipeline) {
+      return pipeline_verify_file(jcr, ff_pkt, fname, attribs, link,
+                                  digest_type, digest_stream) ? 1 : 0;
+   }
+
+   /* Send file attributes to Director (note different format than for Storage) */
+   Dmsg2(400, "send ATTR inx=%d fname=%s\n", jcr->JobFiles, ff_pkt->fname);
+   stat = dir->fsend("%d %d %s %s%c%s%c%s%c", jcr->JobFiles,
+                     STREAM_UNIX_ATTRIBUTES, ff_pkt->VerifyOpts, fname,
+                     0, attribs, 0, link, 0);
    Dmsg2(20, "bfiled>bdird: attribs len=%d: msg=%s\n", dir->msglen, dir->msg);
    if (!stat) {
       Jmsg(jcr, M_FATAL, 0, _("Network error in send to Director: ERR=%s\n"), dir->bstrerror());
       return 0;
    }
 
-   /*
-    * The remainder of the function is all about getting the checksum.
-    * First we initialise, then we read files, other streams and Finder Info.
-    */
-   if (ff_pkt->type != FT_LNKSAVED && (S_ISREG(ff_pkt->statp.st_mode) &&
-            ff_pkt->flags & (FO_MD5|FO_SHA1|FO_SHA256|FO_SHA512))) {
+   if (digest_stream != STREAM_NONE) {
       /*
        * Create our digest context. If this fails, the digest will be set to NULL
        * and not used.
        */
-      if (ff_pkt->flags & FO_MD5) {
-         digest = crypto_digest_new(jcr, CRYPTO_DIGEST_MD5);
-         digest_stream = STREAM_MD5_DIGEST;
-
-      } else if (ff_pkt->flags & FO_SHA1) {
-         digest = crypto_digest_new(jcr, CRYPTO_DIGEST_SHA1);
-         digest_stream = STREAM_SHA1_DIGEST;
-
-      } else if (ff_pkt->flags & FO_SHA256) {
-         digest = crypto_digest_new(jcr, CRYPTO_DIGEST_SHA256);
-         digest_stream = STREAM_SHA256_DIGEST;
-
-      } else if (ff_pkt->flags & FO_SHA512) {
-         digest = crypto_digest_new(jcr, CRYPTO_DIGEST_SHA512);
-         digest_stream = STREAM_SHA512_DIGEST;
-      }
+      digest = crypto_digest_new(jcr, digest_type);
 
       /* Did digest initialization fail? */
-      if (digest_stream != STREAM_NONE && digest == NULL) {
+      if (digest == NULL) {
          Jmsg(jcr, M_WARNING, 0, _("%s digest initialization failed\n"),
               stream_to_ascii(digest_stream));
       }
 
       /* compute MD5 or SHA1 hash */
       if (digest) {
-         char md[CRYPTO_DIGEST_MAX_SIZE];
-         uint32_t size;
-
-         size = sizeof(md);
+         POOL_MEM msg;
 
          if (digest_file(jcr, ff_pkt, digest) != 0) {
             jcr->JobErrors++;
             goto good_rtn;
          }
 
-         if (crypto_digest_finalize(digest, (uint8_t *)md, &size)) {
-            char *digest_buf;
-            const char *digest_name;
-
-            digest_buf = (char *)malloc(BASE64_SIZE(size));
-            digest_name = crypto_digest_name(digest);
-
-            bin_to_base64(digest_buf, BASE64_SIZE(size), md, size, true);
-            Dmsg3(400, "send inx=%d %s=%s\n", jcr->JobFiles, digest_name, digest_buf);
-            dir->fsend("%d %d %s *%s-%d*", jcr->JobFiles, digest_stream, digest_buf,
-                       digest_name, jcr->JobFiles);
-            Dmsg3(20, "bfiled>bdird: %s len=%d: msg=%s\n", digest_name,
-                  dir->msglen, dir->msg);
-
-            free(digest_buf);
+         if (edit_verify_digest(digest, jcr->JobFiles, digest_stream, msg) > 0) {
+            dir->fsend("%s", msg.c_str());
+            Dmsg2(20, "bfiled>bdird: digest len=%d: msg=%s\n", dir->msglen, dir->msg);
          }
       }
    }
@@ -281,43 +267,99 @@ good_rtn:
    return 1;
 }
 
+/*
+ * Select the digest algorithm of the FileSet options of the file.
+ *  Returns the digest stream, STREAM_NONE if no digest is wanted.
+ */
+static int verify_digest_stream(FF_PKT *ff_pkt, crypto_digest_t *type)
+{
+   if (ff_pkt->flags & FO_MD5) {
+      *type = CRYPTO_DIGEST_MD5;
+      return STREAM_MD5_DIGEST;
+
+   } else if (ff_pkt->flags & FO_SHA1) {
+      *type = CRYPTO_DIGEST_SHA1;
+      return STREAM_SHA1_DIGEST;
+
+   } else if (ff_pkt->flags & FO_SHA256) {
+      *type = CRYPTO_DIGEST_SHA256;
+      return STREAM_SHA256_DIGEST;
+
+   } else if (ff_pkt->flags & FO_SHA512) {
+      *type = CRYPTO_DIGEST_SHA512;
+      return STREAM_SHA512_DIGEST;
+
+   } else if (ff_pkt->flags & FO_XXH128) {
+      *type = CRYPTO_DIGEST_XXH128;
+      return STREAM_XXH128_DIGEST;
+
+   } else if (ff_pkt->flags & FO_BLAKE3) {
+      *type = CRYPTO_DIGEST_BLAKE3;
+      return STREAM_BLAKE3_DIGEST;
+   }
+   *type = CRYPTO_DIGEST_NONE;
+   return STREAM_NONE;
+}
+
+/*
+ * Finalize the digest and edit the message sent to the Director
+ *  for the file FileIndex. Returns the length of the message,
+ *  0 if the digest cannot be finalized.
+ */
+int edit_verify_digest(DIGEST *digest, int32_t FileIndex, int digest_stream,
+                       POOL_MEM &msg)
+{
+   char md[CRYPTO_DIGEST_MAX_SIZE];
+   char *digest_buf;
+   const char *digest_name;
+   uint32_t size = sizeof(md);
+   int len;
+
+   if (!crypto_digest_finalize(digest, (uint8_t *)md, &size)) {
+      return 0;
+   }
+   digest_buf = (char *)malloc(BASE64_SIZE(size));
+   digest_name = crypto_digest_name(digest);
+
+   bin_to_base64(digest_buf, BASE64_SIZE(size), md, size, true);
+   Dmsg3(400, "send inx=%d %s=%s\n", FileIndex, digest_name, digest_buf);
+   len = Mmsg(msg, "%d %d %s *%s-%d*", FileIndex, digest_stream, digest_buf,
+              digest_name, FileIndex);
+   free(digest_buf);
+   return len;
+}
+
 /*
  * Compute message digest for the file specified by ff_pkt.
  * In case of errors we need the job control record and file name.
  */
 int digest_file(JCR *jcr, FF_PKT *ff_pkt, DIGEST *digest)
 {
-   BFILE bfd;
-   bool do_digest = true;
-   Dmsg0(50, "=== digest_file\n");
-   binit(&bfd);
+   uint64_t nbytes = 0;
+   int ret;
 
-   /* On Windows, even an empty file has some data to read and compare like the
-    * security stream, while on linux, the empty file is just empty.
+   Dmsg0(50, "=== digest_file\n");
+   ret = digest_file_data(jcr, ff_pkt->fname, ff_pkt->snap_fname, ff_pkt->type,
+                          ff_pkt->flags, ff_pkt->statp.st_size, ff_pkt->ra,
+                          digest, &nbytes);
+   /* Can be used by BaseJobs or with accurate, update only for Verify
+    * jobs
     */
-#ifndef HAVE_WIN32
-   if (ff_pkt->statp.st_size == 0) {
-      do_digest = false;
+   if (jcr->getJobType() == JT_VERIFY) {
+      jcr->JobBytes += nbytes;
    }
-#endif
-
-   if (do_digest || ff_pkt->type == FT_RAW || ff_pkt->type == FT_FIFO)
-   {
-      int noatime = ff_pkt->flags & FO_NOATIME ? O_NOATIME : 0;
-      if ((bopen(&bfd, ff_pkt->snap_fname, O_RDONLY | O_BINARY | noatime, 0)) < 0) {
-         ff_pkt->ff_errno = errno;
-         berrno be;
-         be.set_errno(bfd.berrno);
-         Dmsg2(100, "Cannot open %s: ERR=%s\n", ff_pkt->fname, be.bstrerror());
-         Jmsg(jcr, M_ERROR, 1, _("     Cannot open %s: ERR=%s.\n"),
-               ff_pkt->fname, be.bstrerror());
-         return 1;
-      }
-      read_digest(&bfd, digest, jcr);
-      bclose(&bfd);
+   jcr->ReadBytes += nbytes;
+   if (ret > 0) {
+      ff_pkt->ff_errno = errno;
+      return 1;
+   }
+   if (ret < 0) {
+      jcr->JobErrors++;
    }
 
 #ifdef HAVE_DARWIN_OS
+   BFILE bfd;
+   binit(&bfd);
    /* Open resource fork if necessary */
    if (ff_pkt->flags & FO_HFSPLUS && ff_pkt->hfsinfo.rsrclength > 0) {
       if (bopen_rsrc(&bfd, ff_pkt->snap_fname, O_RDONLY | O_BINARY, 0) < 0) {
@@ -330,7 +372,15 @@ int digest_file(JCR *jcr, FF_PKT *ff_pkt, DIGEST *digest)
          }
          return 1;
       } 
-      read_digest(&bfd, digest, jcr);
+      nbytes = 0;
+      if (read_digest(&bfd, digest, jcr, ff_pkt->fname, ff_pkt->type, ff_pkt->flags,
+                      ff_pkt->statp.st_size, &nbytes) < 0) {
+         jcr->JobErrors++;
+      }
+      if (jcr->getJobType() == JT_VERIFY) {
+         jcr->JobBytes += nbytes;
+      }
+      jcr->ReadBytes += nbytes;
       bclose(&bfd);
    } 
    if (digest && ff_pkt->flags & FO_HFSPLUS) {
@@ -340,16 +390,64 @@ int digest_file(JCR *jcr, FF_PKT *ff_pkt, DIGEST *digest)
    return 0;
 }
 
+/*
+ * Compute the message digest of the data of a file, without using
+ *  the FF_PKT, so it can be called by the verify pipeline workers.
+ *  The bytes read are returned in nbytes, the caller updates the
+ *  job counters.
+ *
+ * Returns: 0 if OK, 1 if the file cannot be opened, -1 on a read error
+ */
+int digest_file_data(JCR *jcr, const char *fname, const char *snap_fname,
+                     int type, uint64_t flags, int64_t size, read_ahead *ra,
+                     DIGEST *digest, uint64_t *nbytes)
+{
+   BFILE bfd;
+   bool do_digest = true;
+   int ret = 0;
+   binit(&bfd);
+
+   /* On Windows, even an empty file has some data to read and compare like the
+    * security stream, while on linux, the empty file is just empty.
+    */
+#ifndef HAVE_WIN32
+   if (size == 0) {
+      do_digest = false;
+   }
+#endif
+
+   if (do_digest || type == FT_RAW || type == FT_FIFO)
+   {
+      int noatime = flags & FO_NOATIME ? O_NOATIME : 0;
+      int directio = (flags & FO_DIRECTIO) &&
+         (type == FT_REG || type == FT_REGE) ? O_DIRECT : 0;
+      if ((bopen(&bfd, snap_fname, O_RDONLY | O_BINARY | noatime | directio, 0)) < 0) {
+         berrno be;
+         be.set_errno(bfd.berrno);
+         Dmsg2(100, "Cannot open %s: ERR=%s\n", fname, be.bstrerror());
+         Jmsg(jcr, M_ERROR, 1, _("     Cannot open %s: ERR=%s.\n"),
+               fname, be.bstrerror());
+         return 1;
+      }
+      if (ra && (type == FT_REG || type == FT_REGE)) {
+         bread_ahead_attach(&bfd, ra, size);
+      }
+      ret = read_digest(&bfd, digest, jcr, fname, type, flags, size, nbytes);
+      bclose(&bfd);
+   }
+   return ret;
+}
+
 /*
  * Read message digest of bfd, updating digest
  * In case of errors we need the job control record and file name.
  */
-static int read_digest(BFILE *bfd, DIGEST *digest, JCR *jcr)
+static int read_digest(BFILE *bfd, DIGEST *digest, JCR *jcr, const char *fname,
+                       int type, uint64_t flags, int64_t size, uint64_t *nbytes)
 {
    char  *buf;
    int64_t n;
    int64_t bufsiz = jcr->buf_size;
-   FF_PKT *ff_pkt = (FF_PKT *)jcr->ff;
    uint64_t fileAddr = 0;             /* file address */
 
    buf = (char *)malloc(bufsiz);
@@ -357,17 +455,17 @@ static int read_digest(BFILE *bfd, DIGEST *digest, JCR *jcr)
    /* With this option, we read shorter blocks, so to not break the
     * sparse block detection, we need to adjust the read size.
     */
-   if (ff_pkt->flags & FO_SPARSE) {
+   if (flags & FO_SPARSE) {
       bufsiz -= OFFSET_FADDR_SIZE;
    }
    while ((n=bread(bfd, buf, bufsiz)) > 0) {
       /* Check for sparse blocks */
-      if (ff_pkt->flags & FO_SPARSE) {
+      if (flags & FO_SPARSE) {
          bool allZeros = false;
          if ((n == bufsiz &&
-              fileAddr+n < (uint64_t)ff_pkt->statp.st_size) ||
-             ((ff_pkt->type == FT_RAW || ff_pkt->type == FT_FIFO) &&
-               (uint64_t)ff_pkt->statp.st_size == 0)) {
+              fileAddr+n < (uint64_t)size) ||
+             ((type == FT_RAW || type == FT_FIFO) &&
+               (uint64_t)size == 0)) {
             allZeros = is_buf_zero(buf, bufsiz);
          }
          fileAddr += n;               /* update file address */
@@ -378,23 +476,19 @@ static int read_digest(BFILE *bfd, DIGEST *digest, JCR *jcr)
       }
 
       crypto_digest_update(digest, (uint8_t *)buf, n);
+      *nbytes += n;
 
-      /* Can be used by BaseJobs or with accurate, update only for Verify
-       * jobs
-       */
-      if (jcr->getJobType() == JT_VERIFY) {
-         jcr->JobBytes += n;
+      if (jcr->is_job_canceled()) {
+         break;
       }
-      jcr->ReadBytes += n;
    }
    free(buf);
    if (n < 0) {
       berrno be;
       be.set_errno(bfd->berrno);
-      Dmsg2(100, "Error reading file %s: ERR=%s\n", jcr->last_fname, be.bstrerror());
+      Dmsg2(100, "Error reading file %s: ERR=%s\n", fname, be.bstrerror());
       Jmsg(jcr, M_ERROR, 1, _("Error reading file %s: ERR=%s\n"),
-            jcr->last_fname, be.bstrerror());
-      jcr->JobErrors++;
+            fname, be.bstrerror());
       return -1;
    }
    return 0;
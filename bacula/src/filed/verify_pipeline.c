@@ -0,0 +1,429 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+ */
+/*
+ *  Bacula File Daemon  verify_pipeline.c
+ *
+ *  Multi-threaded computation of the file digests during a verify.
+ *
+ *  verify_file() puts each file in a ring of slots, with the attributes
+ *  message already edited. A pool of workers computes the digests of
+ *  the slots, in any order. The job thread sends the slots to the
+ *  Director from the oldest one, as soon as the digest is computed,
+ *  so the Director receives exactly the messages and the order of
+ *  the single threaded code.
+ *
+ *  The memory in flight is bounded by the number of slots (names and
+ *  attributes) and by one read buffer per worker.
+ */
+
+#include "bacula.h"
+#include "filed.h"
+
+/* One file going through the pipeline */
+struct vpipe_slot {
+   POOLMEM *attr;                     /* attributes message */
+   POOLMEM *fname;                    /* file to digest */
+   POOLMEM *snap_fname;
+   POOLMEM *msg;                      /* digest message */
+   int32_t attr_len;
+   int32_t msg_len;                   /* 0 if no digest to send */
+   int32_t FileIndex;
+   int type;
+   uint64_t flags;
+   int64_t size;
+   crypto_digest_t digest_type;
+   int digest_stream;
+   bool claimed;                      /* a worker has it */
+   bool done;                         /* digest computed or nothing to do */
+};
+
+/* Counters of a worker */
+struct vpipe_stat {
+   btime_t busy;
+   btime_t wait;
+   uint64_t files;
+   uint64_t bytes;
+};
+
+class vpipeline: public SMARTALLOC {
+public:
+   JCR *jcr;
+   pthread_mutex_t mutex;
+   pthread_cond_t work;               /* the workers wait for work */
+   pthread_cond_t done;               /* the job thread waits for a digest */
+   vpipe_slot *slots;
+   int nb_slots;
+   int nb_workers;
+   int nb_threads;                    /* threads started */
+   int next_id;                       /* id of the next worker */
+   pthread_t *tids;
+   uint64_t wseq;                     /* next slot to fill */
+   uint64_t sseq;                     /* next slot to send */
+   bool quit;
+   bool error;                        /* cannot send to the Director */
+   vpipe_stat *stats;                 /* one per worker */
+
+   vpipeline(JCR *ajcr, int workers);
+   ~vpipeline();
+   vpipe_slot *slot(uint64_t seq) { return &slots[seq % nb_slots]; };
+   bool send_ready();
+};
+
+vpipeline::vpipeline(JCR *ajcr, int workers)
+{
+   jcr = ajcr;
+   nb_workers = workers;
+   nb_slots = 16 * workers;
+   nb_threads = 0;
+   next_id = 0;
+   tids = (pthread_t *)malloc(workers * sizeof(pthread_t));
+   slots = (vpipe_slot *)malloc(nb_slots * sizeof(vpipe_slot));
+   memset(slots, 0, nb_slots * sizeof(vpipe_slot));
+   for (int i=0; i < nb_slots; i++) {
+      slots[i].attr = get_pool_memory(PM_MESSAGE);
+      slots[i].fname = get_pool_memory(PM_FNAME);
+      slots[i].snap_fname = get_pool_memory(PM_FNAME);
+      slots[i].msg = get_pool_memory(PM_MESSAGE);
+   }
+   stats = (vpipe_stat *)malloc(workers * sizeof(vpipe_stat));
+   memset(stats, 0, workers * sizeof(vpipe_stat));
+   wseq = sseq = 0;
+   quit = error = false;
+   pthread_mutex_init(&mutex, NULL);
+   pthread_cond_init(&work, NULL);
+   pthread_cond_init(&done, NULL);
+}
+
+vpipeline::~vpipeline()
+{
+   for (int i=0; i < nb_slots; i++) {
+      free_pool_memory(slots[i].attr);
+      free_pool_memory(slots[i].fname);
+      free_pool_memory(slots[i].snap_fname);
+      free_pool_memory(slots[i].msg);
+   }
+   free(slots);
+   free(stats);
+   free(tids);
+   pthread_cond_destroy(&done);
+   pthread_cond_destroy(&work);
+   pthread_mutex_destroy(&mutex);
+}
+
+/*
+ * Send to the Director the oldest slots that are done. Only the job
+ *  thread sends, a slot that is done is not touched by the workers,
+ *  so the mutex is released during the network I/O.
+ *
+ *  Must be called with the mutex locked.
+ */
+bool vpipeline::send_ready()
+{
+   BSOCK *dir = jcr->dir_bsock;
+
+   while (!error && sseq < wseq && slot(sseq)->done) {
+      vpipe_slot *s = slot(sseq);
+      V(mutex);
+
+      POOLMEM *msgsave = dir->msg;
+      bool ok;
+      Dmsg2(400, "send ATTR inx=%d fname=%s\n", s->FileIndex, s->fname);
+      dir->msg = s->attr;
+      dir->msglen = s->attr_len;
+      ok = dir->send();
+      if (ok && s->msg_len > 0) {
+         dir->msg = s->msg;
+         dir->msglen = s->msg_len;
+         ok = dir->send();
+      }
+      dir->msg = msgsave;
+      if (!ok) {
+         Jmsg(jcr, M_FATAL, 0, _("Network error in send to Director: ERR=%s\n"),
+              dir->bstrerror());
+      }
+
+      P(mutex);
+      if (!ok) {
+         error = true;
+      }
+      sseq++;
+   }
+   return !error;
+}
+
+/*
+ * Compute the digest of any slot that is waiting for it
+ */
+extern "C" void *vpipe_digest_thread(void *arg)
+{
+   vpipeline *p = (vpipeline *)arg;
+   JCR *jcr = p->jcr;
+   POOL_MEM msg;
+   btime_t start, wait;
+   int id;
+
+   set_jcr_in_tsd(jcr);
+   P(p->mutex);
+   id = p->next_id++;
+   for ( ;; ) {
+      vpipe_slot *slot = NULL;
+      start = get_current_btime();
+      while (!p->quit) {
+         for (uint64_t seq = p->sseq; seq < p->wseq; seq++) {
+            if (!p->slot(seq)->done && !p->slot(seq)->claimed) {
+               slot = p->slot(seq);
+               break;
+            }
+         }
+         if (slot) {
+            break;
+         }
+         pthread_cond_wait(&p->work, &p->mutex);
+      }
+      if (!slot) {
+         break;                       /* quit */
+      }
+      slot->claimed = true;
+      wait = get_current_btime() - start;
+      V(p->mutex);
+
+      start = get_current_btime();
+      uint64_t nbytes = 0;
+      int32_t len = 0;
+      DIGEST *digest = crypto_digest_new(jcr, slot->digest_type);
+      if (!digest) {
+         Jmsg(jcr, M_WARNING, 0, _("%s digest initialization failed\n"),
+              stream_to_ascii(slot->digest_stream));
+      } else {
+         int ret = digest_file_data(jcr, slot->fname, slot->snap_fname, slot->type,
+                      slot->flags, slot->size, NULL, digest, &nbytes);
+         if (ret <= 0) {
+            len = edit_verify_digest(digest, slot->FileIndex, slot->digest_stream, msg);
+            if (len > 0) {
+               pm_memcpy(slot->msg, msg.c_str(), len + 1);
+            }
+         }
+         crypto_digest_free(digest);
+         jcr->lock();
+         jcr->JobBytes += nbytes;
+         jcr->ReadBytes += nbytes;
+         if (ret != 0) {
+            jcr->JobErrors++;
+         }
+         jcr->unlock();
+      }
+
+      P(p->mutex);
+      p->stats[id].busy += get_current_btime() - start;
+      p->stats[id].wait += wait;
+      p->stats[id].files++;
+      p->stats[id].bytes += nbytes;
+      slot->msg_len = len;
+      slot->done = true;
+      pthread_cond_signal(&p->done);
+   }
+   V(p->mutex);
+   return NULL;
+}
+
+/*
+ * Queue a file of the verify, called by verify_file() in place of
+ *  the sending of the attributes and of the digest. The files that
+ *  are ready are sent to the Director.
+ *
+ *  Returns: false if the job must stop
+ */
+bool pipeline_verify_file(JCR *jcr, FF_PKT *ff_pkt, const char *fname,
+                          const char *attribs, const char *link,
+                          crypto_digest_t digest_type, int digest_stream)
+{
+   vpipeline *p = jcr->verify_pipeline;
+   POOL_MEM msg;
+   int32_t msg_len = 0;
+   bool in_thread = false;
+   bool ok;
+
+#ifdef HAVE_DARWIN_OS
+   /* The resource fork and the Finder info are read with the FF_PKT */
+   if (digest_stream != STREAM_NONE && ff_pkt->flags & FO_HFSPLUS) {
+      DIGEST *digest = crypto_digest_new(jcr, digest_type);
+      if (!digest) {
+         Jmsg(jcr, M_WARNING, 0, _("%s digest initialization failed\n"),
+              stream_to_ascii(digest_stream));
+      } else {
+         if (digest_file(jcr, ff_pkt, digest) != 0) {
+            jcr->JobErrors++;
+         } else {
+            msg_len = edit_verify_digest(digest, jcr->JobFiles, digest_stream, msg);
+         }
+         crypto_digest_free(digest);
+      }
+      in_thread = true;
+   }
+#endif
+
+   /* Wait for a free slot, the oldest one is released when it is sent */
+   P(p->mutex);
+   while (p->wseq - p->sseq >= (uint64_t)p->nb_slots) {
+      if (!p->send_ready()) {
+         break;
+      }
+      if (p->wseq - p->sseq >= (uint64_t)p->nb_slots) {
+         pthread_cond_wait(&p->done, &p->mutex);
+      }
+   }
+   if (p->error) {
+      V(p->mutex);
+      return false;
+   }
+   vpipe_slot *slot = p->slot(p->wseq);
+   V(p->mutex);
+
+   /* The slot is not visible by the workers until wseq is incremented */
+   slot->FileIndex = jcr->JobFiles;
+   slot->attr_len = Mmsg(slot->attr, "%d %d %s %s%c%s%c%s%c", jcr->JobFiles,
+                         STREAM_UNIX_ATTRIBUTES, ff_pkt->VerifyOpts, fname,
+                         0, attribs, 0, link, 0);
+   pm_strcpy(slot->fname, ff_pkt->fname);
+   pm_strcpy(slot->snap_fname, ff_pkt->snap_fname);
+   slot->type = ff_pkt->type;
+   slot->flags = ff_pkt->flags;
+   slot->size = ff_pkt->statp.st_size;
+   slot->digest_type = digest_type;
+   slot->digest_stream = digest_stream;
+   slot->claimed = false;
+   slot->done = digest_stream == STREAM_NONE || in_thread;
+   slot->msg_len = msg_len;
+   if (msg_len > 0) {
+      pm_memcpy(slot->msg, msg.c_str(), msg_len + 1);
+   }
+
+   P(p->mutex);
+   p->wseq++;
+   if (!slot->done) {
+      pthread_cond_signal(&p->work);
+   }
+   ok = p->send_ready();
+   V(p->mutex);
+   return ok;
+}
+
+/*
+ * Start the digest workers for a verify job. If the threads
+ *  cannot be started, the job runs with the single threaded code.
+ */
+bool start_verify_pipeline(JCR *jcr, int nb_workers)
+{
+   vpipeline *p;
+   int stat;
+
+   if (nb_workers <= 0) {
+      return false;
+   }
+   p = New(vpipeline(jcr, nb_workers));
+   for (int i=0; i < nb_workers; i++) {
+      if ((stat = pthread_create(&p->tids[i], NULL, vpipe_digest_thread, (void *)p)) != 0) {
+         berrno be;
+         Jmsg(jcr, M_WARNING, 0, _("Unable to start verify pipeline thread: ERR=%s\n"),
+              be.bstrerror(stat));
+         break;
+      }
+      p->nb_threads++;
+   }
+   if (p->nb_threads == 0) {
+      jcr->verify_pipeline = p;
+      stop_verify_pipeline(jcr);
+      return false;
+   }
+   Dmsg2(50, "Verify pipeline started with %d threads and %d slots\n",
+         p->nb_threads, p->nb_slots);
+   jcr->lock();
+   jcr->verify_pipeline = p;
+   jcr->unlock();
+   return true;
+}
+
+/*
+ * Send the files still in the pipeline, stop the workers and
+ *  report their throughput.
+ */
+void stop_verify_pipeline(JCR *jcr)
+{
+   vpipeline *p = jcr->verify_pipeline;
+   POOL_MEM msg;
+
+   if (!p) {
+      return;
+   }
+   P(p->mutex);
+   while (p->sseq < p->wseq && p->send_ready()) {
+      if (p->sseq < p->wseq) {
+         pthread_cond_wait(&p->done, &p->mutex);
+      }
+   }
+   p->quit = true;
+   pthread_cond_broadcast(&p->work);
+   V(p->mutex);
+   for (int i=0; i < p->nb_threads; i++) {
+      pthread_join(p->tids[i], NULL);
+   }
+   if (p->wseq > 0 && edit_verify_pipeline_status(jcr, msg) > 0) {
+      Jmsg(jcr, M_INFO, 0, "%s", msg.c_str());
+   }
+   jcr->lock();
+   jcr->verify_pipeline = NULL;
+   jcr->unlock();
+   delete p;
+}
+
+/*
+ * Edit the counters of each worker for "status client" and the
+ *  job report. Returns the length of the message.
+ */
+int edit_verify_pipeline_status(JCR *jcr, POOL_MEM &msg)
+{
+   POOL_MEM tmp;
+   char ed1[50], ed2[50], ed3[50], ed4[50], ed5[50];
+   int len;
+
+   jcr->lock();
+   vpipeline *p = jcr->verify_pipeline;
+   if (!p) {
+      jcr->unlock();
+      return 0;
+   }
+   P(p->mutex);
+   len = Mmsg(msg, _("    Verify pipeline: Workers=%d Slots=%d\n"), p->nb_threads,
+              p->nb_slots);
+   for (int i=0; i < p->nb_threads; i++) {
+      vpipe_stat *st = &p->stats[i];
+      /* bytes per microsecond of work is MB/s */
+      double rate = st->busy > 0 ? (double)st->bytes / st->busy : 0;
+      Mmsg(tmp, _("      Worker %-2d Files=%s Bytes=%s Busy=%ss Wait=%ss Rate=%s KB/s\n"),
+           i, edit_uint64_with_commas(st->files, ed1),
+           edit_uint64_with_commas(st->bytes, ed2),
+           edit_uint64_with_commas(st->busy / 1000000, ed3),
+           edit_uint64_with_commas(st->wait / 1000000, ed4),
+           edit_uint64_with_commas((uint64_t)(rate * 1000), ed5));
+      len = pm_strcat(msg, tmp);
+   }
+   V(p->mutex);
+   jcr->unlock();
+   return len;
+}
@@ -30,18 +30,6 @@
 #include "filed.h"
 #include "findlib/win32filter.h"
 
-#if   defined(HAVE_LIBZ)
-const bool have_libz = true;
-#else
-const bool have_libz = false;
-#endif
-
-#ifdef HAVE_LZO
-const bool have_lzo = true;
-#else
-const bool have_lzo = false;
-#endif
-
 /* Context used during Verify Data job. We use it in the
  * verify loop to compute checksums and check attributes.
  */
@@ -165,6 +153,14 @@ void v_ctx::scan_fileset()
             digesttype = CRYPTO_DIGEST_SHA512;
             return;
          }
+         if (fo->flags & FO_XXH128) {
+            digesttype = CRYPTO_DIGEST_XXH128;
+            return;
+         }
+         if (fo->flags & FO_BLAKE3) {
+            digesttype = CRYPTO_DIGEST_BLAKE3;
+            return;
+         }
       }
    }
    digesttype = CRYPTO_DIGEST_NONE;
@@ -283,12 +279,9 @@ void do_verify_volume(JCR *jcr)
    }
    jcr->buf_size = sd->msglen;
 
-   /* use the same buffer size to decompress both gzip and lzo */
-   if (have_libz || have_lzo) {
-      uint32_t compress_buf_size = jcr->buf_size + 12 + ((jcr->buf_size+999) / 1000) + 100;
-      jcr->compress_buf = get_memory(compress_buf_size);
-      jcr->compress_buf_size = compress_buf_size;
-   }
+   /* use the same buffer size to decompress all the algorithms, lz4 is always there */
+   jcr->compress_buf_size = jcr->buf_size + 12 + ((jcr->buf_size+999) / 1000) + 100;
+   jcr->compress_buf = get_memory(jcr->compress_buf_size);
 
    GetMsg *fdmsg = get_msg_buffer(jcr, sd, rec_header);
    fdmsg->start_read_sock();
@@ -434,6 +427,16 @@ void do_verify_volume(JCR *jcr)
          digest_code = "SHA512";
          break;
 
+      case STREAM_XXH128_DIGEST:
+         bin_to_base64(digest, sizeof(digest), (char *)bmsg->rbuf, CRYPTO_DIGEST_XXH128_SIZE, true);
+         digest_code = "XXH128";
+         break;
+
+      case STREAM_BLAKE3_DIGEST:
+         bin_to_base64(digest, sizeof(digest), (char *)bmsg->rbuf, CRYPTO_DIGEST_BLAKE3_SIZE, true);
+         digest_code = "BLAKE3";
+         break;
+
       default:
          *digest = 0;
          break;
@@ -579,6 +582,12 @@ ok_out:
       free_pool_memory(jcr->compress_buf);
       jcr->compress_buf = NULL;
    }
+#ifdef HAVE_ZSTD
+   if (jcr->ZSTD_decompress_workset) {
+      ZSTD_freeDCtx((ZSTD_DCtx *)jcr->ZSTD_decompress_workset);
+      jcr->ZSTD_decompress_workset = NULL;
+   }
+#endif
    /* TODO: We probably want to mark the job as failed if we have errors */
    Dmsg2(50, "End Verify-Vol. Files=%d Bytes=%" lld "\n", jcr->JobFiles,
       jcr->JobBytes);
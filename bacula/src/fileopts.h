@@ -64,5 +64,10 @@
 #define FO_PLUGIN        (1<<29)      /* Plugin data stream -- return to plugin on restore */
 #define FO_OFFSETS       (1<<30)      /* Keep I/O file offsets */
 #define FO_DEDUPLICATION (1ULL<<31)   /* Do deduplication */
+#define FO_INODE_ORDER   (1ULL<<32)   /* Read directory entries in inode order */
+#define FO_COMPRESS_LONG (1ULL<<33)   /* zstd long distance matching */
+#define FO_DIRECTIO      (1ULL<<34)   /* Read files with O_DIRECT */
+#define FO_XXH128        (1ULL<<35)   /* Do XXH3 128 bit checksum */
+#define FO_BLAKE3        (1ULL<<36)   /* Do BLAKE3 checksum */
 
 #endif /* __BFILEOPTSS_H */
@@ -53,6 +53,9 @@ HANDLE bget_handle(BFILE *bfd);
 #ifndef HAVE_LCHMOD
 #define lchmod chmod
 #endif
+#ifndef HAVE_FDATASYNC
+#define fdatasync fsync
+#endif
 
 /*=============================================================*/
 /*                                                             */
@@ -165,6 +168,16 @@ bool set_mod_own_time(JCR *jcr, BFILE *ofd, ATTR *attr)
             attr->ofname, be.bstrerror());
          ok = false;
       }
+#ifdef HAVE_RESTORE_DIRS
+      /*
+       * A file restored later in the directory would change its times,
+       *  they are set at the end of a fast restore.
+       */
+      if (jcr && jcr->rdirs && attr->type == FT_DIREND) {
+         jcr->rdirs->defer_times(attr);
+         return ok;
+      }
+#endif
       /*
        * Reset file times.
        */
@@ -227,7 +240,6 @@ int select_data_stream(FF_PKT *ff_pkt)
    /*
     * Handle compression and encryption options
     */
-#if defined(HAVE_LIBZ) || defined(HAVE_LZO)
    if (ff_pkt->flags & FO_COMPRESS) {
       #ifdef HAVE_LIBZ
          if(ff_pkt->Compress_algo == COMPRESS_GZIP) {
@@ -275,8 +287,51 @@ int select_data_stream(FF_PKT *ff_pkt)
             }
          }
       #endif
+      #ifdef HAVE_ZSTD
+         if(ff_pkt->Compress_algo == COMPRESS_ZSTD) {
+            switch (stream) {
+            case STREAM_WIN32_DATA:
+                  stream = STREAM_WIN32_COMPRESSED_DATA;
+               break;
+            case STREAM_SPARSE_DATA:
+                  stream = STREAM_SPARSE_COMPRESSED_DATA;
+               break;
+            case STREAM_FILE_DATA:
+                  stream = STREAM_COMPRESSED_DATA;
+               break;
+            default:
+               /*
+                * All stream types that do not support compression should clear out
+                * FO_COMPRESS above, and this code block should be unreachable.
+                */
+               ASSERT(!(ff_pkt->flags & FO_COMPRESS));
+               stream = STREAM_NONE;
+               goto get_out;
+            }
+         }
+      #endif
+         if(ff_pkt->Compress_algo == COMPRESS_LZ4) {
+            switch (stream) {
+            case STREAM_WIN32_DATA:
+                  stream = STREAM_WIN32_COMPRESSED_DATA;
+               break;
+            case STREAM_SPARSE_DATA:
+                  stream = STREAM_SPARSE_COMPRESSED_DATA;
+               break;
+            case STREAM_FILE_DATA:
+                  stream = STREAM_COMPRESSED_DATA;
+               break;
+            default:
+               /*
+                * All stream types that do not support compression should clear out
+                * FO_COMPRESS above, and this code block should be unreachable.
+                */
+               ASSERT(!(ff_pkt->flags & FO_COMPRESS));
+               stream = STREAM_NONE;
+               goto get_out;
+            }
+         }
    }
-#endif
 #ifdef HAVE_CRYPTO
    if (ff_pkt->flags & FO_ENCRYPT) {
       switch (stream) {
@@ -691,6 +746,16 @@ bool set_attributes(JCR *jcr, ATTR *attr, BFILE *ofd)
 
 bail_out:
    if (is_bopen(ofd)) {
+#ifndef HAVE_WIN32
+      /* RestoreFileSync, the data is on the disk when the file is closed */
+      if (jcr && jcr->sync_restored_files && !ofd->cmd_plugin &&
+          fdatasync(ofd->fid) < 0) {
+         berrno be;
+         Jmsg2(jcr, M_ERROR, 0, _("Unable to sync file %s: ERR=%s\n"),
+            attr->ofname, be.bstrerror());
+         ok = false;
+      }
+#endif
       bclose(ofd);
    }
    pm_strcpy(attr->ofname, "*none*");
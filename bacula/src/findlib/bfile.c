@@ -41,6 +41,12 @@ boffset_t (*plugin_blseek)(BFILE *bfd, boffset_t offset, int whence) = NULL;
 #include <sys/paths.h>
 #endif
 
+#ifdef HAVE_LINUX_OS
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+#endif
+
 #if !defined(HAVE_FDATASYNC)
 #define fdatasync(fd)
 #endif
@@ -126,6 +132,10 @@ const char *stream_to_ascii(int stream)
          return _("SHA256 digest");
       case STREAM_SHA512_DIGEST:
          return _("SHA512 digest");
+      case STREAM_XXH128_DIGEST:
+         return _("XXH128 digest");
+      case STREAM_BLAKE3_DIGEST:
+         return _("BLAKE3 digest");
       case STREAM_SIGNED_DIGEST:
          return _("Signed digest");
       case STREAM_ENCRYPTED_FILE_DATA:
@@ -364,13 +374,6 @@ bool is_restore_stream_supported(int stream)
    case STREAM_GZIP_DATA:
    case STREAM_SPARSE_GZIP_DATA:
    case STREAM_WIN32_GZIP_DATA:
-#endif
-#ifndef HAVE_LZO
-   case STREAM_COMPRESSED_DATA:
-   case STREAM_SPARSE_COMPRESSED_DATA:
-   case STREAM_WIN32_COMPRESSED_DATA:
-   case STREAM_ENCRYPTED_FILE_COMPRESSED_DATA:
-   case STREAM_ENCRYPTED_WIN32_COMPRESSED_DATA:
 #endif
    case STREAM_MACOS_FORK_DATA:
    case STREAM_HFSPLUS_ATTRIBUTES:
@@ -383,11 +386,9 @@ bool is_restore_stream_supported(int stream)
    case STREAM_SPARSE_GZIP_DATA:
    case STREAM_WIN32_GZIP_DATA:
 #endif
-#ifdef HAVE_LZO
    case STREAM_COMPRESSED_DATA:
    case STREAM_SPARSE_COMPRESSED_DATA:
    case STREAM_WIN32_COMPRESSED_DATA:
-#endif
    case STREAM_WIN32_DATA:
    case STREAM_UNIX_ATTRIBUTES:
    case STREAM_FILE_DATA:
@@ -401,16 +402,16 @@ bool is_restore_stream_supported(int stream)
    case STREAM_SHA256_DIGEST:
    case STREAM_SHA512_DIGEST:
 #endif
+   case STREAM_XXH128_DIGEST:
+   case STREAM_BLAKE3_DIGEST:
 #ifdef HAVE_CRYPTO
    case STREAM_SIGNED_DIGEST:
    case STREAM_ENCRYPTED_FILE_DATA:
    case STREAM_ENCRYPTED_FILE_GZIP_DATA:
    case STREAM_ENCRYPTED_WIN32_DATA:
    case STREAM_ENCRYPTED_WIN32_GZIP_DATA:
-#ifdef HAVE_LZO
    case STREAM_ENCRYPTED_FILE_COMPRESSED_DATA:
    case STREAM_ENCRYPTED_WIN32_COMPRESSED_DATA:
-#endif
 #endif     /* !HAVE_CRYPTO */
    case 0:                            /* compatibility with old tapes */
       return true;
@@ -836,6 +837,15 @@ boffset_t blseek(BFILE *bfd, boffset_t offset, int whence)
    return ((boffset_t)offset_high << 32) | dwResult;
 }
 
+/* Windows */
+int bget_data_extent(BFILE *bfd, boffset_t offset, boffset_t *start, boffset_t *end)
+{
+   return -1;                   /* not implemented, read everything */
+}
+
+/* Windows */
+void bdirect_io_disable(BFILE *bfd) { }
+
 #else  /* Unix systems */
 
 /* ===============================================================
@@ -917,13 +927,6 @@ bool is_restore_stream_supported(int stream)
    case STREAM_SPARSE_GZIP_DATA:
    case STREAM_WIN32_GZIP_DATA:
 #endif
-#ifndef HAVE_LZO
-   case STREAM_COMPRESSED_DATA:
-   case STREAM_SPARSE_COMPRESSED_DATA:
-   case STREAM_WIN32_COMPRESSED_DATA:
-   case STREAM_ENCRYPTED_FILE_COMPRESSED_DATA:
-   case STREAM_ENCRYPTED_WIN32_COMPRESSED_DATA:
-#endif
 #ifndef HAVE_DARWIN_OS
    case STREAM_MACOS_FORK_DATA:
    case STREAM_HFSPLUS_ATTRIBUTES:
@@ -936,13 +939,11 @@ bool is_restore_stream_supported(int stream)
    case STREAM_SPARSE_GZIP_DATA:
    case STREAM_WIN32_GZIP_DATA:
 #endif
-#ifdef HAVE_LZO
    case STREAM_COMPRESSED_DATA:
    case STREAM_SPARSE_COMPRESSED_DATA:
    case STREAM_WIN32_COMPRESSED_DATA:
    case STREAM_ENCRYPTED_FILE_COMPRESSED_DATA:
    case STREAM_ENCRYPTED_WIN32_COMPRESSED_DATA:
-#endif
    case STREAM_WIN32_DATA:
    case STREAM_UNIX_ATTRIBUTES:
    case STREAM_FILE_DATA:
@@ -956,6 +957,8 @@ bool is_restore_stream_supported(int stream)
    case STREAM_SHA256_DIGEST:
    case STREAM_SHA512_DIGEST:
 #endif
+   case STREAM_XXH128_DIGEST:
+   case STREAM_BLAKE3_DIGEST:
 #ifdef HAVE_CRYPTO
    case STREAM_SIGNED_DIGEST:
    case STREAM_ENCRYPTED_FILE_DATA:
@@ -993,6 +996,13 @@ int bopen(BFILE *bfd, const char *fname, uint64_t flags, mode_t mode)
    /* We use fnctl to set O_NOATIME if requested to avoid open error */
    bfd->fid = open(fname, (flags | O_CLOEXEC) & ~O_NOATIME, mode);
 
+   /* Some filesystems (tmpfs, fuse, ...) reject O_DIRECT, use the page cache */
+   if (bfd->fid == -1 && errno == EINVAL && (flags & O_DIRECT)) {
+      Dmsg1(dbglvl, "O_DIRECT not supported for %s\n", fname);
+      flags &= ~O_DIRECT;
+      bfd->fid = open(fname, (flags | O_CLOEXEC) & ~O_NOATIME, mode);
+   }
+
    /* Set O_NOATIME if possible */
    if (bfd->fid != -1 && flags & O_NOATIME) {
       int oldflags = fcntl(bfd->fid, F_GETFL, 0);
@@ -1020,8 +1030,8 @@ int bopen(BFILE *bfd, const char *fname, uint64_t flags, mode_t mode)
    bfd->win32filter.init();
 
 #if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_WILLNEED)
-   /* If not RDWR or WRONLY must be Read Only */
-   if (bfd->fid != -1 && !(flags & (O_RDWR|O_WRONLY))) {
+   /* If not RDWR or WRONLY must be Read Only, O_DIRECT reads bypass the cache */
+   if (bfd->fid != -1 && !(flags & (O_RDWR|O_WRONLY|O_DIRECT))) {
       int stat = posix_fadvise(bfd->fid, 0, 0, POSIX_FADV_WILLNEED);
       Dmsg3(400, "Did posix_fadvise WILLNEED on %s fid=%d stat=%d\n", fname, bfd->fid, stat);
    }
@@ -1030,6 +1040,28 @@ int bopen(BFILE *bfd, const char *fname, uint64_t flags, mode_t mode)
    return bfd->fid;
 }
 
+#ifdef HAVE_OPENAT
+/*
+ * Open a file relative to an open directory, used by the restore to
+ *  create the files without resolving their full path, see restore_dirs.
+ *  No plugin, O_NOATIME or O_DIRECT here.
+ */
+int bopenat(BFILE *bfd, int dirfd, const char *fname, uint64_t flags, mode_t mode)
+{
+   Dmsg2(dbglvl, "open file %s at fd=%d\n", fname, dirfd);
+   bfd->fid = openat(dirfd, fname, (int)(flags | O_CLOEXEC), mode);
+   bfd->berrno = errno;
+   bfd->m_flags = flags;
+   bfd->block = 0;
+   bfd->total_bytes = 0;
+   Dmsg1(400, "Open file %d\n", bfd->fid);
+   errno = bfd->berrno;
+
+   bfd->win32filter.init();
+   return bfd->fid;
+}
+#endif
+
 #ifdef HAVE_DARWIN_OS
 /* Open the resource fork of a file. */
 int bopen_rsrc(BFILE *bfd, const char *fname, uint64_t flags, mode_t mode)
@@ -1062,6 +1094,7 @@ int bclose(BFILE *bfd)
    if (bfd->fid == -1) {
       return 0;
    }
+   bread_ahead_detach(bfd);
    if (bfd->cmd_plugin && plugin_bclose) {
       stat = plugin_bclose(bfd);
       bfd->fid = -1;
@@ -1083,6 +1116,66 @@ int bclose(BFILE *bfd)
    bfd->berrno = errno;
    bfd->fid = -1;
    bfd->cmd_plugin = false;
+   if (bfd->dio_buf) {
+      free_aligned_memory(bfd->dio_buf);
+      bfd->dio_buf = NULL;
+      bfd->dio_size = 0;
+   }
+   return stat;
+}
+
+/*
+ * Stop using O_DIRECT on an open file, when the filesystem rejects
+ *  a read (alignment larger than DIO_ALIGN, unaligned position after
+ *  a seek or at the end of the file, ...).
+ */
+void bdirect_io_disable(BFILE *bfd)
+{
+   if (!(bfd->m_flags & O_DIRECT)) {
+      return;
+   }
+   int oflags = fcntl(bfd->fid, F_GETFL, 0);
+   if (oflags != -1) {
+      fcntl(bfd->fid, F_SETFL, oflags & ~O_DIRECT);
+   }
+   bfd->m_flags &= ~O_DIRECT;
+   Dmsg1(dbglvl, "O_DIRECT disabled for fid=%d\n", bfd->fid);
+}
+
+/*
+ * O_DIRECT read, the buffer, the size and the file position must be
+ *  aligned. The data goes through bfd->dio_buf when the caller buffer
+ *  is not aligned, and only whole blocks are read, so we may return
+ *  less than count as read() does.
+ */
+static ssize_t bread_direct(BFILE *bfd, void *buf, size_t count)
+{
+   size_t len = count & ~((size_t)DIO_ALIGN - 1);
+   ssize_t stat;
+
+   if (len == 0) {
+      bdirect_io_disable(bfd);
+      return read(bfd->fid, buf, count);
+   }
+   if (((uintptr_t)buf & (DIO_ALIGN - 1)) == 0) {
+      stat = read(bfd->fid, buf, len);
+   } else {
+      if (bfd->dio_size < (int32_t)len) {
+         if (bfd->dio_buf) {
+            free_aligned_memory(bfd->dio_buf);
+         }
+         bfd->dio_buf = get_aligned_memory(len, DIO_ALIGN);
+         bfd->dio_size = len;
+      }
+      stat = read(bfd->fid, bfd->dio_buf, len);
+      if (stat > 0) {
+         memcpy(buf, bfd->dio_buf, stat);
+      }
+   }
+   if (stat < 0 && errno == EINVAL) {
+      bdirect_io_disable(bfd);
+      return read(bfd->fid, buf, count);
+   }
    return stat;
 }
 
@@ -1095,7 +1188,15 @@ ssize_t bread(BFILE *bfd, void *buf, size_t count)
       return plugin_bread(bfd, buf, count);
    }
 
-   stat = read(bfd->fid, buf, count);
+   if (bfd->ra) {
+      return bread_ahead(bfd, buf, count);
+   }
+
+   if (bfd->m_flags & O_DIRECT) {
+      stat = bread_direct(bfd, buf, count);
+   } else {
+      stat = read(bfd->fid, buf, count);
+   }
    bfd->berrno = errno;
    bfd->block++;
    if (stat > 0) {
@@ -1135,9 +1236,94 @@ boffset_t blseek(BFILE *bfd, boffset_t offset, int whence)
    if (bfd->cmd_plugin && plugin_bwrite) {
       return plugin_blseek(bfd, offset, whence);
    }
+   if (bfd->ra) {
+      return blseek_ahead(bfd, offset, whence);
+   }
    pos = (boffset_t)lseek(bfd->fid, offset, whence);
    bfd->berrno = errno;
    return pos;
 }
 
+#if defined(HAVE_LINUX_OS) && defined(FS_IOC_FIEMAP)
+/*
+ * Ask the filesystem for the first allocated extent that ends after
+ *  offset. Unwritten (preallocated) extents read as zeros, they are
+ *  handled as holes.
+ *
+ * Returns 1 if found, 0 if there is no more data, -1 if not supported.
+ */
+static int fiemap_data_extent(int fd, boffset_t offset, boffset_t *start, boffset_t *end)
+{
+   union {
+      struct fiemap fm;
+      char buf[sizeof(struct fiemap) + sizeof(struct fiemap_extent)];
+   } u;
+   struct fiemap_extent *fe = &u.fm.fm_extents[0];
+
+   for ( ;; ) {
+      memset(&u, 0, sizeof(u));
+      u.fm.fm_start = offset;
+      u.fm.fm_length = FIEMAP_MAX_OFFSET - offset;
+      u.fm.fm_flags = FIEMAP_FLAG_SYNC; /* dirty data must be allocated */
+      u.fm.fm_extent_count = 1;
+      if (ioctl(fd, FS_IOC_FIEMAP, &u.fm) < 0) {
+         return -1;
+      }
+      if (u.fm.fm_mapped_extents == 0) {
+         return 0;
+      }
+      /* Filesystems without extents (tmpfs, ...) cannot say where the data is */
+      if (fe->fe_flags & (FIEMAP_EXTENT_UNKNOWN|FIEMAP_EXTENT_NOT_ALIGNED|FIEMAP_EXTENT_DATA_INLINE)) {
+         return -1;
+      }
+      if (!(fe->fe_flags & FIEMAP_EXTENT_UNWRITTEN)) {
+         *start = MAX((boffset_t)fe->fe_logical, offset);
+         *end = fe->fe_logical + fe->fe_length;
+         return 1;
+      }
+      if (fe->fe_flags & FIEMAP_EXTENT_LAST) {
+         return 0;
+      }
+      offset = fe->fe_logical + fe->fe_length;
+   }
+}
+#endif
+
+/*
+ * Find the next range of the file that holds data, starting at offset.
+ *  The ranges before start and after end are holes, they read as zeros.
+ *  FIEMAP is used when available, else SEEK_DATA/SEEK_HOLE. The file
+ *  position is not defined after the call.
+ *
+ * Returns 1 if found, 0 if there is no more data until the end of the
+ *  file, -1 if the filesystem cannot tell.
+ */
+int bget_data_extent(BFILE *bfd, boffset_t offset, boffset_t *start, boffset_t *end)
+{
+   if (bfd->cmd_plugin || bfd->fid < 0) {
+      return -1;
+   }
+#if defined(HAVE_LINUX_OS) && defined(FS_IOC_FIEMAP)
+   int ret = fiemap_data_extent(bfd->fid, offset, start, end);
+   if (ret >= 0) {
+      return ret;
+   }
+#endif
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+   boffset_t pos = (boffset_t)lseek(bfd->fid, offset, SEEK_DATA);
+   if (pos < 0) {
+      return errno == ENXIO ? 0 : -1;
+   }
+   *start = pos;
+   pos = (boffset_t)lseek(bfd->fid, pos, SEEK_HOLE);
+   if (pos < 0) {
+      return -1;
+   }
+   *end = pos;
+   return 1;
+#else
+   return -1;
+#endif
+}
+
 #endif
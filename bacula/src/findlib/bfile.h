@@ -92,6 +92,11 @@ HANDLE bget_handle(BFILE *bfd);
  *  =======================================================
  */
 
+class read_ahead;                   /* see read_ahead.c */
+
+/* Alignment of the buffers, sizes and offsets of O_DIRECT reads */
+#define DIO_ALIGN 4096
+
 /* Basic Unix low level I/O file packet */
 struct BFILE {
    int fid;                           /* file id on Unix */
@@ -106,6 +111,9 @@ struct BFILE {
    int use_backup_decomp;             /* set if using BackupRead Stream Decomposition */
    bool reparse_point;                /* not used in Unix */
    bool cmd_plugin;                   /* set if we have a command plugin */
+   read_ahead *ra;                    /* asynchronous read ahead, see read_ahead.c */
+   char *dio_buf;                     /* aligned buffer for O_DIRECT reads */
+   int32_t dio_size;                  /* size of dio_buf */
 };
 
 #endif
@@ -127,10 +135,15 @@ bool    is_restore_stream_supported(int stream);
 bool    is_win32_stream(int stream);
 int     bopen(BFILE *bfd, const char *fname, uint64_t flags, mode_t mode);
 int     bopen_rsrc(BFILE *bfd, const char *fname, uint64_t flags, mode_t mode);
+#if defined(HAVE_OPENAT) && !defined(HAVE_WIN32)
+int     bopenat(BFILE *bfd, int dirfd, const char *fname, uint64_t flags, mode_t mode);
+#endif
 int     bclose(BFILE *bfd);
 ssize_t bread(BFILE *bfd, void *buf, size_t count);
 ssize_t bwrite(BFILE *bfd, void *buf, size_t count);
 boffset_t blseek(BFILE *bfd, boffset_t offset, int whence);
+int     bget_data_extent(BFILE *bfd, boffset_t offset, boffset_t *start, boffset_t *end);
+void    bdirect_io_disable(BFILE *bfd);
 const char   *stream_to_ascii(int stream);
 
 bool processWin32BackupAPIBlock (BFILE *bfd, void *pBuffer, ssize_t dwSize);
@@ -45,6 +45,43 @@
 static int separate_path_and_file(JCR *jcr, char *fname, char *ofile);
 static int path_already_seen(JCR *jcr, char *path, int pnl);
 
+/*
+ * Look up, remove and create a file relative to the directory dirfd
+ *  when it is open (fast restore), else name is the full path.
+ */
+static int blstatat(int dirfd, const char *name, struct stat *statp)
+{
+#ifdef HAVE_RESTORE_DIRS
+   if (dirfd >= 0) {
+      return fstatat(dirfd, name, statp, AT_SYMLINK_NOFOLLOW);
+   }
+#endif
+   return lstat(name, statp);
+}
+
+static int bunlinkat(int dirfd, const char *name)
+{
+#ifdef HAVE_RESTORE_DIRS
+   if (dirfd >= 0) {
+      return unlinkat(dirfd, name, 0);
+   }
+#endif
+   return unlink(name);
+}
+
+static int bcreate(JCR *jcr, BFILE *bfd, int dirfd, const char *name, int flags, mode_t mode)
+{
+#ifdef HAVE_RESTORE_DIRS
+   if (dirfd >= 0) {
+      if (bopenat(bfd, dirfd, name, flags, mode) >= 0) {
+         jcr->rdirs->nb_files++;
+      }
+      return bfd->fid;
+   }
+#endif
+   return bopen(bfd, name, flags, mode);
+}
+
 
 /*
  * Create the file, or the directory
@@ -55,7 +92,9 @@ static int path_already_seen(JCR *jcr, char *path, int pnl);
  * Returns:  CF_SKIP     if file should be skipped
  *           CF_ERROR    on error
  *           CF_EXTRACT  file created and data to restore
- *           CF_CREATED  file created no data to restore
+ *           CF_CREATED  file created no data to restore, or kept
+ *                       as is with attr->unchanged (IfChanged)
+ *           CF_DELTA    existing file opened, data to compare and restore
  *
  *   Note, we create the file here, except for special files,
  *     we do not set the attributes because we want to first
@@ -74,8 +113,11 @@ int create_file(JCR *jcr, ATTR *attr, BFILE *bfd, int replace)
    int pnl;
    bool exists = false;
    struct stat mstatp;
+   int dirfd = -1;                    /* fd of the directory, see restore_dirs */
+   const char *name = attr->ofname;   /* name relative to dirfd */
 
    bfd->reparse_point = false;
+   attr->unchanged = false;
    if (is_win32_stream(attr->data_stream)) {
       set_win32_backup(bfd);
    } else {
@@ -111,8 +153,25 @@ int create_file(JCR *jcr, ATTR *attr, BFILE *bfd, int replace)
    }
 #endif
 
+#ifdef HAVE_RESTORE_DIRS
+   /*
+    * With a fast restore, the regular files are looked up and created
+    *  relative to the fd of their directory when it exists.
+    */
+   if (jcr->rdirs && (attr->type == FT_REG || attr->type == FT_REGE) &&
+       !bfd->cmd_plugin) {
+      char *p = strrchr(attr->ofname, '/');
+      if (p && p > attr->ofname && p[1]) {
+         dirfd = jcr->rdirs->dir_fd(attr->ofname, p - attr->ofname);
+         if (dirfd >= 0) {
+            name = p + 1;
+         }
+      }
+   }
+#endif
+
    Dmsg2(400, "Replace=%c %d\n", (char)replace, replace);
-   if (lstat(attr->ofname, &mstatp) == 0) {
+   if (blstatat(dirfd, name, &mstatp) == 0) {
       exists = true;
       switch (replace) {
       case REPLACE_IFNEWER:
@@ -142,6 +201,8 @@ int create_file(JCR *jcr, ATTR *attr, BFILE *bfd, int replace)
          Qmsg(jcr, M_SKIPPED, 0, _("File skipped. Already exists: %s\n"), attr->ofname);
          return CF_SKIP;
 
+      case REPLACE_IFCHANGED:
+      case REPLACE_IFDIFFERENT:
       case REPLACE_ALWAYS:
          break;
       }
@@ -160,10 +221,37 @@ int create_file(JCR *jcr, ATTR *attr, BFILE *bfd, int replace)
        *  we may blow away a FIFO that is being used to read the
        *  restore data, or we may blow away a partition definition.
        */
+#ifndef HAVE_WIN32
+      /*
+       * Keep a regular file that has a single link, the restore writes
+       *  only the data that differs, see CF_DELTA. With IfChanged, the
+       *  data of a file with the same size and time is not restored.
+       */
+      if (exists && (replace == REPLACE_IFCHANGED || replace == REPLACE_IFDIFFERENT) &&
+          (attr->type == FT_REG || attr->type == FT_REGE) &&
+          S_ISREG(mstatp.st_mode) && mstatp.st_nlink == 1 &&
+          !bfd->cmd_plugin && !is_win32_stream(attr->data_stream)) {
+         if (replace == REPLACE_IFCHANGED &&
+             mstatp.st_size == attr->statp.st_size &&
+             mstatp.st_mtime == attr->statp.st_mtime) {
+            Dmsg1(400, "Not changed %s\n", attr->ofname);
+            attr->unchanged = true;
+            return CF_CREATED;
+         }
+         if (is_bopen(bfd)) {
+            Qmsg1(jcr, M_ERROR, 0, _("bpkt already open fid=%d\n"), bfd->fid);
+            bclose(bfd);
+         }
+         if (bcreate(jcr, bfd, dirfd, name, O_RDWR | O_BINARY, 0) >= 0) {
+            return CF_DELTA;
+         }
+         Dmsg1(100, "Cannot open %s for a delta restore, replace it\n", attr->ofname);
+      }
+#endif
       if (exists && attr->type != FT_RAW && attr->type != FT_FIFO) {
          /* Get rid of old copy */
          Dmsg1(400, "unlink %s\n", attr->ofname);
-         if (unlink(attr->ofname) == -1) {
+         if (bunlinkat(dirfd, name) == -1) {
             berrno be;
             Qmsg(jcr, M_ERROR, 0, _("File %s already exists and could not be replaced. ERR=%s.\n"),
                attr->ofname, be.bstrerror());
@@ -183,9 +271,10 @@ int create_file(JCR *jcr, ATTR *attr, BFILE *bfd, int replace)
 
       /*
        * If path length is <= 0 we are making a file in the root
-       *  directory. Assume that the directory already exists.
+       *  directory, else dirfd is open when the directory was found
+       *  for a fast restore. Assume that the directory already exists.
        */
-      if (pnl > 0) {
+      if (pnl > 0 && dirfd < 0) {
          char savechr;
          savechr = attr->ofname[pnl];
          attr->ofname[pnl] = 0;                 /* terminate path */
@@ -221,7 +310,16 @@ int create_file(JCR *jcr, ATTR *attr, BFILE *bfd, int replace)
          }
 
          set_fattrs(bfd, &attr->statp);
-         if ((bopen(bfd, attr->ofname, flags, S_IRUSR | S_IWUSR)) < 0) {
+#ifdef HAVE_RESTORE_DIRS
+         /* The directory was just created, keep it for the next files */
+         if (jcr->rdirs && dirfd < 0 && pnl > 0 && !bfd->cmd_plugin) {
+            dirfd = jcr->rdirs->dir_fd(attr->ofname, pnl);
+            if (dirfd >= 0) {
+               name = attr->ofname + pnl + 1;
+            }
+         }
+#endif
+         if (bcreate(jcr, bfd, dirfd, name, flags, S_IRUSR | S_IWUSR) < 0) {
             berrno be;
             be.set_errno(bfd->berrno);
             Qmsg2(jcr, M_ERROR, 0, _("Could not create %s: ERR=%s\n"),
@@ -0,0 +1,301 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+*/
+/*
+ *  Read a directory through its file descriptor
+ *
+ *  find_one_file() keeps the directory it is reading open, and
+ *  looks up its entries with fstatat() and openat() relative to
+ *  that fd, so the kernel does not resolve the full path of each
+ *  file again from the top of the tree.
+ *
+ *  On Linux the entries are read with getdents64() in large batches
+ *  and come with their inode number and file type (d_type). Other
+ *  systems use fdopendir() and readdir(), the type and the inode
+ *  are then unknown.
+ *
+ *  With the InodeOrder FileSet option, all the entries of a
+ *  directory are read first and returned sorted by inode number,
+ *  on most file systems this is the order of the inodes on disk.
+ *
+ *  The accurate mode can also ask for the order of the list sent
+ *  by the Director, sorted by path then by file name: the files of
+ *  the directory by name, then its subdirectories by name followed
+ *  by a '/'.
+ */
+
+#include "bacula.h"
+#include "find.h"
+
+#ifdef HAVE_DIR_READER
+
+#ifdef HAVE_LINUX_OS
+#include <sys/syscall.h>
+
+/* The kernel structure, glibc < 2.30 does not export it */
+struct linux_dirent64 {
+   uint64_t d_ino;
+   int64_t  d_off;
+   unsigned short d_reclen;
+   unsigned char d_type;
+   char d_name[];
+};
+
+/* Size of a getdents64() batch */
+#define DIR_READER_BUFSIZE (64 * 1024)
+#endif
+
+int breaddir(DIR *dirp, POOLMEM *&d_name);
+
+#ifndef O_DIRECTORY
+#define O_DIRECTORY 0
+#endif
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+/*
+ * Open the directory name relative to at_fd (AT_FDCWD for a full path).
+ *  Symbolic links are not followed.
+ *
+ * Returns false with errno set on error.
+ */
+bool dir_reader::open(int at_fd, const char *name)
+{
+   close();
+   m_fd = openat(at_fd, name, O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+   if (m_fd < 0) {
+      return false;
+   }
+   return true;
+}
+
+/*
+ * Prepare to read the entries, sorted by name if name_order is set,
+ *  else by inode number if inode_order is set and the inode numbers
+ *  are known.
+ *
+ * Returns false with errno set on error.
+ */
+bool dir_reader::start(bool inode_order, bool name_order)
+{
+   m_errno = 0;
+   m_eof = false;
+#ifdef HAVE_LINUX_OS
+   m_buf = get_memory(DIR_READER_BUFSIZE);
+   m_buf_len = m_buf_pos = 0;
+   if (inode_order || name_order) {
+      read_all(name_order);
+   }
+#else
+   if ((m_dirp = fdopendir(m_fd)) == NULL) {
+      return false;
+   }
+   m_dname = get_pool_memory(PM_FNAME);
+   if (name_order) {
+      read_all(name_order);
+   }
+#endif
+   return true;
+}
+
+#ifdef HAVE_LINUX_OS
+/* Read the next batch of entries, false at the end or on error */
+bool dir_reader::read_batch()
+{
+   long nb;
+
+   if (m_eof) {
+      return false;
+   }
+   nb = syscall(SYS_getdents64, m_fd, m_buf, sizeof_pool_memory(m_buf));
+   if (nb <= 0) {
+      m_errno = nb < 0 ? errno : 0;
+      m_eof = true;
+      return false;
+   }
+   m_buf_len = nb;
+   m_buf_pos = 0;
+   return true;
+}
+#endif
+
+/* Read the next entry from the directory, false at the end */
+bool dir_reader::read_one(dir_reader_entry *e)
+{
+#ifdef HAVE_LINUX_OS
+   if (m_buf_pos >= m_buf_len && !read_batch()) {
+      return false;
+   }
+   struct linux_dirent64 *d = (struct linux_dirent64 *)(m_buf + m_buf_pos);
+   m_buf_pos += d->d_reclen;
+   e->name = d->d_name;
+   e->ino = d->d_ino;
+   e->type = d->d_type;
+#else
+   int status = breaddir(m_dirp, m_dname);
+   if (status != 0) {
+      m_errno = status > 0 ? status : 0;
+      m_eof = true;
+      return false;
+   }
+   e->name = m_dname;
+   e->ino = 0;
+   e->type = DT_UNKNOWN;
+#endif
+   return true;
+}
+
+static int cmp_ino(const void *a, const void *b)
+{
+   const dir_reader_entry *e1 = (const dir_reader_entry *)a;
+   const dir_reader_entry *e2 = (const dir_reader_entry *)b;
+   if (e1->ino < e2->ino) {
+      return -1;
+   }
+   return e1->ino > e2->ino ? 1 : 0;
+}
+
+/*
+ * Order of the accurate list: the other files first, then the
+ *  directories, compared as if their name was followed by a '/'.
+ */
+static int cmp_name(const void *a, const void *b)
+{
+   const dir_reader_entry *e1 = (const dir_reader_entry *)a;
+   const dir_reader_entry *e2 = (const dir_reader_entry *)b;
+   bool d1 = e1->type == DT_DIR;
+   bool d2 = e2->type == DT_DIR;
+   if (d1 != d2) {
+      return d1 ? 1 : -1;
+   }
+   if (!d1) {
+      return strcmp(e1->name, e2->name);
+   }
+   const uint8_t *p1 = (const uint8_t *)e1->name;
+   const uint8_t *p2 = (const uint8_t *)e2->name;
+   while (*p1 && *p1 == *p2) {
+      p1++; p2++;
+   }
+   return (int)(*p1 ? *p1 : '/') - (int)(*p2 ? *p2 : '/');
+}
+
+/*
+ * Read all the entries and sort them by inode or by name. The names
+ *  are copied in m_names, the entries point to them.
+ */
+void dir_reader::read_all(bool name_order)
+{
+   dir_reader_entry e;
+   int max_entries = 0;
+   int32_t names_len = 0;
+
+   m_names = get_pool_memory(PM_FNAME);
+   while (read_one(&e)) {
+      int l = strlen(e.name) + 1;
+      if (m_nb_entries == max_entries) {
+         max_entries = max_entries ? max_entries * 2 : 64;
+         m_entries = (dir_reader_entry *)brealloc(m_entries, max_entries * sizeof(dir_reader_entry));
+      }
+      m_names = check_pool_memory_size(m_names, names_len + l);
+      memcpy(m_names + names_len, e.name, l);
+      /* The directories are sorted with a '/', we need the type */
+      if (name_order && e.type == DT_UNKNOWN) {
+         struct stat st;
+         if (fstatat(m_fd, e.name, &st, AT_SYMLINK_NOFOLLOW) == 0 &&
+             S_ISDIR(st.st_mode)) {
+            e.type = DT_DIR;
+         }
+      }
+      /* Keep the offset, m_names may move */
+      e.name = (char *)(intptr_t)names_len;
+      m_entries[m_nb_entries++] = e;
+      names_len += l;
+   }
+   for (int i=0; i < m_nb_entries; i++) {
+      m_entries[i].name = m_names + (intptr_t)m_entries[i].name;
+   }
+   if (m_nb_entries > 1) {
+      qsort(m_entries, m_nb_entries, sizeof(dir_reader_entry),
+            name_order ? cmp_name : cmp_ino);
+   }
+   /* The batch buffer is not needed anymore */
+   if (m_buf) {
+      free_pool_memory(m_buf);
+      m_buf = NULL;
+   }
+   if (!m_entries) {
+      /* Empty, or an error, next() returns false */
+      m_entries = (dir_reader_entry *)bmalloc(sizeof(dir_reader_entry));
+   }
+}
+
+/*
+ * Get the next entry, `.' and `..' are skipped. The name is valid
+ *  until the next call.
+ *
+ * Returns false at the end of the directory or on error, see error().
+ */
+bool dir_reader::next(dir_reader_entry *e)
+{
+   for ( ;; ) {
+      if (m_entries) {
+         if (m_next >= m_nb_entries) {
+            return false;
+         }
+         *e = m_entries[m_next++];
+      } else if (!read_one(e)) {
+         return false;
+      }
+      char *p = e->name;
+      if (!(p[0] == '\0' || (p[0] == '.' && (p[1] == '\0' ||
+           (p[1] == '.' && p[2] == '\0'))))) {
+         return true;
+      }
+   }
+}
+
+void dir_reader::close()
+{
+   if (m_dirp) {
+      closedir(m_dirp);              /* closes m_fd */
+      m_dirp = NULL;
+   } else if (m_fd >= 0) {
+      ::close(m_fd);
+   }
+   m_fd = -1;
+   if (m_buf) {
+      free_pool_memory(m_buf);
+      m_buf = NULL;
+   }
+   if (m_dname) {
+      free_pool_memory(m_dname);
+      m_dname = NULL;
+   }
+   if (m_names) {
+      free_pool_memory(m_names);
+      m_names = NULL;
+   }
+   if (m_entries) {
+      free(m_entries);
+      m_entries = NULL;
+   }
+   m_nb_entries = m_next = 0;
+}
+
+#endif /* HAVE_DIR_READER */
@@ -0,0 +1,78 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+*/
+/*
+ *  Read a directory through its file descriptor, see dir_reader.c
+ */
+
+#ifndef _DIR_READER_H
+#define _DIR_READER_H 1
+
+#if defined(HAVE_FSTATAT) && defined(HAVE_FDOPENDIR) && !defined(HAVE_WIN32)
+#define HAVE_DIR_READER 1
+#endif
+
+#ifdef HAVE_DIR_READER
+
+#ifndef DT_UNKNOWN
+#define DT_UNKNOWN 0
+#define DT_DIR     4
+#endif
+
+/* An entry returned by dir_reader::next() */
+struct dir_reader_entry {
+   char *name;                        /* file name in the directory */
+   uint64_t ino;                      /* inode number, 0 if not known */
+   int type;                          /* DT_xxx, DT_UNKNOWN if not known */
+};
+
+class dir_reader {
+   int m_fd;                          /* directory fd */
+   int m_errno;                       /* errno of the last read */
+   bool m_eof;
+   POOLMEM *m_buf;                    /* getdents64() batch */
+   int m_buf_len;
+   int m_buf_pos;
+   DIR *m_dirp;                       /* fdopendir() when no getdents64() */
+   POOLMEM *m_dname;
+   dir_reader_entry *m_entries;       /* inode or name order, all the entries */
+   POOLMEM *m_names;                  /* names of m_entries */
+   int m_nb_entries;
+   int m_next;
+
+   bool read_batch();
+   bool read_one(dir_reader_entry *e);
+   void read_all(bool name_order);
+
+public:
+   dir_reader() { m_fd=-1; m_errno=0; m_eof=false; m_buf=NULL; m_buf_len=m_buf_pos=0;
+                  m_dirp=NULL; m_dname=NULL; m_entries=NULL; m_names=NULL;
+                  m_nb_entries=m_next=0; };
+   ~dir_reader() { close(); };
+   bool open(int at_fd, const char *name);
+   bool start(bool inode_order, bool name_order = false);
+   bool next(dir_reader_entry *e);
+   void close();
+   bool is_open() { return m_fd >= 0; };
+   int fd() { return m_fd; };
+   int error() { return m_errno; };
+};
+
+#endif /* HAVE_DIR_READER */
+
+#endif /* _DIR_READER_H */
@@ -41,6 +41,7 @@ int32_t path_max;              /* path name max length */
 #define bmalloc(x) sm_malloc(__FILE__, __LINE__, x)
 #endif
 static int our_callback(JCR *jcr, FF_PKT *ff, bool top_level);
+static void stop_find_threads(FF_PKT *ff);
 
 static const int fnmode = 0;
 
@@ -99,6 +100,48 @@ set_find_snapshot_function(FF_PKT *ff,
    ff->snapshot_convert_fct = convert_path;
 }
 
+/*
+ * True when a top level file of the FileSet is inside another one or
+ *  listed twice, the walk then finds some files more than once.
+ */
+static bool fileset_has_overlap(findFILESET *fileset)
+{
+   findINCEXE *inc1, *inc2;
+   dlistString *n1, *n2;
+   const char *a, *b;
+   int la, lb;
+
+   for (int i=0; i<fileset->include_list.size(); i++) {
+      inc1 = (findINCEXE *)fileset->include_list.get(i);
+      foreach_dlist(n1, &inc1->name_list) {
+         for (int j=0; j<fileset->include_list.size(); j++) {
+            inc2 = (findINCEXE *)fileset->include_list.get(j);
+            foreach_dlist(n2, &inc2->name_list) {
+               if (n1 == n2) {
+                  continue;
+               }
+               /* a is the shorter name, is b under it? */
+               a = n1->c_str();
+               b = n2->c_str();
+               la = strlen(a);
+               lb = strlen(b);
+               if (la > lb) {
+                  continue;           /* done with the pair swapped */
+               }
+               while (la > 1 && IsPathSeparator(a[la - 1])) {
+                  la--;
+               }
+               if (strncmp(a, b, la) == 0 &&
+                   (b[la] == 0 || IsPathSeparator(b[la]) || IsPathSeparator(a[la - 1]))) {
+                  return true;
+               }
+            }
+         }
+      }
+   }
+   return false;
+}
+
 /*
  * Call this subroutine with a callback subroutine as the first
  * argument and a packet as the second argument, this packet
@@ -122,6 +165,10 @@ find_files(JCR *jcr, FF_PKT *ff, int file_save(JCR *jcr, FF_PKT *ff_pkt, bool to
        * (not only Options{} blocks inside a Include{})
        */
       ff->flags = 0;
+      /* The hard linked files can be forgotten when all their links were
+       * found, unless the same file can be found again
+       */
+      ff->link_release = !fileset_has_overlap(fileset);
       for (i=0; i<fileset->include_list.size(); i++) {
          findINCEXE *incexe = (findINCEXE *)fileset->include_list.get(i);
          fileset->incexe = incexe;
@@ -132,6 +179,11 @@ find_files(JCR *jcr, FF_PKT *ff, int file_save(JCR *jcr, FF_PKT *ff_pkt, bool to
          strcpy(ff->BaseJobOpts, "Jspug5"); /* size+perm+user+group+chk  */
          ff->plugin = NULL;
          ff->opt_plugin = false;
+         ff->walker_threads = 0;
+         ff->inode_order = false;
+         ff->read_ahead_depth = 0;
+         ff->read_ahead_size = 0;
+         ff->prefetch_files = 0;
 
          /*
           * By setting all options, we in effect OR the global options
@@ -160,6 +212,21 @@ find_files(JCR *jcr, FF_PKT *ff, int file_save(JCR *jcr, FF_PKT *ff_pkt, bool to
                ff->Dedup_level = fo->Dedup_level;
             }
             ff->strip_path = fo->strip_path;
+            if (fo->walker_threads > ff->walker_threads) {
+               ff->walker_threads = fo->walker_threads;
+            }
+            if (fo->flags & FO_INODE_ORDER) {
+               ff->inode_order = true;
+            }
+            if (fo->read_ahead_depth > ff->read_ahead_depth) {
+               ff->read_ahead_depth = fo->read_ahead_depth;
+            }
+            if (fo->read_ahead_size > ff->read_ahead_size) {
+               ff->read_ahead_size = fo->read_ahead_size;
+            }
+            if (fo->prefetch_files > ff->prefetch_files) {
+               ff->prefetch_files = fo->prefetch_files;
+            }
             ff->fstypes = fo->fstype;
             ff->drivetypes = fo->drivetype;
             if (fo->plugin != NULL) {
@@ -176,6 +243,22 @@ find_files(JCR *jcr, FF_PKT *ff, int file_save(JCR *jcr, FF_PKT *ff_pkt, bool to
          }
          Dmsg4(50, "Verify=<%s> Accurate=<%s> BaseJob=<%s> flags=<%lld>\n",
                ff->VerifyOpts, ff->AccurateOpts, ff->BaseJobOpts, ff->flags);
+         /* An estimate only does lstat(), always in parallel */
+         if (ff->stat_only && ff->walker_threads < ESTIMATE_WALKER_THREADS) {
+            ff->walker_threads = ESTIMATE_WALKER_THREADS;
+         }
+         /* Read the directories in parallel if requested */
+         if (ff->walker_threads > 0) {
+            ff->walker = new_dir_walker(jcr, ff->walker_threads, ff->inode_order,
+                                        ff->name_order, ff->stat_only);
+         }
+         /* Read the files asynchronously if requested */
+         if (ff->read_ahead_depth > 0) {
+            /* The prefetch fills the page cache that DirectIO avoids */
+            int prefetch = ff->walker && !(ff->flags & FO_DIRECTIO) ? ff->prefetch_files : 0;
+            ff->ra = new_read_ahead(jcr, ff->read_ahead_depth, ff->read_ahead_size,
+                                    prefetch);
+         }
          dlistString *node;
          foreach_dlist(node, &incexe->name_list) {
             POOL_MEM fname(PM_FNAME);
@@ -191,13 +274,16 @@ find_files(JCR *jcr, FF_PKT *ff, int file_save(JCR *jcr, FF_PKT *ff_pkt, bool to
             }
 
             if (find_one_file(jcr, ff, our_callback, fname.c_str(), ff->top_fname, (dev_t)-1, true) == 0) {
+               stop_find_threads(ff);
                return 0;                  /* error return */
             }
 
             if (job_canceled(jcr)) {
+               stop_find_threads(ff);
                return 0;
             }
          }
+         stop_find_threads(ff);
          foreach_dlist(node, &incexe->plugin_list) {
             char *fname = node->c_str();
             if (!plugin_save) {
@@ -226,6 +312,19 @@ find_files(JCR *jcr, FF_PKT *ff, int file_save(JCR *jcr, FF_PKT *ff_pkt, bool to
    return 1;
 }
 
+/* Stop the walker and the read ahead threads of an Include */
+static void stop_find_threads(FF_PKT *ff)
+{
+   if (ff->walker) {
+      free_dir_walker(ff->walker);
+      ff->walker = NULL;
+   }
+   if (ff->ra) {
+      free_read_ahead(ff->ra);
+      ff->ra = NULL;
+   }
+}
+
 /*
  * Test if the currently selected directory (in ff->fname) is
  *  explicitly in the Include list or explicitly in the Exclude
@@ -264,25 +363,165 @@ bool is_in_fileset(FF_PKT *ff)
 }
 
 
+/*
+ * Tell if a wild card of a list matches a string. The list is compiled
+ *  in a set, compiled again if a plugin added a pattern since.
+ */
+static bool wild_match(FF_PKT *ff, wild_set **ws, alist *list, const char *str,
+                       int flags)
+{
+   char *pattern;
+
+   if (list->size() == 0) {
+      return false;
+   }
+   if (!ff->legacy_match) {
+      if (*ws && ((*ws)->size() != (uint32_t)list->size() || (*ws)->get_flags() != flags)) {
+         delete *ws;
+         *ws = NULL;
+      }
+      if (!*ws) {
+         *ws = New(wild_set(flags));
+         foreach_alist(pattern, list) {
+            (*ws)->add(pattern);
+         }
+      }
+      return (*ws)->match(str);
+   }
+   foreach_alist(pattern, list) {
+      if (fnmatch(pattern, str, flags) == 0) {
+         return true;
+      }
+   }
+   return false;
+}
+
+/*
+ * Same for a list of regexes, the set is filled by add_regex_to_matcher(),
+ *  it is not used if some regexes were added without it
+ */
+static bool regex_match(FF_PKT *ff, regex_set *rs, alist *list, const char *str)
+{
+   regex_t *preg;
+
+   if (list->size() == 0) {
+      return false;
+   }
+   if (!ff->legacy_match && rs && rs->size() == (uint32_t)list->size()) {
+      return rs->match(str);
+   }
+   foreach_alist(preg, list) {
+      const int nmatch = 30;
+      regmatch_t pmatch[nmatch];
+      if (regexec(preg, str, nmatch, pmatch,  0) == 0) {
+         return true;
+      }
+   }
+   return false;
+}
+
+/* Same for the names of an Exclude { } */
+static bool exclude_name_match(FF_PKT *ff, findINCEXE *incexe, int flags)
+{
+   wild_set *ws = incexe->name_set;
+   dlistString *node;
+
+   if (incexe->name_list.size() == 0) {
+      return false;
+   }
+   if (!ff->legacy_match) {
+      if (ws && (ws->size() != (uint32_t)incexe->name_list.size() || ws->get_flags() != flags)) {
+         delete ws;
+         ws = NULL;
+      }
+      if (!ws) {
+         ws = New(wild_set(flags));
+         foreach_dlist(node, &incexe->name_list) {
+            ws->add(node->c_str());
+         }
+         incexe->name_set = ws;
+      }
+      return ws->match(ff->fname);
+   }
+   foreach_dlist(node, &incexe->name_list) {
+      if (fnmatch(node->c_str(), ff->fname, flags) == 0) {
+         return true;
+      }
+   }
+   return false;
+}
+
+static fopts_matcher *get_matcher(findFOPTS *fo)
+{
+   if (!fo->matcher) {
+      fo->matcher = (fopts_matcher *)bmalloc(sizeof(fopts_matcher));
+      memset(fo->matcher, 0, sizeof(fopts_matcher));
+   }
+   return fo->matcher;
+}
+
+/*
+ * Add a regex compiled with cflags to the matcher of an Options block,
+ *  type is ' ', 'D' or 'F' like in the FileSet
+ */
+void add_regex_to_matcher(findFOPTS *fo, int type, const char *pattern, int cflags,
+                          regex_t *preg)
+{
+   fopts_matcher *m = get_matcher(fo);
+   regex_set **rs;
+
+   if (type == 'D') {
+      rs = &m->regexdir;
+   } else if (type == 'F') {
+      rs = &m->regexfile;
+   } else {
+      rs = &m->regex;
+   }
+   if (!*rs) {
+      *rs = New(regex_set());
+   }
+   (*rs)->add(pattern, cflags, preg);
+}
+
+void free_fopts_matcher(findFOPTS *fo)
+{
+   fopts_matcher *m = fo->matcher;
+
+   if (!m) {
+      return;
+   }
+   delete m->wild;
+   delete m->wilddir;
+   delete m->wildfile;
+   delete m->wildbase;
+   delete m->regex;
+   delete m->regexdir;
+   delete m->regexfile;
+   free(m);
+   fo->matcher = NULL;
+}
+
+/*
+ * The patterns of each Options block are matched with its sets, see
+ *  lib/matchset.h. A block only tells if one of its patterns matches,
+ *  so the first block that matches decides like before.
+ */
 bool accept_file(FF_PKT *ff)
 {
-   int i, j, k;
+   int i, j;
    int fnm_flags;
    findFILESET *fileset = ff->fileset;
    findINCEXE *incexe = fileset->incexe;
    const char *basename;
-   int (*match_func)(const char *pattern, const char *string, int flags);
+   fopts_matcher *m;
 
    Dmsg1(dbglvl, "enter accept_file: fname=%s\n", ff->fname);
    if (ff->flags & FO_ENHANCEDWILD) {
-//    match_func = enh_fnmatch;
-      match_func = fnmatch;
       if ((basename = last_path_separator(ff->fname)) != NULL)
          basename++;
       else
          basename = ff->fname;
    } else {
-      match_func = fnmatch;
       basename = ff->fname;
    }
 
@@ -300,83 +539,61 @@ bool accept_file(FF_PKT *ff)
 
       fnm_flags = (ff->flags & FO_IGNORECASE) ? FNM_CASEFOLD : 0;
       fnm_flags |= (ff->flags & FO_ENHANCEDWILD) ? FNM_PATHNAME : 0;
+      fnm_flags |= fnmode;
+      m = get_matcher(fo);
 
       if (S_ISDIR(ff->statp.st_mode)) {
-         for (k=0; k<fo->wilddir.size(); k++) {
-            if (match_func((char *)fo->wilddir.get(k), ff->fname, fnmode|fnm_flags) == 0) {
-               if (ff->flags & FO_EXCLUDE) {
-                  Dmsg2(dbglvl, "Exclude wilddir: %s file=%s\n", (char *)fo->wilddir.get(k),
-                     ff->fname);
-                  return false;       /* reject dir */
-               }
-               return true;           /* accept dir */
+         if (wild_match(ff, &m->wilddir, &fo->wilddir, ff->fname, fnm_flags)) {
+            if (ff->flags & FO_EXCLUDE) {
+               Dmsg1(dbglvl, "Exclude wilddir: file=%s\n", ff->fname);
+               return false;       /* reject dir */
             }
+            return true;           /* accept dir */
          }
       } else {
-         for (k=0; k<fo->wildfile.size(); k++) {
-            if (match_func((char *)fo->wildfile.get(k), ff->fname, fnmode|fnm_flags) == 0) {
-               if (ff->flags & FO_EXCLUDE) {
-                  Dmsg2(dbglvl, "Exclude wildfile: %s file=%s\n", (char *)fo->wildfile.get(k),
-                     ff->fname);
-                  return false;       /* reject file */
-               }
-               return true;           /* accept file */
+         if (wild_match(ff, &m->wildfile, &fo->wildfile, ff->fname, fnm_flags)) {
+            if (ff->flags & FO_EXCLUDE) {
+               Dmsg1(dbglvl, "Exclude wildfile: file=%s\n", ff->fname);
+               return false;       /* reject file */
             }
+            return true;           /* accept file */
          }
 
-         for (k=0; k<fo->wildbase.size(); k++) {
-            if (match_func((char *)fo->wildbase.get(k), basename, fnmode|fnm_flags) == 0) {
-               if (ff->flags & FO_EXCLUDE) {
-                  Dmsg2(dbglvl, "Exclude wildbase: %s file=%s\n", (char *)fo->wildbase.get(k),
-                     basename);
-                  return false;       /* reject file */
-               }
-               return true;           /* accept file */
+         if (wild_match(ff, &m->wildbase, &fo->wildbase, basename, fnm_flags)) {
+            if (ff->flags & FO_EXCLUDE) {
+               Dmsg1(dbglvl, "Exclude wildbase: file=%s\n", basename);
+               return false;       /* reject file */
             }
+            return true;           /* accept file */
          }
       }
-      for (k=0; k<fo->wild.size(); k++) {
-         if (match_func((char *)fo->wild.get(k), ff->fname, fnmode|fnm_flags) == 0) {
-            if (ff->flags & FO_EXCLUDE) {
-               Dmsg2(dbglvl, "Exclude wild: %s file=%s\n", (char *)fo->wild.get(k),
-                  ff->fname);
-               return false;          /* reject file */
-            }
-            return true;              /* accept file */
+      if (wild_match(ff, &m->wild, &fo->wild, ff->fname, fnm_flags)) {
+         if (ff->flags & FO_EXCLUDE) {
+            Dmsg1(dbglvl, "Exclude wild: file=%s\n", ff->fname);
+            return false;          /* reject file */
          }
+         return true;              /* accept file */
       }
       if (S_ISDIR(ff->statp.st_mode)) {
-         for (k=0; k<fo->regexdir.size(); k++) {
-            const int nmatch = 30;
-            regmatch_t pmatch[nmatch];
-            if (regexec((regex_t *)fo->regexdir.get(k), ff->fname, nmatch, pmatch,  0) == 0) {
-               if (ff->flags & FO_EXCLUDE) {
-                  return false;       /* reject file */
-               }
-               return true;           /* accept file */
+         if (regex_match(ff, m->regexdir, &fo->regexdir, ff->fname)) {
+            if (ff->flags & FO_EXCLUDE) {
+               return false;       /* reject file */
             }
+            return true;           /* accept file */
          }
       } else {
-         for (k=0; k<fo->regexfile.size(); k++) {
-            const int nmatch = 30;
-            regmatch_t pmatch[nmatch];
-            if (regexec((regex_t *)fo->regexfile.get(k), ff->fname, nmatch, pmatch,  0) == 0) {
-               if (ff->flags & FO_EXCLUDE) {
-                  return false;       /* reject file */
-               }
-               return true;           /* accept file */
+         if (regex_match(ff, m->regexfile, &fo->regexfile, ff->fname)) {
+            if (ff->flags & FO_EXCLUDE) {
+               return false;       /* reject file */
             }
+            return true;           /* accept file */
          }
       }
-      for (k=0; k<fo->regex.size(); k++) {
-         const int nmatch = 30;
-         regmatch_t pmatch[nmatch];
-         if (regexec((regex_t *)fo->regex.get(k), ff->fname, nmatch, pmatch,  0) == 0) {
-            if (ff->flags & FO_EXCLUDE) {
-               return false;          /* reject file */
-            }
-            return true;              /* accept file */
+      if (regex_match(ff, m->regex, &fo->regex, ff->fname)) {
+         if (ff->flags & FO_EXCLUDE) {
+            return false;          /* reject file */
          }
+         return true;              /* accept file */
       }
       /*
        * If we have an empty Options clause with exclude, then
@@ -398,11 +615,10 @@ bool accept_file(FF_PKT *ff)
       for (j=0; j<incexe->opts_list.size(); j++) {
          findFOPTS *fo = (findFOPTS *)incexe->opts_list.get(j);
          fnm_flags = (fo->flags & FO_IGNORECASE) ? FNM_CASEFOLD : 0;
-         for (k=0; k<fo->wild.size(); k++) {
-            if (fnmatch((char *)fo->wild.get(k), ff->fname, fnmode|fnm_flags) == 0) {
-               Dmsg1(dbglvl, "Reject wild1: %s\n", ff->fname);
-               return false;          /* reject file */
-            }
+         m = get_matcher(fo);
+         if (wild_match(ff, &m->wild, &fo->wild, ff->fname, fnmode|fnm_flags)) {
+            Dmsg1(dbglvl, "Reject wild1: %s\n", ff->fname);
+            return false;          /* reject file */
          }
       }
       /* FIXME: I don't think we can set Options{} inside an Exclude{}, so it is
@@ -412,13 +628,9 @@ bool accept_file(FF_PKT *ff)
        */
       fnm_flags = (incexe->current_opts != NULL && incexe->current_opts->flags & FO_IGNORECASE)
              ? FNM_CASEFOLD : 0;
-      dlistString *node;
-      foreach_dlist(node, &incexe->name_list) {
-         char *fname = node->c_str();
-         if (fnmatch(fname, ff->fname, fnmode|fnm_flags) == 0) {
-            Dmsg1(dbglvl, "Reject wild2: %s\n", ff->fname);
-            return false;          /* reject file */
-         }
+      if (exclude_name_match(ff, incexe, fnmode|fnm_flags)) {
+         Dmsg1(dbglvl, "Reject wild2: %s\n", ff->fname);
+         return false;          /* reject file */
       }
    }
    return true;
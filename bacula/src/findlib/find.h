@@ -58,6 +58,10 @@ struct utimbuf {
 #include <regex.h>
 #endif
 
+#include "lib/matchset.h"
+#include "dir_reader.h"
+#include "restore_dirs.h"
+
 /* For options FO_xxx values see src/fileopts.h */
 
 struct s_included_file {
@@ -93,6 +97,21 @@ enum {
    state_error
 };
 
+/*
+ * The patterns of an Options block compiled for accept_file(), the
+ *  wild cards are added when the first file is checked, the regexes
+ *  when they are added to the block, see add_regex_to_matcher()
+ */
+struct fopts_matcher {
+   wild_set *wild;
+   wild_set *wilddir;
+   wild_set *wildfile;
+   wild_set *wildbase;
+   regex_set *regex;
+   regex_set *regexdir;
+   regex_set *regexfile;
+};
+
 /* File options structure */
 struct findFOPTS {
    uint64_t flags;                    /* options in bits */
@@ -100,6 +119,10 @@ struct findFOPTS {
    int Compress_level;                /* compression level */
    int Dedup_level;                   /* dedup level 0=None, 1=Global, 2=Client */
    int strip_path;                    /* strip path count */
+   int walker_threads;                /* parallel directory walker threads */
+   int read_ahead_depth;              /* reads in flight, see read_ahead.c */
+   int32_t read_ahead_size;           /* size of the reads */
+   int prefetch_files;                /* next files to prefetch */
    char VerifyOpts[MAX_FOPTS];        /* verify options */
    char AccurateOpts[MAX_FOPTS];      /* accurate mode options */
    char BaseJobOpts[MAX_FOPTS];       /* basejob mode options */
@@ -114,6 +137,7 @@ struct findFOPTS {
    alist base;                        /* list of base names */
    alist fstype;                      /* file system type limitation */
    alist drivetype;                   /* drive type limitation */
+   fopts_matcher *matcher;            /* compiled patterns, NULL if none */
 };
 
 
@@ -125,6 +149,7 @@ struct findINCEXE {
    dlist plugin_list;                 /* plugin list -- holds dlistString */
    char *ignoredir;                   /* ignore directories with this file */
    bool  list_drives;                 /* list drives on win32 (File=/) */
+   wild_set *name_set;                /* compiled name_list of an Exclude */
 };
 
 /*
@@ -144,6 +169,25 @@ struct HFSPLUS_INFO {
    off_t rsrclength;                  /* Size of resource fork */
 };
 
+/* Walker threads of an estimate when the FileSet does not ask more */
+#define ESTIMATE_WALKER_THREADS 4
+
+class dir_walker;
+class read_ahead;
+struct walk_dir;
+class dir_reader;
+struct dir_reader_entry;
+
+/*
+ * An entry of a directory read ahead by the walker threads
+ */
+struct walk_entry {
+   char *name;                        /* file name in the directory */
+   struct stat statp;                 /* lstat() of the file */
+   int stat_errno;                    /* errno if lstat() failed */
+   struct walk_dir *subdir;           /* read ahead of this subdirectory */
+};
+
 /*
  * Definition of the find_files packet passed as the
  * first argument to the find_files callback subroutine.
@@ -178,7 +222,7 @@ struct FF_PKT {
    int32_t object_index;              /* Object index */
    int32_t object_len;                /* Object length */
    int32_t object_compression;        /* Type of compression for object */
-   struct f_link *linked;             /* Set if this file is hard linked */
+   link_entry *linked;                /* Set if this file is hard linked */
    int type;                          /* FT_ type from above */
    int ff_errno;                      /* errno */
    BFILE bfd;                         /* Bacula file descriptor */
@@ -205,8 +249,16 @@ struct FF_PKT {
    int Compress_level;                /* compression level */
    int Dedup_level;                   /* dedup level 0=None, 1=Global, 2=Client */
    int strip_path;                    /* strip path count */
+   int walker_threads;                /* walker threads for the current Include */
+   int read_ahead_depth;              /* read ahead for the current Include */
+   int32_t read_ahead_size;
+   int prefetch_files;
+   bool inode_order;                  /* read directories in inode order */
+   bool name_order;                   /* walk in the order of the accurate list */
    bool cmd_plugin;                   /* set if we have a command plugin */
    bool opt_plugin;                   /* set if we have an option plugin */
+   bool legacy_match;                 /* match the patterns one by one (testfind) */
+   bool stat_only;                    /* estimate, only the attributes are used */
    rblist *mtab_list;                 /* List of mtab entries */
    uint64_t last_fstype;              /* cache last file system type */
    char last_fstypename[32];          /* cache last file system type name */
@@ -215,7 +267,19 @@ struct FF_PKT {
    alist mount_points;                /* Possible mount points to be snapshotted */
 
    /* List of all hard linked files found */
-   struct f_link **linkhash;          /* hard linked files */
+   linktab *linkhash;                 /* hard linked files */
+   bool link_release;                 /* each file is found once, see find_files() */
+
+   /* Parallel directory walker, see walker.c */
+   dir_walker *walker;                /* walker threads, NULL if not used */
+   struct walk_entry *walk_entry;     /* lstat() of the next file done by the walker */
+
+   /* Asynchronous read ahead of the files, see read_ahead.c */
+   read_ahead *ra;                    /* NULL if not used */
+
+   /* Directory of the next file, see dir_reader.c */
+   dir_reader *at_dir;                /* open parent directory */
+   struct dir_reader_entry *at_entry; /* the file in at_dir */
 
    /* Darwin specific things.
     * To avoid clutter, we always include rsrc_bfd and volhas_attrlist */
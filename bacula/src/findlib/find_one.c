@@ -40,43 +40,6 @@ int breaddir(DIR *dirp, POOLMEM *&d_name);
 extern int32_t name_max;              /* filename max length */
 extern int32_t path_max;              /* path name max length */
 
-/*
- * Structure for keeping track of hard linked files, we
- *   keep an entry for each hardlinked file that we save,
- *   which is the first one found. For all the other files that
- *   are linked to this one, we save only the directory
- *   entry so we can link it.
- */
-struct f_link {
-    struct f_link *next;
-    dev_t dev;                        /* device */
-    ino_t ino;                        /* inode with device is unique */
-    int32_t FileIndex;                /* Bacula FileIndex of this file */
-    int32_t digest_stream;            /* Digest type if needed */
-    uint32_t digest_len;              /* Digest len if needed */
-    char *digest;                     /* Checksum of the file if needed */
-    char name[1];                     /* The name */
-};
-
-typedef struct f_link link_t;
-#define LINK_HASHTABLE_BITS 16
-#define LINK_HASHTABLE_SIZE (1<<LINK_HASHTABLE_BITS)
-#define LINK_HASHTABLE_MASK (LINK_HASHTABLE_SIZE-1)
-
-static inline int LINKHASH(const struct stat &info)
-{
-    int hash = info.st_dev;
-    unsigned long long i = info.st_ino;
-    hash ^= i;
-    i >>= 16;
-    hash ^= i;
-    i >>= 16;
-    hash ^= i;
-    i >>= 16;
-    hash ^= i;
-    return hash & LINK_HASHTABLE_MASK;
-}
-
 /*
  * Create a new directory Find File packet, but copy
  *   some of the essential info from the current packet.
@@ -107,6 +70,11 @@ static FF_PKT *new_dir_ff_pkt(FF_PKT *ff_pkt)
    dir_ff_pkt->excluded_paths_list = NULL;
    dir_ff_pkt->linkhash = NULL;
    dir_ff_pkt->ignoredir_fname = NULL;
+   dir_ff_pkt->walker = NULL;
+   dir_ff_pkt->walk_entry = NULL;
+   dir_ff_pkt->ra = NULL;
+   dir_ff_pkt->at_dir = NULL;
+   dir_ff_pkt->at_entry = NULL;
    return dir_ff_pkt;
 }
 
@@ -342,11 +310,8 @@ void
 ff_pkt_set_link_digest(FF_PKT *ff_pkt,
                        int32_t digest_stream, const char *digest, uint32_t len)
 {
-   if (ff_pkt->linked && !ff_pkt->linked->digest) {     /* is a hardlink */
-      ff_pkt->linked->digest = (char *) bmalloc(len);
-      memcpy(ff_pkt->linked->digest, digest, len);
-      ff_pkt->linked->digest_len = len;
-      ff_pkt->linked->digest_stream = digest_stream;
+   if (ff_pkt->linked) {                                /* is a hardlink */
+      ff_pkt->linkhash->set_digest(ff_pkt->linked, digest_stream, digest, len);
    }
 }
 
@@ -365,12 +330,47 @@ find_one_file(JCR *jcr, FF_PKT *ff_pkt,
 {
    struct utimbuf restore_times;
    int rtn_stat;
-   int len;
+   walk_entry *entry = ff_pkt->walk_entry;   /* set if found by the walker */
+#ifdef HAVE_DIR_READER
+   dir_reader directory;                     /* if we descend into this file */
+   dir_reader *at_dir = ff_pkt->at_dir;      /* set if found by our parent */
+   dir_reader_entry *at_entry = ff_pkt->at_entry;
+   int rc;
+
+   ff_pkt->at_dir = NULL;
+   ff_pkt->at_entry = NULL;
+#endif
 
    ff_pkt->fname = ff_pkt->link = fname;
    ff_pkt->snap_fname = snap_fname;
+   ff_pkt->walk_entry = NULL;
+
+   if (entry) {
+      /* The walker threads already did the lstat() */
+      if (entry->stat_errno != 0) {
+         ff_pkt->type = FT_NOSTAT;
+         ff_pkt->ff_errno = entry->stat_errno;
+         return handle_file(jcr, ff_pkt, top_level);
+      }
+      memcpy(&ff_pkt->statp, &entry->statp, sizeof(struct stat));
+
+#ifdef HAVE_DIR_READER
+   } else if (at_dir) {
+      /*
+       * Look the file up in the parent directory fd. A directory is
+       *  opened only when we descend into it (below), not when it is
+       *  excluded or on an other filesystem (an autofs mount point
+       *  would be mounted by the open).
+       */
+      rc = fstatat(at_dir->fd(), at_entry->name, &ff_pkt->statp, AT_SYMLINK_NOFOLLOW);
+      if (rc != 0) {
+         ff_pkt->type = FT_NOSTAT;
+         ff_pkt->ff_errno = errno;
+         return handle_file(jcr, ff_pkt, top_level);
+      }
+#endif
 
-   if (lstat(snap_fname, &ff_pkt->statp) != 0) {
+   } else if (lstat(snap_fname, &ff_pkt->statp) != 0) {
        /* Cannot stat file */
        ff_pkt->type = FT_NOSTAT;
        ff_pkt->ff_errno = errno;
@@ -479,47 +479,43 @@ find_one_file(JCR *jcr, FF_PKT *ff_pkt,
            || S_ISFIFO(ff_pkt->statp.st_mode)
            || S_ISSOCK(ff_pkt->statp.st_mode))) {
 
-       struct f_link *lp;
+       link_entry *lp;
        if (ff_pkt->linkhash == NULL) {
-           ff_pkt->linkhash = (link_t **)bmalloc(LINK_HASHTABLE_SIZE * sizeof(link_t *));
-           memset(ff_pkt->linkhash, 0, LINK_HASHTABLE_SIZE * sizeof(link_t *));
+           ff_pkt->linkhash = New(linktab());
+       }
+
+      /* Search the table of hard linked files */
+       lp = ff_pkt->linkhash->lookup(ff_pkt->statp.st_dev, ff_pkt->statp.st_ino);
+       if (lp) {
+          /* If we have already backed up the hard linked file don't do it again */
+          if (strcmp(lp->name, fname) == 0) {
+             Dmsg2(400, "== Name identical skip FI=%d file=%s\n", lp->FileIndex, fname);
+             return 1;             /* ignore */
+          }
+          ff_pkt->link = lp->name;
+          ff_pkt->type = FT_LNKSAVED;       /* Handle link, file already saved */
+          ff_pkt->LinkFI = lp->FileIndex;
+          ff_pkt->linked = 0;
+          ff_pkt->digest = lp->digest;
+          ff_pkt->digest_stream = lp->digest_stream;
+          ff_pkt->digest_len = lp->digest_len;
+          rtn_stat = handle_file(jcr, ff_pkt, top_level);
+          Dmsg3(400, "FT_LNKSAVED FI=%d LinkFI=%d file=%s\n",
+             ff_pkt->FileIndex, lp->FileIndex, lp->name);
+          /* All the links were found, the inode will not be seen again
+           * unless the walk can cross into another file system
+           */
+          if (ff_pkt->linkhash->all_seen(lp, ff_pkt->statp.st_nlink) &&
+              ff_pkt->link_release && !(ff_pkt->flags & FO_MULTIFS)) {
+             ff_pkt->link = ff_pkt->fname;
+             ff_pkt->digest = NULL;
+             ff_pkt->linkhash->remove(lp);
+          }
+          return rtn_stat;
        }
-       const int linkhash = LINKHASH(ff_pkt->statp);
-
-      /* Search link list of hard linked files */
-       for (lp = ff_pkt->linkhash[linkhash]; lp; lp = lp->next)
-         if (lp->ino == (ino_t)ff_pkt->statp.st_ino &&
-             lp->dev == (dev_t)ff_pkt->statp.st_dev) {
-             /* If we have already backed up the hard linked file don't do it again */
-             if (strcmp(lp->name, fname) == 0) {
-                Dmsg2(400, "== Name identical skip FI=%d file=%s\n", lp->FileIndex, fname);
-                return 1;             /* ignore */
-             }
-             ff_pkt->link = lp->name;
-             ff_pkt->type = FT_LNKSAVED;       /* Handle link, file already saved */
-             ff_pkt->LinkFI = lp->FileIndex;
-             ff_pkt->linked = 0;
-             ff_pkt->digest = lp->digest;
-             ff_pkt->digest_stream = lp->digest_stream;
-             ff_pkt->digest_len = lp->digest_len;
-             rtn_stat = handle_file(jcr, ff_pkt, top_level);
-             Dmsg3(400, "FT_LNKSAVED FI=%d LinkFI=%d file=%s\n",
-                ff_pkt->FileIndex, lp->FileIndex, lp->name);
-             return rtn_stat;
-         }
 
-      /* File not previously dumped. Chain it into our list. */
-      len = strlen(fname) + 1;
-      lp = (struct f_link *)bmalloc(sizeof(struct f_link) + len);
-      lp->digest = NULL;                /* set later */
-      lp->digest_stream = 0;            /* set later */
-      lp->digest_len = 0;               /* set later */
-      lp->ino = ff_pkt->statp.st_ino;
-      lp->dev = ff_pkt->statp.st_dev;
-      lp->FileIndex = 0;                  /* set later */
-      bstrncpy(lp->name, fname, len);
-      lp->next = ff_pkt->linkhash[linkhash];
-      ff_pkt->linkhash[linkhash] = lp;
+      /* File not previously dumped. Add it to the table. */
+      lp = ff_pkt->linkhash->add(ff_pkt->statp.st_dev, ff_pkt->statp.st_ino, fname);
       ff_pkt->linked = lp;            /* mark saved link */
       Dmsg2(400, "added to hash FI=%d file=%s\n", ff_pkt->FileIndex, lp->name);
    } else {
@@ -556,6 +552,11 @@ find_one_file(JCR *jcr, FF_PKT *ff_pkt,
       int size;
       char *buffer = (char *)alloca(path_max + name_max + 102);
 
+#ifdef HAVE_DIR_READER
+      if (at_dir) {
+         size = readlinkat(at_dir->fd(), at_entry->name, buffer, path_max + name_max + 101);
+      } else
+#endif
       size = readlink(snap_fname, buffer, path_max + name_max + 101);
       if (size < 0) {
          /* Could not follow link */
@@ -577,12 +578,18 @@ find_one_file(JCR *jcr, FF_PKT *ff_pkt,
       return rtn_stat;
 
    } else if (S_ISDIR(ff_pkt->statp.st_mode)) {
-      DIR *directory;
+#ifdef HAVE_DIR_READER
+      dir_reader_entry de;
+#else
+      DIR *directory = NULL;
       POOL_MEM dname(PM_FNAME);
+      int status;
+#endif
+      walk_dir *wd = NULL;
+      bool opened;
       char *link;
       int link_len;
       int len;
-      int status;
       dev_t our_device = ff_pkt->statp.st_dev;
       bool recurse = true;
       bool volhas_attrlist = ff_pkt->volhas_attrlist;    /* Remember this if we recurse */
@@ -746,7 +753,25 @@ find_one_file(JCR *jcr, FF_PKT *ff_pkt,
        *   all the files in it.
        */
       errno = 0;
-      if ((directory = opendir(snap_fname)) == NULL) {
+      if (ff_pkt->walker) {
+         wd = walker_open_dir(ff_pkt->walker, entry, snap_fname, our_device);
+         opened = wd != NULL;
+      } else {
+#ifdef HAVE_DIR_READER
+         /* Opened relative to the parent directory fd when we have it */
+         if (at_dir) {
+            directory.open(at_dir->fd(), at_entry->name);
+         } else {
+            directory.open(AT_FDCWD, snap_fname);
+         }
+         opened = directory.is_open() &&
+            directory.start(ff_pkt->inode_order, ff_pkt->name_order);
+#else
+         directory = opendir(snap_fname);
+         opened = directory != NULL;
+#endif
+      }
+      if (!opened) {
          ff_pkt->type = FT_NOOPEN;
          ff_pkt->ff_errno = errno;
          rtn_stat = handle_file(jcr, ff_pkt, top_level);
@@ -772,28 +797,46 @@ find_one_file(JCR *jcr, FF_PKT *ff_pkt,
 
       /*
        * Process all files in this directory entry (recursing).
-       *    This would possibly run faster if we chdir to the directory
-       *    before traversing it.
+       *    When we have the dir_reader, the files are looked up
+       *    relative to the directory fd rather than by full path.
        */
       rtn_stat = 1;
       while (!job_canceled(jcr)) {
          char *p, *q, *s;
          int l;
          int i;
+         walk_entry *went = NULL;
 
-         status = breaddir(directory, dname.addr());
-         if (status != 0) {
-            /* error or end of directory */
-//          Dmsg1(99, "breaddir returned stat=%d\n", status);
-            break;
+         if (wd) {
+            if ((went = walker_next_entry(wd)) == NULL) {
+               break;                 /* end of directory */
+            }
+            if (ff_pkt->ra && ff_pkt->prefetch_files > 0) {
+               walker_prefetch(wd, ff_pkt);
+            }
+            p = went->name;
+         } else {
+#ifdef HAVE_DIR_READER
+            if (!directory.next(&de)) {
+               break;                 /* error or end of directory */
+            }
+            p = de.name;
+#else
+            status = breaddir(directory, dname.addr());
+            if (status != 0) {
+               /* error or end of directory */
+//             Dmsg1(99, "breaddir returned stat=%d\n", status);
+               break;
+            }
+            p = dname.c_str();
+#endif
          }
-         p = dname.c_str();
          /* Skip `.', `..', and excluded file names.  */
          if (p[0] == '\0' || (p[0] == '.' && (p[1] == '\0' ||
              (p[1] == '.' && p[2] == '\0')))) {
             continue;
          }
-         l = strlen(dname.c_str());
+         l = strlen(p);
          if (l + len >= link_len) {
              link_len = len + l + 1;
              link = (char *)brealloc(link, link_len + 1);
@@ -810,6 +853,13 @@ find_one_file(JCR *jcr, FF_PKT *ff_pkt,
          }
          *q = *s = 0;
          if (!file_is_excluded(ff_pkt, link)) {
+            ff_pkt->walk_entry = went;
+#ifdef HAVE_DIR_READER
+            if (!wd) {
+               ff_pkt->at_dir = &directory;
+               ff_pkt->at_entry = &de;
+            }
+#endif
             rtn_stat = find_one_file(jcr, ff_pkt, handle_file, link, snap_link, our_device, false);
             if (ff_pkt->linked) {
                ff_pkt->linked->FileIndex = ff_pkt->FileIndex;
@@ -817,7 +867,15 @@ find_one_file(JCR *jcr, FF_PKT *ff_pkt,
          }
 
       }
-      closedir(directory);
+      if (wd) {
+         walker_close_dir(ff_pkt->walker, wd);
+      } else {
+#ifdef HAVE_DIR_READER
+         directory.close();
+#else
+         closedir(directory);
+#endif
+      }
       free(link);
       free(snap_link);
 
@@ -875,30 +933,15 @@ find_one_file(JCR *jcr, FF_PKT *ff_pkt,
 
 int term_find_one(FF_PKT *ff)
 {
-   struct f_link *lp, *lc;
-   int count = 0;
-   int i;
-
+   int count;
 
    if (ff->linkhash == NULL) return 0;
 
-   for (i =0 ; i < LINK_HASHTABLE_SIZE; i ++) {
-   /* Free up list of hard linked files */
-      lp = ff->linkhash[i];
-      while (lp) {
-         lc = lp;
-         lp = lp->next;
-         if (lc) {
-            if (lc->digest) {
-               free(lc->digest);
-            }
-            free(lc);
-            count++;
-         }
-      }
-      ff->linkhash[i] = NULL;
-   }
-   free(ff->linkhash);
+   /* Free up the table of hard linked files */
+   count = ff->linkhash->total();
+   Dmsg3(100, "Hard links: inodes=%d left=%d max_mem=%lld\n", count,
+         ff->linkhash->size(), ff->linkhash->max_mem_size());
+   delete ff->linkhash;
    ff->linkhash = NULL;
    return count;
 }
@@ -189,6 +189,28 @@ void add_fname_to_include_list(FF_PKT *ff, int prefixed, const char *fname)
                inc->algo = COMPRESS_LZO1X;
                inc->Compress_level = 1; /* not used with LZO */
             }
+            else if (*rp == 'l') {  /* Zl<acceleration>: lz4 */
+               rp++;
+               inc->options |= FO_COMPRESS;
+               inc->algo = COMPRESS_LZ4;
+               inc->Compress_level = atoi(rp);
+               while (*rp && *rp != ':') {
+                  rp++;
+               }
+            }
+            else if (*rp == 's') {  /* Zs[l]<level>: zstd */
+               rp++;
+               if (*rp == 'l') {
+                  inc->options |= FO_COMPRESS_LONG;
+                  rp++;
+               }
+               inc->options |= FO_COMPRESS;
+               inc->algo = COMPRESS_ZSTD;
+               inc->Compress_level = atoi(rp);
+               while (*rp && *rp != ':') {
+                  rp++;
+               }
+            }
             Dmsg2(200, "Compression alg=%d level=%d\n", inc->algo, inc->Compress_level);
             break;
          case 'd':                 /* Deduplication 0=none 1=Global 2=Local */
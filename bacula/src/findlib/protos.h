@@ -46,6 +46,9 @@ int   match_files(JCR *jcr, FF_PKT *ff, int sub(JCR *, FF_PKT *ff_pkt, bool));
 int   term_find_files(FF_PKT *ff);
 bool  is_in_fileset(FF_PKT *ff);
 bool accept_file(FF_PKT *ff);
+void add_regex_to_matcher(findFOPTS *fo, int type, const char *pattern, int cflags,
+                          regex_t *preg);
+void free_fopts_matcher(findFOPTS *fo);
 
 /* From match.c */
 void  init_include_exclude_files(FF_PKT *ff);
@@ -67,6 +70,26 @@ bool check_changes(JCR *jcr, FF_PKT *ff_pkt);
 void ff_pkt_set_link_digest(FF_PKT *ff_pkt,
                             int32_t digest_stream, const char *digest, uint32_t len);
 
+/* From walker.c */
+dir_walker *new_dir_walker(JCR *jcr, int nb_threads, bool inode_order,
+                           bool name_order, bool stat_only);
+void  free_dir_walker(dir_walker *walker);
+struct walk_dir *walker_open_dir(dir_walker *walker, struct walk_entry *entry,
+                                 const char *snap_fname, dev_t dev);
+struct walk_entry *walker_next_entry(struct walk_dir *wd);
+void  walker_close_dir(dir_walker *walker, struct walk_dir *wd);
+void  walker_prefetch(struct walk_dir *wd, FF_PKT *ff_pkt);
+
+/* From read_ahead.c */
+read_ahead *new_read_ahead(JCR *jcr, int depth, int32_t read_size, int prefetch_files);
+void  free_read_ahead(read_ahead *ra);
+bool  read_ahead_uses_io_uring(read_ahead *ra);
+bool  bread_ahead_attach(BFILE *bfd, read_ahead *ra, boffset_t size);
+void  bread_ahead_detach(BFILE *bfd);
+ssize_t bread_ahead(BFILE *bfd, void *buf, size_t count);
+boffset_t blseek_ahead(BFILE *bfd, boffset_t offset, int whence);
+void  read_ahead_prefetch(read_ahead *ra, const char *fname, boffset_t size);
+
 /* From get_priv.c */
 int enable_backup_privileges(JCR *jcr, int ignore_errors);
 
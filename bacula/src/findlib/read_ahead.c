@@ -0,0 +1,784 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+*/
+/*
+ *  Asynchronous read ahead of the files being saved
+ *
+ *  Without it, bread() waits for each read of jcr->buf_size bytes,
+ *  on high latency storage (NFS, Ceph, ...) most of the time is
+ *  spent waiting. With the ReadAhead FileSet option, a read_ahead
+ *  engine is attached to the BFILE after bopen(): it keeps up to
+ *  ReadAhead reads of ReadAheadSize bytes in flight on the file,
+ *  and bread() copies the data from the buffers as they complete.
+ *
+ *  The reads are done with io_uring when the kernel supports it,
+ *  else by helper threads with pread(). bread() returns exactly
+ *  what read() would return, and blseek() restarts the reads at
+ *  the new position.
+ *
+ *  With the PrefetchFiles option and the directory walker, the
+ *  helper thread also asks the kernel to read the start of the next
+ *  files of the directory before the job thread opens them.
+ *
+ *  An engine is used by one file at a time, it is created by
+ *  find_files() for each Include and used by the job thread only.
+ */
+
+#include "bacula.h"
+#include "find.h"
+
+#ifndef HAVE_WIN32
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+static const int dbglvl = 450;
+
+/* Limits of the FileSet options */
+#define RA_MAX_DEPTH     64
+#define RA_MIN_SIZE      (4 * 1024)
+#define RA_MAX_SIZE      (64 * 1024 * 1024)
+#define RA_DEFAULT_SIZE  (1024 * 1024)
+
+/* Helper threads when io_uring is not available */
+#define RA_MAX_THREADS   4
+
+enum {
+   RA_FREE,                           /* not used */
+   RA_QUEUED,                         /* waiting for a helper thread */
+   RA_RUNNING,                        /* read in progress */
+   RA_DONE                            /* data ready */
+};
+
+/* A read of the file */
+struct ra_buf {
+   char *data;
+   boffset_t offset;                  /* file offset of the data */
+   int32_t len;                       /* bytes read, -1 on error */
+   int error;                         /* errno of the read */
+   int state;
+#ifdef HAVE_IO_URING
+   struct iovec iov;
+#endif
+};
+
+/* A file to prefetch */
+struct ra_prefetch {
+   dlink link;
+   boffset_t size;
+   char fname[1];
+};
+
+#ifdef HAVE_IO_URING
+/* The io_uring rings, mapped from the kernel */
+struct ra_uring {
+   int fd;
+   void *sq_ring;
+   size_t sq_ring_size;
+   void *cq_ring;
+   size_t cq_ring_size;
+   struct io_uring_sqe *sqes;
+   size_t sqes_size;
+   unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+   unsigned *cq_head, *cq_tail, *cq_mask;
+   struct io_uring_cqe *cqes;
+};
+#endif
+
+class read_ahead: public SMARTALLOC {
+public:
+   JCR *jcr;
+   pthread_mutex_t mutex;
+   pthread_cond_t work;               /* helper threads wait for work */
+   pthread_cond_t done;               /* bread() waits for a read */
+   ra_buf *bufs;                      /* ring of reads */
+   int depth;
+   int32_t read_size;
+   BFILE *bfd;                        /* attached file, NULL if none */
+   int fd;
+   boffset_t size;                    /* size of the file from stat() */
+   int head;                          /* buffer with the next data */
+   int nb_used;                       /* buffers not free from head */
+   int32_t head_pos;                  /* position in the head buffer */
+   boffset_t next_offset;             /* offset of the next read to start */
+   bool eof;
+   dlist *prefetch;                   /* files to prefetch */
+   int nb_prefetch;
+   int max_prefetch;
+   pthread_t *tids;
+   int nb_threads;
+   bool quit;
+#ifdef HAVE_IO_URING
+   ra_uring *ring;                    /* NULL if io_uring is not used */
+#endif
+   uint64_t nb_reads;                 /* reads done */
+   uint64_t nb_waits;                 /* times bread() had to wait */
+   uint64_t nb_prefetched;            /* files prefetched */
+};
+
+#ifdef HAVE_IO_URING
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+   return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                              unsigned flags)
+{
+   return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                       NULL, 0);
+}
+
+static void free_uring(ra_uring *r)
+{
+   if (r->sqes && r->sqes != MAP_FAILED) {
+      munmap(r->sqes, r->sqes_size);
+   }
+   if (r->cq_ring && r->cq_ring != MAP_FAILED && r->cq_ring != r->sq_ring) {
+      munmap(r->cq_ring, r->cq_ring_size);
+   }
+   if (r->sq_ring && r->sq_ring != MAP_FAILED) {
+      munmap(r->sq_ring, r->sq_ring_size);
+   }
+   if (r->fd >= 0) {
+      close(r->fd);
+   }
+   free(r);
+}
+
+/*
+ * Setup an io_uring with depth entries, NULL if the kernel does
+ *  not support it or does not allow it.
+ */
+static ra_uring *new_uring(int depth)
+{
+   struct io_uring_params p;
+   ra_uring *r = (ra_uring *)bmalloc(sizeof(ra_uring));
+   char *sq, *cq;
+
+   memset(r, 0, sizeof(ra_uring));
+   memset(&p, 0, sizeof(p));
+   r->fd = sys_io_uring_setup(depth, &p);
+   if (r->fd < 0) {
+      Dmsg1(dbglvl, "io_uring_setup failed errno=%d\n", errno);
+      free(r);
+      return NULL;
+   }
+   r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+   r->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+   if (p.features & IORING_FEAT_SINGLE_MMAP) {
+      r->sq_ring_size = r->cq_ring_size = MAX(r->sq_ring_size, r->cq_ring_size);
+   }
+   r->sq_ring = mmap(NULL, r->sq_ring_size, PROT_READ|PROT_WRITE,
+                     MAP_SHARED|MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+   if (r->sq_ring == MAP_FAILED) {
+      goto bail_out;
+   }
+   if (p.features & IORING_FEAT_SINGLE_MMAP) {
+      r->cq_ring = r->sq_ring;
+   } else {
+      r->cq_ring = mmap(NULL, r->cq_ring_size, PROT_READ|PROT_WRITE,
+                        MAP_SHARED|MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+      if (r->cq_ring == MAP_FAILED) {
+         goto bail_out;
+      }
+   }
+   r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+   r->sqes = (struct io_uring_sqe *)mmap(NULL, r->sqes_size, PROT_READ|PROT_WRITE,
+                     MAP_SHARED|MAP_POPULATE, r->fd, IORING_OFF_SQES);
+   if (r->sqes == MAP_FAILED) {
+      goto bail_out;
+   }
+   sq = (char *)r->sq_ring;
+   cq = (char *)r->cq_ring;
+   r->sq_head = (unsigned *)(sq + p.sq_off.head);
+   r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+   r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+   r->sq_array = (unsigned *)(sq + p.sq_off.array);
+   r->cq_head = (unsigned *)(cq + p.cq_off.head);
+   r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+   r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+   r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+   return r;
+
+bail_out:
+   Dmsg1(dbglvl, "io_uring mmap failed errno=%d\n", errno);
+   free_uring(r);
+   return NULL;
+}
+
+/* Start a read with io_uring, false if it cannot be queued */
+static bool uring_submit(read_ahead *ra, int idx)
+{
+   ra_uring *r = ra->ring;
+   ra_buf *b = &ra->bufs[idx];
+   unsigned tail = *r->sq_tail;
+   unsigned i = tail & *r->sq_mask;
+   struct io_uring_sqe *sqe = &r->sqes[i];
+   int stat;
+
+   b->iov.iov_base = b->data;
+   b->iov.iov_len = ra->read_size;
+   memset(sqe, 0, sizeof(*sqe));
+   sqe->opcode = IORING_OP_READV;
+   sqe->fd = ra->fd;
+   sqe->off = b->offset;
+   sqe->addr = (uint64_t)(intptr_t)&b->iov;
+   sqe->len = 1;
+   sqe->user_data = idx;
+   r->sq_array[i] = i;
+   __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+   do {
+      stat = sys_io_uring_enter(r->fd, 1, 0, 0);
+   } while (stat < 0 && errno == EINTR);
+   if (stat != 1) {
+      /* Not consumed by the kernel, take it back */
+      __atomic_store_n(r->sq_tail, tail, __ATOMIC_RELEASE);
+      return false;
+   }
+   return true;
+}
+
+/*
+ * Get the completed reads, wait for one if wait is set. Called with
+ *  the mutex locked, only the job thread uses the ring.
+ *
+ * Returns 0, or the errno if the ring cannot be waited on, the
+ *  reads in flight will not complete.
+ */
+static int uring_reap(read_ahead *ra, bool wait)
+{
+   ra_uring *r = ra->ring;
+   unsigned head, tail;
+   int nb = 0;
+
+   for ( ;; ) {
+      head = *r->cq_head;
+      tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+      for ( ; head != tail; head++, nb++) {
+         struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+         ra_buf *b = &ra->bufs[cqe->user_data];
+         if (cqe->res < 0) {
+            b->len = -1;
+            b->error = -cqe->res;
+         } else {
+            b->len = cqe->res;
+            b->error = 0;
+         }
+         b->state = RA_DONE;
+         ra->nb_reads++;
+      }
+      __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+      if (nb > 0 || !wait) {
+         return 0;
+      }
+      V(ra->mutex);
+      int stat = sys_io_uring_enter(r->fd, 0, 1, IORING_ENTER_GETEVENTS);
+      int error = errno;
+      P(ra->mutex);
+      /* EAGAIN and EBUSY: the kernel is short of resources, try again */
+      if (stat < 0 && error != EINTR && error != EAGAIN && error != EBUSY) {
+         Dmsg1(dbglvl, "io_uring_enter failed errno=%d\n", error);
+         return error;
+      }
+   }
+}
+#endif /* HAVE_IO_URING */
+
+/* Read a buffer with pread() */
+static void pread_buf(read_ahead *ra, ra_buf *b)
+{
+   b->len = pread(ra->fd, b->data, ra->read_size, b->offset);
+   b->error = b->len < 0 ? errno : 0;
+}
+
+/* Read a buffer ourself. Called with the mutex locked. */
+static void sync_read(read_ahead *ra, ra_buf *b)
+{
+   pread_buf(ra, b);
+   b->state = RA_DONE;
+   ra->nb_reads++;
+}
+
+/*
+ * Start the reads for all the free buffers. Past the size of the
+ *  file, only one read is done at a time to find the end of the
+ *  file. Called with the mutex locked.
+ */
+static void submit_reads(read_ahead *ra)
+{
+   bool queued = false;
+
+   while (!ra->eof && ra->nb_used < ra->depth &&
+          (ra->next_offset < ra->size || ra->nb_used == 0)) {
+      int idx = (ra->head + ra->nb_used) % ra->depth;
+      ra_buf *b = &ra->bufs[idx];
+      b->offset = ra->next_offset;
+      b->len = 0;
+      b->error = 0;
+      ra->next_offset += ra->read_size;
+      ra->nb_used++;
+#ifdef HAVE_IO_URING
+      if (ra->ring) {
+         b->state = RA_RUNNING;
+         if (!uring_submit(ra, idx)) {
+            sync_read(ra, b);
+         }
+         continue;
+      }
+#endif
+      if (ra->nb_threads > 0) {
+         b->state = RA_QUEUED;
+         queued = true;
+      } else {
+         sync_read(ra, b);
+      }
+   }
+   if (queued) {
+      pthread_cond_broadcast(&ra->work);
+   }
+}
+
+/* Wait for a buffer to be read. Called with the mutex locked. */
+static void wait_buf(read_ahead *ra, ra_buf *b)
+{
+   if (b->state != RA_DONE) {
+      ra->nb_waits++;
+   }
+   while (b->state != RA_DONE) {
+#ifdef HAVE_IO_URING
+      if (ra->ring) {
+         int error = uring_reap(ra, true);
+         if (error) {
+            /* The read of this buffer is lost, report it as a read error */
+            b->len = -1;
+            b->error = error;
+            b->state = RA_DONE;
+            break;
+         }
+         continue;
+      }
+#endif
+      if (b->state == RA_QUEUED) {
+         /* Do not wait for a busy helper thread */
+         b->state = RA_RUNNING;
+         V(ra->mutex);
+         pread_buf(ra, b);
+         P(ra->mutex);
+         b->state = RA_DONE;
+         ra->nb_reads++;
+         break;
+      }
+      pthread_cond_wait(&ra->done, &ra->mutex);
+   }
+}
+
+/*
+ * Forget all the reads in flight, the next reads start at offset.
+ *  Called with the mutex locked.
+ */
+static void reset_reads(read_ahead *ra, boffset_t offset)
+{
+   for (int i=0; i < ra->nb_used; i++) {
+      ra_buf *b = &ra->bufs[(ra->head + i) % ra->depth];
+      if (b->state == RA_QUEUED) {
+         b->state = RA_DONE;           /* not started, just drop it */
+      } else {
+         wait_buf(ra, b);
+      }
+      b->state = RA_FREE;
+   }
+   ra->head = 0;
+   ra->nb_used = 0;
+   ra->head_pos = 0;
+   ra->next_offset = offset;
+   ra->eof = false;
+}
+
+/* Ask the kernel to read the start of a file in the page cache */
+static void prefetch_file(read_ahead *ra, ra_prefetch *pf)
+{
+#if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_WILLNEED)
+   int fd;
+   boffset_t len = MIN(pf->size, (boffset_t)ra->depth * ra->read_size);
+
+#ifdef O_NOATIME
+   fd = open(pf->fname, O_RDONLY|O_NOATIME|O_CLOEXEC);
+   if (fd < 0 && errno == EPERM) {
+      fd = open(pf->fname, O_RDONLY|O_CLOEXEC);
+   }
+#else
+   fd = open(pf->fname, O_RDONLY|O_CLOEXEC);
+#endif
+   if (fd >= 0) {
+      posix_fadvise(fd, 0, len, POSIX_FADV_WILLNEED);
+      close(fd);
+      ra->nb_prefetched++;
+   }
+#endif
+}
+
+extern "C" void *read_ahead_thread(void *arg)
+{
+   read_ahead *ra = (read_ahead *)arg;
+
+   set_jcr_in_tsd(ra->jcr);
+   P(ra->mutex);
+   for ( ;; ) {
+      ra_buf *b = NULL;
+      ra_prefetch *pf = NULL;
+
+      while (!ra->quit) {
+         for (int i=0; i < ra->nb_used; i++) {
+            ra_buf *t = &ra->bufs[(ra->head + i) % ra->depth];
+            if (t->state == RA_QUEUED) {
+               b = t;
+               break;
+            }
+         }
+         if (b || (pf = (ra_prefetch *)ra->prefetch->first()) != NULL) {
+            break;
+         }
+         pthread_cond_wait(&ra->work, &ra->mutex);
+      }
+      if (ra->quit) {
+         break;
+      }
+      if (b) {
+         b->state = RA_RUNNING;
+         V(ra->mutex);
+         pread_buf(ra, b);
+         P(ra->mutex);
+         b->state = RA_DONE;
+         ra->nb_reads++;
+         pthread_cond_broadcast(&ra->done);
+      } else {
+         ra->prefetch->remove(pf);
+         ra->nb_prefetch--;
+         V(ra->mutex);
+         prefetch_file(ra, pf);
+         free(pf);
+         P(ra->mutex);
+      }
+   }
+   V(ra->mutex);
+   return NULL;
+}
+
+/*
+ * Create a read ahead engine with depth reads of read_size bytes
+ *  in flight, and prefetch of up to prefetch_files files.
+ */
+read_ahead *new_read_ahead(JCR *jcr, int depth, int32_t read_size, int prefetch_files)
+{
+   read_ahead *ra = New(read_ahead);
+   ra_prefetch *pf = NULL;
+   int nb_threads = 0;
+   int stat;
+
+   if (read_size <= 0) {
+      read_size = RA_DEFAULT_SIZE;
+   }
+   ra->jcr = jcr;
+   ra->depth = MIN(MAX(depth, 1), RA_MAX_DEPTH);
+   ra->read_size = MIN(MAX(read_size, RA_MIN_SIZE), RA_MAX_SIZE);
+   /* The reads must be aligned for files opened with O_DIRECT */
+   ra->read_size &= ~(DIO_ALIGN - 1);
+   ra->bufs = (ra_buf *)bmalloc(ra->depth * sizeof(ra_buf));
+   memset(ra->bufs, 0, ra->depth * sizeof(ra_buf));
+   for (int i=0; i < ra->depth; i++) {
+      ra->bufs[i].data = get_aligned_memory(ra->read_size, DIO_ALIGN);
+   }
+   pthread_mutex_init(&ra->mutex, NULL);
+   pthread_cond_init(&ra->work, NULL);
+   pthread_cond_init(&ra->done, NULL);
+   ra->bfd = NULL;
+   ra->fd = -1;
+   ra->size = 0;
+   ra->head = ra->nb_used = ra->head_pos = 0;
+   ra->next_offset = 0;
+   ra->eof = false;
+   ra->prefetch = New(dlist(pf, &pf->link));
+   ra->nb_prefetch = 0;
+   ra->max_prefetch = prefetch_files;
+   ra->quit = false;
+   ra->nb_reads = ra->nb_waits = ra->nb_prefetched = 0;
+
+#ifdef HAVE_IO_URING
+   ra->ring = new_uring(ra->depth);
+   if (!ra->ring) {
+      nb_threads = MIN(ra->depth, RA_MAX_THREADS);
+   }
+#else
+   nb_threads = MIN(ra->depth, RA_MAX_THREADS);
+#endif
+   if (prefetch_files > 0 && nb_threads == 0) {
+      nb_threads = 1;                 /* for the prefetch */
+   }
+   ra->tids = (pthread_t *)bmalloc(MAX(nb_threads, 1) * sizeof(pthread_t));
+   ra->nb_threads = 0;
+   for (int i=0; i < nb_threads; i++) {
+      if ((stat = pthread_create(&ra->tids[i], NULL, read_ahead_thread, (void *)ra)) != 0) {
+         berrno be;
+         Jmsg(jcr, M_WARNING, 0, _("Unable to start read ahead thread: ERR=%s\n"),
+              be.bstrerror(stat));
+         break;
+      }
+      ra->nb_threads++;
+   }
+   Dmsg4(50, "Read ahead depth=%d size=%d io_uring=%d threads=%d\n",
+         ra->depth, ra->read_size, read_ahead_uses_io_uring(ra), ra->nb_threads);
+   return ra;
+}
+
+void free_read_ahead(read_ahead *ra)
+{
+   ra_prefetch *pf;
+
+   P(ra->mutex);
+   ra->quit = true;
+   pthread_cond_broadcast(&ra->work);
+   V(ra->mutex);
+   for (int i=0; i < ra->nb_threads; i++) {
+      pthread_join(ra->tids[i], NULL);
+   }
+   Dmsg3(50, "Read ahead: reads=%lld waits=%lld prefetched=%lld\n",
+         ra->nb_reads, ra->nb_waits, ra->nb_prefetched);
+   while ((pf = (ra_prefetch *)ra->prefetch->first()) != NULL) {
+      ra->prefetch->remove(pf);
+      free(pf);
+   }
+   delete ra->prefetch;
+#ifdef HAVE_IO_URING
+   if (ra->ring) {
+      free_uring(ra->ring);
+   }
+#endif
+   for (int i=0; i < ra->depth; i++) {
+      free_aligned_memory(ra->bufs[i].data);
+   }
+   free(ra->bufs);
+   free(ra->tids);
+   pthread_cond_destroy(&ra->done);
+   pthread_cond_destroy(&ra->work);
+   pthread_mutex_destroy(&ra->mutex);
+   delete ra;
+}
+
+bool read_ahead_uses_io_uring(read_ahead *ra)
+{
+#ifdef HAVE_IO_URING
+   return ra->ring != NULL;
+#else
+   return false;
+#endif
+}
+
+/*
+ * Start the read ahead of a file just opened by bopen() for
+ *  reading, size is the size of the file from stat().
+ *
+ * Returns false if the file cannot use the engine, bread() then
+ *  reads the file directly.
+ */
+bool bread_ahead_attach(BFILE *bfd, read_ahead *ra, boffset_t size)
+{
+   if (!ra || ra->bfd || bfd->cmd_plugin || bfd->fid < 0 || bfd->ra) {
+      return false;
+   }
+   P(ra->mutex);
+   ra->bfd = bfd;
+   ra->fd = bfd->fid;
+   ra->size = size;
+   reset_reads(ra, (boffset_t)lseek(bfd->fid, 0, SEEK_CUR));
+   if (ra->next_offset < 0) {
+      ra->next_offset = 0;
+   }
+   submit_reads(ra);
+   V(ra->mutex);
+   bfd->ra = ra;
+   return true;
+}
+
+/* Stop the read ahead, called by bclose() */
+void bread_ahead_detach(BFILE *bfd)
+{
+   read_ahead *ra = bfd->ra;
+
+   if (!ra) {
+      return;
+   }
+   P(ra->mutex);
+   reset_reads(ra, 0);
+   ra->bfd = NULL;
+   ra->fd = -1;
+   V(ra->mutex);
+   bfd->ra = NULL;
+}
+
+/*
+ * bread() with the read ahead. As read() on a regular file, we
+ *  return count bytes, less only at the end of the file.
+ */
+ssize_t bread_ahead(BFILE *bfd, void *buf, size_t count)
+{
+   read_ahead *ra = bfd->ra;
+   char *p = (char *)buf;
+   size_t copied = 0;
+
+   P(ra->mutex);
+   while (copied < count) {
+      if (ra->nb_used == 0) {
+         if (ra->eof) {
+            break;
+         }
+         submit_reads(ra);
+      }
+      ra_buf *b = &ra->bufs[ra->head];
+      wait_buf(ra, b);
+      if (b->len < 0 && b->error == EINVAL && (bfd->m_flags & O_DIRECT)) {
+         /* Unaligned position, continue without O_DIRECT */
+         bdirect_io_disable(bfd);
+         reset_reads(ra, b->offset);
+         continue;
+      }
+      if (b->len < 0) {
+         if (copied > 0) {
+            break;                    /* report the error on the next call */
+         }
+         bfd->berrno = errno = b->error;
+         V(ra->mutex);
+         return -1;
+      }
+      size_t n = MIN((size_t)(b->len - ra->head_pos), count - copied);
+      memcpy(p + copied, b->data + ra->head_pos, n);
+      ra->head_pos += n;
+      copied += n;
+      if (ra->head_pos == b->len) {
+         /* Buffer done, start the next read */
+         boffset_t end = b->offset + b->len;
+         bool eof = b->len == 0;
+         bool shortread = b->len < ra->read_size;
+         b->state = RA_FREE;
+         ra->head = (ra->head + 1) % ra->depth;
+         ra->nb_used--;
+         ra->head_pos = 0;
+         if (shortread) {
+            /* End of the file, or a short read, restart after the data */
+            reset_reads(ra, end);
+            ra->eof = eof;
+         }
+         submit_reads(ra);
+      }
+   }
+   V(ra->mutex);
+   bfd->block++;
+   bfd->total_bytes += copied;
+   return copied;
+}
+
+/* blseek() with the read ahead, the reads restart at the new position */
+boffset_t blseek_ahead(BFILE *bfd, boffset_t offset, int whence)
+{
+   read_ahead *ra = bfd->ra;
+   boffset_t pos;
+
+   P(ra->mutex);
+   /* The file position is not used by the reads, compute it */
+   pos = ra->next_offset;
+   if (ra->nb_used > 0) {
+      pos = ra->bufs[ra->head].offset + ra->head_pos;
+   }
+   if (whence == SEEK_CUR) {
+      offset += pos;
+      whence = SEEK_SET;
+   }
+   if (whence == SEEK_SET && offset == pos) {
+      V(ra->mutex);
+      return pos;                     /* keep the reads in flight */
+   }
+   pos = (boffset_t)lseek(bfd->fid, offset, whence);
+   bfd->berrno = errno;
+   if (pos >= 0) {
+      reset_reads(ra, pos);
+      submit_reads(ra);
+   }
+   V(ra->mutex);
+   return pos;
+}
+
+/*
+ * Queue a file for the prefetch, it is dropped if the queue is
+ *  full. Called by the directory walker.
+ */
+void read_ahead_prefetch(read_ahead *ra, const char *fname, boffset_t size)
+{
+   ra_prefetch *pf;
+   int len;
+
+   if (!ra || ra->nb_threads == 0 || ra->max_prefetch <= 0 || size <= 0) {
+      return;
+   }
+   P(ra->mutex);
+   if (ra->nb_prefetch < ra->max_prefetch) {
+      len = strlen(fname);
+      pf = (ra_prefetch *)bmalloc(sizeof(ra_prefetch) + len);
+      memcpy(pf->fname, fname, len + 1);
+      pf->size = size;
+      ra->prefetch->append(pf);
+      ra->nb_prefetch++;
+      pthread_cond_signal(&ra->work);
+   }
+   V(ra->mutex);
+}
+
+#else /* HAVE_WIN32 */
+
+/* No read ahead on Windows, bread() reads the file directly */
+read_ahead *new_read_ahead(JCR *jcr, int depth, int32_t read_size, int prefetch_files)
+{
+   return NULL;
+}
+
+void free_read_ahead(read_ahead *ra) { }
+
+bool read_ahead_uses_io_uring(read_ahead *ra)
+{
+   return false;
+}
+
+bool bread_ahead_attach(BFILE *bfd, read_ahead *ra, boffset_t size)
+{
+   return false;
+}
+
+void read_ahead_prefetch(read_ahead *ra, const char *fname, boffset_t size) { }
+
+#endif /* HAVE_WIN32 */
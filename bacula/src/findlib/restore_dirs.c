@@ -0,0 +1,208 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+*/
+/*
+ *  Directories of a fast restore (FastRestore = yes in the FileDaemon)
+ *
+ *  create_file() looks up, removes and creates the regular files with
+ *  fstatat(), unlinkat() and openat() relative to the fd of their
+ *  directory, the kernel does not resolve the full path of each file
+ *  again. The fds of the last directories used are kept open, the
+ *  files of a directory are restored together, but they are mixed
+ *  with the files of its subdirectories.
+ *
+ *  The times of the directories are not set when their attributes
+ *  are restored, a file restored later in the directory (from another
+ *  job, a hard link, ...) would change them. They are all set at the
+ *  end of the restore, sorted by name.
+ */
+
+#include "bacula.h"
+#include "find.h"
+
+#ifdef HAVE_RESTORE_DIRS
+
+restore_dirs::restore_dirs()
+{
+   for (int i = 0; i < RDIR_CACHE_SIZE; i++) {
+      m_fds[i].path = get_pool_memory(PM_FNAME);
+      m_fds[i].len = 0;
+      m_fds[i].fd = -1;
+      m_fds[i].last_use = 0;
+   }
+   m_use = 0;
+   m_times = NULL;
+   m_nb_times = m_max_times = 0;
+   nb_files = nb_opens = 0;
+}
+
+restore_dirs::~restore_dirs()
+{
+   close_fds();
+   for (int i = 0; i < RDIR_CACHE_SIZE; i++) {
+      free_pool_memory(m_fds[i].path);
+   }
+   for (uint32_t i = 0; i < m_nb_times; i++) {
+      free(m_times[i].fname);
+   }
+   if (m_times) {
+      free(m_times);
+   }
+}
+
+int restore_dirs::find_fd(const char *path, int len)
+{
+   for (int i = 0; i < RDIR_CACHE_SIZE; i++) {
+      if (m_fds[i].fd >= 0 && m_fds[i].len == len &&
+          memcmp(m_fds[i].path, path, len) == 0) {
+         return i;
+      }
+   }
+   return -1;
+}
+
+/*
+ * Return an fd of the directory path (len characters), -1 with errno
+ *  set if it cannot be opened. The fd stays owned by the cache.
+ */
+int restore_dirs::dir_fd(const char *path, int len)
+{
+   int i = find_fd(path, len);
+
+   if (i < 0) {
+      /* Take the slot used the least recently */
+      i = 0;
+      for (int j = 1; j < RDIR_CACHE_SIZE; j++) {
+         if (m_fds[j].last_use < m_fds[i].last_use) {
+            i = j;
+         }
+      }
+      if (m_fds[i].fd >= 0) {
+         close(m_fds[i].fd);
+         m_fds[i].fd = -1;
+      }
+      m_fds[i].path = check_pool_memory_size(m_fds[i].path, len + 1);
+      memcpy(m_fds[i].path, path, len);
+      m_fds[i].path[len] = 0;
+      m_fds[i].fd = open(m_fds[i].path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      if (m_fds[i].fd < 0) {
+         Dmsg1(200, "Cannot open directory %s\n", m_fds[i].path);
+         return -1;
+      }
+      m_fds[i].len = len;
+      nb_opens++;
+   }
+   m_fds[i].last_use = ++m_use;
+   return m_fds[i].fd;
+}
+
+void restore_dirs::close_fds()
+{
+   for (int i = 0; i < RDIR_CACHE_SIZE; i++) {
+      if (m_fds[i].fd >= 0) {
+         close(m_fds[i].fd);
+         m_fds[i].fd = -1;
+      }
+      m_fds[i].last_use = 0;
+   }
+}
+
+/*
+ * Keep the times of a directory, see set_times()
+ */
+void restore_dirs::defer_times(ATTR *attr)
+{
+   if (m_nb_times == m_max_times) {
+      m_max_times = m_max_times ? m_max_times * 2 : 1024;
+      m_times = (rdir_times *)realloc(m_times, m_max_times * sizeof(rdir_times));
+   }
+   rdir_times *t = &m_times[m_nb_times];
+   t->fname = bstrdup(attr->ofname);
+   strip_trailing_slashes(t->fname);
+   t->seq = m_nb_times++;
+   t->atime = attr->statp.st_atime;
+   t->mtime = attr->statp.st_mtime;
+}
+
+static int rdir_times_cmp(const void *a, const void *b)
+{
+   const rdir_times *t1 = (const rdir_times *)a;
+   const rdir_times *t2 = (const rdir_times *)b;
+   int ret = strcmp(t1->fname, t2->fname);
+   if (ret == 0) {
+      ret = t1->seq < t2->seq ? -1 : 1;
+   }
+   return ret;
+}
+
+/*
+ * Set the times of the directories restored, called at the end
+ *  of the restore. The sort puts the directories near their parent,
+ *  most of the parent fds are found in the cache.
+ */
+bool restore_dirs::set_times(JCR *jcr)
+{
+   bool ok = true;
+   bool print_error = chk_dbglvl(100) || (getuid() == 0 && (!jcr || jcr->job_uid == 0));
+
+   if (m_nb_times > 1) {
+      qsort(m_times, m_nb_times, sizeof(rdir_times), rdir_times_cmp);
+   }
+
+   for (uint32_t i = 0; i < m_nb_times; i++) {
+      rdir_times *t = &m_times[i];
+      int ret;
+#ifdef HAVE_UTIMENSAT
+      struct timespec times[2];
+      char *p = strrchr(t->fname, '/');
+      int fd = -1;
+
+      times[0].tv_sec = t->atime;
+      times[0].tv_nsec = 0;
+      times[1].tv_sec = t->mtime;
+      times[1].tv_nsec = 0;
+      if (p && p[1]) {
+         fd = dir_fd(t->fname, p == t->fname ? 1 : p - t->fname);
+      }
+      if (fd >= 0) {
+         ret = utimensat(fd, p + 1, times, AT_SYMLINK_NOFOLLOW);
+      } else {
+         ret = utimensat(AT_FDCWD, t->fname, times, AT_SYMLINK_NOFOLLOW);
+      }
+#else
+      struct utimbuf ut;
+      ut.actime = t->atime;
+      ut.modtime = t->mtime;
+      ret = utime(t->fname, &ut);
+#endif
+      if (ret < 0 && print_error) {
+         berrno be;
+         Jmsg2(jcr, M_ERROR, 0, _("Unable to set file times %s: ERR=%s\n"),
+            t->fname, be.bstrerror());
+         ok = false;
+      }
+      free(t->fname);
+   }
+   Dmsg3(100, "Directory times=%u files=%llu directory opens=%llu\n",
+         m_nb_times, (unsigned long long)nb_files, (unsigned long long)nb_opens);
+   m_nb_times = 0;
+   close_fds();
+   return ok;
+}
+
+#endif /* HAVE_RESTORE_DIRS */
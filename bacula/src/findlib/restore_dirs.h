@@ -0,0 +1,75 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+*/
+/*
+ *  Directories of a fast restore, see restore_dirs.c
+ */
+
+#ifndef _RESTORE_DIRS_H
+#define _RESTORE_DIRS_H 1
+
+#if defined(HAVE_OPENAT) && defined(HAVE_FSTATAT) && defined(HAVE_UNLINKAT) && \
+    !defined(HAVE_WIN32)
+#define HAVE_RESTORE_DIRS 1
+#endif
+
+#ifdef HAVE_RESTORE_DIRS
+
+/* Number of directory fds kept open */
+#define RDIR_CACHE_SIZE 16
+
+/* An open directory of the cache */
+struct rdir_fd {
+   POOLMEM *path;                     /* path of the directory */
+   int len;                           /* length of path */
+   int fd;                            /* -1 if not used */
+   uint64_t last_use;
+};
+
+/* The times of a directory, set at the end of the restore */
+struct rdir_times {
+   char *fname;
+   uint32_t seq;                      /* the last one wins */
+   time_t atime;
+   time_t mtime;
+};
+
+class restore_dirs: public SMARTALLOC {
+   rdir_fd m_fds[RDIR_CACHE_SIZE];
+   uint64_t m_use;
+   rdir_times *m_times;
+   uint32_t m_nb_times;
+   uint32_t m_max_times;
+
+   int find_fd(const char *path, int len);
+
+public:
+   uint64_t nb_files;                 /* files created with openat() */
+   uint64_t nb_opens;                 /* directories opened */
+
+   restore_dirs();
+   ~restore_dirs();
+   int dir_fd(const char *path, int len);
+   void close_fds();
+   void defer_times(ATTR *attr);
+   bool set_times(JCR *jcr);
+};
+
+#endif /* HAVE_RESTORE_DIRS */
+
+#endif /* _RESTORE_DIRS_H */
@@ -0,0 +1,555 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+*/
+/*
+ *  Parallel directory walker
+ *
+ *  find_one_file() still walks the tree depth first on the job
+ *  thread, and calls handle_file() in exactly the same order as
+ *  without the walker. The FileIndex numbering, the directory
+ *  after its contents order and the hard link table (linkhash,
+ *  only used by the job thread) are not changed.
+ *
+ *  The walker threads do the slow part ahead of the job thread:
+ *  they read directories and lstat() all their entries. When the
+ *  job thread enters a directory, the list of its entries with
+ *  the stat packets is usually ready.
+ *
+ *  The subdirectories found in a directory are queued at the front
+ *  of the work queue, in directory order, so the walker threads
+ *  read them roughly in the order the job thread will need them.
+ *  The number of directories read ahead is limited, and we never
+ *  read ahead a directory that is on another file system than its
+ *  parent, the job thread decides if it must be descended.
+ *
+ *  For an estimate, only the attributes that are counted or
+ *  compared with the accurate list are needed, the walker uses
+ *  statx() with a minimal mask when the system has it.
+ */
+
+#include "bacula.h"
+#include "find.h"
+
+#ifdef MAJOR_IN_MKDEV
+#include <sys/mkdev.h>
+#elif defined MAJOR_IN_SYSMACROS
+#include <sys/sysmacros.h>
+#endif
+
+int breaddir(DIR *dirp, POOLMEM *&d_name);
+
+static const int dbglvl = 450;
+
+/* Directories read ahead for each walker thread */
+#define WALKER_DIRS_PER_THREAD 32
+
+enum {
+   WD_QUEUED,                         /* waiting for a walker thread */
+   WD_RUNNING,                        /* being read */
+   WD_DONE                            /* entries ready */
+};
+
+/* A directory read by the walker */
+struct walk_dir {
+   dlink link;                        /* work queue */
+   char *path;                        /* snapshot path with a trailing slash */
+   dev_t dev;                         /* device of the directory */
+   POOLMEM *names;                    /* all the entry names */
+   walk_entry *entries;
+   int nb_entries;
+   int max_entries;
+   int next;                          /* next entry for the job thread */
+   int prefetch;                      /* next entry to prefetch */
+   int open_errno;                    /* errno of opendir() */
+   int state;
+   bool abandoned;                    /* not needed anymore, free when read */
+};
+
+class dir_walker: public SMARTALLOC {
+public:
+   JCR *jcr;
+   pthread_mutex_t mutex;
+   pthread_cond_t work;               /* walker threads wait for directories */
+   pthread_cond_t done;               /* the job thread waits for a directory */
+   dlist *queue;                      /* directories to read */
+   pthread_t *tids;
+   int nb_threads;
+   int nb_ahead;                      /* directories read ahead not yet used */
+   int max_ahead;
+   bool inode_order;                  /* InodeOrder FileSet option */
+   bool name_order;                   /* order of the accurate list */
+   bool stat_only;                    /* estimate, see walker_stat() */
+   bool quit;
+   uint64_t nb_dirs;                  /* directories read by the walker threads */
+   uint64_t nb_inline;                /* directories read by the job thread */
+   uint64_t nb_waits;                 /* times the job thread had to wait */
+};
+
+static walk_dir *new_walk_dir(const char *path, dev_t dev)
+{
+   walk_dir *wd = (walk_dir *)bmalloc(sizeof(walk_dir));
+   int len = strlen(path);
+
+   memset(wd, 0, sizeof(walk_dir));
+   wd->path = (char *)bmalloc(len + 2);
+   strcpy(wd->path, path);
+   /* Strip all trailing slashes, add back one */
+   while (len >= 1 && IsPathSeparator(wd->path[len - 1])) {
+      len--;
+   }
+   wd->path[len++] = '/';
+   wd->path[len] = 0;
+   wd->dev = dev;
+   wd->state = WD_QUEUED;
+   return wd;
+}
+
+static void release_walk_dir(dir_walker *w, walk_dir *wd);
+
+/*
+ * Free a directory and the read ahead of its subdirectories
+ *  that were not used. Called with the mutex locked.
+ */
+static void free_walk_dir(dir_walker *w, walk_dir *wd)
+{
+   for (int i=0; i < wd->nb_entries; i++) {
+      if (wd->entries[i].subdir) {
+         release_walk_dir(w, wd->entries[i].subdir);
+      }
+   }
+   if (wd->entries) {
+      free(wd->entries);
+   }
+   if (wd->names) {
+      free_pool_memory(wd->names);
+   }
+   free(wd->path);
+   free(wd);
+}
+
+/*
+ * A directory that was read ahead is not needed by the job
+ *  thread. Called with the mutex locked.
+ */
+static void release_walk_dir(dir_walker *w, walk_dir *wd)
+{
+   w->nb_ahead--;
+   switch (wd->state) {
+   case WD_QUEUED:
+      w->queue->remove(wd);
+      free_walk_dir(w, wd);
+      break;
+   case WD_RUNNING:
+      wd->abandoned = true;           /* the walker thread will free it */
+      break;
+   default:
+      free_walk_dir(w, wd);
+      break;
+   }
+}
+
+#if defined(HAVE_DIR_READER) && defined(STATX_BASIC_STATS)
+/* What an estimate needs: the type, the size, the times of an
+ *  incremental, the hard links and the accurate options
+ */
+#define WALKER_STATX_MASK (STATX_TYPE | STATX_MODE | STATX_NLINK | STATX_UID | \
+                           STATX_GID | STATX_INO | STATX_SIZE | STATX_MTIME | \
+                           STATX_CTIME)
+
+static bool no_statx = false;         /* ENOSYS, the kernel is too old */
+
+/*
+ * lstat() an entry with statx(), the fields not asked may be left
+ *  out by the file system and are zero. AT_STATX_DONT_SYNC lets a
+ *  network file system use its cached attributes.
+ */
+static int walker_statx(int dirfd, const char *name, struct stat *statp)
+{
+   struct statx stx;
+
+   if (statx(dirfd, name, AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC,
+             WALKER_STATX_MASK, &stx) != 0) {
+      return -1;
+   }
+   memset(statp, 0, sizeof(struct stat));
+   statp->st_dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+   statp->st_rdev = makedev(stx.stx_rdev_major, stx.stx_rdev_minor);
+   statp->st_ino = stx.stx_ino;
+   statp->st_mode = stx.stx_mode;
+   statp->st_nlink = stx.stx_nlink;
+   statp->st_uid = stx.stx_uid;
+   statp->st_gid = stx.stx_gid;
+   statp->st_size = stx.stx_size;
+   statp->st_blksize = stx.stx_blksize;
+   if (stx.stx_mask & STATX_BLOCKS) {
+      statp->st_blocks = stx.stx_blocks;
+   }
+   if (stx.stx_mask & STATX_ATIME) {
+      statp->st_atime = stx.stx_atime.tv_sec;
+   }
+   statp->st_mtime = stx.stx_mtime.tv_sec;
+   statp->st_ctime = stx.stx_ctime.tv_sec;
+   return 0;
+}
+#endif
+
+#ifdef HAVE_DIR_READER
+/* lstat() an entry of the directory */
+static int walker_stat(dir_walker *w, int dirfd, const char *name, struct stat *statp)
+{
+#ifdef STATX_BASIC_STATS
+   if (w->stat_only && !no_statx) {
+      if (walker_statx(dirfd, name, statp) == 0) {
+         return 0;
+      }
+      if (errno != ENOSYS) {
+         return -1;
+      }
+      no_statx = true;
+   }
+#endif
+   return fstatat(dirfd, name, statp, AT_SYMLINK_NOFOLLOW);
+}
+#endif
+
+/*
+ * Read all the entries of a directory, then lstat() them.
+ *  Called without the mutex.
+ */
+static void read_walk_dir(dir_walker *w, walk_dir *wd)
+{
+   int32_t *offsets = NULL;
+   int32_t names_len = 0;
+#ifdef HAVE_DIR_READER
+   dir_reader directory;
+   dir_reader_entry de;
+
+   errno = 0;
+   if (!directory.open(AT_FDCWD, wd->path) ||
+       !directory.start(w->inode_order, w->name_order)) {
+      wd->open_errno = errno ? errno : ENOENT;
+      return;
+   }
+   wd->names = get_pool_memory(PM_FNAME);
+   while (!job_canceled(w->jcr) && directory.next(&de)) {
+      char *p = de.name;
+#else
+   DIR *directory;
+   POOL_MEM dname(PM_FNAME);
+   POOL_MEM fname(PM_FNAME);
+   int plen;
+
+   errno = 0;
+   if ((directory = opendir(wd->path)) == NULL) {
+      wd->open_errno = errno ? errno : ENOENT;
+      return;
+   }
+   wd->names = get_pool_memory(PM_FNAME);
+   while (!job_canceled(w->jcr)) {
+      if (breaddir(directory, dname.addr()) != 0) {
+         break;                       /* error or end of directory */
+      }
+      char *p = dname.c_str();
+      /* Skip `.' and `..' */
+      if (p[0] == '\0' || (p[0] == '.' && (p[1] == '\0' ||
+          (p[1] == '.' && p[2] == '\0')))) {
+         continue;
+      }
+#endif
+      int l = strlen(p) + 1;
+      if (wd->nb_entries == wd->max_entries) {
+         wd->max_entries = wd->max_entries ? wd->max_entries * 2 : 64;
+         offsets = (int32_t *)brealloc(offsets, wd->max_entries * sizeof(int32_t));
+      }
+      wd->names = check_pool_memory_size(wd->names, names_len + l);
+      memcpy(wd->names + names_len, p, l);
+      offsets[wd->nb_entries++] = names_len;
+      names_len += l;
+   }
+#ifndef HAVE_DIR_READER
+   closedir(directory);
+#endif
+
+   if (wd->nb_entries == 0) {
+      if (offsets) {
+         free(offsets);
+      }
+      return;
+   }
+   wd->entries = (walk_entry *)bmalloc(wd->nb_entries * sizeof(walk_entry));
+   memset(wd->entries, 0, wd->nb_entries * sizeof(walk_entry));
+#ifndef HAVE_DIR_READER
+   pm_strcpy(fname, wd->path);
+   plen = strlen(wd->path);
+#endif
+   for (int i=0; i < wd->nb_entries; i++) {
+      walk_entry *e = &wd->entries[i];
+      e->name = wd->names + offsets[i];
+#ifdef HAVE_DIR_READER
+      if (walker_stat(w, directory.fd(), e->name, &e->statp) != 0) {
+         e->stat_errno = errno;
+      }
+#else
+      fname.check_size(plen + strlen(e->name) + 1);
+      strcpy(fname.c_str() + plen, e->name);
+      if (lstat(fname.c_str(), &e->statp) != 0) {
+         e->stat_errno = errno;
+      }
+#endif
+   }
+   free(offsets);
+}
+
+/*
+ * Queue the subdirectories of a directory that was just read.
+ *  The first subdirectories are put at the front of the queue.
+ *  Called with the mutex locked.
+ */
+static void queue_subdirs(dir_walker *w, walk_dir *wd)
+{
+   int room = w->max_ahead - w->nb_ahead;
+   int last = -1, nb = 0;
+
+   /* Find the subdirectories we have room for */
+   for (int i=0; i < wd->nb_entries && nb < room; i++) {
+      walk_entry *e = &wd->entries[i];
+      if (e->stat_errno == 0 && S_ISDIR(e->statp.st_mode) && e->statp.st_dev == wd->dev) {
+         last = i;
+         nb++;
+      }
+   }
+   if (nb == 0) {
+      return;
+   }
+   POOL_MEM path(PM_FNAME);
+   for (int i=last; i >= 0; i--) {
+      walk_entry *e = &wd->entries[i];
+      if (e->stat_errno == 0 && S_ISDIR(e->statp.st_mode) && e->statp.st_dev == wd->dev) {
+         Mmsg(path, "%s%s", wd->path, e->name);
+         e->subdir = new_walk_dir(path.c_str(), e->statp.st_dev);
+         w->queue->prepend(e->subdir);
+         w->nb_ahead++;
+      }
+   }
+   pthread_cond_broadcast(&w->work);
+}
+
+extern "C" void *walker_thread(void *arg)
+{
+   dir_walker *w = (dir_walker *)arg;
+
+   set_jcr_in_tsd(w->jcr);
+   P(w->mutex);
+   for ( ;; ) {
+      while (!w->quit && w->queue->empty()) {
+         pthread_cond_wait(&w->work, &w->mutex);
+      }
+      if (w->quit) {
+         break;
+      }
+      walk_dir *wd = (walk_dir *)w->queue->first();
+      w->queue->remove(wd);
+      wd->state = WD_RUNNING;
+      V(w->mutex);
+
+      read_walk_dir(w, wd);
+
+      P(w->mutex);
+      w->nb_dirs++;
+      if (wd->abandoned) {
+         free_walk_dir(w, wd);
+      } else {
+         wd->state = WD_DONE;
+         queue_subdirs(w, wd);
+         pthread_cond_broadcast(&w->done);
+      }
+   }
+   V(w->mutex);
+   return NULL;
+}
+
+/*
+ * Start the walker threads, returns NULL if no thread can be started.
+ */
+dir_walker *new_dir_walker(JCR *jcr, int nb_threads, bool inode_order,
+                           bool name_order, bool stat_only)
+{
+   dir_walker *w = New(dir_walker);
+   walk_dir *wd = NULL;
+   int stat;
+
+   w->jcr = jcr;
+   pthread_mutex_init(&w->mutex, NULL);
+   pthread_cond_init(&w->work, NULL);
+   pthread_cond_init(&w->done, NULL);
+   w->queue = New(dlist(wd, &wd->link));
+   w->tids = (pthread_t *)bmalloc(nb_threads * sizeof(pthread_t));
+   w->nb_threads = 0;
+   w->nb_ahead = 0;
+   w->max_ahead = nb_threads * WALKER_DIRS_PER_THREAD;
+   w->inode_order = inode_order;
+   w->name_order = name_order;
+   w->stat_only = stat_only;
+   w->quit = false;
+   w->nb_dirs = w->nb_inline = w->nb_waits = 0;
+
+   for (int i=0; i < nb_threads; i++) {
+      if ((stat = pthread_create(&w->tids[i], NULL, walker_thread, (void *)w)) != 0) {
+         berrno be;
+         Jmsg(jcr, M_WARNING, 0, _("Unable to start directory walker thread: ERR=%s\n"),
+              be.bstrerror(stat));
+         break;
+      }
+      w->nb_threads++;
+   }
+   if (w->nb_threads == 0) {
+      free_dir_walker(w);
+      return NULL;
+   }
+   Dmsg2(50, "Directory walker started with %d threads stat_only=%d\n",
+         w->nb_threads, stat_only);
+   return w;
+}
+
+void free_dir_walker(dir_walker *w)
+{
+   walk_dir *wd;
+
+   P(w->mutex);
+   w->quit = true;
+   pthread_cond_broadcast(&w->work);
+   V(w->mutex);
+   for (int i=0; i < w->nb_threads; i++) {
+      pthread_join(w->tids[i], NULL);
+   }
+   Dmsg3(50, "Directory walker: dirs read ahead=%lld inline=%lld waits=%lld\n",
+         w->nb_dirs, w->nb_inline, w->nb_waits);
+   /* All directories are released by the job thread, just in case */
+   while ((wd = (walk_dir *)w->queue->first()) != NULL) {
+      w->queue->remove(wd);
+      free_walk_dir(w, wd);
+   }
+   delete w->queue;
+   free(w->tids);
+   pthread_cond_destroy(&w->done);
+   pthread_cond_destroy(&w->work);
+   pthread_mutex_destroy(&w->mutex);
+   delete w;
+}
+
+/*
+ * Get the entries of the directory the job thread is entering.
+ *  entry is the walker entry of the directory if it was found
+ *  by the walker, it may have been read ahead.
+ *
+ * Returns NULL with errno set if the directory cannot be opened.
+ */
+walk_dir *walker_open_dir(dir_walker *w, walk_entry *entry,
+                          const char *snap_fname, dev_t dev)
+{
+   walk_dir *wd = NULL;
+   bool must_read = true;
+
+   P(w->mutex);
+   if (entry && entry->subdir) {
+      wd = entry->subdir;
+      entry->subdir = NULL;           /* we own it now */
+      w->nb_ahead--;
+      if (wd->state == WD_QUEUED) {
+         w->queue->remove(wd);        /* not started, read it ourself */
+         wd->state = WD_RUNNING;
+      } else {
+         if (wd->state == WD_RUNNING) {
+            w->nb_waits++;
+         }
+         while (wd->state == WD_RUNNING) {
+            pthread_cond_wait(&w->done, &w->mutex);
+         }
+         must_read = false;
+      }
+   }
+   V(w->mutex);
+
+   if (must_read) {
+      if (!wd) {
+         wd = new_walk_dir(snap_fname, dev);
+      }
+      read_walk_dir(w, wd);
+      P(w->mutex);
+      w->nb_inline++;
+      wd->state = WD_DONE;
+      if (wd->open_errno == 0) {
+         queue_subdirs(w, wd);
+      }
+      V(w->mutex);
+   }
+   if (wd->open_errno != 0) {
+      int err = wd->open_errno;
+      P(w->mutex);
+      free_walk_dir(w, wd);
+      V(w->mutex);
+      errno = err;
+      return NULL;
+   }
+   Dmsg2(dbglvl, "walker dir=%s entries=%d\n", wd->path, wd->nb_entries);
+   return wd;
+}
+
+/* Next entry of the directory, NULL at the end */
+walk_entry *walker_next_entry(walk_dir *wd)
+{
+   if (wd->next >= wd->nb_entries) {
+      return NULL;
+   }
+   return &wd->entries[wd->next++];
+}
+
+/*
+ * Queue the next regular files of the directory for the prefetch
+ *  of the read ahead engine, the job thread will open them soon.
+ *  With an incremental, only the files that changed are queued.
+ */
+void walker_prefetch(walk_dir *wd, FF_PKT *ff_pkt)
+{
+   POOL_MEM fname(PM_FNAME);
+   int last = MIN(wd->next + ff_pkt->prefetch_files, wd->nb_entries);
+
+   for (wd->prefetch = MAX(wd->prefetch, wd->next); wd->prefetch < last; wd->prefetch++) {
+      walk_entry *e = &wd->entries[wd->prefetch];
+      if (e->stat_errno != 0 || !S_ISREG(e->statp.st_mode)) {
+         continue;
+      }
+      if (ff_pkt->incremental &&
+          e->statp.st_mtime < ff_pkt->save_time &&
+          e->statp.st_ctime < ff_pkt->save_time) {
+         continue;
+      }
+      Mmsg(fname, "%s%s", wd->path, e->name);
+      read_ahead_prefetch(ff_pkt->ra, fname.c_str(), e->statp.st_size);
+   }
+}
+
+/*
+ * The job thread is done with the directory
+ */
+void walker_close_dir(dir_walker *w, walk_dir *wd)
+{
+   P(w->mutex);
+   free_walk_dir(w, wd);
+   V(w->mutex);
+}
@@ -152,14 +152,21 @@ class HashBlockDict;
 class HashList;
 class DedupFiledInterface;
 class DedupStoredInterfaceBase;
+class restore_dirs;
 
 
 #ifdef FILE_DAEMON
 class VSSClient;
 class htable;
+class acclist;
+class accspool;
+struct est_ctx;
 class BACL;
 class BXATTR;
 class snapshot_manager;
+class bpipeline;
+class vpipeline;
+class rpipeline;
 
 struct CRYPTO_CTX {
    bool pki_sign;                     /* Enable PKI Signatures? */
@@ -172,6 +179,8 @@ struct CRYPTO_CTX {
    POOLMEM *pki_session_encoded;      /* Cached DER-encoded copy of pki_session */
    int32_t pki_session_encoded_size;  /* Size of DER-encoded pki_session */
    POOLMEM *crypto_buf;               /* Encryption/Decryption buffer */
+   bool pki_aead;                     /* Records sealed one by one (AES-GCM) */
+   uint64_t pki_record;               /* Next record number of pki_session */
 };
 #endif
 
@@ -292,6 +301,7 @@ public:
    bool cmd_plugin;                   /* Set when processing a command Plugin = */
    bool opt_plugin;                   /* Set when processing an option Plugin = */
    bool keep_path_list;               /* Keep newly created path in a hash */
+   bool sync_restored_files;          /* Sync each restored file to disk */
    bool accurate;                     /* true if job is accurate */
    bool HasBase;                      /* True if job use base jobs */
    bool rerunning;                    /* rerunning an incomplete job */
@@ -318,6 +328,7 @@ public:
    POOLMEM *comment;                  /* Comment for this Job */
    int64_t max_bandwidth;             /* Bandwidth limit for this Job */
    htable *path_list;                 /* Directory list (used by findlib) */
+   restore_dirs *rdirs;               /* Fast restore directories (used by findlib) */
    int     job_uid;                   /* UID used during job session */
    char   *job_user;                  /* Specific permission for a job */
    char   *job_group;                 /* Specific permission for a job */
@@ -438,12 +449,17 @@ public:
    time_t stat_interval;              /* Stats send interval */
    utime_t mtime;                     /* begin time for SINCE */
    int listing;                       /* job listing in estimate */
+   int32_t SDVersion;                 /* Storage daemon version number */
+   est_ctx *estimate;                 /* estimate in progress, see estimate.c */
    long Ticket;                       /* Ticket */
    char *big_buf;                     /* I/O buffer */
    POOLMEM *compress_buf;             /* Compression buffer */
    int32_t compress_buf_size;         /* Length of compression buffer */
    void *pZLIB_compress_workset;      /* zlib compression session data */
    void *LZO_compress_workset;        /* lzo compression session data */
+   void *ZSTD_compress_workset;       /* zstd compression context */
+   void *LZ4_compress_workset;        /* lz4 compression state */
+   void *ZSTD_decompress_workset;     /* zstd decompression context */
    int32_t replace;                   /* Replace options */
    int32_t buf_size;                  /* length of buffer */
    FF_PKT *ff;                        /* Find Files packet */
@@ -471,13 +487,19 @@ public:
    bool got_metadata;                 /* set when found job_metatdata */
    bool multi_restore;                /* Dir can do multiple storage restore */
    bool interactive_session;          /* Use interactive session with the SD */
-   htable *file_list;                 /* Previous file list (accurate mode) */
+   acclist *file_list;                /* Previous file list (accurate mode) */
+   accspool *file_spool;              /* Or the sorted list in a spool file */
+   char *accurate_cache;              /* Base name of the list kept between jobs */
+   char *accurate_cache_jobids;       /* JobIds of the list to keep */
    uint64_t base_size;                /* compute space saved with base job */
    utime_t snapshot_retention;        /* Snapshot retention (from director) */
    snapshot_manager *snap_mgr;        /* Snapshot manager */
    DedupFiledInterface *dedup;        /* help the FD to do deduplication */
    bool dedup_use_cache;              /* use client cache */
    VSSClient *pVSSClient;             /* VSS handler */
+   bpipeline *pipeline;               /* Backup pipeline threads */
+   vpipeline *verify_pipeline;        /* Verify digest threads */
+   rpipeline *restore_pipeline;       /* Restore pipeline threads */
 #endif /* FILE_DAEMON */
 
 
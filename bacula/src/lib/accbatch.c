@@ -0,0 +1,329 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+*/
+/*
+ * Binary format of the accurate file list, see accbatch.h
+ */
+
+#include "bacula.h"
+
+accbatch::accbatch()
+{
+   buf = get_pool_memory(PM_BSOCK);
+   buf = check_pool_memory_size(buf, ACC_BATCH_SIZE + 4096);
+   len = 0;
+   count = 0;
+}
+
+/* The file name is sent as one string, Path and Filename come from the catalog */
+void accbatch::add(const char *path, const char *fname, const char *lstat,
+                   const char *chksum, int32_t delta_seq)
+{
+   uint32_t plen = strlen(path);
+   uint32_t flen = strlen(fname) + 1;
+   uint32_t llen = strlen(lstat) + 1;
+   uint32_t clen = strlen(chksum) + 1;
+   uint32_t need = ACC_BATCH_HEADER + plen + flen + llen + clen;
+   ser_declare;
+
+   buf = check_pool_memory_size(buf, len + need);
+   ser_begin(buf + len, need);
+   ser_uint32(plen + flen);
+   ser_uint16(llen);
+   ser_uint16(clen);
+   ser_int32(delta_seq);
+   ser_bytes(path, plen);
+   ser_bytes(fname, flen);
+   ser_bytes(lstat, llen);
+   ser_bytes(chksum, clen);
+   ser_end(buf + len, need);
+   len += need;
+   count++;
+}
+
+/* The buffer is swapped with the one of the socket to avoid a copy */
+bool accbatch::send(BSOCK *bs)
+{
+   POOLMEM *msg;
+   bool ret;
+
+   if (len == 0) {
+      return true;
+   }
+   msg = bs->msg;
+   bs->msg = buf;
+   bs->msglen = len;
+   ret = bs->send();
+   bs->msg = msg;
+   len = 0;
+   count = 0;
+   return ret;
+}
+
+int acc_batch_next(char *msg, int32_t msglen, int32_t *pos, acc_batch_file *file)
+{
+   uint32_t flen;
+   uint16_t llen, clen;
+   unser_declare;
+
+   if (*pos >= msglen) {
+      return 0;
+   }
+   if (msglen - *pos < ACC_BATCH_HEADER) {
+      return -1;
+   }
+   unser_begin(msg + *pos, ACC_BATCH_HEADER);
+   unser_uint32(flen);
+   unser_uint16(llen);
+   unser_uint16(clen);
+   unser_int32(file->delta_seq);
+   if (flen < 2 || llen == 0 || clen == 0 ||
+       (uint64_t)flen + llen + clen > (uint64_t)(msglen - *pos - ACC_BATCH_HEADER)) {
+      return -1;
+   }
+   file->fname = msg + *pos + ACC_BATCH_HEADER;
+   file->lstat = file->fname + flen;
+   file->chksum = file->lstat + llen;
+   if (file->lstat[-1] || file->chksum[-1] || file->chksum[clen - 1]) {
+      return -1;
+   }
+   *pos += ACC_BATCH_HEADER + flen + llen + clen;
+   return 1;
+}
+
+#ifndef TEST_PROGRAM
+#define TEST_PROGRAM_A
+#endif
+
+#ifdef TEST_PROGRAM
+#include "unittests.h"
+
+#define NFILES   200000
+
+/* What the reader got, must be the same with both formats */
+struct bench_ctx {
+   BSOCK *bs;
+   bool batch;
+   uint32_t msgs;
+   uint32_t files;
+   uint64_t bytes;
+   int64_t delta;
+   bool error;
+};
+
+static void make_file(int i, char *path, char *fname, char *lstat, char *chksum)
+{
+   uint8_t md[16];
+   char *p = lstat;
+
+   sprintf(path, "/home/user%d/projects/bacula/src/module%d/dir%d/", i % 20,
+           i % 100, i / 100);
+   sprintf(fname, "%s%d.c", (i % 3) ? "source_file_" : "f", i);
+   /* As done by encode_stat() */
+   p += to_base64(0x801, p); *p++ = ' ';
+   p += to_base64(1234567 + i, p); *p++ = ' ';
+   p += to_base64(0100644, p); *p++ = ' ';
+   p += to_base64(1, p); *p++ = ' ';
+   p += to_base64(1000 + i % 20, p); *p++ = ' ';
+   p += to_base64(100, p); *p++ = ' ';
+   p += to_base64(0, p); *p++ = ' ';
+   p += to_base64((i * 7919) % 1000000, p); *p++ = ' ';
+   p += to_base64(4096, p); *p++ = ' ';
+   p += to_base64(i % 2000 + 1, p); *p++ = ' ';
+   p += to_base64(1600000000 + i * 13 + 86400, p); *p++ = ' ';
+   p += to_base64(1600000000 + i * 13, p); *p++ = ' ';
+   p += to_base64(1600000000 + i * 13 + i % 7, p); *p++ = ' ';
+   p += to_base64(0, p); *p++ = ' ';
+   p += to_base64(0, p); *p++ = ' ';
+   p += to_base64(1, p); *p++ = ' ';
+   p += to_base64(0, p);
+   *p = 0;
+   for (int k = 0; k < 16; k++) {
+      md[k] = (uint8_t)(i * 31 + k * 131);
+   }
+   bin_to_base64(chksum, 30, (char *)md, 16, true);
+}
+
+/* Read the list as the File Daemon does in accurate_cmd() */
+static void *bench_reader(void *arg)
+{
+   bench_ctx *ctx = (bench_ctx *)arg;
+   BSOCK *bs = ctx->bs;
+   acc_batch_file f;
+   int32_t pos, lstat_pos, chksum_pos;
+   int ret;
+
+   while (bs->recv() >= 0) {
+      ctx->msgs++;
+      if (ctx->batch) {
+         pos = 0;
+         while ((ret = acc_batch_next(bs->msg, bs->msglen, &pos, &f)) > 0) {
+            ctx->files++;
+            ctx->bytes += strlen(f.fname) + strlen(f.lstat) + strlen(f.chksum);
+            ctx->delta += f.delta_seq;
+         }
+         if (ret < 0) {
+            ctx->error = true;
+         }
+      } else {
+         lstat_pos = strlen(bs->msg) + 1;
+         chksum_pos = lstat_pos + strlen(bs->msg + lstat_pos) + 1;
+         ctx->files++;
+         ctx->bytes += strlen(bs->msg) + strlen(bs->msg + lstat_pos) +
+            strlen(bs->msg + chksum_pos);
+         ctx->delta += str_to_int32(bs->msg + chksum_pos +
+                                    strlen(bs->msg + chksum_pos) + 1);
+      }
+   }
+   return NULL;
+}
+
+/* Send the list through a socket pair, as done by the Director */
+static btime_t bench(bool batch, bool compress, bench_ctx *ctx, uint64_t *wire)
+{
+   char path[512], fname[128], lstat[200], chksum[50], delta[20];
+   accbatch *b = New(accbatch());
+   BSOCK *bs;
+   pthread_t tid;
+   btime_t t0;
+   int sv[2];
+
+   if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+      return 0;
+   }
+   bmemzero(ctx, sizeof(bench_ctx));
+   ctx->batch = batch;
+   ctx->bs = New(BSOCK(sv[1]));
+   bs = New(BSOCK(sv[0]));
+   if (compress) {
+      bs->set_compress();
+   }
+   t0 = get_current_btime();
+   pthread_create(&tid, NULL, bench_reader, ctx);
+   for (int i = 0; i < NFILES; i++) {
+      make_file(i, path, fname, lstat, chksum);
+      if (batch) {
+         b->add(path, fname, lstat, chksum, i % 3);
+         if (b->full()) {
+            b->send(bs);
+         }
+      } else {
+         edit_int64(i % 3, delta);
+         bs->fsend("%s%s%c%s%c%s%c%s", path, fname, 0, lstat, 0, chksum, 0, delta);
+      }
+   }
+   b->send(bs);
+   bs->signal(BNET_EOD);
+   bs->close();
+   pthread_join(tid, NULL);
+   t0 = get_current_btime() - t0;
+   *wire = bs->CommCompressedBytes();
+   ctx->bs->close();
+   delete ctx->bs;
+   delete bs;
+   delete b;
+   return t0;
+}
+
+int main()
+{
+   Unittests accbatch_test("accbatch_test", true);
+   char *msg = get_pool_memory(PM_BSOCK);
+   accbatch *b;
+   acc_batch_file f;
+   bench_ctx text, batch, lz4;
+   uint64_t text_wire, batch_wire, lz4_wire;
+   btime_t t_text, t_batch, t_lz4;
+   int32_t pos, len;
+   bool check_cont;
+   int sv[2];
+   BSOCK *w, *r;
+
+   Pmsg0(0, "Initialize tests ...\n");
+
+   /* A few files, as the FD reads them */
+   if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+      return 1;
+   }
+   w = New(BSOCK(sv[0]));
+   r = New(BSOCK(sv[1]));
+   b = New(accbatch());
+   b->add("/etc/", "passwd", "A A IH/ B A A A", "1B2M2Y8AsgTpgAmY7PhCfg", 2);
+   b->add("/etc/", "", "A A EHt C A A A", "", 0);
+   b->add("/tmp/", "deleted", "", "", -1);
+   ok(b->size() == 3 && !b->full(), "Add files");
+   ok(b->send(w) && b->size() == 0, "Send a batch");
+   ok(b->send(w), "Nothing to send");
+   ok(r->recv() > 0, "Receive a batch");
+   pos = 0;
+   ok(acc_batch_next(r->msg, r->msglen, &pos, &f) == 1 &&
+      strcmp(f.fname, "/etc/passwd") == 0 && strcmp(f.lstat, "A A IH/ B A A A") == 0 &&
+      strcmp(f.chksum, "1B2M2Y8AsgTpgAmY7PhCfg") == 0 && f.delta_seq == 2,
+      "Read a file");
+   ok(acc_batch_next(r->msg, r->msglen, &pos, &f) == 1 &&
+      strcmp(f.fname, "/etc/") == 0 && *f.chksum == 0 && f.delta_seq == 0,
+      "Read a directory without checksum");
+   ok(acc_batch_next(r->msg, r->msglen, &pos, &f) == 1 &&
+      strcmp(f.fname, "/tmp/deleted") == 0 && *f.lstat == 0 && f.delta_seq == -1,
+      "Read a deleted file");
+   ok(acc_batch_next(r->msg, r->msglen, &pos, &f) == 0 && pos == r->msglen,
+      "End of the batch");
+
+   /* Corrupted messages */
+   len = r->msglen;
+   msg = check_pool_memory_size(msg, len);
+   memcpy(msg, r->msg, len);
+   pos = 0;
+   ok(acc_batch_next(msg, len - 1, &pos, &f) == 1 &&
+      acc_batch_next(msg, len - 1, &pos, &f) == 1 &&
+      acc_batch_next(msg, len - 1, &pos, &f) == -1, "Truncated message");
+   pos = 0;
+   ok(acc_batch_next(msg, 5, &pos, &f) == -1, "Truncated header");
+   msg[3] = 100;                      /* name length */
+   pos = 0;
+   ok(acc_batch_next(msg, len, &pos, &f) == -1, "Wrong name length");
+   memcpy(msg, r->msg, len);
+   msg[ACC_BATCH_HEADER + strlen("/etc/passwd")] = 'x';
+   pos = 0;
+   ok(acc_batch_next(msg, len, &pos, &f) == -1, "Name not terminated");
+   delete b;
+   delete w;
+   delete r;
+
+   /* Text format against batches of the binary format */
+   t_text = bench(false, false, &text, &text_wire);
+   t_batch = bench(true, false, &batch, &batch_wire);
+   t_lz4 = bench(true, true, &lz4, &lz4_wire);
+   Pmsg4(0, "Text:  %u files %u messages %lld bytes %lldms\n",
+         text.files, text.msgs, text_wire, t_text / 1000);
+   Pmsg4(0, "Batch: %u files %u messages %lld bytes %lldms\n",
+         batch.files, batch.msgs, batch_wire, t_batch / 1000);
+   Pmsg4(0, "LZ4:   %u files %u messages %lld bytes %lldms\n",
+         lz4.files, lz4.msgs, lz4_wire, t_lz4 / 1000);
+   check_cont = text.files == NFILES && batch.files == NFILES && lz4.files == NFILES &&
+      text.bytes == batch.bytes && text.bytes == lz4.bytes &&
+      text.delta == batch.delta && text.delta == lz4.delta &&
+      !batch.error && !lz4.error;
+   ok(check_cont, "Same list with both formats");
+   ok(batch.msgs * 1000 < text.msgs, "Thousands of files per message");
+   ok(lz4_wire < batch_wire, "Compressed batches");
+
+   free_pool_memory(msg);
+   return report();
+}
+#endif
@@ -0,0 +1,71 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+*/
+/*
+ * Binary format of the accurate file list sent by the Director
+ *
+ *  The text format uses one message per file. When the File Daemon
+ *  supports it, the files are packed in messages of about
+ *  ACC_BATCH_SIZE bytes, so a few thousand files share the framing
+ *  and the system calls of one message. The message goes through the
+ *  comm line compression like any other one.
+ *
+ *  Each file is written in network byte order as
+ *     uint32 name length, uint16 LStat length, uint16 checksum length,
+ *     int32 delta sequence, then the name, the LStat and the checksum.
+ *  The lengths include the terminating \0, so the reader uses the
+ *  strings in place. A deleted file has an empty LStat.
+ */
+
+#ifndef _ACCBATCH_H_
+#define _ACCBATCH_H_
+
+#define ACC_BATCH_SIZE    (256 * 1024)    /* bytes sent per message */
+#define ACC_BATCH_HEADER  12              /* fixed part of a file */
+
+/* A file read from a message, the strings point in the message */
+struct acc_batch_file {
+   char *fname;
+   char *lstat;                       /* empty for a deleted file */
+   char *chksum;
+   int32_t delta_seq;
+};
+
+/* Files packed by the Director */
+class accbatch : public SMARTALLOC {
+   POOLMEM *buf;
+   uint32_t len;                      /* bytes used in buf */
+   uint32_t count;                    /* files in buf */
+
+public:
+   accbatch();
+   ~accbatch() { free_pool_memory(buf); };
+   void add(const char *path, const char *fname, const char *lstat,
+            const char *chksum, int32_t delta_seq);
+   bool full() { return len >= ACC_BATCH_SIZE; };
+   bool send(BSOCK *bs);              /* send and empty the batch */
+   uint32_t size() { return count; };
+};
+
+/*
+ * Read the file at *pos of a message
+ *  returns 1 with the file, 0 at the end, -1 if the message is corrupted
+ */
+int acc_batch_next(char *msg, int32_t msglen, int32_t *pos, acc_batch_file *file);
+
+#endif
@@ -0,0 +1,953 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+*/
+/*
+ * Compact file list for the accurate mode, see acclist.h
+ *
+ *  A file record is:
+ *    id, directory node            varint
+ *    base name                     string + \0
+ *    flags                         byte, ACC_SAME_xxx
+ *    delta_seq                     zigzag varint, if not 0
+ *    mode nlink uid gid            varint, if not the common value
+ *    ino                           zigzag varint, from the directory base
+ *    size                          varint
+ *    mtime                         zigzag varint, from the directory base
+ *    ctime, atime                  zigzag varint, from mtime
+ *    checksum length*2 + is_text   varint
+ *    checksum                      bytes
+ *
+ *  A file name is split after its last '/' (a trailing '/' of a
+ *  directory is kept with the base name), each component of the
+ *  directory part including its '/' is a node of the tree.
+ */
+
+#include "bacula.h"
+
+static const int dbglvl = 500;
+
+#define ACC_NONE       ((uint32_t)~0)
+#define ACC_MAX_BLOCKS (1 << (32 - (ACC_BLOCK_SHIFT - 2)))
+
+/* Longest checksum string that we try to decode from base64 */
+#define ACC_MAX_B64    BASE64_SIZE(CRYPTO_DIGEST_MAX_SIZE)
+
+/* First size of a block, then doubled up to ACC_BLOCK_SIZE */
+#define ACC_MIN_BLOCK  (64 * 1024)
+
+/* Fields of a record that are not stored */
+#define ACC_DELTA_0    0x01            /* delta_seq is 0 */
+#define ACC_SAME_MODE  0x02            /* mode of the directory base */
+#define ACC_NLINK_1    0x04            /* nlink is 1 */
+#define ACC_SAME_UID   0x08            /* uid of the directory base */
+#define ACC_SAME_GID   0x10            /* gid of the directory base */
+#define ACC_SAME_CTIME 0x20            /* ctime is mtime */
+
+static inline uint32_t acc_hash(uint32_t seed, const char *s, int len)
+{
+   uint32_t h = 2166136261u ^ (seed * 0x9E3779B1u);
+   for (int i = 0; i < len; i++) {
+      h = (h ^ (uint8_t)s[i]) * 16777619u;
+   }
+   h ^= h >> 16;
+   h *= 0x85EBCA6Bu;
+   h ^= h >> 13;
+   return h;
+}
+
+static inline uint8_t *put_varint(uint8_t *p, uint64_t v)
+{
+   while (v >= 0x80) {
+      *p++ = (uint8_t)v | 0x80;
+      v >>= 7;
+   }
+   *p++ = (uint8_t)v;
+   return p;
+}
+
+static inline const uint8_t *get_varint(const uint8_t *p, uint64_t *v)
+{
+   uint64_t val = 0;
+   int shift = 0;
+   while (*p & 0x80) {
+      val |= (uint64_t)(*p++ & 0x7F) << shift;
+      shift += 7;
+   }
+   *v = val | ((uint64_t)*p++ << shift);
+   return p;
+}
+
+static inline uint64_t zigzag(int64_t v)
+{
+   return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t v)
+{
+   return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+/*
+ * Split a file name into the directory and the base name,
+ *  return the length of the directory part
+ */
+static int split_fname(const char *fname, int len)
+{
+   int i = len - 1;
+   if (i > 0 && fname[i] == '/') {
+      i--;                    /* keep the trailing / with the base name */
+   }
+   for ( ; i >= 0; i--) {
+      if (fname[i] == '/') {
+         return i + 1;
+      }
+   }
+   return 0;
+}
+
+void acc_pool::init()
+{
+   blocks = NULL;
+   used = NULL;
+   nb_blocks = max_blocks = last_size = 0;
+}
+
+void acc_pool::destroy()
+{
+   for (uint32_t i = 0; i < nb_blocks; i++) {
+      free(blocks[i]);
+   }
+   if (blocks) {
+      free(blocks);
+      free(used);
+   }
+   init();
+}
+
+/*
+ * Get size bytes aligned on 4 bytes, the first 4 bytes of
+ *  the first block are never used, so a 0 reference is free.
+ */
+char *acc_pool::alloc(uint32_t size, uint32_t *ref)
+{
+   char *p;
+   uint32_t last;
+
+   size = (size + 3) & ~3;
+   if (size > ACC_BLOCK_SIZE - 4) {
+      return NULL;
+   }
+   if (nb_blocks == 0 || used[nb_blocks-1] + size > ACC_BLOCK_SIZE) {
+      if (nb_blocks == ACC_MAX_BLOCKS) {
+         return NULL;
+      }
+      if (nb_blocks == max_blocks) {
+         max_blocks = MAX(16, max_blocks * 2);
+         blocks = (char **)realloc(blocks, max_blocks * sizeof(char *));
+         used = (uint32_t *)realloc(used, max_blocks * sizeof(uint32_t));
+      }
+      last_size = ACC_MIN_BLOCK;
+      blocks[nb_blocks] = (char *)malloc(last_size);
+      used[nb_blocks] = (nb_blocks == 0) ? 4 : 0;
+      nb_blocks++;
+   }
+   last = nb_blocks - 1;
+   if (used[last] + size > last_size) {
+      while (used[last] + size > last_size) {
+         last_size *= 2;
+      }
+      blocks[last] = (char *)realloc(blocks[last], last_size);
+   }
+   p = blocks[last] + used[last];
+   *ref = (last << (ACC_BLOCK_SHIFT - 2)) | (used[last] >> 2);
+   used[last] += size;
+   return p;
+}
+
+/* Compare a binary checksum with the one of the list */
+bool acc_file::chksum_equal(const uint8_t *bin, uint32_t len)
+{
+   if (chksum_text) {
+      char buf[ACC_MAX_B64];
+      bin_to_base64(buf, sizeof(buf), (char *)bin, len, true);
+      return chksum_len == strlen(buf) && memcmp(buf, chksum, chksum_len) == 0;
+   }
+   return chksum_len == len && memcmp(bin, chksum, len) == 0;
+}
+
+/* Compare a base64 checksum with the one of the list */
+bool acc_file::chksum_equal(const char *str)
+{
+   if (chksum_text) {
+      return chksum_len == strlen(str) && memcmp(str, chksum, chksum_len) == 0;
+   }
+   char buf[ACC_MAX_B64];
+   bin_to_base64(buf, sizeof(buf), (char *)chksum, chksum_len, true);
+   return strcmp(buf, str) == 0;
+}
+
+/* Edit the checksum as it was sent by the Director */
+char *acc_file::chksum_str(POOLMEM *&buf)
+{
+   if (chksum_text) {
+      buf = check_pool_memory_size(buf, chksum_len + 1);
+      memcpy(buf, chksum, chksum_len);
+      buf[chksum_len] = 0;
+   } else {
+      buf = check_pool_memory_size(buf, ACC_MAX_B64);
+      bin_to_base64(buf, ACC_MAX_B64, (char *)chksum, chksum_len, true);
+   }
+   return buf;
+}
+
+acclist::acclist(uint32_t nbfile)
+{
+   names.init();
+   files.init();
+   max_dirs = 64;
+   nb_dirs = 1;                       /* node 0 is the root */
+   dirs = (acc_dir *)malloc(max_dirs * sizeof(acc_dir));
+   bmemzero(dirs, sizeof(acc_dir));
+   dir_mask = 255;
+   dir_table = (uint32_t *)malloc((dir_mask + 1) * sizeof(uint32_t));
+   bmemzero(dir_table, (dir_mask + 1) * sizeof(uint32_t));
+
+   /* Keep the load of the file table under 3/4 */
+   file_size = MAX(256, (uint64_t)nbfile * 4 / 3 + 2);
+   file_table = (uint32_t *)malloc(file_size * sizeof(uint32_t));
+   bmemzero(file_table, file_size * sizeof(uint32_t));
+   num_items = 0;
+
+   seen_bits = MAX(1024, nbfile);
+   seen = (char *)malloc(nbytes_for_bits(seen_bits));
+   bmemzero(seen, nbytes_for_bits(seen_bits));
+
+   rec = get_pool_memory(PM_MESSAGE);
+   last_dir = get_pool_memory(PM_FNAME);
+   last_dir_len = -1;
+   last_dir_id = 0;
+   walk_fname = get_pool_memory(PM_FNAME);
+   walk_dir = ACC_NONE;
+   walk_dir_len = 0;
+   walk_block = walk_pos = 0;
+}
+
+void acclist::destroy()
+{
+   if (!dirs) {
+      return;
+   }
+   names.destroy();
+   files.destroy();
+   free(dirs);
+   free(dir_table);
+   free(file_table);
+   free(seen);
+   free_pool_memory(rec);
+   free_pool_memory(last_dir);
+   free_pool_memory(walk_fname);
+   dirs = NULL;
+   num_items = 0;
+}
+
+void acclist::grow_dir_table()
+{
+   uint32_t size = (dir_mask + 1) * 2;
+   free(dir_table);
+   dir_mask = size - 1;
+   dir_table = (uint32_t *)malloc(size * sizeof(uint32_t));
+   bmemzero(dir_table, size * sizeof(uint32_t));
+   for (uint32_t id = 1; id < nb_dirs; id++) {
+      uint32_t i = dirs[id].hash & dir_mask;
+      while (dir_table[i]) {
+         i = (i + 1) & dir_mask;
+      }
+      dir_table[i] = id;
+   }
+}
+
+/*
+ * Find the node of a directory, the path must end with a /.
+ *  With create, the missing nodes are added.
+ *
+ *  Returns: the node or ACC_NONE
+ */
+uint32_t acclist::find_dir(const char *path, int len, bool create)
+{
+   uint32_t node = 0;
+   int start = 0;
+
+   if (len == 0) {
+      return 0;
+   }
+   if (len == last_dir_len && memcmp(path, last_dir, len) == 0) {
+      if (last_dir_id != ACC_NONE || !create) {
+         return last_dir_id;
+      }
+   } else if (last_dir_len > 0 && last_dir_id != ACC_NONE &&
+              len > last_dir_len && memcmp(path, last_dir, last_dir_len) == 0) {
+      node = last_dir_id;             /* subdirectory of the last one */
+      start = last_dir_len;
+   }
+
+   while (start < len) {
+      const char *comp = path + start;
+      const char *end = (const char *)memchr(comp, '/', len - start);
+      int clen = end ? end - comp + 1 : len - start;
+      uint32_t h = acc_hash(node, comp, clen);
+      uint32_t i, id;
+
+      for (i = h & dir_mask; (id = dir_table[i]) != 0; i = (i + 1) & dir_mask) {
+         if (dirs[id].hash == h && dirs[id].parent == node) {
+            char *name = names.ptr(dirs[id].name);
+            if (memcmp(name, comp, clen) == 0 && name[clen] == 0) {
+               break;
+            }
+         }
+      }
+      if (id == 0) {
+         if (!create) {
+            node = ACC_NONE;
+            break;
+         }
+         uint32_t ref;
+         char *name = names.alloc(clen + 1, &ref);
+         if (!name) {
+            return ACC_NONE;
+         }
+         memcpy(name, comp, clen);
+         name[clen] = 0;
+         if (nb_dirs == max_dirs) {
+            max_dirs *= 2;
+            dirs = (acc_dir *)realloc(dirs, max_dirs * sizeof(acc_dir));
+         }
+         id = nb_dirs++;
+         bmemzero(&dirs[id], sizeof(acc_dir));
+         dirs[id].parent = node;
+         dirs[id].name = ref;
+         dirs[id].hash = h;
+         dir_table[i] = id;
+         if (nb_dirs > (dir_mask + 1) / 4 * 3) {
+            grow_dir_table();
+         }
+      }
+      node = id;
+      start += clen;
+   }
+
+   last_dir = check_pool_memory_size(last_dir, len + 1);
+   memcpy(last_dir, path, len);
+   last_dir_len = len;
+   last_dir_id = node;
+   return node;
+}
+
+/* Edit the path of a directory node, return its length */
+uint32_t acclist::dir_path(uint32_t dir, POOLMEM *&buf)
+{
+   uint32_t len = 0, pos;
+
+   for (uint32_t id = dir; id; id = dirs[id].parent) {
+      len += strlen(names.ptr(dirs[id].name));
+   }
+   buf = check_pool_memory_size(buf, len + 1);
+   pos = len;
+   for (uint32_t id = dir; id; id = dirs[id].parent) {
+      char *name = names.ptr(dirs[id].name);
+      int clen = strlen(name);
+      pos -= clen;
+      memcpy(buf + pos, name, clen);
+   }
+   buf[len] = 0;
+   return len;
+}
+
+/* Hash of a file record, from its directory and its base name */
+static inline uint32_t acc_record_hash(const uint8_t *p)
+{
+   uint64_t id, dir;
+   p = get_varint(p, &id);
+   p = get_varint(p, &dir);
+   return acc_hash((uint32_t)dir, (const char *)p, strlen((const char *)p));
+}
+
+/* First slot of a hash in the file table, the table size is not a power of 2 */
+static inline uint32_t acc_slot(uint32_t hash, uint32_t size)
+{
+   return (uint32_t)(((uint64_t)hash * size) >> 32);
+}
+
+void acclist::insert_file(uint32_t ref, uint32_t hash)
+{
+   uint32_t i = acc_slot(hash, file_size);
+   while (file_table[i]) {
+      if (++i == file_size) {
+         i = 0;
+      }
+   }
+   file_table[i] = ref;
+}
+
+void acclist::grow_file_table()
+{
+   uint32_t *old = file_table;
+   uint32_t old_size = file_size;
+
+   file_size = old_size * 2;
+   file_table = (uint32_t *)malloc(file_size * sizeof(uint32_t));
+   bmemzero(file_table, file_size * sizeof(uint32_t));
+   for (uint32_t i = 0; i < old_size; i++) {
+      if (old[i]) {
+         insert_file(old[i], acc_record_hash((uint8_t *)files.ptr(old[i])));
+      }
+   }
+   free(old);
+}
+
+/*
+ * Decode a file record into elt, return the end of the record.
+ *  The directory node and the base name are returned for the walk.
+ */
+const uint8_t *acclist::decode(const uint8_t *p, acc_file *elt,
+                               uint32_t *dir, const char **name)
+{
+   uint64_t v;
+   int64_t mtime;
+   acc_dir *d;
+   uint8_t flags;
+
+   p = get_varint(p, &v);
+   elt->id = (uint32_t)v;
+   p = get_varint(p, &v);
+   *dir = (uint32_t)v;
+   *name = (const char *)p;
+   p += strlen((const char *)p) + 1;
+
+   d = &dirs[*dir];
+   flags = *p++;
+   bmemzero(&elt->statp, sizeof(elt->statp));
+   elt->delta_seq = 0;
+   if (!(flags & ACC_DELTA_0)) {
+      p = get_varint(p, &v);
+      elt->delta_seq = (int32_t)unzigzag(v);
+   }
+   v = d->mode;
+   if (!(flags & ACC_SAME_MODE)) {
+      p = get_varint(p, &v);
+   }
+   elt->statp.st_mode = (mode_t)v;
+   v = 1;
+   if (!(flags & ACC_NLINK_1)) {
+      p = get_varint(p, &v);
+   }
+   elt->statp.st_nlink = (nlink_t)v;
+   v = d->uid;
+   if (!(flags & ACC_SAME_UID)) {
+      p = get_varint(p, &v);
+   }
+   elt->statp.st_uid = (uid_t)v;
+   v = d->gid;
+   if (!(flags & ACC_SAME_GID)) {
+      p = get_varint(p, &v);
+   }
+   elt->statp.st_gid = (gid_t)v;
+   p = get_varint(p, &v);
+   elt->statp.st_ino = (ino_t)(d->ino + unzigzag(v));
+   p = get_varint(p, &v);
+   elt->statp.st_size = (off_t)v;
+   p = get_varint(p, &v);
+   mtime = d->mtime + unzigzag(v);
+   elt->statp.st_mtime = (time_t)mtime;
+   elt->statp.st_ctime = (time_t)mtime;
+   if (!(flags & ACC_SAME_CTIME)) {
+      p = get_varint(p, &v);
+      elt->statp.st_ctime = (time_t)(mtime + unzigzag(v));
+   }
+   p = get_varint(p, &v);
+   elt->statp.st_atime = (time_t)(mtime + unzigzag(v));
+   p = get_varint(p, &v);
+   elt->chksum_text = v & 1;
+   elt->chksum_len = (uint32_t)(v >> 1);
+   elt->chksum = p;
+   elt->seen = is_seen(elt->id);
+   elt->fname = NULL;
+   return p + elt->chksum_len;
+}
+
+/*
+ * Add a file to the list. If the file is already in the list,
+ *  the first one is kept.
+ *
+ *  Returns: false if the file cannot be stored
+ */
+bool acclist::add(const char *fname, struct stat *statp, int32_t delta_seq,
+                  const char *chksum)
+{
+   int len = strlen(fname);
+   int dlen = split_fname(fname, len);
+   const char *base = fname + dlen;
+   int blen = len - dlen;
+   int clen = strlen(chksum);
+   uint8_t bin[ACC_MAX_B64];
+   const uint8_t *csum = (const uint8_t *)chksum;
+   bool text = true;
+   uint32_t dir, h, ref;
+   acc_file elt;
+   acc_dir *d;
+   uint8_t *p, flags;
+   char *dest;
+
+   if (lookup(fname, &elt)) {
+      return true;
+   }
+   dir = find_dir(fname, dlen, true);
+   if (dir == ACC_NONE) {
+      return false;
+   }
+   h = acc_hash(dir, base, blen);
+
+   /* Keep the checksum in binary when we can edit it back */
+   if (clen > 0 && clen < ACC_MAX_B64) {
+      char buf[ACC_MAX_B64];
+      int n = base64_to_bin((char *)bin, sizeof(bin), (char *)chksum, clen);
+      bin_to_base64(buf, sizeof(buf), (char *)bin, n, true);
+      if (n > 0 && strcmp(buf, chksum) == 0) {
+         csum = bin;
+         clen = n;
+         text = false;
+      }
+   }
+
+   rec = check_pool_memory_size(rec, blen + clen + 160);
+   p = (uint8_t *)rec;
+   p = put_varint(p, num_items);
+   p = put_varint(p, dir);
+   memcpy(p, base, blen + 1);
+   p += blen + 1;
+   d = &dirs[dir];
+   if (!d->has_base) {
+      d->ino = (uint64_t)statp->st_ino;
+      d->mtime = statp->st_mtime;
+      d->mode = (uint32_t)statp->st_mode;
+      d->uid = (uint32_t)statp->st_uid;
+      d->gid = (uint32_t)statp->st_gid;
+      d->has_base = true;
+   }
+   flags = 0;
+   if (delta_seq == 0) {
+      flags |= ACC_DELTA_0;
+   }
+   if ((uint64_t)statp->st_mode == d->mode) {
+      flags |= ACC_SAME_MODE;
+   }
+   if (statp->st_nlink == 1) {
+      flags |= ACC_NLINK_1;
+   }
+   if ((uint64_t)statp->st_uid == d->uid) {
+      flags |= ACC_SAME_UID;
+   }
+   if ((uint64_t)statp->st_gid == d->gid) {
+      flags |= ACC_SAME_GID;
+   }
+   if (statp->st_ctime == statp->st_mtime) {
+      flags |= ACC_SAME_CTIME;
+   }
+   *p++ = flags;
+   if (!(flags & ACC_DELTA_0)) {
+      p = put_varint(p, zigzag(delta_seq));
+   }
+   if (!(flags & ACC_SAME_MODE)) {
+      p = put_varint(p, (uint64_t)statp->st_mode);
+   }
+   if (!(flags & ACC_NLINK_1)) {
+      p = put_varint(p, (uint64_t)statp->st_nlink);
+   }
+   if (!(flags & ACC_SAME_UID)) {
+      p = put_varint(p, (uint64_t)statp->st_uid);
+   }
+   if (!(flags & ACC_SAME_GID)) {
+      p = put_varint(p, (uint64_t)statp->st_gid);
+   }
+   p = put_varint(p, zigzag((int64_t)((uint64_t)statp->st_ino - d->ino)));
+   p = put_varint(p, (uint64_t)statp->st_size);
+   p = put_varint(p, zigzag((int64_t)statp->st_mtime - d->mtime));
+   if (!(flags & ACC_SAME_CTIME)) {
+      p = put_varint(p, zigzag((int64_t)statp->st_ctime - statp->st_mtime));
+   }
+   p = put_varint(p, zigzag((int64_t)statp->st_atime - statp->st_mtime));
+   p = put_varint(p, ((uint64_t)clen << 1) | (text ? 1 : 0));
+   memcpy(p, csum, clen);
+   p += clen;
+
+   dest = files.alloc(p - (uint8_t *)rec, &ref);
+   if (!dest) {
+      Dmsg1(dbglvl, "Cannot store <%s> in the accurate list\n", fname);
+      return false;
+   }
+   memcpy(dest, rec, p - (uint8_t *)rec);
+
+   if (num_items >= seen_bits) {
+      uint32_t old = nbytes_for_bits(seen_bits);
+      seen_bits *= 2;
+      seen = (char *)realloc(seen, nbytes_for_bits(seen_bits));
+      bmemzero(seen + old, nbytes_for_bits(seen_bits) - old);
+   }
+   num_items++;
+   insert_file(ref, h);
+   if (num_items > (uint64_t)file_size * 3 / 4) {
+      grow_file_table();
+   }
+   return true;
+}
+
+/*
+ * Find a file in the list
+ *
+ *  Returns: true and elt filled if the file is in the list
+ */
+bool acclist::lookup(const char *fname, acc_file *elt)
+{
+   int len = strlen(fname);
+   int dlen = split_fname(fname, len);
+   const char *base = fname + dlen;
+   uint32_t dir, h, i, ref;
+
+   dir = find_dir(fname, dlen, false);
+   if (dir == ACC_NONE) {
+      return false;
+   }
+   h = acc_hash(dir, base, len - dlen);
+   for (i = acc_slot(h, file_size); (ref = file_table[i]) != 0; ) {
+      const uint8_t *p = (const uint8_t *)files.ptr(ref);
+      const char *name;
+      uint64_t id, d;
+      p = get_varint(p, &id);
+      p = get_varint(p, &d);
+      if (d == dir && strcmp((const char *)p, base) == 0) {
+         uint32_t edir;
+         decode((const uint8_t *)files.ptr(ref), elt, &edir, &name);
+         return true;
+      }
+      if (++i == file_size) {
+         i = 0;
+      }
+   }
+   return false;
+}
+
+/* Walk the list in the order of insertion */
+bool acclist::first(acc_file *elt)
+{
+   walk_block = 0;
+   walk_pos = 4;
+   walk_dir = ACC_NONE;
+   return next(elt);
+}
+
+bool acclist::next(acc_file *elt)
+{
+   const uint8_t *p, *end;
+   const char *name;
+   uint32_t dir;
+   int blen;
+
+   while (walk_block < files.nb_blocks && walk_pos >= files.used[walk_block]) {
+      walk_block++;
+      walk_pos = 0;
+   }
+   if (walk_block >= files.nb_blocks) {
+      return false;
+   }
+   p = (const uint8_t *)files.blocks[walk_block] + walk_pos;
+   end = decode(p, elt, &dir, &name);
+   walk_pos += ((end - p) + 3) & ~3;
+
+   if (dir != walk_dir) {
+      walk_dir_len = dir_path(dir, walk_fname);
+      walk_dir = dir;
+   }
+   blen = strlen(name);
+   walk_fname = check_pool_memory_size(walk_fname, walk_dir_len + blen + 1);
+   memcpy(walk_fname + walk_dir_len, name, blen + 1);
+   elt->fname = walk_fname;
+   return true;
+}
+
+uint64_t acclist::mem_size()
+{
+   uint64_t size;
+
+   size = names.last_size + files.last_size;
+   if (names.nb_blocks > 1) {
+      size += (uint64_t)(names.nb_blocks - 1) * ACC_BLOCK_SIZE;
+   }
+   if (files.nb_blocks > 1) {
+      size += (uint64_t)(files.nb_blocks - 1) * ACC_BLOCK_SIZE;
+   }
+   size += (uint64_t)(names.max_blocks + files.max_blocks) *
+      (sizeof(char *) + sizeof(uint32_t));
+   size += (uint64_t)max_dirs * sizeof(acc_dir);
+   size += (uint64_t)(dir_mask + 1 + file_size) * sizeof(uint32_t);
+   size += nbytes_for_bits(seen_bits);
+   return size;
+}
+
+void acclist::stats()
+{
+   uint64_t used = 0;
+   for (uint32_t i = 0; i < files.nb_blocks; i++) {
+      used += files.used[i];
+   }
+   Dmsg5(0, "acclist: files=%u dirs=%u mem=%lld bytes records=%lld bytes table=%u\n",
+         num_items, nb_dirs - 1, mem_size(), used, file_size);
+}
+
+#ifndef TEST_PROGRAM
+#define TEST_PROGRAM_A
+#endif
+
+#ifdef TEST_PROGRAM
+#include "unittests.h"
+
+/* The file list as it was stored in a htable */
+struct OLDCurFile {
+   hlink link;
+   char *fname;
+   char *lstat;
+   char *chksum;
+   int32_t delta_seq;
+   bool seen;
+};
+
+#define NDIRS    2000
+#define NFILES   100                  /* per directory */
+
+static void make_file(int i, int j, char *fname, struct stat *statp, char *chksum)
+{
+   uint8_t md[16];
+
+   sprintf(fname, "/home/user%d/projects/bacula/src/module%d/dir%d/%s%d.c",
+           i % 20, i % 100, i, (j % 3) ? "source_file_" : "f", j);
+   bmemzero(statp, sizeof(struct stat));
+   statp->st_mode = 0100644;
+   statp->st_nlink = 1;
+   statp->st_uid = 1000 + i % 20;
+   statp->st_gid = 100;
+   statp->st_ino = 1234567 + i * NFILES + j;
+   statp->st_size = (i * 7919 + j * 104729) % 1000000;
+   statp->st_mtime = 1600000000 + i * 13 + j;
+   statp->st_ctime = statp->st_mtime + j % 7;
+   statp->st_atime = statp->st_mtime + 86400;
+   for (int k = 0; k < 16; k++) {
+      md[k] = (uint8_t)(i * 31 + j * 17 + k * 131);
+   }
+   bin_to_base64(chksum, 30, (char *)md, 16, true);
+}
+
+/* Size of the lstat string, as done by encode_stat() */
+static int lstat_len(struct stat *statp)
+{
+   char buf[500], *p = buf;
+   p += to_base64(0x801, p); *p++ = ' ';
+   p += to_base64(statp->st_ino, p); *p++ = ' ';
+   p += to_base64(statp->st_mode, p); *p++ = ' ';
+   p += to_base64(statp->st_nlink, p); *p++ = ' ';
+   p += to_base64(statp->st_uid, p); *p++ = ' ';
+   p += to_base64(statp->st_gid, p); *p++ = ' ';
+   p += to_base64(0, p); *p++ = ' ';
+   p += to_base64(statp->st_size, p); *p++ = ' ';
+   p += to_base64(4096, p); *p++ = ' ';
+   p += to_base64(statp->st_size / 512 + 1, p); *p++ = ' ';
+   p += to_base64(statp->st_atime, p); *p++ = ' ';
+   p += to_base64(statp->st_mtime, p); *p++ = ' ';
+   p += to_base64(statp->st_ctime, p); *p++ = ' ';
+   p += to_base64(0, p); *p++ = ' ';
+   p += to_base64(0, p); *p++ = ' ';
+   p += to_base64(1, p); *p++ = ' ';
+   p += to_base64(0, p);
+   return p - buf;
+}
+
+int main()
+{
+   Unittests acclist_test("acclist_test");
+   char fname[512], chksum[100];
+   struct stat st;
+   acclist *list;
+   acc_file elt;
+   OLDCurFile *item = NULL;
+   htable *old;
+   uint64_t old_size = 0;
+   btime_t t0, t1, t2;
+   bool check_cont;
+   int i, j, count;
+
+   Pmsg0(0, "Initialize tests ...\n");
+   list = New(acclist(100));
+   ok(list->size() == 0, "Default initialization");
+   ok(!list->lookup("/etc/passwd", &elt), "Lookup in an empty list");
+
+   /* Corner cases of the names */
+   const char *names[] = { "/", "/etc/", "/etc/passwd", "file", "dir/",
+                           "c:/", "c:/windows/", "c:/windows/win.ini",
+                           "//double//slash", "/etc/passwd/", "/etc/pass",
+                           "/a/b/c/d/e/f/g/h/i/j/k/l/m/n/o/p/q/r/s/t/u/v/w/x/y/z",
+                           NULL };
+   bmemzero(&st, sizeof(st));
+   for (i = 0; names[i]; i++) {
+      st.st_size = i;
+      st.st_mtime = 1600000000 - i;         /* ctime and atime before mtime */
+      st.st_ctime = 1000 + i;
+      st.st_atime = 0;
+      st.st_uid = 4000000000U;
+      st.st_ino = (ino_t)0xFFFFFFFFFFFFULL + i;
+      list->add(names[i], &st, i - 5, (i % 2) ? "" : "1B2M2Y8AsgTpgAmY7PhCfg");
+   }
+   list->add("/etc/passwd", &st, 0, "");    /* duplicate, the first is kept */
+   ok(list->size() == (uint32_t)i, "Checking size");
+   check_cont = true;
+   for (i = 0; names[i]; i++) {
+      if (!list->lookup(names[i], &elt) ||
+          elt.statp.st_size != i ||
+          elt.statp.st_mtime != 1600000000 - i ||
+          elt.statp.st_ctime != 1000 + i ||
+          elt.statp.st_atime != 0 ||
+          elt.statp.st_uid != 4000000000U ||
+          elt.statp.st_ino != (ino_t)0xFFFFFFFFFFFFULL + i ||
+          elt.delta_seq != i - 5 ||
+          elt.chksum_len != (uint32_t)((i % 2) ? 0 : 16)) {
+         Pmsg1(0, "Error on %s\n", names[i]);
+         check_cont = false;
+      }
+   }
+   ok(check_cont, "Checking corner cases lookup");
+   ok(!list->lookup("/etc/pas", &elt) && !list->lookup("/etc", &elt) &&
+      !list->lookup("/etc/passwd/x", &elt) && !list->lookup("c:/windows", &elt) &&
+      !list->lookup("", &elt), "Checking missing files");
+
+   /* Checksums that cannot be edited back are kept as text */
+   list->add("/text/1", &st, 0, "not a base64 checksum!");
+   list->add("/text/2", &st, 0, "1B2M2Y8AsgTpgAmY7PhCfg==");
+   list->lookup("/text/1", &elt);
+   POOLMEM *buf = get_pool_memory(PM_MESSAGE);
+   ok(elt.chksum_text && strcmp(elt.chksum_str(buf), "not a base64 checksum!") == 0,
+      "Checking text checksum");
+   list->lookup("/text/2", &elt);
+   ok(elt.chksum_text && elt.chksum_equal("1B2M2Y8AsgTpgAmY7PhCfg=="),
+      "Checking padded checksum");
+   list->lookup("/etc/passwd", &elt);
+   ok(!elt.chksum_text && elt.chksum_equal("1B2M2Y8AsgTpgAmY7PhCfg") &&
+      !elt.chksum_equal("1B2M2Y8AsgTpgAmY7PhCfh") &&
+      strcmp(elt.chksum_str(buf), "1B2M2Y8AsgTpgAmY7PhCfg") == 0,
+      "Checking binary checksum");
+
+   /* Seen bitmap and walk */
+   list->lookup("/etc/", &elt);
+   list->set_seen(elt.id);
+   count = 0;
+   check_cont = true;
+   foreach_acclist(&elt, list) {
+      if (count < 12 && strcmp(elt.fname, names[count]) != 0) {
+         Pmsg2(0, "Walk error %s != %s\n", elt.fname, names[count]);
+         check_cont = false;
+      }
+      if (elt.seen != (strcmp(elt.fname, "/etc/") == 0)) {
+         check_cont = false;
+      }
+      count++;
+   }
+   ok(check_cont && count == (int)list->size(), "Checking walk and seen flag");
+   free_pool_memory(buf);
+   delete list;
+
+   /* Big list, compared to the htable */
+   Pmsg1(0, "Inserting %d items\n", NDIRS * NFILES);
+   list = New(acclist(NDIRS * NFILES));
+   old = (htable *)malloc(sizeof(htable));
+   old->init(item, &item->link, NDIRS * NFILES);
+   t0 = get_current_btime();
+   for (i = 0; i < NDIRS; i++) {
+      for (j = 0; j < NFILES; j++) {
+         make_file(i, j, fname, &st, chksum);
+         list->add(fname, &st, 0, chksum);
+      }
+   }
+   t1 = get_current_btime();
+   for (i = 0; i < NDIRS; i++) {
+      for (j = 0; j < NFILES; j++) {
+         make_file(i, j, fname, &st, chksum);
+         int len = strlen(fname) + lstat_len(&st) + strlen(chksum) + 5;
+         item = (OLDCurFile *)old->hash_malloc(sizeof(OLDCurFile) + len + 3);
+         item->fname = (char *)item + sizeof(OLDCurFile);
+         strcpy(item->fname, fname);
+         old->insert(item->fname, item);
+         old_size += sizeof(OLDCurFile) + len + 3;
+      }
+   }
+   t2 = get_current_btime();
+   old_size += (NDIRS * NFILES / 4) * sizeof(hlink *);
+   ok(list->size() == NDIRS * NFILES, "Checking size");
+   Pmsg4(0, "Insert: acclist %lldms, htable %lldms. Memory: acclist %lldKB, htable %lldKB\n",
+         (t1 - t0) / 1000, (t2 - t1) / 1000, list->mem_size() / 1024, old_size / 1024);
+   ok(list->mem_size() * 4 <= old_size, "Checking memory usage");
+   list->stats();
+
+   t0 = get_current_btime();
+   check_cont = true;
+   for (i = 0; i < NDIRS; i++) {
+      for (j = 0; j < NFILES; j++) {
+         make_file(i, j, fname, &st, chksum);
+         if (!list->lookup(fname, &elt) ||
+             elt.statp.st_ino != st.st_ino ||
+             elt.statp.st_mtime != st.st_mtime ||
+             elt.statp.st_ctime != st.st_ctime ||
+             elt.statp.st_size != st.st_size ||
+             !elt.chksum_equal(chksum)) {
+            check_cont = false;
+         }
+         list->set_seen(elt.id);
+      }
+   }
+   t1 = get_current_btime();
+   for (i = 0; i < NDIRS; i++) {
+      for (j = 0; j < NFILES; j++) {
+         make_file(i, j, fname, &st, chksum);
+         if (!old->lookup(fname)) {
+            check_cont = false;
+         }
+      }
+   }
+   t2 = get_current_btime();
+   ok(check_cont, "Checking content");
+   Pmsg2(0, "Lookup: acclist %lldms, htable %lldms\n",
+         (t1 - t0) / 1000, (t2 - t1) / 1000);
+
+   count = 0;
+   foreach_acclist(&elt, list) {
+      if (elt.seen && old->lookup(elt.fname)) {
+         count++;
+      }
+   }
+   ok(count == NDIRS * NFILES, "Checking number of items");
+
+   old->destroy();
+   free(old);
+   delete list;
+   return report();
+}
+#endif
@@ -0,0 +1,148 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+*/
+/*
+ * Compact list of the files of the previous jobs used by the
+ *  accurate mode of the File Daemon.
+ *
+ *  Directory names are stored in a tree, one node per path component,
+ *  so a directory is stored only once for all its files and
+ *  subdirectories. Each file is a record in big memory blocks holding
+ *  its directory node, its base name, the stat fields compared by the
+ *  accurate code as variable length integers and the checksum decoded
+ *  from base64. The hash tables hold only 32 bit references and the
+ *  seen flags are kept in a separate bitmap.
+ *
+ *  The list is not thread safe, lookups use a cache of the last
+ *  directory.
+ */
+
+#ifndef _ACCLIST_H_
+#define _ACCLIST_H_
+
+/* Memory block of the list, a record never spans two blocks */
+#define ACC_BLOCK_SHIFT 20
+#define ACC_BLOCK_SIZE  (1 << ACC_BLOCK_SHIFT)
+
+/* A file of the list, filled by lookup() and while walking the list */
+struct acc_file {
+   char *fname;                       /* file name, set while walking */
+   uint32_t id;                       /* file index in the list */
+   int32_t delta_seq;                 /* delta sequence */
+   bool seen;                         /* file was seen by the job */
+   bool chksum_text;                  /* checksum was not base64 */
+   uint32_t chksum_len;               /* checksum length, 0 if none */
+   const uint8_t *chksum;             /* binary (or text) checksum */
+   struct stat statp;                 /* only the fields we compare */
+
+   bool chksum_equal(const uint8_t *bin, uint32_t len);
+   bool chksum_equal(const char *str);
+   char *chksum_str(POOLMEM *&buf);
+};
+
+#define foreach_acclist(elt, tbl) \
+        for (bool _acc_more = (tbl)->first(elt); \
+             _acc_more; \
+             _acc_more = (tbl)->next(elt))
+
+/*
+ * Chain of big blocks, an item is found with a 32 bit reference.
+ *  The last block grows with realloc(), so a pointer returned by
+ *  ptr() is valid only until the next alloc().
+ */
+struct acc_pool {
+   char **blocks;                     /* allocated blocks */
+   uint32_t *used;                    /* bytes used in each block */
+   uint32_t nb_blocks;                /* number of blocks in use */
+   uint32_t max_blocks;               /* size of the arrays */
+   uint32_t last_size;                /* size of the last block */
+
+   void init();
+   void destroy();
+   char *alloc(uint32_t size, uint32_t *ref);
+   char *ptr(uint32_t ref) {
+      return blocks[ref >> (ACC_BLOCK_SHIFT - 2)] +
+         ((ref << 2) & (ACC_BLOCK_SIZE - 1));
+   };
+};
+
+/*
+ * A node of the directory tree. The attributes of the first file
+ *  added in the directory are used as base for the other ones.
+ */
+struct acc_dir {
+   uint64_t ino;                      /* base inode */
+   int64_t mtime;                     /* base mtime */
+   uint32_t parent;                   /* parent node, 0 is the root */
+   uint32_t name;                     /* reference of the component */
+   uint32_t hash;                     /* hash of parent and component */
+   uint32_t mode;                     /* common mode */
+   uint32_t uid;                      /* common uid */
+   uint32_t gid;                      /* common gid */
+   bool has_base;                     /* a file was added in the directory */
+};
+
+class acclist : public SMARTALLOC {
+   acc_pool names;                    /* directory components */
+   acc_pool files;                    /* file records */
+   acc_dir *dirs;                     /* directory tree */
+   uint32_t nb_dirs;                  /* nodes in the tree */
+   uint32_t max_dirs;                 /* size of dirs */
+   uint32_t *dir_table;               /* hash of the tree nodes */
+   uint32_t dir_mask;                 /* dir_table size - 1 */
+   uint32_t *file_table;              /* hash of the file records */
+   uint32_t file_size;                /* file_table size */
+   uint32_t num_items;                /* number of files */
+   char *seen;                        /* seen bitmap */
+   uint32_t seen_bits;                /* size of the bitmap */
+   POOLMEM *rec;                      /* record being built */
+   POOLMEM *last_dir;                 /* last directory looked up */
+   int32_t last_dir_len;              /* its length, -1 if none */
+   uint32_t last_dir_id;              /* and its node */
+   POOLMEM *walk_fname;               /* file name while walking */
+   uint32_t walk_dir;                 /* node of the walk_fname directory */
+   int32_t walk_dir_len;              /* length of the directory part */
+   uint32_t walk_block;               /* walk position */
+   uint32_t walk_pos;
+
+   uint32_t find_dir(const char *path, int len, bool create);
+   void grow_dir_table();
+   void grow_file_table();
+   void insert_file(uint32_t ref, uint32_t hash);
+   const uint8_t *decode(const uint8_t *p, acc_file *elt, uint32_t *dir,
+                         const char **name);
+   uint32_t dir_path(uint32_t dir, POOLMEM *&buf);
+
+public:
+   acclist(uint32_t nbfile = 0);
+   ~acclist() { destroy(); };
+   bool add(const char *fname, struct stat *statp, int32_t delta_seq,
+            const char *chksum);
+   bool lookup(const char *fname, acc_file *elt);
+   void set_seen(uint32_t id) { set_bit(id, seen); };
+   bool is_seen(uint32_t id) { return bit_is_set(id, seen); };
+   bool first(acc_file *elt);         /* walk the list */
+   bool next(acc_file *elt);
+   uint32_t size() { return num_items; };
+   uint32_t dir_count() { return nb_dirs - 1; };
+   uint64_t mem_size();               /* bytes allocated */
+   void stats();
+   void destroy();
+};
+
+#endif
@@ -0,0 +1,761 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+*/
+/*
+ * Sorted file list of the accurate mode in a spool file, see accspool.h
+ *
+ *  A record is an acc_spool_rec followed by the file name and the
+ *  checksum, both terminated by \0. The file is written and read by
+ *  the same daemon, so the header is kept in the native format.
+ */
+
+#include "bacula.h"
+
+static const int dbglvl = 500;
+
+struct acc_spool_rec {
+   uint32_t len;                      /* length of the record */
+   int32_t delta_seq;
+   uint64_t ino;
+   int64_t size;
+   int64_t atime;
+   int64_t mtime;
+   int64_t ctime;
+   uint32_t mode;
+   uint32_t nlink;
+   uint32_t uid;
+   uint32_t gid;
+   uint8_t seen;                      /* updated in place */
+};
+
+#define REC_FNAME(p) ((char *)(p) + sizeof(acc_spool_rec))
+
+/*
+ * Length of the directory part of a file name, as it is stored
+ *  in the Path table. A directory has no file name part.
+ */
+static inline int acc_path_len(const char *fname, int len)
+{
+   if (len > 0 && fname[len - 1] == '/') {
+      return len;
+   }
+   for (int i = len - 1; i >= 0; i--) {
+      if (fname[i] == '/') {
+         return i + 1;
+      }
+   }
+   return 0;
+}
+
+/*
+ * The catalog sorts the list by Path then by Filename with a binary
+ *  collation, so "/a/b/" (Path of the files of b) comes after all the
+ *  files of "/a/", but before "/a/b/c/" and after "/a/b-c/".
+ */
+int acc_name_cmp(const char *a, const char *b)
+{
+   int alen = strlen(a);
+   int blen = strlen(b);
+   int apath = acc_path_len(a, alen);
+   int bpath = acc_path_len(b, blen);
+   int ret = memcmp(a, b, MIN(apath, bpath));
+   if (ret != 0) {
+      return ret;
+   }
+   if (apath != bpath) {
+      return apath < bpath ? -1 : 1;
+   }
+   return strcmp(a + apath, b + bpath);
+}
+
+accspool::accspool()
+{
+   fd = -1;
+   path = get_pool_memory(PM_FNAME);
+   *path = 0;
+   remove = true;
+   sorted = true;
+   writing = true;
+   num_items = 0;
+   end = 0;
+   max_index = 64;
+   nb_index = 0;
+   index = (acc_spool_key *)malloc(max_index * sizeof(acc_spool_key));
+   buf_size = ACC_SPOOL_BUF;
+   buf = (char *)malloc(buf_size);
+   buf_off = 0;
+   buf_len = 0;
+   buf_dirty = false;
+   prev = get_pool_memory(PM_FNAME);
+   cur = get_pool_memory(PM_FNAME);
+   *prev = 0;
+   prev_ok = false;
+   cur_nr = 0;
+   cur_off = 0;
+   found_off = -1;
+   found_nr = 0;
+}
+
+/* Create the spool file */
+bool accspool::open(const char *fname, POOLMEM *&errmsg)
+{
+   pm_strcpy(path, fname);
+   fd = ::open(fname, O_RDWR|O_CREAT|O_TRUNC|O_BINARY, 0600);
+   if (fd < 0) {
+      berrno be;
+      Mmsg(errmsg, _("Could not create accurate spool file %s. ERR=%s\n"),
+           fname, be.bstrerror());
+      *path = 0;
+      return false;
+   }
+   return true;
+}
+
+/*
+ * Open the spool file kept by a previous job. The number of records
+ *  is not known and no index is built, the list can be read with
+ *  first() and next().
+ */
+bool accspool::open_existing(const char *fname, POOLMEM *&errmsg)
+{
+   struct stat statp;
+
+   pm_strcpy(path, fname);
+   fd = ::open(fname, O_RDONLY|O_BINARY);
+   if (fd < 0 || fstat(fd, &statp) != 0) {
+      berrno be;
+      Mmsg(errmsg, _("Could not open accurate spool file %s. ERR=%s\n"),
+           fname, be.bstrerror());
+      if (fd >= 0) {
+         ::close(fd);
+         fd = -1;
+      }
+      *path = 0;
+      return false;
+   }
+   remove = false;
+   writing = false;
+   end = statp.st_size;
+   num_items = UINT32_MAX;            /* set when the end is reached */
+   cur_nr = num_items;
+   return true;
+}
+
+/* Keep the spool file under a new name, the list is closed */
+bool accspool::save_as(const char *fname, POOLMEM *&errmsg)
+{
+   bool ret = true;
+
+   if (fd < 0 || writing || !remove) {
+      Mmsg(errmsg, _("Accurate spool file %s cannot be saved\n"), path);
+      return false;
+   }
+   if (!flush() || ::close(fd) != 0) {
+      Mmsg(errmsg, _("Write error on accurate spool file %s\n"), path);
+      ret = false;
+   } else if (rename(path, fname) != 0) {
+      berrno be;
+      Mmsg(errmsg, _("Could not rename accurate spool file %s to %s. ERR=%s\n"),
+           path, fname, be.bstrerror());
+      ret = false;
+   }
+   if (!ret) {
+      unlink(path);
+   }
+   fd = -1;
+   return ret;
+}
+
+/*
+ * Write the buffer. While adding the records it is the end of the
+ *  file, after it holds updated seen flags.
+ */
+bool accspool::flush()
+{
+   if (fd < 0 || buf_len == 0 || (!writing && !buf_dirty)) {
+      return true;
+   }
+   if (lseek(fd, buf_off, SEEK_SET) != buf_off ||
+       write(fd, buf, buf_len) != (ssize_t)buf_len) {
+      berrno be;
+      Emsg2(M_ERROR, 0, _("Write error on accurate spool file %s. ERR=%s\n"),
+            path, be.bstrerror());
+      return false;
+   }
+   if (writing) {
+      buf_off += buf_len;
+      buf_len = 0;
+   }
+   buf_dirty = false;
+   return true;
+}
+
+/* Get len bytes of the file at off in the buffer */
+char *accspool::fill(boffset_t off, uint32_t len)
+{
+   ssize_t nb;
+
+   if (off >= buf_off && off + len <= buf_off + buf_len) {
+      return buf + (off - buf_off);
+   }
+   if (!flush()) {
+      return NULL;
+   }
+   if (len > buf_size) {
+      buf_size = len;
+      buf = (char *)realloc(buf, buf_size);
+   }
+   buf_off = off;
+   buf_len = 0;
+   if (lseek(fd, off, SEEK_SET) != off) {
+      return NULL;
+   }
+   while (buf_len < buf_size && off + buf_len < end) {
+      nb = read(fd, buf + buf_len, buf_size - buf_len);
+      if (nb <= 0) {
+         break;
+      }
+      buf_len += nb;
+   }
+   if (buf_len < len) {
+      berrno be;
+      Emsg2(M_ERROR, 0, _("Read error on accurate spool file %s. ERR=%s\n"),
+            path, be.bstrerror());
+      return NULL;
+   }
+   return buf + (off - buf_off);
+}
+
+bool accspool::add(const char *fname, struct stat *statp, int32_t delta_seq,
+                   const char *chksum)
+{
+   acc_spool_rec *rec;
+   int flen = strlen(fname);
+   int clen = strlen(chksum);
+   uint32_t len = sizeof(acc_spool_rec) + flen + clen + 2;
+
+   if (!writing || fd < 0) {
+      return false;
+   }
+   if (num_items > 0 && sorted && acc_name_cmp(prev, fname) >= 0) {
+      Dmsg2(dbglvl, "List not sorted <%s> >= <%s>\n", prev, fname);
+      sorted = false;
+   }
+   if (num_items % ACC_SPOOL_STEP == 0) {
+      if (nb_index == max_index) {
+         max_index *= 2;
+         index = (acc_spool_key *)realloc(index, max_index * sizeof(acc_spool_key));
+      }
+      index[nb_index].offset = end;
+      index[nb_index].fname = bstrdup(fname);
+      nb_index++;
+   }
+   if (buf_len + len > buf_size) {
+      if (!flush()) {
+         return false;
+      }
+      if (len > buf_size) {
+         buf_size = len;
+         buf = (char *)realloc(buf, buf_size);
+      }
+   }
+   rec = (acc_spool_rec *)(buf + buf_len);
+   memset(rec, 0, sizeof(acc_spool_rec));
+   rec->len = len;
+   rec->delta_seq = delta_seq;
+   rec->ino = statp->st_ino;
+   rec->size = statp->st_size;
+   rec->atime = statp->st_atime;
+   rec->mtime = statp->st_mtime;
+   rec->ctime = statp->st_ctime;
+   rec->mode = statp->st_mode;
+   rec->nlink = statp->st_nlink;
+   rec->uid = statp->st_uid;
+   rec->gid = statp->st_gid;
+   memcpy(REC_FNAME(rec), fname, flen + 1);
+   memcpy(REC_FNAME(rec) + flen + 1, chksum, clen + 1);
+   buf_len += len;
+   end += len;
+   num_items++;
+   pm_strcpy(prev, fname);
+   return true;
+}
+
+/* Write the last records, the list can now be read */
+bool accspool::end_add()
+{
+   bool ret = flush();
+   writing = false;
+   buf_off = 0;
+   buf_len = 0;
+   cur_nr = num_items;               /* no cursor yet */
+   prev_ok = false;
+   return ret;
+}
+
+/* Read the record of the cursor */
+bool accspool::load()
+{
+   uint32_t len;
+   char *p;
+
+   if (cur_nr >= num_items) {
+      return false;
+   }
+   if (cur_off >= end) {
+      num_items = cur_nr;             /* end of a file kept by a previous job */
+      return false;
+   }
+   if ((p = fill(cur_off, sizeof(uint32_t))) == NULL) {
+      cur_nr = num_items;
+      return false;
+   }
+   memcpy(&len, p, sizeof(len));
+   if (len < sizeof(acc_spool_rec) || (p = fill(cur_off, len)) == NULL) {
+      Emsg1(M_ERROR, 0, _("Corrupted accurate spool file %s\n"), path);
+      cur_nr = num_items;
+      return false;
+   }
+   cur = check_pool_memory_size(cur, len);
+   memcpy(cur, p, len);
+   return true;
+}
+
+/* Move the cursor to a key of the index */
+void accspool::seek(uint32_t key)
+{
+   cur_nr = key * ACC_SPOOL_STEP;
+   cur_off = index[key].offset;
+   prev_ok = false;
+   load();
+}
+
+/* Move the cursor to the next record, the current one is kept in prev */
+bool accspool::forward()
+{
+   POOLMEM *tmp;
+
+   if (cur_nr >= num_items) {
+      return false;
+   }
+   cur_off += ((acc_spool_rec *)cur)->len;
+   cur_nr++;
+   tmp = prev;
+   prev = cur;
+   cur = tmp;
+   prev_ok = true;
+   return load();
+}
+
+void accspool::decode(acc_file *elt)
+{
+   acc_spool_rec *rec = (acc_spool_rec *)cur;
+
+   elt->fname = REC_FNAME(cur);
+   elt->id = cur_nr;
+   elt->delta_seq = rec->delta_seq;
+   elt->seen = rec->seen;
+   elt->chksum_text = true;
+   elt->chksum = (const uint8_t *)elt->fname + strlen(elt->fname) + 1;
+   elt->chksum_len = strlen((const char *)elt->chksum);
+   bmemzero(&elt->statp, sizeof(struct stat));
+   elt->statp.st_ino = rec->ino;
+   elt->statp.st_size = rec->size;
+   elt->statp.st_atime = rec->atime;
+   elt->statp.st_mtime = rec->mtime;
+   elt->statp.st_ctime = rec->ctime;
+   elt->statp.st_mode = rec->mode;
+   elt->statp.st_nlink = rec->nlink;
+   elt->statp.st_uid = rec->uid;
+   elt->statp.st_gid = rec->gid;
+   found_off = cur_off;
+   found_nr = cur_nr;
+}
+
+bool accspool::lookup(const char *fname, acc_file *elt)
+{
+   uint32_t lo = 0, hi = nb_index, mid, key;
+   int ret;
+
+   found_off = -1;
+   if (writing || !sorted || num_items == 0) {
+      return false;
+   }
+   /* Last key of the index lower or equal to fname */
+   while (lo < hi) {
+      mid = (lo + hi) / 2;
+      if (acc_name_cmp(index[mid].fname, fname) <= 0) {
+         lo = mid + 1;
+      } else {
+         hi = mid;
+      }
+   }
+   if (lo == 0) {
+      return false;                   /* before the first record */
+   }
+   key = lo - 1;
+
+   /*
+    * The cursor can go forward when all the records before it are
+    *  lower than fname, it is the case of a walk done in the same
+    *  order. A new file stops on the record after it.
+    */
+   if (cur_nr < key * ACC_SPOOL_STEP ||
+       (prev_ok && acc_name_cmp(REC_FNAME(prev), fname) >= 0) ||
+       (!prev_ok && cur_nr != key * ACC_SPOOL_STEP)) {
+      Dmsg2(dbglvl, "seek to key %d for <%s>\n", key, fname);
+      seek(key);
+   }
+   while (cur_nr < num_items) {
+      ret = acc_name_cmp(REC_FNAME(cur), fname);
+      if (ret == 0) {
+         decode(elt);
+         return true;
+      }
+      if (ret > 0) {
+         break;
+      }
+      forward();
+   }
+   return false;
+}
+
+/* Set the seen flag of the file returned by the last lookup */
+void accspool::set_seen(uint32_t id)
+{
+   char *p;
+
+   if (found_off < 0 || id != found_nr) {
+      return;
+   }
+   if ((p = fill(found_off, sizeof(acc_spool_rec))) == NULL) {
+      return;
+   }
+   ((acc_spool_rec *)p)->seen = 1;
+   buf_dirty = true;
+   if (found_off == cur_off && found_nr == cur_nr) {
+      ((acc_spool_rec *)cur)->seen = 1;
+   }
+}
+
+bool accspool::first(acc_file *elt)
+{
+   if (writing) {
+      return false;
+   }
+   cur_nr = 0;
+   cur_off = 0;
+   prev_ok = false;
+   if (!load()) {
+      return false;
+   }
+   decode(elt);
+   return true;
+}
+
+bool accspool::next(acc_file *elt)
+{
+   if (!forward()) {
+      return false;
+   }
+   decode(elt);
+   return true;
+}
+
+uint64_t accspool::mem_size()
+{
+   uint64_t size = buf_size + max_index * sizeof(acc_spool_key);
+   for (uint32_t i = 0; i < nb_index; i++) {
+      size += strlen(index[i].fname) + 1;
+   }
+   return size + sizeof_pool_memory(prev) + sizeof_pool_memory(cur) +
+      sizeof_pool_memory(path);
+}
+
+void accspool::stats()
+{
+   char ed1[50], ed2[50];
+   Dmsg4(0, "accspool: %u files sorted=%d spool=%sB memory=%sB\n",
+         num_items, sorted, edit_uint64_with_suffix(end, ed1),
+         edit_uint64_with_suffix(mem_size(), ed2));
+}
+
+void accspool::destroy()
+{
+   if (fd >= 0) {
+      ::close(fd);
+      if (remove) {
+         unlink(path);
+      }
+      fd = -1;
+   }
+   if (index) {
+      for (uint32_t i = 0; i < nb_index; i++) {
+         free(index[i].fname);
+      }
+      free(index);
+      index = NULL;
+      nb_index = 0;
+   }
+   if (buf) {
+      free(buf);
+      buf = NULL;
+   }
+   if (path) {
+      free_pool_memory(path);
+      free_pool_memory(prev);
+      free_pool_memory(cur);
+      path = prev = cur = NULL;
+   }
+   num_items = 0;
+}
+
+#ifndef TEST_PROGRAM
+#define TEST_PROGRAM_A
+#endif
+
+#ifdef TEST_PROGRAM
+#include "unittests.h"
+
+#define NFILES   200000
+
+static char **names;
+
+static int name_sort(const void *a, const void *b)
+{
+   return acc_name_cmp(*(char **)a, *(char **)b);
+}
+
+static void make_stat(int i, struct stat *statp)
+{
+   bmemzero(statp, sizeof(struct stat));
+   statp->st_mode = (i % 10) ? 0100644 : 040755;
+   statp->st_nlink = 1;
+   statp->st_uid = 1000;
+   statp->st_gid = 100;
+   statp->st_ino = 1000 + i;
+   statp->st_size = i * 7;
+   statp->st_mtime = 1600000000 + i;
+   statp->st_ctime = 1600000000 + i;
+}
+
+int main()
+{
+   Unittests accspool_test("accspool_test");
+   POOLMEM *err = get_pool_memory(PM_MESSAGE);
+   char fname[512];
+   struct stat st;
+   accspool *spool;
+   acclist *list;
+   acc_file elt;
+   btime_t t0, t1;
+   bool check_cont;
+   int i, count;
+
+   Pmsg0(0, "Initialize tests ...\n");
+
+   /* Order of the catalog query */
+   ok(acc_name_cmp("/a/b", "/a/b/") < 0, "File before the directory");
+   ok(acc_name_cmp("/a/z", "/a/b/") < 0, "Files before the subdirectories");
+   ok(acc_name_cmp("/a/b-c/", "/a/b/") < 0, "Directories sorted with the /");
+   ok(acc_name_cmp("/a/b/", "/a/b/c") < 0, "Directory before its files");
+   ok(acc_name_cmp("/a/b/x", "/a/b-c/x") > 0, "Sorted by path first");
+   ok(acc_name_cmp("/a/\xe9", "/a/z") > 0, "Binary collation");
+
+   spool = New(accspool());
+   ok(!spool->open("/nonexistent/dir/spool", err), "Open error");
+   delete spool;
+
+   /* Small list, lookups in the walk order with new and deleted files */
+   const char *sorted[] = { "/", "/etc/", "/etc/group", "/etc/passwd",
+                            "/etc/rc.d/", "/etc/rc.d/init", "/etc/x11/",
+                            "/etc/x11/xorg.conf", "/home/", "/home/user/",
+                            "/home/user/.profile", NULL };
+   spool = New(accspool());
+   ok(spool->open("accspool.test", err), "Open the spool file");
+   bmemzero(&st, sizeof(st));
+   for (i = 0; sorted[i]; i++) {
+      st.st_size = i;
+      spool->add(sorted[i], &st, i, (i % 2) ? "" : "1B2M2Y8AsgTpgAmY7PhCfg");
+   }
+   ok(spool->end_add() && spool->is_sorted(), "Checking the order");
+   ok(spool->size() == (uint32_t)i, "Checking size");
+   check_cont = spool->lookup("/", &elt) && elt.statp.st_size == 0;
+   spool->set_seen(elt.id);
+   check_cont = check_cont && !spool->lookup("/bin/", &elt);    /* new */
+   check_cont = check_cont && spool->lookup("/etc/", &elt);
+   spool->set_seen(elt.id);
+   check_cont = check_cont && !spool->lookup("/etc/fstab", &elt);
+   check_cont = check_cont && spool->lookup("/etc/passwd", &elt) &&
+      elt.delta_seq == 3 && elt.chksum_len == 0;
+   spool->set_seen(elt.id);
+   check_cont = check_cont && spool->lookup("/etc/x11/", &elt) &&
+      elt.chksum_equal("1B2M2Y8AsgTpgAmY7PhCfg");
+   check_cont = check_cont && spool->lookup("/etc/x11/xorg.conf", &elt) &&
+      elt.chksum_len == 0 && elt.statp.st_size == 7;
+   spool->set_seen(elt.id);
+   check_cont = check_cont && spool->lookup("/etc/group", &elt); /* backward */
+   spool->set_seen(elt.id);
+   check_cont = check_cont && !spool->lookup("/zzz", &elt) &&
+      !spool->lookup("", &elt);
+   ok(check_cont, "Checking lookups");
+   count = 0;
+   check_cont = true;
+   foreach_acclist(&elt, spool) {
+      bool seen = strcmp(elt.fname, "/") == 0 || strcmp(elt.fname, "/etc/") == 0 ||
+         strcmp(elt.fname, "/etc/passwd") == 0 || strcmp(elt.fname, "/etc/group") == 0 ||
+         strcmp(elt.fname, "/etc/x11/xorg.conf") == 0;
+      if (strcmp(elt.fname, sorted[count]) != 0 || elt.seen != seen) {
+         Pmsg2(0, "Walk error %s seen=%d\n", elt.fname, elt.seen);
+         check_cont = false;
+      }
+      count++;
+   }
+   ok(check_cont && count == i, "Checking walk and seen flags");
+   delete spool;
+   ok(access("accspool.test", F_OK) != 0, "Spool file removed");
+
+   /* Not sorted */
+   spool = New(accspool());
+   spool->open("accspool.test", err);
+   spool->add("/b", &st, 0, "");
+   spool->add("/a", &st, 0, "");
+   spool->end_add();
+   ok(!spool->is_sorted() && !spool->lookup("/a", &elt), "Checking unsorted list");
+   count = 0;
+   foreach_acclist(&elt, spool) {
+      count++;
+   }
+   ok(count == 2, "Walk of an unsorted list");
+   delete spool;
+
+   /* List kept for the next job */
+   spool = New(accspool());
+   spool->open("accspool.test", err);
+   bmemzero(&st, sizeof(st));
+   for (i = 0; sorted[i]; i++) {
+      st.st_size = i;
+      spool->add(sorted[i], &st, i, "1B2M2Y8AsgTpgAmY7PhCfg");
+   }
+   spool->end_add();
+   spool->lookup("/etc/passwd", &elt);
+   spool->set_seen(elt.id);
+   ok(spool->save_as("accspool.cache", err), "Save the list");
+   delete spool;
+   ok(access("accspool.cache", F_OK) == 0 && access("accspool.test", F_OK) != 0,
+      "Spool file renamed");
+   spool = New(accspool());
+   ok(!spool->open_existing("accspool.none", err), "Open error of a saved list");
+   delete spool;
+   spool = New(accspool());
+   ok(spool->open_existing("accspool.cache", err), "Open the saved list");
+   count = 0;
+   check_cont = true;
+   foreach_acclist(&elt, spool) {
+      if (strcmp(elt.fname, sorted[count]) != 0 || elt.delta_seq != count ||
+          elt.statp.st_size != count || !elt.chksum_equal("1B2M2Y8AsgTpgAmY7PhCfg")) {
+         Pmsg1(0, "Walk error %s\n", elt.fname);
+         check_cont = false;
+      }
+      count++;
+   }
+   ok(check_cont && count == i && spool->size() == (uint32_t)i, "Walk of the saved list");
+   ok(!spool->lookup("/etc/", &elt), "No lookup in a saved list");
+   delete spool;
+   ok(access("accspool.cache", F_OK) == 0, "Saved list not removed");
+   unlink("accspool.cache");
+
+   /* Big list */
+   names = (char **)malloc(NFILES * sizeof(char *));
+   for (i = 0; i < NFILES; i++) {
+      if (i % 10) {
+         bsnprintf(fname, sizeof(fname), "/home/user%d/src/dir%d/file_%d.c",
+                   i % 7, (i / 10) % 1000, i);
+      } else {
+         bsnprintf(fname, sizeof(fname), "/home/user%d/src/dir%d-%d/",
+                   i % 7, (i / 10) % 1000, i);
+      }
+      names[i] = bstrdup(fname);
+   }
+   qsort(names, NFILES, sizeof(char *), name_sort);
+   spool = New(accspool());
+   spool->open("accspool.test", err);
+   list = New(acclist(NFILES));
+   for (i = 0; i < NFILES; i++) {
+      make_stat(i, &st);
+      spool->add(names[i], &st, 0, "1B2M2Y8AsgTpgAmY7PhCfg");
+      list->add(names[i], &st, 0, "1B2M2Y8AsgTpgAmY7PhCfg");
+   }
+   ok(spool->end_add() && spool->is_sorted(), "Checking order of the big list");
+   spool->stats();
+
+   /* Walk order, one file on 5 is deleted, one on 7 is new */
+   t0 = get_current_btime();
+   check_cont = true;
+   for (i = 0; i < NFILES; i++) {
+      if (i % 5 != 0) {
+         make_stat(i, &st);
+         if (!spool->lookup(names[i], &elt) || elt.statp.st_ino != st.st_ino ||
+             elt.statp.st_mode != st.st_mode || elt.statp.st_mtime != st.st_mtime) {
+            check_cont = false;
+         }
+         spool->set_seen(elt.id);
+      }
+      if (i % 7 == 0) {
+         /* Sorted after names[i] and before names[i+1] */
+         bsnprintf(fname, sizeof(fname), "%s\x01", names[i]);
+         if (spool->lookup(fname, &elt)) {
+            check_cont = false;
+         }
+      }
+   }
+   t1 = get_current_btime();
+   ok(check_cont, "Checking merge of the walk");
+   Pmsg1(0, "Merge: %lldms\n", (t1 - t0) / 1000);
+
+   /* Random lookups */
+   check_cont = true;
+   for (i = 0; i < 1000; i++) {
+      int j = (i * 7919) % NFILES;
+      if (!spool->lookup(names[j], &elt) || elt.seen != (j % 5 != 0)) {
+         check_cont = false;
+      }
+   }
+   ok(check_cont, "Checking random lookups");
+
+   count = 0;
+   foreach_acclist(&elt, spool) {
+      if (!elt.seen) {
+         count++;
+      }
+   }
+   ok(count == (NFILES + 4) / 5, "Checking deleted files");
+   Pmsg2(0, "Memory: accspool %lldKB, acclist %lldKB\n",
+         spool->mem_size() / 1024, list->mem_size() / 1024);
+   ok(spool->mem_size() * 10 < list->mem_size(), "Checking memory usage");
+
+   delete list;
+   delete spool;
+   for (i = 0; i < NFILES; i++) {
+      free(names[i]);
+   }
+   free(names);
+   free_pool_memory(err);
+   return report();
+}
+#endif
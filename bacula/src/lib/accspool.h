@@ -0,0 +1,105 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+*/
+/*
+ * Sorted list of the files of the previous jobs kept in a spool file
+ *  for the accurate mode of the File Daemon.
+ *
+ *  The Director sends the list ordered by path then by file name, the
+ *  order of a walk done with the name_order option of the FileSet
+ *  code. The records are written in the working directory and only
+ *  one key every ACC_SPOOL_STEP records stays in memory. The lookups
+ *  done while walking the directories move a cursor forward in the
+ *  file, so the two sorted streams are merged with a constant amount
+ *  of memory. A lookup out of the order starts from the closest key
+ *  of the sparse index.
+ *
+ *  The interface is the one of the acclist, a file found by lookup()
+ *  can be marked as seen until the next lookup.
+ *
+ *  The spool file can be kept with save_as() and read again by a next
+ *  job with open_existing(), this list can only be walked.
+ */
+
+#ifndef _ACCSPOOL_H_
+#define _ACCSPOOL_H_
+
+#define ACC_SPOOL_STEP  4096              /* records per index key */
+#define ACC_SPOOL_BUF   (64 * 1024)       /* I/O buffer size */
+
+/* Compare two file names in the order of the catalog query */
+int acc_name_cmp(const char *a, const char *b);
+
+/* One key of the sparse index */
+struct acc_spool_key {
+   boffset_t offset;                  /* offset of the record */
+   char *fname;                       /* its file name */
+};
+
+class accspool : public SMARTALLOC {
+   int fd;                            /* spool file */
+   POOLMEM *path;                     /* spool file name */
+   bool remove;                       /* unlink the file in destroy() */
+   bool sorted;                       /* records were added in order */
+   bool writing;                      /* records are being added */
+   uint32_t num_items;                /* number of records */
+   boffset_t end;                     /* size of the spool file */
+   acc_spool_key *index;              /* sparse index */
+   uint32_t nb_index;
+   uint32_t max_index;
+   char *buf;                         /* I/O buffer */
+   uint32_t buf_size;
+   boffset_t buf_off;                 /* file offset of the buffer */
+   uint32_t buf_len;                  /* valid bytes in the buffer */
+   bool buf_dirty;                    /* seen flags to write back */
+   POOLMEM *prev;                     /* last name added, or record before the cursor */
+   POOLMEM *cur;                      /* record at the cursor */
+   bool prev_ok;                      /* prev is the previous record */
+   uint32_t cur_nr;                   /* record number of the cursor */
+   boffset_t cur_off;                 /* offset of the cursor */
+   boffset_t found_off;               /* last record found, -1 if none */
+   uint32_t found_nr;
+
+   bool flush();
+   char *fill(boffset_t off, uint32_t len);
+   bool load();
+   void seek(uint32_t key);
+   bool forward();
+   void decode(acc_file *elt);
+
+public:
+   accspool();
+   ~accspool() { destroy(); };
+   bool open(const char *fname, POOLMEM *&errmsg);
+   bool open_existing(const char *fname, POOLMEM *&errmsg);
+   bool save_as(const char *fname, POOLMEM *&errmsg);  /* keep the file */
+   bool add(const char *fname, struct stat *statp, int32_t delta_seq,
+            const char *chksum);
+   bool end_add();                    /* all records are added */
+   bool is_sorted() { return sorted; };
+   bool lookup(const char *fname, acc_file *elt);
+   void set_seen(uint32_t id);        /* id of the last lookup */
+   bool first(acc_file *elt);         /* walk the list */
+   bool next(acc_file *elt);
+   uint32_t size() { return num_items; }; /* known at the end of a walk */
+   uint64_t mem_size();               /* bytes allocated */
+   void stats();
+   void destroy();                    /* also removes the file */
+};
+
+#endif
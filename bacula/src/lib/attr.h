@@ -48,6 +48,7 @@ struct ATTR {
    char *fname;                       /* filename */
    char *lname;                       /* link name if any */
    JCR *jcr;                          /* jcr pointer */
+   bool unchanged;                    /* set by create_file(), the file is kept as is */
 };
 
 #endif /* __ATTR_H_ */
@@ -0,0 +1,781 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+*/
+/*
+ *  BLAKE3 hash
+ *
+ *  Implementation of the BLAKE3 hash function (regular hash mode,
+ *   32 bytes of output) following the specification and the reference
+ *   implementation of https://github.com/BLAKE3-team/BLAKE3. It is
+ *   used for the Signature=Blake3 FileSet option.
+ *
+ *  The input is cut in chunks of 1KB that are the leaves of a binary
+ *   tree, so the chunks can be hashed independently:
+ *   - with SSE2, four chunks are compressed at the same time in the
+ *     four lanes of the vector registers.
+ *   - when the context is created with threads, the data of large files
+ *     is collected by blocks of 1MB, and each block is split between
+ *     the helper threads of the context. The threads are only started
+ *     when a file is larger than 1MB.
+ */
+
+#include "bacula.h"
+#include "blake3.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Size of the blocks handed to the threads */
+#define MT_CHUNKS     1024
+#define MT_SIZE       (MT_CHUNKS * BLAKE3_CHUNK_LEN)
+
+enum {
+   CHUNK_START = 1 << 0,
+   CHUNK_END   = 1 << 1,
+   PARENT      = 1 << 2,
+   ROOT        = 1 << 3
+};
+
+static const uint32_t IV[8] = {
+   0x6A09E667UL, 0xBB67AE85UL, 0x3C6EF372UL, 0xA54FF53AUL,
+   0x510E527FUL, 0x9B05688CUL, 0x1F83D9ABUL, 0x5BE0CD19UL
+};
+
+/* Message words used by each round, the permutation is applied 6 times */
+static const uint8_t MSG_SCHEDULE[7][16] = {
+   {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+   {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+   {3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+   {10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+   {12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+   {9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+   {11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13},
+};
+
+/* A node of the tree that is not yet compressed */
+typedef struct {
+   uint32_t cv[8];
+   uint8_t  block[BLAKE3_BLOCK_LEN];
+   uint8_t  block_len;
+   uint64_t counter;
+   uint8_t  flags;
+} output_t;
+
+/* A part of the input hashed by a thread */
+typedef struct {
+   const uint8_t *input;
+   size_t nchunks;
+   uint64_t counter;
+   uint32_t cv[8];
+} blake3_task;
+
+struct blake3_mt {
+   uint8_t *buf;                       /* input not yet hashed */
+   uint32_t len;                       /* bytes in buf */
+   pthread_mutex_t mutex;
+   pthread_cond_t work;                /* tasks to do */
+   pthread_cond_t done;                /* all tasks done */
+   pthread_t tids[BLAKE3_MAX_THREADS];
+   int nb_threads;
+   blake3_task tasks[BLAKE3_MAX_THREADS];
+   int nb_tasks;                       /* tasks for the current buffer */
+   int next_task;                      /* next task to start */
+   int pending;                        /* tasks not yet done */
+   bool quit;
+};
+
+static inline uint32_t load32(const uint8_t *p)
+{
+   return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+      ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void store32(uint8_t *p, uint32_t w)
+{
+   p[0] = (uint8_t)w;
+   p[1] = (uint8_t)(w >> 8);
+   p[2] = (uint8_t)(w >> 16);
+   p[3] = (uint8_t)(w >> 24);
+}
+
+static inline uint32_t rotr32(uint32_t w, int c)
+{
+   return (w >> c) | (w << (32 - c));
+}
+
+static inline void g(uint32_t *v, int a, int b, int c, int d, uint32_t x, uint32_t y)
+{
+   v[a] = v[a] + v[b] + x;
+   v[d] = rotr32(v[d] ^ v[a], 16);
+   v[c] = v[c] + v[d];
+   v[b] = rotr32(v[b] ^ v[c], 12);
+   v[a] = v[a] + v[b] + y;
+   v[d] = rotr32(v[d] ^ v[a], 8);
+   v[c] = v[c] + v[d];
+   v[b] = rotr32(v[b] ^ v[c], 7);
+}
+
+static void compress(const uint32_t cv[8], const uint8_t block[BLAKE3_BLOCK_LEN],
+                     uint8_t block_len, uint64_t counter, uint8_t flags,
+                     uint32_t out[16])
+{
+   uint32_t m[16], v[16];
+   int i;
+
+   for (i = 0; i < 16; i++) {
+      m[i] = load32(block + 4 * i);
+   }
+   for (i = 0; i < 8; i++) {
+      v[i] = cv[i];
+   }
+   v[8] = IV[0];
+   v[9] = IV[1];
+   v[10] = IV[2];
+   v[11] = IV[3];
+   v[12] = (uint32_t)counter;
+   v[13] = (uint32_t)(counter >> 32);
+   v[14] = block_len;
+   v[15] = flags;
+   for (int r = 0; r < 7; r++) {
+      const uint8_t *s = MSG_SCHEDULE[r];
+      g(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+      g(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+      g(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+      g(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+      g(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+      g(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+      g(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+      g(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+   }
+   for (i = 0; i < 8; i++) {
+      out[i] = v[i] ^ v[i + 8];
+      out[i + 8] = v[i + 8] ^ cv[i];
+   }
+}
+
+static void output_cv(const output_t *o, uint32_t cv[8])
+{
+   uint32_t out[16];
+   compress(o->cv, o->block, o->block_len, o->counter, o->flags, out);
+   memcpy(cv, out, 8 * sizeof(uint32_t));
+}
+
+static void output_root(const output_t *o, uint8_t digest[BLAKE3_DIGEST_SIZE])
+{
+   uint32_t out[16];
+   compress(o->cv, o->block, o->block_len, 0, o->flags | ROOT, out);
+   for (int i = 0; i < 8; i++) {
+      store32(digest + 4 * i, out[i]);
+   }
+}
+
+static void parent_output(const uint32_t left[8], const uint32_t right[8], output_t *o)
+{
+   memcpy(o->cv, IV, sizeof(IV));
+   for (int i = 0; i < 8; i++) {
+      store32(o->block + 4 * i, left[i]);
+      store32(o->block + 32 + 4 * i, right[i]);
+   }
+   o->block_len = BLAKE3_BLOCK_LEN;
+   o->counter = 0;
+   o->flags = PARENT;
+}
+
+/* cv may be one of the children */
+static void parent_cv(const uint32_t left[8], const uint32_t right[8], uint32_t cv[8])
+{
+   output_t o;
+   parent_output(left, right, &o);
+   output_cv(&o, cv);
+}
+
+/*
+ * Chunk state, for the chunks that are not given in one piece
+ */
+static void chunk_init(BLAKE3_CHUNK *c, uint64_t counter)
+{
+   memcpy(c->cv, IV, sizeof(IV));
+   c->counter = counter;
+   memset(c->buf, 0, sizeof(c->buf));
+   c->buf_len = 0;
+   c->blocks_compressed = 0;
+}
+
+static inline size_t chunk_len(const BLAKE3_CHUNK *c)
+{
+   return BLAKE3_BLOCK_LEN * (size_t)c->blocks_compressed + c->buf_len;
+}
+
+static inline uint8_t chunk_start_flag(const BLAKE3_CHUNK *c)
+{
+   return c->blocks_compressed == 0 ? CHUNK_START : 0;
+}
+
+static void chunk_update(BLAKE3_CHUNK *c, const uint8_t *in, size_t len)
+{
+   while (len > 0) {
+      /* The last block is compressed by chunk_output() */
+      if (c->buf_len == BLAKE3_BLOCK_LEN) {
+         uint32_t out[16];
+         compress(c->cv, c->buf, BLAKE3_BLOCK_LEN, c->counter, chunk_start_flag(c), out);
+         memcpy(c->cv, out, sizeof(c->cv));
+         c->blocks_compressed++;
+         memset(c->buf, 0, sizeof(c->buf));
+         c->buf_len = 0;
+      }
+      size_t take = MIN(BLAKE3_BLOCK_LEN - (size_t)c->buf_len, len);
+      memcpy(c->buf + c->buf_len, in, take);
+      c->buf_len += take;
+      in += take;
+      len -= take;
+   }
+}
+
+static void chunk_output(const BLAKE3_CHUNK *c, output_t *o)
+{
+   memcpy(o->cv, c->cv, sizeof(o->cv));
+   memcpy(o->block, c->buf, sizeof(o->block));
+   o->block_len = c->buf_len;
+   o->counter = c->counter;
+   o->flags = chunk_start_flag(c) | CHUNK_END;
+}
+
+/* Chaining value of a complete chunk */
+static void hash_chunk(const uint8_t *in, uint64_t counter, uint32_t cv[8])
+{
+   uint32_t out[16];
+
+   memcpy(cv, IV, sizeof(IV));
+   for (int b = 0; b < BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN; b++) {
+      uint8_t flags = 0;
+      if (b == 0) {
+         flags |= CHUNK_START;
+      }
+      if (b == BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN - 1) {
+         flags |= CHUNK_END;
+      }
+      compress(cv, in + b * BLAKE3_BLOCK_LEN, BLAKE3_BLOCK_LEN, counter, flags, out);
+      memcpy(cv, out, 8 * sizeof(uint32_t));
+   }
+}
+
+#ifdef __SSE2__
+#define ROTR4(x, c) _mm_or_si128(_mm_srli_epi32((x), (c)), _mm_slli_epi32((x), 32 - (c)))
+
+static inline void g4(__m128i *v, int a, int b, int c, int d, __m128i x, __m128i y)
+{
+   v[a] = _mm_add_epi32(_mm_add_epi32(v[a], v[b]), x);
+   v[d] = ROTR4(_mm_xor_si128(v[d], v[a]), 16);
+   v[c] = _mm_add_epi32(v[c], v[d]);
+   v[b] = ROTR4(_mm_xor_si128(v[b], v[c]), 12);
+   v[a] = _mm_add_epi32(_mm_add_epi32(v[a], v[b]), y);
+   v[d] = ROTR4(_mm_xor_si128(v[d], v[a]), 8);
+   v[c] = _mm_add_epi32(v[c], v[d]);
+   v[b] = ROTR4(_mm_xor_si128(v[b], v[c]), 7);
+}
+
+/* Lane j of the result gets the word j of each vector */
+static inline void transpose4(__m128i *v)
+{
+   __m128i ab01 = _mm_unpacklo_epi32(v[0], v[1]);
+   __m128i ab23 = _mm_unpackhi_epi32(v[0], v[1]);
+   __m128i cd01 = _mm_unpacklo_epi32(v[2], v[3]);
+   __m128i cd23 = _mm_unpackhi_epi32(v[2], v[3]);
+   v[0] = _mm_unpacklo_epi64(ab01, cd01);
+   v[1] = _mm_unpackhi_epi64(ab01, cd01);
+   v[2] = _mm_unpacklo_epi64(ab23, cd23);
+   v[3] = _mm_unpackhi_epi64(ab23, cd23);
+}
+
+/* Chaining values of 4 consecutive complete chunks, one per lane */
+static void hash4_chunks(const uint8_t *in, uint64_t counter, uint32_t cvs[4][8])
+{
+   __m128i h[8], m[16], v[16];
+   __m128i counter_lo = _mm_set_epi32((int)(uint32_t)(counter + 3), (int)(uint32_t)(counter + 2),
+                                      (int)(uint32_t)(counter + 1), (int)(uint32_t)counter);
+   __m128i counter_hi = _mm_set_epi32((int)(uint32_t)((counter + 3) >> 32),
+                                      (int)(uint32_t)((counter + 2) >> 32),
+                                      (int)(uint32_t)((counter + 1) >> 32),
+                                      (int)(uint32_t)(counter >> 32));
+   int i;
+
+   for (i = 0; i < 8; i++) {
+      h[i] = _mm_set1_epi32((int)IV[i]);
+   }
+   for (int b = 0; b < BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN; b++) {
+      uint8_t flags = 0;
+      if (b == 0) {
+         flags |= CHUNK_START;
+      }
+      if (b == BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN - 1) {
+         flags |= CHUNK_END;
+      }
+      for (int q = 0; q < 4; q++) {
+         for (int j = 0; j < 4; j++) {
+            m[4 * q + j] = _mm_loadu_si128((const __m128i *)
+               (in + j * BLAKE3_CHUNK_LEN + b * BLAKE3_BLOCK_LEN + 16 * q));
+         }
+         transpose4(&m[4 * q]);
+      }
+      for (i = 0; i < 8; i++) {
+         v[i] = h[i];
+      }
+      for (i = 0; i < 4; i++) {
+         v[8 + i] = _mm_set1_epi32((int)IV[i]);
+      }
+      v[12] = counter_lo;
+      v[13] = counter_hi;
+      v[14] = _mm_set1_epi32(BLAKE3_BLOCK_LEN);
+      v[15] = _mm_set1_epi32(flags);
+      for (int r = 0; r < 7; r++) {
+         const uint8_t *s = MSG_SCHEDULE[r];
+         g4(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+         g4(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+         g4(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+         g4(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+         g4(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+         g4(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+         g4(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+         g4(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+      }
+      for (i = 0; i < 8; i++) {
+         h[i] = _mm_xor_si128(v[i], v[i + 8]);
+      }
+   }
+   transpose4(&h[0]);
+   transpose4(&h[4]);
+   for (int j = 0; j < 4; j++) {
+      _mm_storeu_si128((__m128i *)&cvs[j][0], h[j]);
+      _mm_storeu_si128((__m128i *)&cvs[j][4], h[4 + j]);
+   }
+}
+#endif
+
+/*
+ * Chaining value of a complete subtree, nchunks is a power of 2
+ *  and counter a multiple of nchunks.
+ */
+static void hash_subtree(const uint8_t *in, size_t nchunks, uint64_t counter, uint32_t cv[8])
+{
+   uint32_t left[8], right[8];
+
+   if (nchunks == 1) {
+      hash_chunk(in, counter, cv);
+      return;
+   }
+#ifdef __SSE2__
+   if (nchunks == 4) {
+      uint32_t cvs[4][8];
+      hash4_chunks(in, counter, cvs);
+      parent_cv(cvs[0], cvs[1], left);
+      parent_cv(cvs[2], cvs[3], right);
+      parent_cv(left, right, cv);
+      return;
+   }
+#endif
+   size_t half = nchunks / 2;
+   hash_subtree(in, half, counter, left);
+   hash_subtree(in + half * BLAKE3_CHUNK_LEN, half, counter + half, right);
+   parent_cv(left, right, cv);
+}
+
+/*
+ * The stack keeps the chaining values of the subtrees along the right
+ *  edge of the tree. They are merged only when we know that more input
+ *  follows, the root node must be compressed with the ROOT flag.
+ */
+static void merge_cv_stack(BLAKE3_CTX *ctx, uint64_t total_chunks)
+{
+   int post_merge_len = 0;
+   for (uint64_t t = total_chunks; t; t &= t - 1) {
+      post_merge_len++;
+   }
+   while (ctx->cv_stack_len > post_merge_len) {
+      int n = ctx->cv_stack_len;
+      parent_cv(ctx->cv_stack[n - 2], ctx->cv_stack[n - 1], ctx->cv_stack[n - 2]);
+      ctx->cv_stack_len--;
+   }
+}
+
+static void push_cv(BLAKE3_CTX *ctx, const uint32_t cv[8], uint64_t counter)
+{
+   merge_cv_stack(ctx, counter);
+   memcpy(ctx->cv_stack[ctx->cv_stack_len], cv, 8 * sizeof(uint32_t));
+   ctx->cv_stack_len++;
+}
+
+/* Hash the input in the calling thread */
+static void hash_input(BLAKE3_CTX *ctx, const uint8_t *in, size_t len)
+{
+   BLAKE3_CHUNK *c = &ctx->chunk;
+   uint32_t cv[8];
+
+   /* Complete the current chunk first */
+   if (chunk_len(c) > 0) {
+      size_t take = MIN(BLAKE3_CHUNK_LEN - chunk_len(c), len);
+      chunk_update(c, in, take);
+      in += take;
+      len -= take;
+      if (len == 0) {
+         return;
+      }
+      output_t o;
+      chunk_output(c, &o);
+      output_cv(&o, cv);
+      push_cv(ctx, cv, c->counter);
+      chunk_init(c, c->counter + 1);
+   }
+
+   /*
+    * Hash the largest complete subtrees we can, they must be aligned on
+    *  their size in the tree. The last chunk is kept for the end, it may
+    *  be the root.
+    */
+   while (len > BLAKE3_CHUNK_LEN) {
+      size_t subtree_len = BLAKE3_CHUNK_LEN;
+      while (subtree_len * 2 <= len) {
+         subtree_len *= 2;
+      }
+      uint64_t count_so_far = c->counter * BLAKE3_CHUNK_LEN;
+      while (((uint64_t)(subtree_len - 1) & count_so_far) != 0) {
+         subtree_len /= 2;
+      }
+      size_t subtree_chunks = subtree_len / BLAKE3_CHUNK_LEN;
+      if (subtree_chunks == 1) {
+         hash_chunk(in, c->counter, cv);
+         push_cv(ctx, cv, c->counter);
+      } else {
+         /* Both children are pushed, the subtree may be the root */
+         size_t half = subtree_chunks / 2;
+         hash_subtree(in, half, c->counter, cv);
+         push_cv(ctx, cv, c->counter);
+         hash_subtree(in + half * BLAKE3_CHUNK_LEN, half, c->counter + half, cv);
+         push_cv(ctx, cv, c->counter + half);
+      }
+      c->counter += subtree_chunks;
+      in += subtree_len;
+      len -= subtree_len;
+   }
+   if (len > 0) {
+      chunk_update(c, in, len);
+      merge_cv_stack(ctx, c->counter);
+   }
+}
+
+/*
+ * Helper threads of a context
+ */
+static int nb_parts = 0;          /* parts of a block, computed once */
+
+static int blake3_nb_parts()
+{
+   if (nb_parts == 0) {
+      long ncpu = 1;
+#ifdef _SC_NPROCESSORS_ONLN
+      ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+      int n = 1;
+      while (n * 2 <= MIN(ncpu, BLAKE3_MAX_THREADS)) {
+         n *= 2;
+      }
+      nb_parts = n;
+   }
+   return nb_parts;
+}
+
+static void *blake3_thread(void *arg)
+{
+   blake3_mt *mt = (blake3_mt *)arg;
+
+   P(mt->mutex);
+   for ( ;; ) {
+      while (!mt->quit && mt->next_task >= mt->nb_tasks) {
+         pthread_cond_wait(&mt->work, &mt->mutex);
+      }
+      if (mt->quit) {
+         break;
+      }
+      blake3_task *t = &mt->tasks[mt->next_task++];
+      V(mt->mutex);
+      hash_subtree(t->input, t->nchunks, t->counter, t->cv);
+      P(mt->mutex);
+      if (--mt->pending == 0) {
+         pthread_cond_signal(&mt->done);
+      }
+   }
+   V(mt->mutex);
+   return NULL;
+}
+
+static bool mt_start(BLAKE3_CTX *ctx)
+{
+   blake3_mt *mt = (blake3_mt *)malloc(sizeof(blake3_mt));
+
+   memset(mt, 0, sizeof(blake3_mt));
+   mt->buf = (uint8_t *)malloc(MT_SIZE);
+   pthread_mutex_init(&mt->mutex, NULL);
+   pthread_cond_init(&mt->work, NULL);
+   pthread_cond_init(&mt->done, NULL);
+   ctx->mt = mt;
+   /* The calling thread hashes one of the parts */
+   for (int i = 0; i < blake3_nb_parts() - 1; i++) {
+      if (pthread_create(&mt->tids[i], NULL, blake3_thread, (void *)mt) != 0) {
+         break;
+      }
+      mt->nb_threads++;
+   }
+   return mt->nb_threads > 0;
+}
+
+static void mt_stop(BLAKE3_CTX *ctx)
+{
+   blake3_mt *mt = ctx->mt;
+
+   P(mt->mutex);
+   mt->quit = true;
+   pthread_cond_broadcast(&mt->work);
+   V(mt->mutex);
+   for (int i = 0; i < mt->nb_threads; i++) {
+      pthread_join(mt->tids[i], NULL);
+   }
+   pthread_cond_destroy(&mt->work);
+   pthread_cond_destroy(&mt->done);
+   pthread_mutex_destroy(&mt->mutex);
+   free(mt->buf);
+   free(mt);
+   ctx->mt = NULL;
+}
+
+/* Hash the full buffer, the chunk state is empty and aligned */
+static void mt_hash_buffer(BLAKE3_CTX *ctx)
+{
+   blake3_mt *mt = ctx->mt;
+   uint64_t counter = ctx->chunk.counter;
+   int nb_parts = blake3_nb_parts();
+   size_t part_chunks = MT_CHUNKS / nb_parts;
+
+   P(mt->mutex);
+   for (int i = 0; i < nb_parts; i++) {
+      mt->tasks[i].input = mt->buf + i * part_chunks * BLAKE3_CHUNK_LEN;
+      mt->tasks[i].nchunks = part_chunks;
+      mt->tasks[i].counter = counter + i * part_chunks;
+   }
+   mt->nb_tasks = nb_parts;
+   mt->next_task = 0;
+   mt->pending = nb_parts;
+   pthread_cond_broadcast(&mt->work);
+   while (mt->next_task < mt->nb_tasks) {
+      blake3_task *t = &mt->tasks[mt->next_task++];
+      V(mt->mutex);
+      hash_subtree(t->input, t->nchunks, t->counter, t->cv);
+      P(mt->mutex);
+      mt->pending--;
+   }
+   while (mt->pending > 0) {
+      pthread_cond_wait(&mt->done, &mt->mutex);
+   }
+   V(mt->mutex);
+
+   for (int i = 0; i < nb_parts; i++) {
+      push_cv(ctx, mt->tasks[i].cv, mt->tasks[i].counter);
+   }
+   ctx->chunk.counter += MT_CHUNKS;
+   mt->len = 0;
+}
+
+/*
+ * API
+ */
+void BLAKE3_init(BLAKE3_CTX *ctx, bool threaded)
+{
+   chunk_init(&ctx->chunk, 0);
+   ctx->cv_stack_len = 0;
+   ctx->threaded = threaded && blake3_nb_parts() > 1;
+   ctx->mt = NULL;
+}
+
+void BLAKE3_update(BLAKE3_CTX *ctx, const uint8_t *data, size_t len)
+{
+   if (!ctx->threaded) {
+      hash_input(ctx, data, len);
+      return;
+   }
+   while (len > 0) {
+      if (!ctx->mt) {
+         /* Small files are hashed without the threads */
+         uint64_t done = ctx->chunk.counter * BLAKE3_CHUNK_LEN + chunk_len(&ctx->chunk);
+         if (done < MT_SIZE) {
+            size_t take = MIN((uint64_t)len, MT_SIZE - done);
+            hash_input(ctx, data, take);
+            data += take;
+            len -= take;
+            continue;
+         }
+         /* More input follows, the last chunk kept by hash_input() can go */
+         if (chunk_len(&ctx->chunk) == BLAKE3_CHUNK_LEN) {
+            uint32_t cv[8];
+            output_t o;
+            chunk_output(&ctx->chunk, &o);
+            output_cv(&o, cv);
+            push_cv(ctx, cv, ctx->chunk.counter);
+            chunk_init(&ctx->chunk, ctx->chunk.counter + 1);
+         }
+         if (!mt_start(ctx)) {
+            mt_stop(ctx);
+            ctx->threaded = false;
+            hash_input(ctx, data, len);
+            return;
+         }
+      }
+      blake3_mt *mt = ctx->mt;
+      if (mt->len == MT_SIZE) {
+         mt_hash_buffer(ctx);
+      }
+      size_t take = MIN(len, (size_t)(MT_SIZE - mt->len));
+      memcpy(mt->buf + mt->len, data, take);
+      mt->len += take;
+      data += take;
+      len -= take;
+   }
+}
+
+void BLAKE3_final(BLAKE3_CTX *ctx, uint8_t digest[BLAKE3_DIGEST_SIZE])
+{
+   output_t o;
+   int remaining;
+
+   if (ctx->mt) {
+      hash_input(ctx, ctx->mt->buf, ctx->mt->len);
+      mt_stop(ctx);
+   }
+   if (ctx->cv_stack_len == 0) {
+      chunk_output(&ctx->chunk, &o);
+      output_root(&o, digest);
+      return;
+   }
+   if (chunk_len(&ctx->chunk) > 0) {
+      remaining = ctx->cv_stack_len;
+      chunk_output(&ctx->chunk, &o);
+   } else {
+      /* There are at least two subtrees on the stack */
+      remaining = ctx->cv_stack_len - 2;
+      parent_output(ctx->cv_stack[remaining], ctx->cv_stack[remaining + 1], &o);
+   }
+   while (remaining > 0) {
+      uint32_t cv[8];
+      remaining--;
+      output_cv(&o, cv);
+      parent_output(ctx->cv_stack[remaining], cv, &o);
+   }
+   output_root(&o, digest);
+}
+
+/* Release the threads of a context that is not finalized */
+void BLAKE3_free(BLAKE3_CTX *ctx)
+{
+   if (ctx->mt) {
+      mt_stop(ctx);
+   }
+}
+
+#ifdef TEST_PROGRAM
+#include "unittests.h"
+
+static void make_data(uint8_t *buf, size_t len)
+{
+   for (size_t i = 0; i < len; i++) {
+      buf[i] = (uint8_t)(i * 7 + 3);
+   }
+}
+
+static const char *to_hex(uint8_t *digest, char *buf)
+{
+   for (int i = 0; i < BLAKE3_DIGEST_SIZE; i++) {
+      sprintf(buf + 2 * i, "%02x", digest[i]);
+   }
+   return buf;
+}
+
+/* Reference values from b3sum */
+static struct {
+   size_t len;
+   const char *digest;
+} tests[] = {
+   {0,       "af1349b9f5f9a1a6a0404dea36dcc9499bcb25c9adc112b7cc9a93cae41f3262"},
+   {1,       "e1e0e81d6ea39b0cf8b86ffd440921011f57400cbc3f76a8a171906a9b8d7505"},
+   {9,       "c129227fe50d0967252ee68671537d0c34026bcd11caa7a2097bc609e8b25358"},
+   {128,     "40b4379f467b50fbdc82b8fce0eb3bec0c15bce6fc89d2eba1f8a5c1d037accd"},
+   {129,     "ccb3df3331b4b0a061b7fb23841e1967819c4745df9d9a9ce37c364ca6e4e6cb"},
+   {1024,    "e3f027f2c0380f4ee59b4213e5bbfc65e5158b27196bb5ea63453a2cbc47a888"},
+   {1025,    "afd7cf3dec77579ce5aaab21256350d354ca4caaef56e897405771d6bb4c0c93"},
+   {65536,   "962f9f945c45d2be3c20272c826c8b4191cf1275fe6ed781b4bb7ac1f1700c1a"},
+   {1000003, "27ece2fd65bbd3b5e225158beada728ebbaf835e101aef67cad4664eceafdd7c"},
+   {3145733, "291ca46300521a33f3a3fda9f0f2f1c0837686d42b0ac8dc1550037a2ae4c85b"},
+   {0, NULL}
+};
+
+/* Sizes of the updates, to cross the block, chunk and subtree boundaries */
+static size_t steps[] = { 1, 64, 1000, 1024, 4096, 65536, 1048576 };
+
+int main(int argc, char *argv[])
+{
+   Unittests blake3_test("blake3_test", true);
+   BLAKE3_CTX ctx;
+   uint8_t digest[BLAKE3_DIGEST_SIZE];
+   char hex[2 * BLAKE3_DIGEST_SIZE + 1];
+   char label[100];
+   size_t max = 3145733;
+   uint8_t *data = (uint8_t *)malloc(max);
+
+   make_data(data, max);
+   /* Use the threads even on a single CPU */
+   nb_parts = BLAKE3_MAX_THREADS;
+   for (int threaded = 0; threaded <= 1; threaded++) {
+      for (int i = 0; tests[i].digest; i++) {
+         BLAKE3_init(&ctx, threaded);
+         BLAKE3_update(&ctx, data, tests[i].len);
+         BLAKE3_final(&ctx, digest);
+         bsnprintf(label, sizeof(label), "Checking BLAKE3 of %lld bytes threads=%d",
+                   (long long)tests[i].len, threaded);
+         is(to_hex(digest, hex), tests[i].digest, label);
+
+         for (int j = 0; j < (int)(sizeof(steps)/sizeof(steps[0])); j++) {
+            size_t len = tests[i].len;
+            BLAKE3_init(&ctx, threaded);
+            for (size_t pos = 0; pos < len; pos += steps[j]) {
+               BLAKE3_update(&ctx, data + pos, MIN(steps[j], len - pos));
+            }
+            BLAKE3_final(&ctx, digest);
+            bsnprintf(label, sizeof(label), "Checking BLAKE3 of %lld bytes by %lld threads=%d",
+                      (long long)len, (long long)steps[j], threaded);
+            is(to_hex(digest, hex), tests[i].digest, label);
+         }
+      }
+   }
+
+   /* A context released before the end must stop its threads */
+   BLAKE3_init(&ctx, true);
+   BLAKE3_update(&ctx, data, max);
+   BLAKE3_free(&ctx);
+   ok(ctx.mt == NULL, "Checking BLAKE3_free()");
+
+   free(data);
+   return report();
+}
+#endif /* TEST_PROGRAM */
@@ -0,0 +1,58 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+*/
+/*
+ * BLAKE3 cryptographic hash, see blake3.c
+ */
+
+#ifndef __BLAKE3_H
+#define __BLAKE3_H
+
+#define BLAKE3_DIGEST_SIZE    32
+#define BLAKE3_BLOCK_LEN      64
+#define BLAKE3_CHUNK_LEN      1024
+#define BLAKE3_MAX_DEPTH      54
+
+/* Maximum number of threads used to hash a large input */
+#define BLAKE3_MAX_THREADS    4
+
+typedef struct {
+   uint32_t cv[8];
+   uint64_t counter;                   /* chunk number */
+   uint8_t  buf[BLAKE3_BLOCK_LEN];
+   uint8_t  buf_len;
+   uint8_t  blocks_compressed;
+} BLAKE3_CHUNK;
+
+struct blake3_mt;
+
+typedef struct {
+   BLAKE3_CHUNK chunk;                 /* current chunk */
+   uint32_t cv_stack[BLAKE3_MAX_DEPTH + 1][8]; /* subtrees not yet merged */
+   uint8_t  cv_stack_len;
+   bool     threaded;                  /* large inputs may use threads */
+   uint64_t total_len;
+   struct blake3_mt *mt;               /* threads and their input buffer */
+} BLAKE3_CTX;
+
+void BLAKE3_init(BLAKE3_CTX *ctx, bool threaded);
+void BLAKE3_update(BLAKE3_CTX *ctx, const uint8_t *data, size_t len);
+void BLAKE3_final(BLAKE3_CTX *ctx, uint8_t digest[BLAKE3_DIGEST_SIZE]);
+void BLAKE3_free(BLAKE3_CTX *ctx);
+
+#endif /* __BLAKE3_H */
@@ -37,6 +37,9 @@
 #include "lz4.h"
 #include <netdb.h>
 #include <netinet/tcp.h>
+#ifndef HAVE_WIN32
+#include <sys/uio.h>
+#endif
 
 #define BSOCK_DEBUG_LVL    900
 
@@ -100,6 +103,28 @@ void BSOCK::init()
    timeout = BSOCK_TIMEOUT;
    m_spool_fd = NULL;
    cmsg = get_pool_memory(PM_BSOCK);
+   init_packing();
+}
+
+/*
+ * No packing, no coalescing, no compression stream, no buffer. Also
+ *  used by dup_bsock(), the duped socket does not share the buffers,
+ *  it compresses its messages one by one.
+ */
+void BSOCK::init_packing()
+{
+   m_pack = m_unpack = NULL;
+   m_pack_len = m_pack_size = m_pack_nb = 0;
+   m_pack_time = 0;
+   m_PackedMsgs = m_Packs = 0;
+   m_unpack_len = m_unpack_pos = 0;
+   m_wbuf = NULL;
+   m_wbuf_len = m_wbuf_size = 0;
+   m_wbuf_time = 0;
+   m_CoalescedMsgs = m_Writes = 0;
+   m_stream_method = 0;
+   m_stream_dict = false;
+   m_cstream = m_dstream = NULL;
 }
 
 /*
@@ -112,6 +137,26 @@ void BSOCK::_destroy()
       free_pool_memory(cmsg);
       cmsg = NULL;
    }
+   if (m_pack) {
+      free_pool_memory(m_pack);
+      m_pack = NULL;
+   }
+   if (m_unpack) {
+      free_pool_memory(m_unpack);
+      m_unpack = NULL;
+   }
+   if (m_wbuf) {
+      free_pool_memory(m_wbuf);
+      m_wbuf = NULL;
+   }
+   if (m_cstream) {
+      delete m_cstream;
+      m_cstream = NULL;
+   }
+   if (m_dstream) {
+      delete m_dstream;
+      m_dstream = NULL;
+   }
 };
 
 #if 0
@@ -236,6 +281,7 @@ bail_out:
  *     BNET_DATACOMPRESSED The data using the specified offset was
  *                   compressed, and normal comm line compression will
  *                   not be done.
+ *     BNET_PACKED   Several small messages, see set_packing()
  *   If any of the above bits are set, then BNET_HDR_EXTEND will be set
  *   in the top bits of msglen, and the full set of flags + the offset
  *   will be passed as a 32 bit word just after the msglen, and then
@@ -253,15 +299,7 @@ bail_out:
 
 bool BSOCK::send(int aflags)
 {
-   int32_t rc;
-   int32_t pktsiz;
-   int32_t *hdrptr;
-   int offset;
-   int hdrsiz;
    bool ok = true;
-   int32_t save_msglen;
-   POOLMEM *save_msg;
-   bool compressed;
    bool locked = false;
 
    if (is_closed()) {
@@ -307,6 +345,39 @@ bool BSOCK::send(int aflags)
       pP(pm_wmutex);
       locked = true;
    }
+   if (m_pack_size > 0) {
+      /* A small message is packed, the others go after the pack */
+      if (aflags == 0 && pack_msg(&ok)) {
+         goto bail_out;
+      }
+      if (!send_pack()) {
+         ok = false;
+         goto bail_out;
+      }
+   }
+   ok = send_packet(aflags);
+
+bail_out:
+   if (locked) pV(pm_wmutex);
+   return ok;
+}
+
+/*
+ * Write the message with its header, called with the write
+ *  mutex locked.
+ */
+bool BSOCK::send_packet(int aflags)
+{
+   int32_t rc;
+   int32_t pktsiz;
+   int32_t *hdrptr;
+   int offset;
+   int hdrsiz;
+   bool ok = true;
+   int32_t save_msglen;
+   POOLMEM *save_msg;
+   bool compressed;
+
    save_msglen = msglen;
    save_msg = msg;
    m_flags = aflags;
@@ -369,8 +440,13 @@ bool BSOCK::send(int aflags)
    /* send data packet */
    timer_start = watchdog_time;  /* start timer */
    clear_timed_out();
-   /* Full I/O done in one write */
-   rc = write_nbytes((char *)hdrptr, pktsiz);
+   if (m_wbuf_size > 0 && !is_spooling()) {
+      /* Written later with the next packets */
+      rc = coalesce_packet((char *)hdrptr, pktsiz);
+   } else {
+      /* Full I/O done in one write */
+      rc = write_nbytes((char *)hdrptr, pktsiz);
+   }
    if (chk_dbglvl(DT_NETWORK|1900)) dump_bsock_msg(m_fd, *pout_msg_no, "SEND", rc, msglen, m_flags, save_msg, save_msglen);
    timer_start = 0;         /* clear timer */
    if (rc != pktsiz) {
@@ -403,10 +479,363 @@ bool BSOCK::send(int aflags)
 //      msglen&BNET_HDR_EXTEND?1:0, msglen&BNET_CMD_BIT?1:0, m_flags);
    msglen = save_msglen;
    msg = save_msg;
-   if (locked) pV(pm_wmutex);
    return ok;
 }
 
+/*
+ * Pack the small messages of a one way stream, the FD sends the
+ *  records of many small files in one write. A pack is a message
+ *  sent with the BNET_PACKED flag, holding the messages with their
+ *  32 bit length or signal:
+ *
+ *    <len1><data1><len2><data2><BNET_EOD>...
+ *
+ *  recv() returns them one by one. The other end must know the
+ *  BNET_PACKED flag, and the sender must call flush_pack() before
+ *  waiting for an answer.
+ */
+void BSOCK::set_packing(int32_t size)
+{
+   size = MAX(MIN(size, BNET_MAX_PACK_SIZE), BNET_MIN_PACK_SIZE);
+   if (!m_pack) {
+      m_pack = get_pool_memory(PM_BSOCK);
+   }
+   m_pack = check_pool_memory_size(m_pack, size);
+   m_pack_size = size;
+   m_pack_len = m_pack_nb = 0;
+}
+
+/* Send the messages packed so far */
+bool BSOCK::flush_pack()
+{
+   bool ok;
+
+   if (m_use_locking) pP(pm_wmutex);
+   ok = send_pack() && flush_wbuf(false);
+   if (m_use_locking) pV(pm_wmutex);
+   return ok;
+}
+
+/*
+ * Send the pack if its first message waits since BNET_PACK_DELAY,
+ *  and write the write buffer if its first packet waits since
+ *  BNET_COALESCE_DELAY. pack_msg() and coalesce_packet() check the
+ *  delay only when the next message comes, the sender calls this
+ *  between the files and between the reads of the file data, so a
+ *  message waits at most the delay plus the time of one read.
+ */
+bool BSOCK::flush_delayed()
+{
+   bool ok = true;
+
+   if (m_use_locking) pP(pm_wmutex);
+   if (m_pack_nb > 0 && watchdog_time - m_pack_time >= BNET_PACK_DELAY) {
+      ok = send_pack();
+   }
+   if (ok && m_wbuf_len > 0 && watchdog_time - m_wbuf_time >= BNET_COALESCE_DELAY) {
+      ok = flush_wbuf(false);
+   }
+   if (m_use_locking) pV(pm_wmutex);
+   return ok;
+}
+
+bool BSOCK::clear_packing()
+{
+   bool ok = flush_pack();
+   m_pack_size = 0;
+   Dmsg3(DT_NETWORK|50, "Packed %lld messages in %lld packs to %s\n",
+         m_PackedMsgs, m_Packs, m_who);
+   return ok;
+}
+
+/*
+ * Add the message to the pack if it is small enough, the pack is
+ *  sent when it is full or when it was started a while ago, so a
+ *  slow sender does not delay the stream.
+ *
+ *  Returns false if the message must be sent alone, ok is false
+ *  if the pack could not be sent.
+ */
+bool BSOCK::pack_msg(bool *ok)
+{
+   int32_t len = MAX(msglen, 0);
+   int32_t hdr;
+
+   *ok = true;
+   /* Only the data and the end of data, not the other signals */
+   if (msglen > m_pack_size / 8 || (msglen < 0 && msglen != BNET_EOD)) {
+      return false;
+   }
+   if (m_pack_len + (int32_t)sizeof(int32_t) + len > m_pack_size) {
+      if (!(*ok = send_pack())) {
+         return true;
+      }
+   }
+   if (m_pack_nb == 0) {
+      m_pack_time = watchdog_time;
+   }
+   hdr = htonl(msglen);
+   memcpy(m_pack + m_pack_len, &hdr, sizeof(int32_t));
+   m_pack_len += sizeof(int32_t);
+   if (len > 0) {
+      memcpy(m_pack + m_pack_len, msg, len);
+      m_pack_len += len;
+   }
+   m_pack_nb++;
+   if (watchdog_time - m_pack_time >= BNET_PACK_DELAY) {
+      *ok = send_pack();
+   }
+   return true;
+}
+
+/* Send the pack, called with the write mutex locked */
+bool BSOCK::send_pack()
+{
+   POOLMEM *save_msg = msg;
+   int32_t save_msglen = msglen;
+   bool ok;
+
+   if (m_pack_nb == 0) {
+      return true;
+   }
+   msg = m_pack;
+   msglen = m_pack_len;
+   ok = send_packet(BNET_PACKED);
+   m_pack = msg;
+   msg = save_msg;
+   msglen = save_msglen;
+   m_Packs++;
+   m_PackedMsgs += m_pack_nb;
+   m_pack_len = m_pack_nb = 0;
+   return ok;
+}
+
+/*
+ * Write the packets of several messages together. send() copies the
+ *  small packets (header and data, as they go on the wire) in a write
+ *  buffer, the buffer is written in one call when it is full, with the
+ *  big packet that does not fit, or when flush() is called. The other
+ *  end sees the same stream, nothing changes in the protocol.
+ *
+ *  recv() and close() write what is waiting, the sender must call
+ *  flush() before waiting for an answer on an other socket, and
+ *  flush_delayed() when it may block, a packet is written when the
+ *  next one comes or flush_delayed() is called BNET_COALESCE_DELAY
+ *  after it was buffered.
+ */
+void BSOCK::set_coalescing(int32_t size)
+{
+   size = MAX(MIN(size, BNET_MAX_COALESCE_SIZE), BNET_MIN_COALESCE_SIZE);
+   if (m_use_locking) pP(pm_wmutex);
+   flush_wbuf(false);
+   if (!m_wbuf) {
+      m_wbuf = get_pool_memory(PM_BSOCK);
+   }
+   m_wbuf = check_pool_memory_size(m_wbuf, size);
+   m_wbuf_size = size;
+   m_wbuf_len = 0;
+   if (m_use_locking) pV(pm_wmutex);
+}
+
+/* Write the packets waiting */
+bool BSOCK::flush()
+{
+   bool ok;
+
+   if (m_use_locking) pP(pm_wmutex);
+   timer_start = watchdog_time;
+   clear_timed_out();
+   ok = send_pack() && flush_wbuf(false);
+   timer_start = 0;
+   if (m_use_locking) pV(pm_wmutex);
+   if (!ok && !m_suppress_error_msgs) {
+      Qmsg4(m_jcr, M_ERROR, 0, _("Write error flushing to %s:%s:%d: ERR=%s\n"),
+            m_who, m_host, m_port, this->bstrerror());
+   }
+   return ok;
+}
+
+bool BSOCK::clear_coalescing()
+{
+   bool ok = flush();
+   m_wbuf_size = 0;
+   Dmsg3(DT_NETWORK|50, "Coalesced %lld messages in %lld writes to %s\n",
+         m_CoalescedMsgs, m_Writes, m_who);
+   return ok;
+}
+
+/*
+ * Add the packet to the write buffer, called by send_packet() with
+ *  the write mutex locked. Returns nbytes or -1 as write_nbytes().
+ */
+int32_t BSOCK::coalesce_packet(char *ptr, int32_t nbytes)
+{
+   int32_t rc;
+
+   if (m_wbuf_len + nbytes > m_wbuf_size) {
+      if (nbytes > m_wbuf_size / 4) {
+         /* Big packet, written after the others in the same call */
+         rc = write2_nbytes(m_wbuf, m_wbuf_len, ptr, nbytes, false);
+         m_Writes++;
+         if (rc != m_wbuf_len + nbytes) {
+            m_wbuf_len = 0;
+            return -1;
+         }
+         m_wbuf_len = 0;
+         return nbytes;
+      }
+      /* The packet goes in the next buffer, more data is coming */
+      if (!flush_wbuf(true)) {
+         return -1;
+      }
+   }
+   if (m_wbuf_len == 0) {
+      m_wbuf_time = watchdog_time;
+   }
+   memcpy(m_wbuf + m_wbuf_len, ptr, nbytes);
+   m_wbuf_len += nbytes;
+   m_CoalescedMsgs++;
+   /* Do not keep a slow stream waiting */
+   if (watchdog_time - m_wbuf_time >= BNET_COALESCE_DELAY && !flush_wbuf(false)) {
+      return -1;
+   }
+   return nbytes;
+}
+
+/*
+ * Write the buffer, called with the write mutex locked. With more,
+ *  the kernel may wait for the next packets to fill a TCP segment
+ *  (MSG_MORE), they are in the buffer and will be written soon.
+ */
+bool BSOCK::flush_wbuf(bool more)
+{
+   int32_t len = m_wbuf_len;
+
+   if (len == 0) {
+      return true;
+   }
+   m_wbuf_len = 0;
+   m_Writes++;
+   if (write2_nbytes(m_wbuf, len, NULL, 0, more) != len) {
+      errors++;
+      b_errno = errno ? errno : EIO;
+      return false;
+   }
+   return true;
+}
+
+/*
+ * Write two buffers in one system call if possible, it may require
+ *  several calls as write_nbytes().
+ */
+int32_t BSOCK::write2_nbytes(char *ptr1, int32_t nbytes1, char *ptr2, int32_t nbytes2, bool more)
+{
+#ifndef HAVE_WIN32
+   struct iovec iov[2];
+   struct msghdr mh;
+   int32_t nwritten, total = 0;
+   int flags = 0;
+
+#ifdef HAVE_TLS
+   if (tls) {
+      goto one_by_one;
+   }
+#endif
+#ifdef MSG_MORE
+   if (more) {
+      flags = MSG_MORE;
+   }
+#endif
+   iov[0].iov_base = ptr1;
+   iov[0].iov_len = nbytes1;
+   iov[1].iov_base = ptr2;
+   iov[1].iov_len = nbytes2;
+   bmemzero(&mh, sizeof(mh));
+   mh.msg_iov = iov;
+   mh.msg_iovlen = nbytes2 > 0 ? 2 : 1;
+   while (mh.msg_iovlen > 0) {
+      do {
+         errno = 0;
+         nwritten = ::sendmsg(m_fd, &mh, flags);
+         if (is_timed_out() || is_terminated()) {
+            return -1;
+         }
+      } while (nwritten == -1 && errno == EINTR);
+      if (nwritten == -1 && errno == EAGAIN) {
+         fd_wait_data(m_fd, WAIT_WRITE, 1, 0);
+         continue;
+      }
+      if (nwritten <= 0) {
+         return -1;                /* error */
+      }
+      total += nwritten;
+      if (use_bwlimit()) {
+         control_bwlimit(nwritten);
+      }
+      /* Skip what was written */
+      while (mh.msg_iovlen > 0 && nwritten >= (int32_t)mh.msg_iov->iov_len) {
+         nwritten -= mh.msg_iov->iov_len;
+         mh.msg_iov++;
+         mh.msg_iovlen--;
+      }
+      if (mh.msg_iovlen > 0) {
+         mh.msg_iov->iov_base = (char *)mh.msg_iov->iov_base + nwritten;
+         mh.msg_iov->iov_len -= nwritten;
+      }
+   }
+   return total;
+
+#ifdef HAVE_TLS
+one_by_one:
+#endif
+#endif /* HAVE_WIN32 */
+   int32_t rc = write_nbytes(ptr1, nbytes1);
+   if (rc != nbytes1 || nbytes2 == 0) {
+      return rc;
+   }
+   rc = write_nbytes(ptr2, nbytes2);
+   return rc < 0 ? rc : nbytes1 + rc;
+}
+
+/*
+ * Next message of the pack received, returned like recv() does.
+ */
+int32_t BSOCK::unpack_msg()
+{
+   int32_t len;
+
+   if (m_unpack_len - m_unpack_pos < (int32_t)sizeof(int32_t)) {
+      goto bail_out;
+   }
+   memcpy(&len, m_unpack + m_unpack_pos, sizeof(int32_t));
+   len = ntohl(len);
+   m_unpack_pos += sizeof(int32_t);
+   if (len < 0) {
+      msglen = len;                   /* signal code */
+      b_errno = ENODATA;
+      return BNET_SIGNAL;
+   }
+   if (len > m_unpack_len - m_unpack_pos) {
+      goto bail_out;
+   }
+   if (len >= (int32_t)sizeof_pool_memory(msg)) {
+      msg = realloc_pool_memory(msg, len + 100);
+   }
+   memcpy(msg, m_unpack + m_unpack_pos, len);
+   m_unpack_pos += len;
+   msg[len] = 0;                      /* terminate in case it is a string */
+   msglen = len;
+   return len;
+
+bail_out:
+   errors++;
+   b_errno = EIO;
+   Qmsg3(m_jcr, M_ERROR, 0, _("Malformed packed message from %s:%s:%d\n"),
+         m_who, m_host, m_port);
+   m_unpack_len = m_unpack_pos = 0;
+   return BNET_ERROR;
+}
+
 /*
  * Receive a message from the other end. Each message consists of
  * two packets. The first is a header that contains the size
@@ -443,6 +872,16 @@ int32_t BSOCK::recv()
       pP(pm_rmutex);
       locked = true;
    }
+   /* Next message of a pack */
+   if (m_unpack_pos < m_unpack_len) {
+      nbytes = unpack_msg();
+      goto get_out;
+   }
+   /* The other end may wait for what we did not write yet */
+   if (m_wbuf_len > 0 && !flush()) {
+      nbytes = BNET_HARDEOF;
+      goto get_out;
+   }
 
    read_seqno++;            /* bump sequence number */
    timer_start = watchdog_time;  /* set start wait time */
@@ -573,6 +1012,20 @@ int32_t BSOCK::recv()
       nbytes = BNET_ERROR;
       goto get_out;
    }
+   /* Compressed after the previous messages */
+   if (compressed && (m_flags & BNET_COMM_STREAM)) {
+      if ((nbytes = decompress_stream()) < 0) {
+         b_errno = EIO;
+         errors++;
+         Qmsg4(m_jcr, M_ERROR, 0, _("Decompression error of a %d bytes message from %s:%s:%d\n"),
+               pktsiz, m_who, m_host, m_port);
+         nbytes = BNET_ERROR;
+         goto get_out;
+      }
+      msglen = nbytes;
+      compressed = false;
+   }
+
    /* If compressed uncompress it */
    if (compressed) {
       int offset = 0;
@@ -638,6 +1091,17 @@ int32_t BSOCK::recv()
     */
    Dsm_check(300);
 
+   /* Several messages, return the first one */
+   if (m_flags & BNET_PACKED) {
+      POOLMEM *packed = msg;
+      msg = m_unpack ? m_unpack : get_pool_memory(PM_BSOCK);
+      m_unpack = packed;
+      m_unpack_len = nbytes;
+      m_unpack_pos = 0;
+      m_flags = 0;
+      nbytes = unpack_msg();
+   }
+
 get_out:
    if ((chk_dbglvl(DT_NETWORK|1900))) dump_bsock_msg(m_fd, read_seqno, "RECV", nbytes, o_pktsiz, m_flags, msg, msglen);
    if (nbytes != BNET_ERROR && command) {
@@ -754,6 +1218,11 @@ bool BSOCK::comm_compress()
    m_CommBytes += msglen;                    /* uncompressed bytes */
    Dmsg4(DT_NETWORK|200, "can_compress=%d compress=%d CommBytes=%lld CommCompresedBytes=%lld\n",
          can_compress(), compress, m_CommBytes, m_CommCompressedBytes);
+   /* The data compressed with an offset is kept by the other end */
+   if (compress && offset == 0 && m_stream_method) {
+      compressed = compress_stream();
+      compress = false;
+   }
    if (compress) {
       int clen;
       int need_size;
@@ -801,6 +1270,87 @@ bool BSOCK::comm_compress()
    return compressed;
 }
 
+/*
+ * Compress the messages with the history of the previous ones
+ *  (LZ4 or zstd stream, see comm_stream.c) instead of one by one.
+ *  The receiver decompresses the messages flagged BNET_COMM_STREAM
+ *  in order, set it only if the other end knows them
+ *  (COMM_STREAM_xxx capabilities sent in the hello).
+ */
+void BSOCK::set_compress_stream(int method, bool dict)
+{
+   if (m_use_locking) pP(pm_wmutex);
+   if (m_cstream) {
+      delete m_cstream;
+      m_cstream = NULL;
+   }
+   m_stream_method = method;
+   m_stream_dict = dict;
+   if (m_use_locking) pV(pm_wmutex);
+}
+
+/*
+ * Compress msg in cmsg after the previous messages, called by
+ *  comm_compress(). Once a message is compressed, it must be sent,
+ *  the other end decompresses it with the next ones.
+ */
+bool BSOCK::compress_stream()
+{
+   int32_t clen;
+
+   if (!m_cstream) {
+      m_cstream = New(comm_stream(m_stream_method, m_stream_dict, true));
+   }
+   if (m_cstream->ok) {
+      clen = m_cstream->compress(msg, msglen, cmsg);
+      if (clen >= 0) {
+         msg = cmsg;
+         msglen = clen;
+         m_flags |= BNET_COMM_STREAM;
+         if (m_stream_method == COMM_STREAM_ZSTD) {
+            m_flags |= BNET_COMM_ZSTD;
+         }
+         if (m_stream_dict) {
+            m_flags |= BNET_COMM_DICT;
+         }
+         return true;
+      }
+   }
+   /* Nothing sent with this stream, the other end does not miss it */
+   Dmsg1(DT_NETWORK|50, "Compression stream error to %s, compress the messages one by one\n",
+         m_who);
+   delete m_cstream;
+   m_cstream = NULL;
+   m_stream_method = 0;
+   return false;
+}
+
+/*
+ * Decompress msg received with BNET_COMM_STREAM, the message is
+ *  returned in msg. Returns the message length or -1.
+ */
+int32_t BSOCK::decompress_stream()
+{
+   int method = (m_flags & BNET_COMM_ZSTD) ? COMM_STREAM_ZSTD : COMM_STREAM_LZ4;
+   bool dict = (m_flags & BNET_COMM_DICT) != 0;
+   int32_t nbytes;
+
+   if (!m_dstream) {
+      m_dstream = New(comm_stream(method, dict, false));
+   }
+   if (!m_dstream->ok || m_dstream->method() != method || m_dstream->dict() != dict) {
+      return -1;
+   }
+   nbytes = m_dstream->decompress(msg, msglen, cmsg);
+   if (nbytes < 0) {
+      return -1;
+   }
+   /* One byte more for the EOS */
+   msg = check_pool_memory_size(msg, nbytes + 1);
+   memcpy(msg, cmsg, nbytes);
+   return nbytes;
+}
+
 /*
  * Note, this routine closes the socket, but leaves the
  *   bsock memory in place.
@@ -810,6 +1360,9 @@ bool BSOCK::comm_compress()
 void BSOCK::close()
 {
    Dmsg1(BSOCK_DEBUG_LVL, "0x%p BSOCK::close()\n", this);
+   if (m_wbuf_len > 0 && !is_closed() && !errors) {
+      flush();
+   }
    BSOCKCORE::close();
    return;
 }
@@ -888,6 +1441,7 @@ BSOCK *dup_bsock(BSOCK *osock)
    bsock->msg = msg;
    bsock->cmsg = cmsg;
    bsock->errmsg = errmsg;
+   bsock->init_packing();
    if (osock->who()) {
       bsock->set_who(bstrdup(osock->who()));
    }
@@ -961,6 +1515,144 @@ int main()
    ok(bs != NULL && bs->jcr() == jcr,
          "Default initialization");
 
+   /* Small messages packed, a big one between them, compressed */
+   int sv[2];
+   ok(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0, "Socket pair");
+   BSOCK *ws = New(BSOCK(sv[0]));
+   BSOCK *rs = New(BSOCK(sv[1]));
+   ws->set_jcr(jcr);
+   rs->set_jcr(jcr);
+   ws->set_compress();
+   ws->set_packing(BNET_MIN_PACK_SIZE);
+   for (int i=0; i < 200; i++) {
+      if (i == 100) {
+         ws->msg = check_pool_memory_size(ws->msg, 3000);
+         memset(ws->msg, 'x', 3000);
+         ws->msglen = 3000;
+         ws->send();
+      }
+      ws->fsend("small message number %d", i);
+      if (i % 10 == 9) {
+         ws->signal(BNET_EOD);
+      }
+   }
+   ok(ws->clear_packing(), "Flush the pack");
+   ok(ws->Packs() > 1 && ws->Packs() < 20 && ws->PackedMsgs() == 220,
+      "Messages packed");
+   btest = true;
+   for (int i=0; i < 200 && btest; i++) {
+      if (i == 100) {
+         btest = rs->recv() == 3000 && rs->msg[2999] == 'x';
+      }
+      bsnprintf(buf, sizeof(buf), "small message number %d", i);
+      btest = btest && rs->recv() == (int32_t)strlen(buf) && strcmp(rs->msg, buf) == 0;
+      if (i % 10 == 9) {
+         btest = btest && rs->recv() == BNET_SIGNAL && rs->msglen == BNET_EOD;
+      }
+   }
+   ok(btest, "Messages unpacked in order");
+   ws->signal(BNET_EOD);              /* not packed anymore */
+   ok(rs->recv() == BNET_SIGNAL && rs->msglen == BNET_EOD, "Packing stopped");
+
+   /* A pack that waits is sent by flush_delayed() */
+   ws->set_packing(BNET_MIN_PACK_SIZE);
+   uint64_t packs = ws->Packs();
+   ws->fsend("waiting message");
+   ok(ws->flush_delayed() && ws->Packs() == packs, "Recent pack kept");
+   watchdog_time += BNET_PACK_DELAY;
+   ok(ws->flush_delayed() && ws->Packs() == packs + 1, "Delayed pack sent");
+   ok(rs->recv() > 0 && strcmp(rs->msg, "waiting message") == 0, "Delayed pack received");
+   ws->clear_packing();
+
+   /* The same stream written with fewer writes */
+   ws->set_coalescing(BNET_MIN_COALESCE_SIZE);
+   for (int i=0; i < 200; i++) {
+      if (i == 100) {
+         ws->msg = check_pool_memory_size(ws->msg, 3000);
+         memset(ws->msg, 'x', 3000);
+         ws->msglen = 3000;
+         ws->send();
+      }
+      ws->fsend("small message number %d", i);
+      if (i % 10 == 9) {
+         ws->signal(BNET_EOD);
+      }
+   }
+   ok(ws->flush(), "Flush the write buffer");
+   ok(ws->Writes() > 1 && ws->Writes() < 20, "Messages coalesced");
+   btest = true;
+   for (int i=0; i < 200 && btest; i++) {
+      if (i == 100) {
+         btest = rs->recv() == 3000 && rs->msg[2999] == 'x';
+      }
+      bsnprintf(buf, sizeof(buf), "small message number %d", i);
+      btest = btest && rs->recv() == (int32_t)strlen(buf) && strcmp(rs->msg, buf) == 0;
+      if (i % 10 == 9) {
+         btest = btest && rs->recv() == BNET_SIGNAL && rs->msglen == BNET_EOD;
+      }
+   }
+   ok(btest, "Coalesced messages received in order");
+   uint64_t writes = ws->Writes();
+   ws->fsend("waiting packet");
+   ok(ws->flush_delayed() && ws->Writes() == writes, "Recent packet kept");
+   watchdog_time += BNET_COALESCE_DELAY;
+   ok(ws->flush_delayed() && ws->Writes() == writes + 1, "Delayed packet written");
+   ok(rs->recv() > 0 && strcmp(rs->msg, "waiting packet") == 0, "Delayed packet received");
+   ws->fsend("question");
+   rs->fsend("answer");
+   ok(ws->recv() > 0 && strcmp(ws->msg, "answer") == 0, "Answer received");
+   ok(rs->recv() > 0 && strcmp(rs->msg, "question") == 0, "Write buffer flushed by recv()");
+   ok(ws->clear_coalescing() && !ws->is_coalescing(), "Coalescing stopped");
+   ws->close();
+   rs->close();
+   delete ws;
+   delete rs;
+
+   /* Compressed after the previous messages, smaller than one by one */
+   int methods[] = { 0, COMM_STREAM_LZ4, COMM_STREAM_ZSTD };
+   uint64_t alone = 0;
+   for (int m=0; m < 3; m++) {
+      if (methods[m] && !(comm_stream_capabilities() & methods[m])) {
+         continue;
+      }
+      ok(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0, "Socket pair");
+      ws = New(BSOCK(sv[0]));
+      rs = New(BSOCK(sv[1]));
+      ws->set_jcr(jcr);
+      rs->set_jcr(jcr);
+      ws->set_compress();
+      ws->set_compress_stream(methods[m], m == 1);
+      for (int i=0; i < 200; i++) {
+         if (i == 100) {
+            ws->msg = check_pool_memory_size(ws->msg, 3000);
+            memset(ws->msg, 'x', 3000);
+            ws->msglen = 3000;
+            ws->send();
+         }
+         ws->fsend("%d 1 /usr/share/doc/libfoo%d/changelog.Debian.gz", i, i % 7);
+      }
+      btest = true;
+      for (int i=0; i < 200 && btest; i++) {
+         if (i == 100) {
+            btest = rs->recv() == 3000 && rs->msg[2999] == 'x';
+         }
+         bsnprintf(buf, sizeof(buf), "%d 1 /usr/share/doc/libfoo%d/changelog.Debian.gz", i, i % 7);
+         btest = btest && rs->recv() == (int32_t)strlen(buf) && strcmp(rs->msg, buf) == 0;
+      }
+      if (methods[m] == 0) {
+         alone = ws->CommCompressedBytes();
+         ok(btest, "Messages compressed one by one");
+      } else {
+         ok(btest, methods[m] == COMM_STREAM_LZ4 ? "LZ4 stream decompressed in order" :
+            "zstd stream decompressed in order");
+         ok(ws->CommCompressedBytes() < alone / 2, "Stream smaller than the messages alone");
+      }
+      ws->close();
+      rs->close();
+      delete ws;
+      delete rs;
+   }
+
    Pmsg0(0, "Preparing fork\n");
    pid = fork();
    if (0 == pid){
@@ -1009,3 +1701,138 @@ int main()
    return report();
 };
 #endif /* TEST_PROGRAM */
+
+#ifdef BSOCK_BENCH
+/*
+ * Messages per second sent on a socket pair with the mix of a backup
+ *  of small files: for each file a header, the attributes, a data
+ *  record and the end of data signals, a big record from time to time.
+ *  A thread reads the messages on the other side.
+ */
+static void usage()
+{
+   fprintf(stderr,
+"\n"
+"Usage: bsock_bench [-n files] [-c coalesce-size] [-p pack-size]\n"
+"       -n <files>  number of files sent (default 100000)\n"
+"       -c <size>   size of the write buffer (default 64k)\n"
+"       -p <size>   size of the packs (default 64k)\n"
+"       -?          print this message.\n"
+"\n\n");
+
+   exit(1);
+}
+
+static void *bench_reader(void *arg)
+{
+   BSOCK *rs = (BSOCK *)arg;
+   int32_t n;
+
+   for ( ;; ) {
+      n = rs->recv();
+      if (n == BNET_SIGNAL && rs->msglen == BNET_TERMINATE) {
+         break;
+      }
+      if (n < 0 && n != BNET_SIGNAL) {
+         fprintf(stderr, "Read error %d\n", n);
+         break;
+      }
+   }
+   return NULL;
+}
+
+static void bench_send(BSOCK *ws, int32_t len)
+{
+   ws->msglen = len;
+   ws->send();
+}
+
+static void bench(const char *name, int nb_files, int coalesce_size, int pack_size)
+{
+   static const int32_t big_len = 64 * 1024;
+   int sv[2];
+   pthread_t tid;
+   btime_t start, elapsed;
+   uint64_t nb_msgs = 0;
+   uint64_t nb_writes;
+
+   if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+      berrno be;
+      fprintf(stderr, "socketpair: ERR=%s\n", be.bstrerror());
+      exit(1);
+   }
+   BSOCK *ws = New(BSOCK(sv[0]));
+   BSOCK *rs = New(BSOCK(sv[1]));
+   ws->msg = check_pool_memory_size(ws->msg, big_len + 1);
+   memset(ws->msg, 'x', big_len);
+   pthread_create(&tid, NULL, bench_reader, rs);
+   if (coalesce_size > 0) {
+      ws->set_coalescing(coalesce_size);
+   }
+   if (pack_size > 0) {
+      ws->set_packing(pack_size);
+   }
+
+   start = get_current_btime();
+   for (int i = 0; i < nb_files; i++) {
+      bench_send(ws, 24);                /* header of the attributes */
+      bench_send(ws, 180);               /* attributes */
+      ws->signal(BNET_EOD);
+      bench_send(ws, 24);                /* header of the data */
+      bench_send(ws, i % 100 == 99 ? big_len : 2000);
+      ws->signal(BNET_EOD);
+      nb_msgs += 6;
+   }
+   if (pack_size > 0) {
+      ws->clear_packing();
+   }
+   ws->signal(BNET_TERMINATE);
+   ws->flush();
+   pthread_join(tid, NULL);
+   elapsed = get_current_btime() - start;
+
+   /* Without coalescing, each message or pack is one write */
+   nb_writes = ws->is_coalescing() ? ws->Writes() : nb_msgs - ws->PackedMsgs() + ws->Packs();
+   printf("%-20s %12.0f msgs/s %10llu writes %8.3f s\n", name,
+          (double)nb_msgs * 1000000 / MAX(elapsed, 1),
+          (unsigned long long)nb_writes, (double)elapsed / 1000000);
+   ws->close();
+   rs->close();
+   delete ws;
+   delete rs;
+}
+
+int main(int argc, char *argv[])
+{
+   int nb_files = 100000;
+   int coalesce_size = 64 * 1024;
+   int pack_size = 64 * 1024;
+   int ch;
+
+   while ((ch = getopt(argc, argv, "n:c:p:?")) != -1) {
+      switch (ch) {
+      case 'n':
+         nb_files = atoi(optarg);
+         break;
+      case 'c':
+         coalesce_size = atoi(optarg);
+         break;
+      case 'p':
+         pack_size = atoi(optarg);
+         break;
+      case '?':
+      default:
+         usage();
+      }
+   }
+   my_name_is(argc, argv, "bsock_bench");
+   lmgr_init_thread();
+   bench("one write per msg", nb_files, 0, 0);
+   bench("coalesced", nb_files, coalesce_size, 0);
+   bench("packed", nb_files, 0, pack_size);
+   bench("packed+coalesced", nb_files, coalesce_size, pack_size);
+   lmgr_cleanup_main();
+   close_memory_pool();
+   return 0;
+}
+#endif /* BSOCK_BENCH */
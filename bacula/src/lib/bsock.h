@@ -44,6 +44,8 @@
 
 #define BSOCK_TIMEOUT  3600 * 24 * 200;  /* default 200 days */
 
+class comm_stream;
+
 class BSOCK: public BSOCKCORE {
 public:
    FILE *m_spool_fd;                  /* spooling file */
@@ -62,12 +64,41 @@ private:
    bool m_compress: 1;                /* set to use comm line compression */
    uint64_t m_CommBytes;              /* Bytes sent */
    uint64_t m_CommCompressedBytes;    /* Compressed bytes sent */
+   POOLMEM *m_pack;                   /* small messages packed to be sent */
+   int32_t m_pack_len;                /* bytes packed */
+   int32_t m_pack_size;               /* size of a packed message, 0=off */
+   int32_t m_pack_nb;                 /* messages packed */
+   time_t m_pack_time;                /* time of the first message packed */
+   uint64_t m_PackedMsgs;             /* messages sent packed */
+   uint64_t m_Packs;                  /* packed messages sent */
+   POOLMEM *m_unpack;                 /* packed message received */
+   int32_t m_unpack_len;
+   int32_t m_unpack_pos;              /* next message to unpack */
+   POOLMEM *m_wbuf;                   /* packets waiting to be written */
+   int32_t m_wbuf_len;                /* bytes waiting */
+   int32_t m_wbuf_size;               /* size of the write buffer, 0=off */
+   time_t m_wbuf_time;                /* time of the first packet waiting */
+   uint64_t m_CoalescedMsgs;          /* messages written with others */
+   uint64_t m_Writes;                 /* writes done for them */
+   int m_stream_method;               /* COMM_STREAM_xxx to compress, 0=per message */
+   bool m_stream_dict;                /* start the stream with the dictionary */
+   comm_stream *m_cstream;            /* messages sent */
+   comm_stream *m_dstream;            /* messages received */
 
    bool open(JCR *jcr, const char *name, char *host, char *service,
                int port, utime_t heart_beat, int *fatal);
    void init();
    void _destroy();
    int32_t write_nbytes(char *ptr, int32_t nbytes);
+   bool send_packet(int flags);
+   bool pack_msg(bool *ok);
+   bool send_pack();
+   int32_t unpack_msg();
+   int32_t coalesce_packet(char *ptr, int32_t nbytes);
+   bool flush_wbuf(bool more);
+   int32_t write2_nbytes(char *ptr1, int32_t nbytes1, char *ptr2, int32_t nbytes2, bool more);
+   bool compress_stream();
+   int32_t decompress_stream();
 
 public:
    BSOCK();
@@ -80,6 +111,15 @@ public:
    bool signal(int signal);
    void close();              /* close connection and destroy packet */
    bool comm_compress();               /* in bsock.c */
+   void set_compress_stream(int method, bool dict); /* see comm_stream.c */
+   void set_packing(int32_t size);     /* pack the small messages */
+   bool flush_pack();                  /* send the messages packed */
+   bool flush_delayed();               /* send what waits since the delay */
+   bool clear_packing();               /* flush and stop packing */
+   void init_packing();                /* no packing state, see dup_bsock() */
+   void set_coalescing(int32_t size);  /* write the packets together */
+   bool flush();                       /* write the packets waiting */
+   bool clear_coalescing();            /* flush and stop coalescing */
    bool despool(void update_attr_spool_size(ssize_t size), ssize_t tsize);
 #if 0
    bool authenticate_director(const char *name, const char *password,
@@ -107,6 +147,12 @@ public:
    void clear_spooling() { m_spool = false; };
    void set_compress() { m_compress = true; };
    void clear_compress() { m_compress = false; };
+   bool is_packing() const { return m_pack_size > 0; };
+   uint64_t PackedMsgs() { return m_PackedMsgs; };
+   uint64_t Packs() { return m_Packs; };
+   bool is_coalescing() const { return m_wbuf_size > 0; };
+   uint64_t CoalescedMsgs() { return m_CoalescedMsgs; };
+   uint64_t Writes() { return m_Writes; };
    void dump();
 };
 
@@ -168,6 +214,20 @@ enum {
 #define BNET_OFFSET           (1<<27)     /* Data compression offset specified */
 #define BNET_NOCOMPRESS       (1<<25)     /* Disable compression */
 #define BNET_DATACOMPRESSED   (1<<24)     /* Data compression */
+#define BNET_PACKED           (1<<23)     /* Several messages, see pack_msg() */
+#define BNET_COMM_STREAM      (1<<22)     /* Compressed after the previous messages */
+#define BNET_COMM_ZSTD        (1<<21)     /*   with zstd, else LZ4 */
+#define BNET_COMM_DICT        (1<<20)     /*   the stream started with the dictionary */
+
+/* Limits of the packed messages, see set_packing() */
+#define BNET_MIN_PACK_SIZE    (4 * 1024)
+#define BNET_MAX_PACK_SIZE    (512 * 1024)
+#define BNET_PACK_DELAY       2           /* seconds a pack may wait */
+
+/* Limits of the write buffer, see set_coalescing() */
+#define BNET_MIN_COALESCE_SIZE (4 * 1024)
+#define BNET_MAX_COALESCE_SIZE (1024 * 1024)
+#define BNET_COALESCE_DELAY   1           /* seconds a packet may wait */
 
 #define BNET_SETBUF_READ  1           /* Arg for bnet_set_buffer_size */
 #define BNET_SETBUF_WRITE 2           /* Arg for bnet_set_buffer_size */
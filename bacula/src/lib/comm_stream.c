@@ -0,0 +1,298 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+*/
+/*
+ *  Streaming comm line compression
+ *
+ *  BSOCK::comm_compress() compresses each message alone, a short
+ *  attribute message has nothing to refer to and barely compresses.
+ *  A comm_stream keeps the history of the messages sent on the
+ *  connection, the next messages refer to the previous ones:
+ *
+ *   - LZ4: the last 64KB sent are kept before the message, it is
+ *     compressed as the continuation of them. The other side keeps
+ *     the same 64KB of decompressed data.
+ *   - zstd: one frame for the whole connection, flushed at the end
+ *     of each message.
+ *
+ *  Both can start with a built-in dictionary of the strings found in
+ *  the attribute and catalog messages. The messages must be
+ *  decompressed in the order they were compressed, by the same
+ *  receiving BSOCK.
+ */
+
+#include "bacula.h"
+#include "lz4.h"
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+
+/* Window of the zstd streams, the memory needed on each side */
+#define COMM_STREAM_ZSTD_WLOG    18
+#define COMM_STREAM_ZSTD_LEVEL   3
+#endif
+
+/* Largest message decompressed, see BSOCK::send() */
+#define COMM_STREAM_MAX_MSG      (8 * 1024 * 1024)
+
+/*
+ * Built-in dictionary, strings of the FD attribute and data headers
+ *  and of the catalog requests. The most frequent ones are at the
+ *  end, closer to the first messages.
+ */
+static const char comm_stream_dict[] =
+   "/usr/share/locale/LC_MESSAGES/.mo\000/usr/share/man/man1/.1.gz\000"
+   "/usr/share/doc/changelog.Debian.gz\000copyright\000README.md\000"
+   "/usr/lib/x86_64-linux-gnu/.so.1\000/usr/lib/python3/dist-packages/"
+   "__init__.py\000__pycache__/.cpython-311.pyc\000/usr/include/.h\000"
+   "/usr/src/linux-headers-/include/linux/Makefile\000Kconfig\000"
+   "/etc/systemd/system/multi-user.target.wants/.service\000"
+   "/var/lib/dpkg/info/.list\000.md5sums\000/var/log/\000/var/cache/"
+   "/home/.cache/.config/.local/share/Documents/Downloads/Pictures/"
+   "/node_modules/package.json\000index.js\000.git/objects/"
+   "C:/Windows/System32/C:/Program Files/C:/Users/AppData/Local/"
+   "Catalog Request Job=\000UpdCat Job=\000FileAttributes \000"
+   "CatReq JobId=\000Storage\000Volume\000Device\000Pool\000"
+   "gD KhW IGk B A A A Bm BAA I Bl+Mt Bl+Mt Bl+Mt A A C\000\000\000"
+   "A A IH/ B A A A BAA BAA I Bl+Mt Bl+Mt Bl+Mt A A M\000\000\000"
+   "P0C 3Fk IHt B A A A Ng BAA I Bl+Mt Bl+Mt Bl+Mt A A M\000\000\000"
+   "P0C 3Fk IGk B A A A Dg BAA I Bl+Mt Bl+Mt Bl+Mt A A C\000\000\000"
+   "1 1 0\0001 3 \0002 1 0\0002 2 \0003 1 0\0003 2 \000"
+   "0\000\0001 12 \000/usr/share/doc/\000/usr/lib/\000/home/\000/etc/\000";
+
+/* The methods that this build can decompress */
+int comm_stream_capabilities()
+{
+#ifdef HAVE_ZSTD
+   return COMM_STREAM_LZ4 | COMM_STREAM_ZSTD;
+#else
+   return COMM_STREAM_LZ4;
+#endif
+}
+
+comm_stream::comm_stream(int method, bool dict, bool compress)
+{
+   m_method = method;
+   m_dict = dict;
+   m_compress = compress;
+   m_lz4 = NULL;
+   m_hist = NULL;
+   m_hist_len = 0;
+   m_zctx = NULL;
+   ok = init();
+}
+
+comm_stream::~comm_stream()
+{
+   if (m_lz4) {
+      LZ4_freeStream((LZ4_stream_t *)m_lz4);
+   }
+   if (m_hist) {
+      free_pool_memory(m_hist);
+   }
+#ifdef HAVE_ZSTD
+   if (m_zctx && m_compress) {
+      ZSTD_freeCCtx((ZSTD_CCtx *)m_zctx);
+   } else if (m_zctx) {
+      ZSTD_freeDCtx((ZSTD_DCtx *)m_zctx);
+   }
+#endif
+}
+
+bool comm_stream::init()
+{
+   int dict_len = m_dict ? sizeof(comm_stream_dict) - 1 : 0;
+
+   if (m_method == COMM_STREAM_LZ4) {
+      m_hist = get_pool_memory(PM_BSOCK);
+      m_hist = check_pool_memory_size(m_hist, COMM_STREAM_LZ4_HISTORY);
+      memcpy(m_hist, comm_stream_dict, dict_len);
+      m_hist_len = dict_len;
+      if (m_compress) {
+         m_lz4 = LZ4_createStream();
+         if (!m_lz4) {
+            return false;
+         }
+         LZ4_loadDict((LZ4_stream_t *)m_lz4, m_hist, m_hist_len);
+      }
+      return true;
+   }
+#ifdef HAVE_ZSTD
+   if (m_method == COMM_STREAM_ZSTD) {
+      size_t ret;
+      if (m_compress) {
+         ZSTD_CCtx *zc = ZSTD_createCCtx();
+         if (!(m_zctx = zc)) {
+            return false;
+         }
+         ret = ZSTD_CCtx_setParameter(zc, ZSTD_c_compressionLevel, COMM_STREAM_ZSTD_LEVEL);
+         if (!ZSTD_isError(ret)) {
+            ret = ZSTD_CCtx_setParameter(zc, ZSTD_c_windowLog, COMM_STREAM_ZSTD_WLOG);
+         }
+         if (!ZSTD_isError(ret) && dict_len > 0) {
+            ret = ZSTD_CCtx_loadDictionary(zc, comm_stream_dict, dict_len);
+         }
+      } else {
+         ZSTD_DCtx *zd = ZSTD_createDCtx();
+         if (!(m_zctx = zd)) {
+            return false;
+         }
+         ret = 0;
+         if (dict_len > 0) {
+            ret = ZSTD_DCtx_loadDictionary(zd, comm_stream_dict, dict_len);
+         }
+      }
+      if (ZSTD_isError(ret)) {
+         Dmsg1(DT_NETWORK|50, "zstd comm stream setup error: %s\n", ZSTD_getErrorName(ret));
+         return false;
+      }
+      return true;
+   }
+#endif
+   return false;
+}
+
+/*
+ * Compress the message after the previous ones, dst is resized.
+ *  Returns the compressed length, -1 on error. After an error the
+ *  stream cannot be used anymore.
+ */
+int32_t comm_stream::compress(const char *src, int32_t len, POOLMEM *&dst)
+{
+   if (m_method == COMM_STREAM_LZ4) {
+      LZ4_stream_t *lz4 = (LZ4_stream_t *)m_lz4;
+      int32_t bound = LZ4_compressBound(len);
+      int32_t clen;
+
+      /* The message follows the history, LZ4 refers to both */
+      if (m_hist_len + len > (int32_t)sizeof_pool_memory(m_hist)) {
+         m_hist = realloc_pool_memory(m_hist, m_hist_len + len);
+         LZ4_loadDict(lz4, m_hist, m_hist_len);     /* the history moved */
+      }
+      memcpy(m_hist + m_hist_len, src, len);
+      dst = check_pool_memory_size(dst, bound + 1);
+      clen = LZ4_compress_fast_continue(lz4, m_hist + m_hist_len, dst, len, bound, 1);
+      if (clen <= 0) {
+         ok = false;
+         return -1;
+      }
+      m_hist_len = LZ4_saveDict(lz4, m_hist, COMM_STREAM_LZ4_HISTORY);
+      return clen;
+   }
+#ifdef HAVE_ZSTD
+   if (m_method == COMM_STREAM_ZSTD) {
+      ZSTD_inBuffer in = { src, (size_t)len, 0 };
+      ZSTD_outBuffer out;
+      size_t ret;
+
+      dst = check_pool_memory_size(dst, ZSTD_compressBound(len) + 100);
+      out.dst = dst;
+      out.size = sizeof_pool_memory(dst);
+      out.pos = 0;
+      for ( ;; ) {
+         ret = ZSTD_compressStream2((ZSTD_CCtx *)m_zctx, &out, &in, ZSTD_e_flush);
+         if (ZSTD_isError(ret)) {
+            Dmsg1(DT_NETWORK|50, "zstd comm stream error: %s\n", ZSTD_getErrorName(ret));
+            ok = false;
+            return -1;
+         }
+         if (ret == 0) {
+            break;                    /* all flushed */
+         }
+         dst = realloc_pool_memory(dst, out.size * 2);
+         out.dst = dst;
+         out.size = sizeof_pool_memory(dst);
+      }
+      return (int32_t)out.pos;
+   }
+#endif
+   ok = false;
+   return -1;
+}
+
+/*
+ * Decompress the next message received, dst is resized.
+ *  Returns the message length, -1 on error.
+ */
+int32_t comm_stream::decompress(const char *src, int32_t len, POOLMEM *&dst)
+{
+   int32_t size = MAX(len * 4, 65536);
+
+   if (m_method == COMM_STREAM_LZ4) {
+      int32_t nbytes;
+
+      /* Decompressed after the history, as it was compressed */
+      for ( ;; ) {
+         m_hist = check_pool_memory_size(m_hist, m_hist_len + size);
+         nbytes = LZ4_decompress_safe_usingDict(src, m_hist + m_hist_len, len, size,
+                                                m_hist, m_hist_len);
+         if (nbytes >= 0 || size >= COMM_STREAM_MAX_MSG) {
+            break;
+         }
+         size *= 2;
+      }
+      if (nbytes < 0) {
+         ok = false;
+         return -1;
+      }
+      dst = check_pool_memory_size(dst, nbytes + 1);
+      memcpy(dst, m_hist + m_hist_len, nbytes);
+      m_hist_len += nbytes;
+      if (m_hist_len > COMM_STREAM_LZ4_HISTORY) {
+         memmove(m_hist, m_hist + m_hist_len - COMM_STREAM_LZ4_HISTORY,
+                 COMM_STREAM_LZ4_HISTORY);
+         m_hist_len = COMM_STREAM_LZ4_HISTORY;
+      }
+      return nbytes;
+   }
+#ifdef HAVE_ZSTD
+   if (m_method == COMM_STREAM_ZSTD) {
+      ZSTD_inBuffer in = { src, (size_t)len, 0 };
+      ZSTD_outBuffer out;
+      size_t ret;
+
+      dst = check_pool_memory_size(dst, size);
+      out.dst = dst;
+      out.size = sizeof_pool_memory(dst);
+      out.pos = 0;
+      for ( ;; ) {
+         ret = ZSTD_decompressStream((ZSTD_DCtx *)m_zctx, &out, &in);
+         if (ZSTD_isError(ret)) {
+            Dmsg1(DT_NETWORK|50, "zstd comm stream error: %s\n", ZSTD_getErrorName(ret));
+            ok = false;
+            return -1;
+         }
+         if (in.pos == in.size && out.pos < out.size) {
+            break;                    /* all the message is out */
+         }
+         if (out.pos == out.size) {
+            if (out.size >= COMM_STREAM_MAX_MSG) {
+               ok = false;
+               return -1;
+            }
+            dst = realloc_pool_memory(dst, out.size * 2);
+            out.dst = dst;
+            out.size = sizeof_pool_memory(dst);
+         }
+      }
+      return (int32_t)out.pos;
+   }
+#endif
+   ok = false;
+   return -1;
+}
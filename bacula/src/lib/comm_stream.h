@@ -0,0 +1,58 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+*/
+/*
+ *  Streaming comm line compression, see comm_stream.c
+ */
+
+#ifndef __COMM_STREAM_H_
+#define __COMM_STREAM_H_
+
+/* Methods, also the capabilities sent in the hello */
+#define COMM_STREAM_LZ4    (1<<0)     /* LZ4 with the history of the messages */
+#define COMM_STREAM_ZSTD   (1<<1)     /* zstd frame flushed at each message */
+
+/* History kept by the LZ4 streams, the maximum of LZ4 */
+#define COMM_STREAM_LZ4_HISTORY (64 * 1024)
+
+/* The methods that this build can decompress */
+int comm_stream_capabilities();
+
+class comm_stream: public SMARTALLOC {
+   int m_method;                      /* COMM_STREAM_LZ4 or COMM_STREAM_ZSTD */
+   bool m_dict;                       /* started with the built-in dictionary */
+   bool m_compress;                   /* compress or decompress side */
+   void *m_lz4;                       /* LZ4_stream_t when compressing */
+   POOLMEM *m_hist;                   /* LZ4: history followed by the message */
+   int32_t m_hist_len;
+   void *m_zctx;                      /* ZSTD_CCtx or ZSTD_DCtx */
+
+   bool init();
+
+public:
+   bool ok;                           /* set if the context is usable */
+
+   comm_stream(int method, bool dict, bool compress);
+   ~comm_stream();
+   int32_t compress(const char *src, int32_t len, POOLMEM *&dst);
+   int32_t decompress(const char *src, int32_t len, POOLMEM *&dst);
+   int method() const { return m_method; };
+   bool dict() const { return m_dict; };
+};
+
+#endif /* __COMM_STREAM_H_ */
@@ -36,8 +36,16 @@
 
 #include "bacula.h"
 #include "jcr.h"
+#include "xxh3.h"
+#include "blake3.h"
 #include <assert.h>
 
+/* Digests done by the lib, with or without a crypto library */
+static bool internal_digest_new(DIGEST *digest);
+static void internal_digest_update(DIGEST *digest, const uint8_t *data, uint32_t length);
+static void internal_digest_finalize(DIGEST *digest, uint8_t *dest, uint32_t *length);
+static void internal_digest_free(DIGEST *digest);
+
 /**
  * For OpenSSL version 1.x, EVP_PKEY_encrypt no longer
  *  exists.  It was not an official API.
@@ -276,6 +284,10 @@ struct Digest {
    crypto_digest_t type;
    JCR *jcr;
    EVP_MD_CTX *ctx;
+   union {                      /* Digests not done by OpenSSL */
+      XXH3_CTX xxh3;
+      BLAKE3_CTX blake3;
+   };
 };
 
 /* Message Signature Structure */
@@ -294,6 +306,9 @@ struct Crypto_Session {
 /* Symmetric Cipher Context */
 struct Cipher_Context {
    EVP_CIPHER_CTX *ctx;
+   bool aead;                                     /* Records sealed one by one */
+   unsigned char iv[EVP_MAX_IV_LENGTH];           /* Base of the record nonces */
+   int iv_len;
 };
 
 /* PEM Password Dispatch Context */
@@ -599,8 +614,13 @@ DIGEST *crypto_digest_new(JCR *jcr, crypto_digest_t type)
    digest = (DIGEST *)malloc(sizeof(DIGEST));
    digest->type = type;
    digest->jcr = jcr;
+   digest->ctx = NULL;
    Dmsg1(150, "crypto_digest_new jcr=%p\n", jcr);
 
+   if (internal_digest_new(digest)) {
+      return digest;
+   }
+
    /* Initialize the OpenSSL message digest context */
    digest->ctx = EVP_MD_CTX_new();
    if (!digest->ctx) {
@@ -651,6 +671,10 @@ err:
  */
 bool crypto_digest_update(DIGEST *digest, const uint8_t *data, uint32_t length)
 {
+   if (!digest->ctx) {
+      internal_digest_update(digest, data, length);
+      return true;
+   }
    if (EVP_DigestUpdate(digest->ctx, data, length) == 0) {
       Dmsg0(150, "digest update failed\n");
       openssl_post_errors(digest->jcr, M_ERROR, _("OpenSSL digest update failed"));
@@ -669,6 +693,10 @@ bool crypto_digest_update(DIGEST *digest, const uint8_t *data, uint32_t length)
  */
 bool crypto_digest_finalize(DIGEST *digest, uint8_t *dest, uint32_t *length)
 {
+   if (!digest->ctx) {
+      internal_digest_finalize(digest, dest, length);
+      return true;
+   }
    if (!EVP_DigestFinal(digest->ctx, dest, (unsigned int *)length)) {
       Dmsg0(150, "digest finalize failed\n");
       openssl_post_errors(digest->jcr, M_ERROR, _("OpenSSL digest finalize failed"));
@@ -683,7 +711,11 @@ bool crypto_digest_finalize(DIGEST *digest, uint8_t *dest, uint32_t *length)
  */
 void crypto_digest_free(DIGEST *digest)
 {
-  EVP_MD_CTX_free(digest->ctx);
+  if (digest->ctx) {
+     EVP_MD_CTX_free(digest->ctx);
+  } else {
+     internal_digest_free(digest);
+  }
   free(digest);
 }
 
@@ -1030,6 +1062,18 @@ CRYPTO_SESSION *crypto_session_new (crypto_cipher_t cipher, alist *pubkeys)
       cs->cryptoData->contentEncryptionAlgorithm = OBJ_nid2obj(NID_bf_cbc);
       ec = EVP_bf_cbc();
       break;
+   case CRYPTO_CIPHER_AES_128_GCM:
+      /* AES 128 bit GCM, the IV is the base of the record nonces */
+      cs->cryptoData->contentEncryptionAlgorithm = OBJ_nid2obj(NID_aes_128_gcm);
+      ec = EVP_aes_128_gcm();
+      break;
+#ifndef HAVE_OPENSSL_EXPORT_LIBRARY
+   case CRYPTO_CIPHER_AES_256_GCM:
+      /* AES 256 bit GCM */
+      cs->cryptoData->contentEncryptionAlgorithm = OBJ_nid2obj(NID_aes_256_gcm);
+      ec = EVP_aes_256_gcm();
+      break;
+#endif
    default:
       Jmsg0(NULL, M_ERROR, 0, _("Unsupported cipher type specified\n"));
       crypto_session_free(cs);
@@ -1310,8 +1354,20 @@ CIPHER_CONTEXT *crypto_cipher_new(CRYPTO_SESSION *cs, bool encrypt, uint32_t *bl
       goto err;
    }
 
+   /*
+    * With an AEAD cipher, the nonce of each record is made with the
+    *  session IV and the record number, see crypto_cipher_seal()
+    */
+   cipher_ctx->aead = EVP_CIPHER_mode(ec) == EVP_CIPH_GCM_MODE;
+   cipher_ctx->iv_len = ASN1_STRING_length(cs->cryptoData->iv);
+   if (cipher_ctx->aead && cipher_ctx->iv_len != CRYPTO_RECORD_NONCE_SIZE) {
+      openssl_post_errors(M_ERROR, _("Encryption session provided an invalid IV"));
+      goto err;
+   }
+   memcpy(cipher_ctx->iv, ASN1_STRING_get0_data(cs->cryptoData->iv), cipher_ctx->iv_len);
+
    /* Add the key and IV to the cipher context */
-   if (!EVP_CipherInit_ex(cipher_ctx->ctx, NULL, NULL, cs->session_key, ASN1_STRING_get0_data(cs->cryptoData->iv), -1)) {
+   if (!EVP_CipherInit_ex(cipher_ctx->ctx, NULL, NULL, cs->session_key, cipher_ctx->aead ? NULL : cipher_ctx->iv, -1)) {
       openssl_post_errors(M_ERROR, _("OpenSSL cipher context key/IV initialization failed"));
       goto err;
    }
@@ -1368,6 +1424,104 @@ void crypto_cipher_free (CIPHER_CONTEXT *cipher_ctx)
    free (cipher_ctx);
 }
 
+/*
+ * Check if the session uses an AEAD cipher (AES-GCM). The data is then
+ *  encrypted with crypto_cipher_seal() and decrypted with
+ *  crypto_cipher_open() rather than with crypto_cipher_update().
+ */
+bool crypto_session_aead(CRYPTO_SESSION *cs)
+{
+   int nid = OBJ_obj2nid(cs->cryptoData->contentEncryptionAlgorithm);
+   return nid == NID_aes_128_gcm || nid == NID_aes_256_gcm;
+}
+
+/* Nonce of a record: the session IV with the record number in the last bytes */
+static void record_nonce(CIPHER_CONTEXT *cipher_ctx, const uint8_t *hdr, unsigned char *nonce)
+{
+   memcpy(nonce, cipher_ctx->iv, CRYPTO_RECORD_NONCE_SIZE);
+   for (int i = 0; i < CRYPTO_RECORD_HDR_SIZE; i++) {
+      nonce[CRYPTO_RECORD_NONCE_SIZE - CRYPTO_RECORD_HDR_SIZE + i] ^= hdr[i];
+   }
+}
+
+/*
+ * Encrypt and authenticate one record with an AEAD cipher context.
+ *  Each record is independent from the others, so that the records
+ *  can be encrypted and decrypted in any order by any number of
+ *  contexts of the same session. The record number must be unique
+ *  in the session, it is written in clear in front of the data and
+ *  it is authenticated with it.
+ *
+ * dest must have room for length + CRYPTO_RECORD_OVERHEAD bytes.
+ *
+ * Returns: true on success, number of bytes output in written
+ *          false on failure
+ */
+bool crypto_cipher_seal(CIPHER_CONTEXT *cipher_ctx, uint64_t recno, const uint8_t *data,
+                        uint32_t length, uint8_t *dest, uint32_t *written)
+{
+   unsigned char nonce[CRYPTO_RECORD_NONCE_SIZE];
+   int len, flen;
+
+   if (!cipher_ctx->aead) {
+      return false;
+   }
+   for (int i = CRYPTO_RECORD_HDR_SIZE - 1; i >= 0; i--) {
+      dest[i] = recno & 0xFF;
+      recno >>= 8;
+   }
+   record_nonce(cipher_ctx, dest, nonce);
+   if (!EVP_CipherInit_ex(cipher_ctx->ctx, NULL, NULL, NULL, nonce, -1) ||
+       !EVP_CipherUpdate(cipher_ctx->ctx, NULL, &len, dest, CRYPTO_RECORD_HDR_SIZE) ||
+       !EVP_CipherUpdate(cipher_ctx->ctx, dest + CRYPTO_RECORD_HDR_SIZE, &len, data, length) ||
+       !EVP_CipherFinal_ex(cipher_ctx->ctx, dest + CRYPTO_RECORD_HDR_SIZE + len, &flen) ||
+       !EVP_CIPHER_CTX_ctrl(cipher_ctx->ctx, EVP_CTRL_GCM_GET_TAG, CRYPTO_RECORD_TAG_SIZE,
+                            dest + CRYPTO_RECORD_HDR_SIZE + len + flen)) {
+      openssl_post_errors(M_ERROR, _("Record encryption failed"));
+      return false;
+   }
+   *written = CRYPTO_RECORD_HDR_SIZE + len + flen + CRYPTO_RECORD_TAG_SIZE;
+   return true;
+}
+
+/*
+ * Decrypt one record made by crypto_cipher_seal() and check its
+ *  authentication tag.
+ *
+ * dest must have room for length bytes.
+ *
+ * Returns: true on success, number of bytes output in written
+ *          false if the record is corrupted or on failure
+ */
+bool crypto_cipher_open(CIPHER_CONTEXT *cipher_ctx, const uint8_t *data, uint32_t length,
+                        uint8_t *dest, uint32_t *written)
+{
+   unsigned char nonce[CRYPTO_RECORD_NONCE_SIZE];
+   const uint8_t *tag;
+   int len, flen;
+
+   if (!cipher_ctx->aead || length < CRYPTO_RECORD_OVERHEAD) {
+      return false;
+   }
+   length -= CRYPTO_RECORD_OVERHEAD;
+   tag = data + CRYPTO_RECORD_HDR_SIZE + length;
+   record_nonce(cipher_ctx, data, nonce);
+   if (!EVP_CipherInit_ex(cipher_ctx->ctx, NULL, NULL, NULL, nonce, -1) ||
+       !EVP_CipherUpdate(cipher_ctx->ctx, NULL, &len, data, CRYPTO_RECORD_HDR_SIZE) ||
+       !EVP_CipherUpdate(cipher_ctx->ctx, dest, &len, data + CRYPTO_RECORD_HDR_SIZE, length) ||
+       !EVP_CIPHER_CTX_ctrl(cipher_ctx->ctx, EVP_CTRL_GCM_SET_TAG, CRYPTO_RECORD_TAG_SIZE,
+                            (void *)tag)) {
+      openssl_post_errors(M_ERROR, _("Record decryption failed"));
+      return false;
+   }
+   /* The tag is checked here */
+   if (!EVP_CipherFinal_ex(cipher_ctx->ctx, dest + len, &flen)) {
+      return false;
+   }
+   *written = len + flen;
+   return true;
+}
+
 #else /* HAVE_OPENSSL */
 # error No encryption library available
 #endif /* HAVE_OPENSSL */
@@ -1385,6 +1539,8 @@ struct Digest {
    union {
       SHA1Context sha1;
       MD5Context md5;
+      XXH3_CTX xxh3;
+      BLAKE3_CTX blake3;
    };
 };
 
@@ -1408,6 +1564,10 @@ DIGEST *crypto_digest_new(JCR *jcr, crypto_digest_t type)
    case CRYPTO_DIGEST_SHA1:
       SHA1Init(&digest->sha1);
       break;
+   case CRYPTO_DIGEST_XXH128:
+   case CRYPTO_DIGEST_BLAKE3:
+      internal_digest_new(digest);
+      break;
    default:
       Jmsg1(jcr, M_ERROR, 0, _("Unsupported digest type=%d specified\n"), type);
       free(digest);
@@ -1433,6 +1593,10 @@ bool crypto_digest_update(DIGEST *digest, const uint8_t *data, uint32_t length)
          return false;
       }
       break;
+   case CRYPTO_DIGEST_XXH128:
+   case CRYPTO_DIGEST_BLAKE3:
+      internal_digest_update(digest, data, length);
+      return true;
    default:
       return false;
    }
@@ -1460,6 +1624,10 @@ bool crypto_digest_finalize(DIGEST *digest, uint8_t *dest, uint32_t *length)
          return false;
       }
       break;
+   case CRYPTO_DIGEST_XXH128:
+   case CRYPTO_DIGEST_BLAKE3:
+      internal_digest_finalize(digest, dest, length);
+      return true;
    default:
       return false;
    }
@@ -1469,6 +1637,7 @@ bool crypto_digest_finalize(DIGEST *digest, uint8_t *dest, uint32_t *length)
 
 void crypto_digest_free(DIGEST *digest)
 {
+   internal_digest_free(digest);
    free(digest);
 }
 
@@ -1503,6 +1672,9 @@ CIPHER_CONTEXT *crypto_cipher_new (CRYPTO_SESSION *cs, bool encrypt, uint32_t *b
 bool crypto_cipher_update (CIPHER_CONTEXT *cipher_ctx, const uint8_t *data, uint32_t length, const uint8_t *dest, uint32_t *written) { return false; }
 bool crypto_cipher_finalize (CIPHER_CONTEXT *cipher_ctx, uint8_t *dest, uint32_t *written) { return false; }
 void crypto_cipher_free (CIPHER_CONTEXT *cipher_ctx) { }
+bool crypto_session_aead (CRYPTO_SESSION *cs) { return false; }
+bool crypto_cipher_seal (CIPHER_CONTEXT *cipher_ctx, uint64_t recno, const uint8_t *data, uint32_t length, uint8_t *dest, uint32_t *written) { return false; }
+bool crypto_cipher_open (CIPHER_CONTEXT *cipher_ctx, const uint8_t *data, uint32_t length, uint8_t *dest, uint32_t *written) { return false; }
 
 #endif /* HAVE_CRYPTO */
 
@@ -1533,6 +1705,10 @@ const char *crypto_digest_name(DIGEST *digest)
       return "SHA256";
    case CRYPTO_DIGEST_SHA512:
       return "SHA512";
+   case CRYPTO_DIGEST_XXH128:
+      return "XXH128";
+   case CRYPTO_DIGEST_BLAKE3:
+      return "BLAKE3";
    case CRYPTO_DIGEST_NONE:
       return "None";
    default:
@@ -1556,11 +1732,63 @@ crypto_digest_t crypto_digest_stream_type(int stream)
       return CRYPTO_DIGEST_SHA256;
    case STREAM_SHA512_DIGEST:
       return CRYPTO_DIGEST_SHA512;
+   case STREAM_XXH128_DIGEST:
+      return CRYPTO_DIGEST_XXH128;
+   case STREAM_BLAKE3_DIGEST:
+      return CRYPTO_DIGEST_BLAKE3;
    default:
       return CRYPTO_DIGEST_NONE;
    }
 }
 
+/*
+ * XXH128 and BLAKE3 are implemented in the lib (xxh3.c, blake3.c).
+ *  Returns: false if the digest type is not one of them.
+ */
+static bool internal_digest_new(DIGEST *digest)
+{
+   switch (digest->type) {
+   case CRYPTO_DIGEST_XXH128:
+      XXH3_128_init(&digest->xxh3);
+      return true;
+   case CRYPTO_DIGEST_BLAKE3:
+      /* Large files are hashed by several threads */
+      BLAKE3_init(&digest->blake3, true);
+      return true;
+   default:
+      return false;
+   }
+}
+
+static void internal_digest_update(DIGEST *digest, const uint8_t *data, uint32_t length)
+{
+   if (digest->type == CRYPTO_DIGEST_XXH128) {
+      XXH3_128_update(&digest->xxh3, data, length);
+   } else {
+      BLAKE3_update(&digest->blake3, data, length);
+   }
+}
+
+static void internal_digest_finalize(DIGEST *digest, uint8_t *dest, uint32_t *length)
+{
+   if (digest->type == CRYPTO_DIGEST_XXH128) {
+      assert(*length >= CRYPTO_DIGEST_XXH128_SIZE);
+      *length = CRYPTO_DIGEST_XXH128_SIZE;
+      XXH3_128_final(&digest->xxh3, dest);
+   } else {
+      assert(*length >= CRYPTO_DIGEST_BLAKE3_SIZE);
+      *length = CRYPTO_DIGEST_BLAKE3_SIZE;
+      BLAKE3_final(&digest->blake3, dest);
+   }
+}
+
+static void internal_digest_free(DIGEST *digest)
+{
+   if (digest->type == CRYPTO_DIGEST_BLAKE3) {
+      BLAKE3_free(&digest->blake3);
+   }
+}
+
 /*
  *  * Given a crypto_error_t value, return the associated
  *   * error string
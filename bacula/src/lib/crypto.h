@@ -64,7 +64,9 @@ typedef enum {
    CRYPTO_DIGEST_MD5 = 1,
    CRYPTO_DIGEST_SHA1 = 2,
    CRYPTO_DIGEST_SHA256 = 3,
-   CRYPTO_DIGEST_SHA512 = 4
+   CRYPTO_DIGEST_SHA512 = 4,
+   CRYPTO_DIGEST_XXH128 = 5,     /* Not cryptographic, see xxh3.c */
+   CRYPTO_DIGEST_BLAKE3 = 6
 } crypto_digest_t;
 
 
@@ -80,7 +82,9 @@ typedef enum {
    CRYPTO_CIPHER_AES_128_CBC,   /* Keep AES128 as the first one */
    CRYPTO_CIPHER_AES_192_CBC,
    CRYPTO_CIPHER_AES_256_CBC,
-   CRYPTO_CIPHER_BLOWFISH_CBC
+   CRYPTO_CIPHER_BLOWFISH_CBC,
+   CRYPTO_CIPHER_AES_128_GCM,   /* AEAD, see crypto_cipher_seal() */
+   CRYPTO_CIPHER_AES_256_GCM
 } crypto_cipher_t;
 
 /* Crypto API Errors */
@@ -100,6 +104,17 @@ typedef enum {
 #define CRYPTO_DIGEST_SHA1_SIZE 20    /* 160 bits */
 #define CRYPTO_DIGEST_SHA256_SIZE 32  /* 256 bits */
 #define CRYPTO_DIGEST_SHA512_SIZE 64  /* 512 bits */
+#define CRYPTO_DIGEST_XXH128_SIZE 16  /* 128 bits */
+#define CRYPTO_DIGEST_BLAKE3_SIZE 32  /* 256 bits */
+
+/*
+ * Records of the AEAD ciphers (AES-GCM). Each record is
+ *  <record number> <encrypted data> <authentication tag>
+ */
+#define CRYPTO_RECORD_HDR_SIZE 8      /* record number, in clear */
+#define CRYPTO_RECORD_NONCE_SIZE 12   /* session IV ^ record number */
+#define CRYPTO_RECORD_TAG_SIZE 16     /* 128 bits */
+#define CRYPTO_RECORD_OVERHEAD (CRYPTO_RECORD_HDR_SIZE + CRYPTO_RECORD_TAG_SIZE)
 
 /* Maximum Message Digest Size */
 #ifdef HAVE_OPENSSL
@@ -116,9 +131,11 @@ typedef enum {
  * to crypto_digest_finalize().
  *      MD5: 128 bits
  *      SHA-1: 160 bits
+ *      XXH128: 128 bits
+ *      BLAKE3: 256 bits
  */
 #ifndef HAVE_SHA2
-#define CRYPTO_DIGEST_MAX_SIZE CRYPTO_DIGEST_SHA1_SIZE
+#define CRYPTO_DIGEST_MAX_SIZE CRYPTO_DIGEST_BLAKE3_SIZE
 #else
 #define CRYPTO_DIGEST_MAX_SIZE CRYPTO_DIGEST_SHA512_SIZE
 #endif
@@ -51,6 +51,7 @@
 #include "address_conf.h"
 #include "bsockcore.h"
 #include "bsock.h"
+#include "comm_stream.h"
 #include "bsock_meeting.h"
 #include "workq.h"
 #ifndef HAVE_FNMATCH
@@ -67,6 +68,10 @@
 #include "var.h"
 #include "guid_to_name.h"
 #include "htable.h"
+#include "accbatch.h"
+#include "acclist.h"
+#include "accspool.h"
+#include "linktab.h"
 #include "sellist.h"
 #include "output.h"
 #include "protos.h"
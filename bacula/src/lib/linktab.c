@@ -0,0 +1,539 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+*/
+/*
+ * Table of the hard linked files, see linktab.h
+ */
+
+#include "bacula.h"
+
+/*
+ * Memory block, each allocation starts with a pointer to its block
+ *  so it can be released. A block is freed when nothing allocated in
+ *  it is still used.
+ */
+struct lt_block {
+   lt_block *next;
+   lt_block *prev;
+   uint32_t size;                     /* bytes for the data */
+   uint32_t used;                     /* bytes used */
+   uint32_t live;                     /* allocations not released */
+};
+
+#define LT_ALIGN(x)   (((x) + 7) & ~7)
+#define LT_HDR        LT_ALIGN(sizeof(lt_block))
+
+static inline uint64_t lt_hash(dev_t dev, ino_t ino)
+{
+   uint64_t h = (uint64_t)ino * 0x9E3779B97F4A7C15ULL ^ (uint64_t)dev;
+
+   h ^= h >> 33;
+   h *= 0xff51afd7ed558ccdULL;
+   h ^= h >> 33;
+   h *= 0xc4ceb9fe1a85ec53ULL;
+   h ^= h >> 33;
+   return h;
+}
+
+linktab::linktab()
+{
+   nb_slots = LINKTAB_MIN_SLOTS;
+   slots = (lt_slot *)bmalloc(nb_slots * sizeof(lt_slot));
+   memset(slots, 0, nb_slots * sizeof(lt_slot));
+   count = 0;
+   blocks = cur = NULL;
+   nb_added = 0;
+   mem = max_mem = nb_slots * sizeof(lt_slot);
+}
+
+void linktab::destroy()
+{
+   lt_block *b;
+
+   while (blocks) {
+      b = blocks;
+      blocks = b->next;
+      free(b);
+   }
+   cur = NULL;
+   if (slots) {
+      free(slots);
+      slots = NULL;
+   }
+   count = nb_slots = 0;
+   mem = 0;
+}
+
+char *linktab::alloc(uint32_t len)
+{
+   uint32_t need = LT_ALIGN(sizeof(lt_block *) + len);
+   uint32_t size = LINKTAB_BLOCK_SIZE;
+   lt_block *b = cur;
+   char *p;
+
+   /* A big allocation gets its own block, the current one is kept */
+   if (need > LINKTAB_BLOCK_SIZE / 4) {
+      b = NULL;
+      size = need;
+   }
+   if (!b || b->used + need > b->size) {
+      b = (lt_block *)bmalloc(LT_HDR + size);
+      b->size = size;
+      b->used = b->live = 0;
+      b->prev = NULL;
+      b->next = blocks;
+      if (blocks) {
+         blocks->prev = b;
+      }
+      blocks = b;
+      mem += LT_HDR + size;
+      if (mem > max_mem) {
+         max_mem = mem;
+      }
+      if (size == LINKTAB_BLOCK_SIZE) {
+         cur = b;                     /* the previous one is full */
+      }
+   }
+   p = (char *)b + LT_HDR + b->used;
+   *(lt_block **)p = b;
+   b->used += need;
+   b->live++;
+   return p + sizeof(lt_block *);
+}
+
+void linktab::release(void *ptr)
+{
+   lt_block *b = *((lt_block **)ptr - 1);
+
+   if (--b->live > 0) {
+      return;
+   }
+   if (b == cur) {
+      b->used = 0;                    /* reuse it */
+      return;
+   }
+   if (b->prev) {
+      b->prev->next = b->next;
+   } else {
+      blocks = b->next;
+   }
+   if (b->next) {
+      b->next->prev = b->prev;
+   }
+   mem -= LT_HDR + b->size;
+   free(b);
+}
+
+/* Change the size of the table, the entries are placed again with their hash */
+void linktab::resize(uint32_t nb)
+{
+   lt_slot *old = slots;
+   uint32_t old_nb = nb_slots;
+   uint32_t mask = nb - 1;
+   uint32_t i;
+
+   slots = (lt_slot *)bmalloc(nb * sizeof(lt_slot));
+   memset(slots, 0, nb * sizeof(lt_slot));
+   nb_slots = nb;
+   for (uint32_t j = 0; j < old_nb; j++) {
+      if (old[j].entry) {
+         for (i = old[j].hash & mask; slots[i].entry; i = (i + 1) & mask) { }
+         slots[i] = old[j];
+      }
+   }
+   free(old);
+   mem = mem - old_nb * sizeof(lt_slot) + nb * sizeof(lt_slot);
+   if (mem > max_mem) {
+      max_mem = mem;
+   }
+}
+
+link_entry *linktab::lookup(dev_t dev, ino_t ino)
+{
+   uint64_t h = lt_hash(dev, ino);
+   uint32_t mask = nb_slots - 1;
+
+   for (uint32_t i = h & mask; slots[i].entry; i = (i + 1) & mask) {
+      if (slots[i].hash == h && slots[i].entry->ino == ino &&
+          slots[i].entry->dev == dev) {
+         return slots[i].entry;
+      }
+   }
+   return NULL;
+}
+
+/* The first name found of an inode, the other ones will be links to it */
+link_entry *linktab::add(dev_t dev, ino_t ino, const char *fname)
+{
+   uint32_t len = strlen(fname) + 1;
+   link_entry *lp;
+   uint64_t h;
+   uint32_t i, mask;
+
+   if ((count + 1) * 4 > nb_slots * 3) {
+      resize(nb_slots * 2);
+   }
+   lp = (link_entry *)alloc(offsetof(link_entry, name) + len);
+   lp->dev = dev;
+   lp->ino = ino;
+   lp->FileIndex = 0;                 /* set later */
+   lp->digest_stream = 0;             /* set later */
+   lp->digest_len = 0;                /* set later */
+   lp->nb_seen = 1;
+   lp->digest = NULL;                 /* set later */
+   memcpy(lp->name, fname, len);
+
+   h = lt_hash(dev, ino);
+   mask = nb_slots - 1;
+   for (i = h & mask; slots[i].entry; i = (i + 1) & mask) { }
+   slots[i].hash = h;
+   slots[i].entry = lp;
+   count++;
+   nb_added++;
+   return lp;
+}
+
+void linktab::set_digest(link_entry *lp, int32_t digest_stream,
+                         const char *digest, uint32_t len)
+{
+   if (lp->digest) {
+      return;
+   }
+   lp->digest = alloc(len);
+   memcpy(lp->digest, digest, len);
+   lp->digest_len = len;
+   lp->digest_stream = digest_stream;
+}
+
+/*
+ * Count one more link of the inode, the link count of the last stat()
+ *  is used in case a link was added or removed during the job
+ */
+bool linktab::all_seen(link_entry *lp, nlink_t nlink)
+{
+   return ++lp->nb_seen >= nlink;
+}
+
+/* Backward shift deletion, the table never has deleted slots */
+void linktab::remove(link_entry *lp)
+{
+   uint32_t mask = nb_slots - 1;
+   uint32_t i, j, home;
+
+   for (i = lt_hash(lp->dev, lp->ino) & mask; slots[i].entry != lp; i = (i + 1) & mask) {
+      if (!slots[i].entry) {
+         return;                      /* not in the table */
+      }
+   }
+   for (j = (i + 1) & mask; slots[j].entry; j = (j + 1) & mask) {
+      home = slots[j].hash & mask;
+      /* The entry at j can fill the hole at i if i is between its home and j */
+      if (((j - home) & mask) >= ((j - i) & mask)) {
+         slots[i] = slots[j];
+         i = j;
+      }
+   }
+   slots[i].entry = NULL;
+   slots[i].hash = 0;
+   count--;
+
+   if (lp->digest) {
+      release(lp->digest);
+   }
+   release(lp);
+
+   /* Most of the links were found, give back the memory */
+   if (nb_slots > LINKTAB_MIN_SLOTS && count * 8 < nb_slots) {
+      resize(nb_slots / 2);
+   }
+}
+
+#ifndef TEST_PROGRAM
+#define TEST_PROGRAM_A
+#endif
+
+#ifdef TEST_PROGRAM
+#include "unittests.h"
+
+/*
+ * Two hard link heavy trees of NINODES inodes
+ *  - a build farm, the objects of each package are linked in its
+ *    build and install directories, the two links are close in the walk
+ *  - a mail spool, each message is delivered to NLINKS mailboxes of the
+ *    NBOX ones, the links are far from each other
+ */
+#define NINODES 1000000
+#define NFILES  50                    /* objects per package */
+#define NLINKS  3
+#define NBOX    50
+
+struct tree_walk {
+   bool spool;
+   int dir;                           /* package directory or mailbox */
+   int i;                             /* position in the directory */
+};
+
+/* Next file of the walk, false at the end */
+static bool tree_next(tree_walk *w, ino_t *ino, nlink_t *nlink, char *name, int len)
+{
+   int msg;
+
+   if (!w->spool) {
+      /* pkgN/obj/ then pkgN/dist/ */
+      if (w->i == 2 * NFILES) {
+         w->i = 0;
+         w->dir++;
+      }
+      if (w->dir * NFILES >= NINODES) {
+         return false;
+      }
+      *ino = 1000 + w->dir * NFILES + w->i % NFILES;
+      *nlink = 2;
+      bsnprintf(name, len, "/srv/build/pkg%d/%s/module%d.o", w->dir,
+                w->i < NFILES ? "obj" : "dist", w->i % NFILES);
+      w->i++;
+      return true;
+   }
+   /* The messages of a mailbox, message m is in the boxes m, m+17, m+34 */
+   for (;;) {
+      if (w->i == NINODES) {
+         w->i = 0;
+         w->dir++;
+      }
+      if (w->dir == NBOX) {
+         return false;
+      }
+      msg = w->i++;
+      if ((msg % NBOX) == w->dir || ((msg + 17) % NBOX) == w->dir ||
+          ((msg + 34) % NBOX) == w->dir) {
+         break;
+      }
+   }
+   *ino = 1000 + msg;
+   *nlink = NLINKS;
+   bsnprintf(name, len, "/var/spool/mail/user%d/cur/%d.M%dP%d.mailhost:2,S",
+             w->dir, 1600000000 + msg, msg * 7, msg % 30000);
+   return true;
+}
+
+/* The table used before, 65536 chains of malloc()ed entries */
+#define OLD_BITS 16
+#define OLD_SIZE (1 << OLD_BITS)
+
+struct old_link {
+   old_link *next;
+   dev_t dev;
+   ino_t ino;
+   int32_t FileIndex;
+   int32_t digest_stream;
+   uint32_t digest_len;
+   char *digest;
+   char name[1];
+};
+
+static inline int old_hash(dev_t dev, ino_t ino)
+{
+   int hash = dev;
+   unsigned long long i = ino;
+   hash ^= i;
+   i >>= 16;
+   hash ^= i;
+   i >>= 16;
+   hash ^= i;
+   i >>= 16;
+   hash ^= i;
+   return hash & (OLD_SIZE - 1);
+}
+
+/* Size of a block of the glibc malloc() */
+static uint64_t malloc_size(uint64_t len)
+{
+   len = (len + 8 + 15) & ~15;
+   return len < 32 ? 32 : len;
+}
+
+struct bench_res {
+   uint64_t found;                    /* links found */
+   uint64_t max_mem;
+   btime_t time;
+};
+
+/* Walk a tree with the table */
+static void bench_new(bool spool, bench_res *res)
+{
+   linktab *t = New(linktab());
+   tree_walk w = { spool, 0, 0 };
+   char name[200];
+   link_entry *lp;
+   ino_t ino;
+   nlink_t nlink;
+   btime_t t0 = get_current_btime();
+
+   res->found = 0;
+   while (tree_next(&w, &ino, &nlink, name, sizeof(name))) {
+      lp = t->lookup(0x801, ino);
+      if (lp) {
+         res->found++;
+         if (t->all_seen(lp, nlink)) {
+            t->remove(lp);
+         }
+         continue;
+      }
+      lp = t->add(0x801, ino, name);
+      t->set_digest(lp, 0, "0123456789abcdef", 16);
+   }
+   res->time = get_current_btime() - t0;
+   res->max_mem = t->max_mem_size();
+   delete t;
+}
+
+/* Same walk with the chained table, the entries are kept until the end */
+static void bench_old(bool spool, bench_res *res)
+{
+   old_link **hash = (old_link **)bmalloc(OLD_SIZE * sizeof(old_link *));
+   tree_walk w = { spool, 0, 0 };
+   old_link *lp, *next;
+   char name[200];
+   uint32_t len;
+   ino_t ino;
+   nlink_t nlink;
+   int h;
+   btime_t t0 = get_current_btime();
+
+   memset(hash, 0, OLD_SIZE * sizeof(old_link *));
+   res->found = 0;
+   res->max_mem = malloc_size(OLD_SIZE * sizeof(old_link *));
+   while (tree_next(&w, &ino, &nlink, name, sizeof(name))) {
+      h = old_hash(0x801, ino);
+      for (lp = hash[h]; lp; lp = lp->next) {
+         if (lp->ino == ino && lp->dev == 0x801) {
+            break;
+         }
+      }
+      if (lp) {
+         res->found++;
+         continue;
+      }
+      len = strlen(name) + 1;
+      lp = (old_link *)bmalloc(sizeof(old_link) + len);
+      lp->dev = 0x801;
+      lp->ino = ino;
+      bstrncpy(lp->name, name, len);
+      lp->digest = (char *)bmalloc(16);
+      memcpy(lp->digest, "0123456789abcdef", 16);
+      lp->next = hash[h];
+      hash[h] = lp;
+      res->max_mem += malloc_size(sizeof(old_link) + len) + malloc_size(16);
+   }
+   res->time = get_current_btime() - t0;
+   for (h = 0; h < OLD_SIZE; h++) {
+      for (lp = hash[h]; lp; lp = next) {
+         next = lp->next;
+         free(lp->digest);
+         free(lp);
+      }
+   }
+   free(hash);
+}
+
+int main()
+{
+   Unittests linktab_test("linktab_test");
+   linktab *t;
+   link_entry *lp, *lp2;
+   bench_res r_new, r_old, s_new, s_old;
+   char name[100];
+   bool check_cont;
+   int i;
+
+   Pmsg0(0, "Initialize tests ...\n");
+
+   t = New(linktab());
+   ok(t->lookup(1, 2) == NULL, "Lookup in an empty table");
+   lp = t->add(1, 2, "/tmp/a");
+   ok(lp && strcmp(lp->name, "/tmp/a") == 0 && t->size() == 1, "Add a file");
+   ok(t->lookup(1, 2) == lp, "Lookup a file");
+   ok(t->lookup(2, 2) == NULL && t->lookup(1, 3) == NULL, "Device and inode");
+   t->set_digest(lp, 3, "abcd", 4);
+   t->set_digest(lp, 4, "efgh", 4);
+   ok(lp->digest_len == 4 && memcmp(lp->digest, "abcd", 4) == 0 &&
+      lp->digest_stream == 3, "First digest kept");
+   ok(!t->all_seen(lp, 3), "Second link of three");
+   ok(t->all_seen(lp, 3), "Third link of three");
+   t->remove(lp);
+   ok(t->lookup(1, 2) == NULL && t->size() == 0, "Remove a file");
+
+   /* Grow the table and remove in a different order */
+   for (i = 0; i < 100000; i++) {
+      bsnprintf(name, sizeof(name), "/data/dir%d/file%d", i % 100, i);
+      t->add(i % 3, i, name);
+   }
+   ok(t->size() == 100000 && t->total() == 100001, "Add many files");
+   check_cont = true;
+   for (i = 0; i < 100000; i++) {
+      bsnprintf(name, sizeof(name), "/data/dir%d/file%d", i % 100, i);
+      lp = t->lookup(i % 3, i);
+      if (!lp || strcmp(lp->name, name) != 0) {
+         check_cont = false;
+      }
+   }
+   ok(check_cont, "Lookup after growing");
+   for (i = 0; i < 100000; i += 2) {
+      t->remove(t->lookup(i % 3, i));
+   }
+   check_cont = t->size() == 50000;
+   for (i = 0; i < 100000; i++) {
+      lp = t->lookup(i % 3, i);
+      if ((i % 2 == 0) != (lp == NULL)) {
+         check_cont = false;
+      }
+   }
+   ok(check_cont, "Remove half of the files");
+   for (i = 1; i < 100000; i += 2) {
+      t->remove(t->lookup(i % 3, i));
+   }
+   ok(t->size() == 0 &&
+      t->mem_size() <= LINKTAB_MIN_SLOTS * sizeof(lt_slot) + LINKTAB_BLOCK_SIZE + 64,
+      "Memory freed");
+   lp = t->add(5, 5, "/x");
+   lp2 = t->add(5, 6, "/y");
+   ok(t->lookup(5, 5) == lp && t->lookup(5, 6) == lp2, "Table usable after removal");
+   delete t;
+
+   /* Hard link heavy trees, the chained table against the new one */
+   bench_old(false, &r_old);
+   bench_new(false, &r_new);
+   bench_old(true, &s_old);
+   bench_new(true, &s_new);
+   Pmsg3(0, "Build farm, chained table: %lld links %lldKB max %lldms\n",
+         r_old.found, r_old.max_mem / 1024, r_old.time / 1000);
+   Pmsg3(0, "Build farm, linktab:       %lld links %lldKB max %lldms\n",
+         r_new.found, r_new.max_mem / 1024, r_new.time / 1000);
+   Pmsg3(0, "Mail spool, chained table: %lld links %lldKB max %lldms\n",
+         s_old.found, s_old.max_mem / 1024, s_old.time / 1000);
+   Pmsg3(0, "Mail spool, linktab:       %lld links %lldKB max %lldms\n",
+         s_new.found, s_new.max_mem / 1024, s_new.time / 1000);
+   ok(r_new.found == r_old.found && r_new.found == NINODES,
+      "Same links found in the build farm");
+   ok(s_new.found == s_old.found && s_new.found == (uint64_t)NINODES * (NLINKS - 1),
+      "Same links found in the mail spool");
+   ok(r_new.max_mem * 100 < r_old.max_mem, "Links found are freed");
+
+   return report();
+}
+#endif
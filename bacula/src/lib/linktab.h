@@ -0,0 +1,93 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+*/
+/*
+ * Table of the hard linked files found by the FileSet code
+ *
+ *  The first name found for an inode is saved with the data, the
+ *  other names are saved as links to it. The inodes are found by
+ *  device and inode number in an open addressing table of small
+ *  slots that doubles when it is 3/4 full and shrinks when it is
+ *  almost empty, so a lookup reads a few consecutive slots whatever
+ *  the number of files.
+ *
+ *  The entries, their names and their digests are allocated in big
+ *  blocks. When all the links of an inode were found, its entry is
+ *  removed, and a block is freed as soon as all its entries are
+ *  removed. Only the inodes with some links still to find use memory.
+ *
+ *  The table is not thread safe, it is used by the job thread.
+ */
+
+#ifndef _LINKTAB_H_
+#define _LINKTAB_H_
+
+#define LINKTAB_BLOCK_SIZE  (64 * 1024)  /* memory block size */
+#define LINKTAB_MIN_SLOTS   1024         /* initial table size */
+
+struct lt_block;
+
+/* An inode with more than one link */
+struct link_entry {
+   dev_t dev;                         /* device */
+   ino_t ino;                         /* inode with device is unique */
+   int32_t FileIndex;                 /* Bacula FileIndex of this file */
+   int32_t digest_stream;             /* Digest type if needed */
+   uint32_t digest_len;               /* Digest len if needed */
+   uint32_t nb_seen;                  /* links found */
+   char *digest;                      /* Checksum of the file if needed */
+   char name[1];                      /* The name */
+};
+
+/* A slot of the table, the hash avoids reading most of the entries */
+struct lt_slot {
+   uint64_t hash;
+   link_entry *entry;                 /* NULL if the slot is free */
+};
+
+class linktab : public SMARTALLOC {
+   lt_slot *slots;
+   uint32_t nb_slots;                 /* power of 2 */
+   uint32_t count;                    /* entries in the table */
+   lt_block *blocks;                  /* allocated blocks */
+   lt_block *cur;                     /* block used by alloc() */
+   uint64_t nb_added;                 /* entries added since the start */
+   uint64_t mem;                      /* bytes allocated */
+   uint64_t max_mem;
+
+   char *alloc(uint32_t len);
+   void release(void *ptr);
+   void resize(uint32_t nb);
+
+public:
+   linktab();
+   ~linktab() { destroy(); };
+   link_entry *lookup(dev_t dev, ino_t ino);
+   link_entry *add(dev_t dev, ino_t ino, const char *fname);
+   void set_digest(link_entry *lp, int32_t digest_stream, const char *digest,
+                   uint32_t len);
+   bool all_seen(link_entry *lp, nlink_t nlink); /* one more link was found */
+   void remove(link_entry *lp);
+   uint32_t size() { return count; };
+   uint64_t total() { return nb_added; };
+   uint64_t mem_size() { return mem; };
+   uint64_t max_mem_size() { return max_mem; };
+   void destroy();
+};
+
+#endif
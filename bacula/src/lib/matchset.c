@@ -0,0 +1,747 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+*/
+/*
+ * Sets of wild cards and of regexes, see matchset.h
+ */
+
+#include "bacula.h"
+#include "matchset.h"
+
+#define WS_MIN_SLOTS  64
+
+/* An exact name or a suffix of the hash table */
+struct ws_entry {
+   uint32_t hash;
+   uint32_t len;
+   bool suffix;
+   char *str;                         /* NULL if the slot is free */
+};
+
+/* A byte of the prefix trie */
+struct ws_node {
+   int32_t child;                     /* first child, 0 if none */
+   int32_t next;                      /* next sibling, 0 if none */
+   char c;
+   bool end;                          /* a prefix ends here */
+};
+
+/* Fold a character like fnmatch() does with FNM_CASEFOLD */
+static inline char ws_fold(char c)
+{
+   return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+static inline uint32_t ws_hash(const char *str, uint32_t len, bool suffix)
+{
+   uint32_t h = suffix ? 0x811c9dc5 : 0x050c5d1f;
+
+   for (uint32_t i = 0; i < len; i++) {
+      h ^= (uint8_t)str[i];
+      h *= 0x01000193;
+   }
+   return h;
+}
+
+wild_set::wild_set(int fnm_flags) :
+   contains(10, owned_by_alist), others(10, owned_by_alist)
+{
+   flags = fnm_flags;
+   nb_slots = WS_MIN_SLOTS;
+   table = (ws_entry *)bmalloc(nb_slots * sizeof(ws_entry));
+   memset(table, 0, nb_slots * sizeof(ws_entry));
+   nb_entries = 0;
+   suffix_len = NULL;
+   nb_suffix_len = 0;
+   max_nodes = 64;
+   trie = (ws_node *)bmalloc(max_nodes * sizeof(ws_node));
+   memset(trie, 0, sizeof(ws_node));
+   nb_nodes = 1;
+   count = 0;
+   folded = get_pool_memory(PM_FNAME);
+}
+
+wild_set::~wild_set()
+{
+   for (uint32_t i = 0; i < nb_slots; i++) {
+      if (table[i].str) {
+         free(table[i].str);
+      }
+   }
+   free(table);
+   if (suffix_len) {
+      free(suffix_len);
+   }
+   free(trie);
+   free_pool_memory(folded);
+}
+
+void wild_set::insert(const char *str, uint32_t len, bool suffix)
+{
+   uint32_t h, i, j;
+
+   if (lookup(str, len, suffix)) {
+      return;                         /* same pattern twice */
+   }
+   if ((nb_entries + 1) * 2 > nb_slots) {
+      ws_entry *old = table;
+      uint32_t old_nb = nb_slots;
+      nb_slots *= 2;
+      table = (ws_entry *)bmalloc(nb_slots * sizeof(ws_entry));
+      memset(table, 0, nb_slots * sizeof(ws_entry));
+      for (i = 0; i < old_nb; i++) {
+         if (old[i].str) {
+            for (j = old[i].hash & (nb_slots - 1); table[j].str; j = (j + 1) & (nb_slots - 1)) { }
+            table[j] = old[i];
+         }
+      }
+      free(old);
+   }
+   h = ws_hash(str, len, suffix);
+   for (i = h & (nb_slots - 1); table[i].str; i = (i + 1) & (nb_slots - 1)) { }
+   table[i].hash = h;
+   table[i].len = len;
+   table[i].suffix = suffix;
+   table[i].str = (char *)bmalloc(len + 1);
+   memcpy(table[i].str, str, len);
+   table[i].str[len] = 0;
+   nb_entries++;
+
+   if (!suffix) {
+      return;
+   }
+   /* Keep the lengths sorted, match() stops at the first one too long */
+   for (i = 0; i < nb_suffix_len && suffix_len[i] < len; i++) { }
+   if (i < nb_suffix_len && suffix_len[i] == len) {
+      return;
+   }
+   suffix_len = (uint32_t *)brealloc(suffix_len, (nb_suffix_len + 1) * sizeof(uint32_t));
+   memmove(suffix_len + i + 1, suffix_len + i, (nb_suffix_len - i) * sizeof(uint32_t));
+   suffix_len[i] = len;
+   nb_suffix_len++;
+}
+
+bool wild_set::lookup(const char *str, uint32_t len, bool suffix)
+{
+   uint32_t h = ws_hash(str, len, suffix);
+
+   for (uint32_t i = h & (nb_slots - 1); table[i].str; i = (i + 1) & (nb_slots - 1)) {
+      if (table[i].hash == h && table[i].len == len && table[i].suffix == suffix &&
+          memcmp(table[i].str, str, len) == 0) {
+         return true;
+      }
+   }
+   return false;
+}
+
+void wild_set::add_prefix(const char *str, uint32_t len)
+{
+   int32_t n = 0, c;
+
+   for (uint32_t i = 0; i < len; i++) {
+      for (c = trie[n].child; c && trie[c].c != str[i]; c = trie[c].next) { }
+      if (!c) {
+         if (nb_nodes == max_nodes) {
+            max_nodes *= 2;
+            trie = (ws_node *)brealloc(trie, max_nodes * sizeof(ws_node));
+         }
+         c = nb_nodes++;
+         trie[c].c = str[i];
+         trie[c].end = false;
+         trie[c].child = 0;
+         trie[c].next = trie[n].child;
+         trie[n].child = c;
+      }
+      n = c;
+   }
+   trie[n].end = true;
+}
+
+bool wild_set::match_prefix(const char *str)
+{
+   int32_t n = 0;
+
+   for (;;) {
+      if (trie[n].end) {
+         return true;
+      }
+      if (!*str) {
+         return false;
+      }
+      for (n = trie[n].child; n && trie[n].c != *str; n = trie[n].next) { }
+      if (!n) {
+         return false;
+      }
+      str++;
+   }
+}
+
+/*
+ * Sort a pattern by its kind, only *, ? [ and \ are special
+ *  when FNM_PATHNAME and the other flags are not used
+ */
+void wild_set::add(const char *pattern)
+{
+   const char *p = pattern, *lit, *end;
+   bool lead = false, trail = false;
+   uint32_t len;
+
+   count++;
+   if (flags & ~FNM_CASEFOLD) {
+      others.append(bstrdup(pattern));
+      return;
+   }
+   for ( ; *p == '*'; p++) {
+      lead = true;
+   }
+   for (lit = p; *p && *p != '*' && *p != '?' && *p != '[' && *p != '\\'; p++) { }
+   end = p;
+   for ( ; *p == '*'; p++) {
+      trail = true;
+   }
+   if (*p) {
+      others.append(bstrdup(pattern));
+      return;
+   }
+   len = end - lit;
+   folded = check_pool_memory_size(folded, len + 1);
+   for (uint32_t i = 0; i < len; i++) {
+      folded[i] = (flags & FNM_CASEFOLD) ? ws_fold(lit[i]) : lit[i];
+   }
+   folded[len] = 0;
+
+   if (len == 0) {
+      add_prefix(folded, 0);          /* only stars, all strings match */
+   } else if (!lead && !trail) {
+      insert(folded, len, false);
+   } else if (lead && !trail) {
+      insert(folded, len, true);
+   } else if (!lead) {
+      add_prefix(folded, len);
+   } else {
+      contains.append(bstrdup(folded));
+   }
+}
+
+bool wild_set::match(const char *str)
+{
+   const char *s = str;
+   char *word;
+   uint32_t len, i;
+
+   if (count == 0) {
+      return false;
+   }
+   len = strlen(str);
+   if (flags & FNM_CASEFOLD) {
+      folded = check_pool_memory_size(folded, len + 1);
+      for (i = 0; i <= len; i++) {
+         folded[i] = ws_fold(str[i]);
+      }
+      s = folded;
+   }
+   if (nb_entries > 0) {
+      if (lookup(s, len, false)) {
+         return true;
+      }
+      for (i = 0; i < nb_suffix_len && suffix_len[i] <= len; i++) {
+         if (lookup(s + len - suffix_len[i], suffix_len[i], true)) {
+            return true;
+         }
+      }
+   }
+   if (nb_nodes > 1 || trie[0].end) {
+      if (match_prefix(s)) {
+         return true;
+      }
+   }
+   foreach_alist(word, &contains) {
+      if (strstr(s, word)) {
+         return true;
+      }
+   }
+   foreach_alist(word, &others) {
+      if (fnmatch(word, str, flags) == 0) {
+         return true;
+      }
+   }
+   return false;
+}
+
+/* Regexes compiled with the same flags */
+struct rs_group : public SMARTALLOC {
+   int cflags;
+   alist members;                     /* regex_t, not owned */
+   POOLMEM *src;                      /* (r1)|(r2)|... */
+   regex_t re;
+   bool ok;                           /* re is compiled */
+
+   rs_group(int flags) : members(10, not_owned_by_alist) {
+      cflags = flags;
+      src = get_pool_memory(PM_MESSAGE);
+      *src = 0;
+      ok = false;
+   };
+   ~rs_group() {
+      if (ok) {
+         regfree(&re);
+      }
+      free_pool_memory(src);
+   };
+};
+
+/*
+ * A regex is combined if wrapping it in parentheses keeps its meaning,
+ *  so it must not have a back reference (the group numbers change) nor
+ *  a ) that would close our parenthesis.
+ */
+static bool rs_can_combine(const char *p)
+{
+   int depth = 0;
+
+   for ( ; *p; p++) {
+      switch (*p) {
+      case '\\':
+         if (p[1] >= '1' && p[1] <= '9') {
+            return false;             /* back reference */
+         }
+         if (p[1]) {
+            p++;
+         }
+         break;
+      case '[':
+         /* A ] first in the bracket expression is a character */
+         p++;
+         if (*p == '^') {
+            p++;
+         }
+         if (*p == ']') {
+            p++;
+         }
+         while (*p && *p != ']') {
+            if (*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '=')) {
+               const char *e = strchr(p + 2, p[1]);
+               for ( ; e && e[1] != ']'; e = strchr(e + 1, p[1])) { }
+               if (!e) {
+                  return false;
+               }
+               p = e + 2;
+            } else {
+               p++;
+            }
+         }
+         if (!*p) {
+            return false;
+         }
+         break;
+      case '(':
+         depth++;
+         break;
+      case ')':
+         if (depth == 0) {
+            return false;
+         }
+         depth--;
+         break;
+      }
+   }
+   return depth == 0;
+}
+
+regex_set::regex_set() :
+   groups(5, not_owned_by_alist), alone(10, not_owned_by_alist)
+{
+   count = 0;
+   compiled = true;
+}
+
+regex_set::~regex_set()
+{
+   rs_group *g;
+
+   foreach_alist(g, &groups) {
+      delete g;
+   }
+}
+
+/*
+ * The regex_t compiled by the caller is used if it cannot be combined,
+ *  it must be kept until the set is deleted
+ */
+void regex_set::add(const char *pattern, int cflags, regex_t *preg)
+{
+   rs_group *g;
+
+   count++;
+   if (!rs_can_combine(pattern)) {
+      alone.append(preg);
+      return;
+   }
+   foreach_alist(g, &groups) {
+      if (g->cflags == cflags) {
+         break;
+      }
+   }
+   if (!g) {
+      g = New(rs_group(cflags));
+      groups.append(g);
+   }
+   if (g->members.size() > 0) {
+      pm_strcat(g->src, "|");
+   }
+   pm_strcat(g->src, "(");
+   pm_strcat(g->src, pattern);
+   pm_strcat(g->src, ")");
+   g->members.append(preg);
+   if (g->ok) {
+      regfree(&g->re);
+      g->ok = false;
+   }
+   compiled = false;
+}
+
+/*
+ * Compile the groups of more than one regex. If the regex library
+ *  does not accept a combined regex, its members are used one by one.
+ */
+void regex_set::compile()
+{
+   rs_group *g;
+
+   foreach_alist(g, &groups) {
+      if (!g->ok && g->members.size() > 1) {
+         g->ok = regcomp(&g->re, g->src, g->cflags | REG_NOSUB) == 0;
+         if (!g->ok) {
+            regfree(&g->re);
+         }
+      }
+   }
+   compiled = true;
+}
+
+bool regex_set::match(const char *str)
+{
+   rs_group *g;
+   regex_t *preg;
+
+   if (!compiled) {
+      compile();
+   }
+   foreach_alist(g, &groups) {
+      if (g->ok) {
+         if (regexec(&g->re, str, 0, NULL, 0) == 0) {
+            return true;
+         }
+         continue;
+      }
+      foreach_alist(preg, &g->members) {
+         if (regexec(preg, str, 0, NULL, 0) == 0) {
+            return true;
+         }
+      }
+   }
+   foreach_alist(preg, &alone) {
+      if (regexec(preg, str, 0, NULL, 0) == 0) {
+         return true;
+      }
+   }
+   return false;
+}
+
+uint32_t regex_set::nb_regexec()
+{
+   rs_group *g;
+   uint32_t nb = alone.size();
+
+   if (!compiled) {
+      compile();
+   }
+   foreach_alist(g, &groups) {
+      nb += g->ok ? 1 : g->members.size();
+   }
+   return nb;
+}
+
+#ifndef TEST_PROGRAM
+#define TEST_PROGRAM_A
+#endif
+
+#ifdef TEST_PROGRAM
+#include "unittests.h"
+
+
+/* Pieces of the random wild cards and names */
+static const char *pieces[] = {
+   "/", "/home", "/usr/lib", "tmp", "Cache", "cache", ".o", ".O", ".tmp",
+   "a", "B", "x.y", "~", ".git", "/proc", "\xc3\xa9t\xc3\xa9", ".mp3", "core"
+};
+#define NPIECES (int)(sizeof(pieces) / sizeof(pieces[0]))
+
+static const char *specials[] = {
+   "*", "**", "?", "[a-c]", "[!a]", "\\*", "\\", "[", "*/", "[[:alpha:]]"
+};
+#define NSPECIALS (int)(sizeof(specials) / sizeof(specials[0]))
+
+static void random_string(POOLMEM **buf, int nb, bool wild)
+{
+   for (int i = 0; i < nb; i++) {
+      if (wild && (rand() % 3) == 0) {
+         pm_strcat(buf, specials[rand() % NSPECIALS]);
+      } else {
+         pm_strcat(buf, pieces[rand() % NPIECES]);
+      }
+   }
+}
+
+/* The set and a loop on fnmatch() must always agree */
+static int check_wild(int fnm_flags, int npatterns, int nnames)
+{
+   wild_set *ws = New(wild_set(fnm_flags));
+   alist patterns(npatterns, owned_by_alist);
+   POOLMEM *buf = get_pool_memory(PM_FNAME);
+   char *p;
+   int errors = 0;
+   bool expected;
+
+   for (int i = 0; i < npatterns; i++) {
+      pm_strcpy(buf, "");
+      switch (rand() % 5) {
+      case 0:                         /* name */
+         random_string(&buf, 1 + rand() % 3, false);
+         break;
+      case 1:                         /* *suffix */
+         pm_strcpy(buf, "*");
+         random_string(&buf, 1 + rand() % 2, false);
+         break;
+      case 2:                         /* prefix* */
+         random_string(&buf, 1 + rand() % 3, false);
+         pm_strcat(buf, "*");
+         break;
+      case 3:                         /* *word* */
+         pm_strcpy(buf, "*");
+         random_string(&buf, 1, false);
+         pm_strcat(buf, "*");
+         break;
+      default:
+         random_string(&buf, 1 + rand() % 4, true);
+         break;
+      }
+      patterns.append(bstrdup(buf));
+      ws->add(buf);
+   }
+   for (int i = 0; i < nnames; i++) {
+      pm_strcpy(buf, "");
+      random_string(&buf, rand() % 6, false);
+      expected = false;
+      foreach_alist(p, &patterns) {
+         if (fnmatch(p, buf, fnm_flags) == 0) {
+            expected = true;
+            break;
+         }
+      }
+      if (ws->match(buf) != expected) {
+         if (errors++ < 5) {
+            Pmsg3(0, "Wrong match of \"%s\" flags=%d expected=%d\n", buf, fnm_flags,
+                  expected);
+         }
+      }
+   }
+   free_pool_memory(buf);
+   delete ws;
+   return errors;
+}
+
+static const char *regexes[] = {
+   "\\.o$", "^/tmp/", "cache", "(a|b)x", "\\.(mp3|ogg)$", "^/proc(/|$)",
+   "[)(]", "[]a]+z", "[^/]*\\.bak$", "[[:digit:]]{3}$", "(.)\\1", "a)b",
+   "^$", "x|y/", "\\(", "/\\.git/", "home/[[:alpha:]]+/\\.cache", "B$"
+};
+#define NREGEXES (int)(sizeof(regexes) / sizeof(regexes[0]))
+
+/* Same with the regexes, each one compiled with or without REG_ICASE */
+static int check_regex(int nnames)
+{
+   regex_set *rs = New(regex_set());
+   regex_t preg[NREGEXES];
+   bool used[NREGEXES];
+   int cflags, errors = 0, i, j;
+   POOLMEM *buf = get_pool_memory(PM_FNAME);
+   regmatch_t pmatch[30];
+   bool expected;
+
+   for (i = 0; i < NREGEXES; i++) {
+      cflags = REG_EXTENDED | ((i % 3) == 0 ? REG_ICASE : 0);
+      used[i] = regcomp(&preg[i], regexes[i], cflags) == 0;
+      if (used[i]) {
+         rs->add(regexes[i], cflags, &preg[i]);
+      } else {
+         regfree(&preg[i]);
+      }
+   }
+   ok(rs->nb_regexec() < rs->size(), "Regexes are combined");
+   for (i = 0; i < nnames; i++) {
+      pm_strcpy(buf, "");
+      random_string(&buf, rand() % 6, false);
+      if (rand() % 4 == 0) {
+         pm_strcat(buf, (rand() % 2) ? "/.git/x" : "/a)b.bak");
+      }
+      expected = false;
+      for (j = 0; j < NREGEXES; j++) {
+         if (used[j] && regexec(&preg[j], buf, 30, pmatch, 0) == 0) {
+            expected = true;
+            break;
+         }
+      }
+      if (rs->match(buf) != expected) {
+         if (errors++ < 5) {
+            Pmsg2(0, "Wrong regex match of \"%s\" expected=%d\n", buf, expected);
+         }
+      }
+   }
+   delete rs;
+   for (i = 0; i < NREGEXES; i++) {
+      if (used[i]) {
+         regfree(&preg[i]);
+      }
+   }
+   free_pool_memory(buf);
+   return errors;
+}
+
+/*
+ * An exclude list like the ones of our FileSets, 100 extensions,
+ *  100 directories and 100 names, against the names of a tree
+ */
+#define BENCH_NAMES 100000
+
+static void bench(const char *label, alist *patterns, int fnm_flags)
+{
+   wild_set *ws = New(wild_set(fnm_flags));
+   char name[200], *p;
+   int found_old = 0, found_new = 0;
+   btime_t t0, t_old, t_new;
+
+   foreach_alist(p, patterns) {
+      ws->add(p);
+   }
+   t0 = get_current_btime();
+   for (int i = 0; i < BENCH_NAMES; i++) {
+      bsnprintf(name, sizeof(name), "/home/user%d/projects/src/module%d/file%d.c",
+                i % 50, i % 300, i);
+      foreach_alist(p, patterns) {
+         if (fnmatch(p, name, fnm_flags) == 0) {
+            found_old++;
+            break;
+         }
+      }
+   }
+   t_old = get_current_btime() - t0;
+   t0 = get_current_btime();
+   for (int i = 0; i < BENCH_NAMES; i++) {
+      bsnprintf(name, sizeof(name), "/home/user%d/projects/src/module%d/file%d.c",
+                i % 50, i % 300, i);
+      if (ws->match(name)) {
+         found_new++;
+      }
+   }
+   t_new = get_current_btime() - t0;
+   Pmsg5(0, "%s: %d names, fnmatch() loop %lldms, wild_set %lldms (%d fnmatch)\n",
+         label, BENCH_NAMES, t_old / 1000, t_new / 1000, ws->nb_fnmatch());
+   is(found_new, found_old, "Same files matched by the benchmark");
+   delete ws;
+}
+
+int main()
+{
+   Unittests matchset_test("matchset_test");
+   wild_set *ws;
+   regex_set *rs;
+   regex_t re[3];
+   alist patterns(300, owned_by_alist);
+   char buf[100];
+
+   srand(1234);
+
+   ws = New(wild_set(0));
+   nok(ws->match("/tmp/a.o"), "Empty set");
+   ws->add("*.o");
+   ws->add("/tmp/*");
+   ws->add("/etc/passwd");
+   ws->add("*cache*");
+   ws->add("/home/*/.Trash");
+   is(ws->size(), 5, "Five patterns");
+   is(ws->nb_fnmatch(), 1, "Only one pattern needs fnmatch()");
+   ok(ws->match("/usr/lib/x.o"), "Suffix");
+   ok(ws->match("/tmp/y"), "Prefix");
+   ok(ws->match("/etc/passwd"), "Name");
+   ok(ws->match("/var/cache/apt"), "Word");
+   ok(ws->match("/home/kern/.Trash"), "fnmatch()");
+   nok(ws->match("/etc/passwd-"), "Name must be complete");
+   nok(ws->match("/usr/lib/x.O"), "Case is kept");
+   nok(ws->match("/var/tm/y"), "Not a prefix");
+   delete ws;
+
+   ws = New(wild_set(FNM_CASEFOLD));
+   ws->add("*.JPG");
+   ws->add("/Users/*");
+   ok(ws->match("/home/a.jpg"), "Suffix without case");
+   ok(ws->match("/users/kern"), "Prefix without case");
+   delete ws;
+
+   ws = New(wild_set(0));
+   ws->add("**");
+   ok(ws->match(""), "A star matches all");
+   delete ws;
+
+   is(check_wild(0, 50, 20000), 0, "Random wild cards");
+   is(check_wild(FNM_CASEFOLD, 50, 20000), 0, "Random wild cards without case");
+   is(check_wild(FNM_PATHNAME, 50, 5000), 0, "Random wild cards with FNM_PATHNAME");
+   is(check_wild(0, 3, 20000), 0, "Small random sets");
+   is(check_regex(20000), 0, "Random names with the regexes");
+
+   rs = New(regex_set());
+   nok(rs->match("/tmp"), "Empty regex set");
+   regcomp(&re[0], "\\.o$", REG_EXTENDED);
+   regcomp(&re[1], "^/tmp/", REG_EXTENDED);
+   regcomp(&re[2], "core$", REG_EXTENDED);
+   rs->add("\\.o$", REG_EXTENDED, &re[0]);
+   rs->add("^/tmp/", REG_EXTENDED, &re[1]);
+   ok(rs->match("/tmp/x"), "Combined regex");
+   is(rs->nb_regexec(), 1, "One regexec() for two regexes");
+   nok(rs->match("/var/core"), "Not yet in the set");
+   rs->add("core$", REG_EXTENDED, &re[2]);
+   ok(rs->match("/var/core"), "Regex added after a match");
+   is(rs->nb_regexec(), 1, "Still one regexec()");
+   delete rs;
+   for (int i = 0; i < 3; i++) {
+      regfree(&re[i]);
+   }
+
+   for (int i = 0; i < 100; i++) {
+      bsnprintf(buf, sizeof(buf), "*.ext%d", i);
+      patterns.append(bstrdup(buf));
+      bsnprintf(buf, sizeof(buf), "/home/user%d/projects/src/module%d/*", i, i + 200);
+      patterns.append(bstrdup(buf));
+      bsnprintf(buf, sizeof(buf), "/var/lib/app%d/data", i);
+      patterns.append(bstrdup(buf));
+   }
+   bench("Exclude list", &patterns, 0);
+   bench("Exclude list without case", &patterns, FNM_CASEFOLD);
+   return report();
+}
+#endif /* TEST_PROGRAM */
@@ -0,0 +1,103 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+*/
+/*
+ * Sets of wild cards and of regexes matched in one call
+ *
+ *  match() tells if any pattern of the set matches a string, with
+ *  the same result as calling fnmatch() or regexec() for each one.
+ *
+ *  In a wild card set, the simple patterns are sorted when added:
+ *     name      in a hash table of the exact names
+ *     *.ext     in the same table with the length of the suffix
+ *     prefix*   in a trie of the prefixes
+ *     *word*    in a list searched with strstr()
+ *  and the other ones are given to fnmatch(). With FNM_CASEFOLD the
+ *  patterns and the string are folded like fnmatch() does, only the
+ *  ASCII letters.
+ *
+ *  In a regex set, the regexes compiled with the same flags are
+ *  combined in a single (r1)|(r2)|... regex without sub-matches, the
+ *  regex library reads the string once for all of them. The regexes
+ *  with back references or unbalanced parentheses are kept alone.
+ *  A regex can be added after a match(), its group is compiled again.
+ *
+ *  The sets are not thread safe, a set is used by one thread.
+ */
+
+#ifndef _MATCHSET_H_
+#define _MATCHSET_H_
+
+#ifndef HAVE_REGEX_H
+#include "bregex.h"
+#else
+#include <regex.h>
+#endif
+
+struct ws_entry;
+struct ws_node;
+
+class wild_set : public SMARTALLOC {
+   int flags;                         /* fnmatch() flags */
+   ws_entry *table;                   /* exact names and suffixes */
+   uint32_t nb_slots;                 /* power of 2 */
+   uint32_t nb_entries;
+   uint32_t *suffix_len;              /* distinct lengths of the suffixes */
+   uint32_t nb_suffix_len;
+   ws_node *trie;                     /* prefixes, the root is trie[0] */
+   uint32_t nb_nodes;
+   uint32_t max_nodes;
+   alist contains;                    /* *word* */
+   alist others;                      /* given to fnmatch() */
+   uint32_t count;                    /* patterns added */
+   POOLMEM *folded;                   /* string folded by match() */
+
+   void insert(const char *str, uint32_t len, bool suffix);
+   bool lookup(const char *str, uint32_t len, bool suffix);
+   void add_prefix(const char *str, uint32_t len);
+   bool match_prefix(const char *str);
+
+public:
+   wild_set(int fnm_flags);
+   ~wild_set();
+   void add(const char *pattern);
+   bool match(const char *str);
+   uint32_t size() { return count; };
+   int get_flags() { return flags; };
+   uint32_t nb_fnmatch() { return others.size(); };
+};
+
+struct rs_group;
+
+class regex_set : public SMARTALLOC {
+   alist groups;                      /* regexes to combine by flags */
+   alist alone;                       /* regex_t not combined, not owned */
+   uint32_t count;                    /* regexes added */
+   bool compiled;                     /* no regex added since compile() */
+
+public:
+   regex_set();
+   ~regex_set();
+   void add(const char *pattern, int cflags, regex_t *preg);
+   void compile();                    /* else done by the next match() */
+   bool match(const char *str);
+   uint32_t size() { return count; };
+   uint32_t nb_regexec();             /* regexec() calls of match() */
+};
+
+#endif
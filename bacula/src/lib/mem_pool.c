@@ -358,6 +358,46 @@ void free_pool_memory(POOLMEM *obuf)
 }
 #endif /* SMARTALLOC */
 
+/*
+ * Aligned memory, e.g. for O_DIRECT I/O. The buffer is not a POOLMEM,
+ *  it is taken from a nonpool buffer of size+align bytes that is
+ *  remembered just before the aligned address. align must be a power
+ *  of 2. Release it with free_aligned_memory().
+ */
+static char *align_memory(POOLMEM *mem, int32_t align)
+{
+   uintptr_t p = (uintptr_t)mem + sizeof(POOLMEM *);
+   p = (p + align - 1) & ~((uintptr_t)align - 1);
+   ((POOLMEM **)p)[-1] = mem;
+   return (char *)p;
+}
+
+#ifdef SMARTALLOC
+char *sm_get_aligned_memory(const char *fname, int lineno, int32_t size, int32_t align)
+{
+   ASSERT(align > 0 && (align & (align - 1)) == 0);
+   return align_memory(sm_get_memory(fname, lineno, size + align + sizeof(POOLMEM *)), align);
+}
+
+void sm_free_aligned_memory(const char *fname, int lineno, char *buf)
+{
+   ASSERT(buf);
+   sm_free_pool_memory(fname, lineno, ((POOLMEM **)buf)[-1]);
+}
+#else
+char *get_aligned_memory(int32_t size, int32_t align)
+{
+   ASSERT(align > 0 && (align & (align - 1)) == 0);
+   return align_memory(get_memory(size + align + sizeof(POOLMEM *)), align);
+}
+
+void free_aligned_memory(char *buf)
+{
+   ASSERT(buf);
+   free_pool_memory(((POOLMEM **)buf)[-1]);
+}
+#endif
+
 /*
  * Clean up memory pool periodically
  *
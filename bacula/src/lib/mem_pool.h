@@ -48,6 +48,12 @@ extern POOLMEM  *sm_check_pool_memory_size(const char *fname, int line, POOLMEM
 #define free_memory(x) sm_free_pool_memory(__FILE__, __LINE__, x)
 extern void sm_free_pool_memory(const char *fname, int line, POOLMEM *buf);
 
+#define get_aligned_memory(size, align) sm_get_aligned_memory(__FILE__, __LINE__, size, align)
+extern char *sm_get_aligned_memory(const char *fname, int line, int32_t size, int32_t align);
+
+#define free_aligned_memory(x) sm_free_aligned_memory(__FILE__, __LINE__, x)
+extern void sm_free_aligned_memory(const char *fname, int line, char *buf);
+
 #else
 
 extern POOLMEM *get_pool_memory(int pool);
@@ -57,6 +63,8 @@ extern POOLMEM  *realloc_pool_memory(POOLMEM *buf, int32_t size);
 extern POOLMEM  *check_pool_memory_size(POOLMEM *buf, int32_t size);
 #define free_memory(x) free_pool_memory(x)
 extern void   free_pool_memory(POOLMEM *buf);
+extern char *get_aligned_memory(int32_t size, int32_t align);
+extern void   free_aligned_memory(char *buf);
 
 #endif
 
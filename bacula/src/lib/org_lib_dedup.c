@@ -17,20 +17,290 @@
    Bacula(R) is a registered trademark of Kern Sibbald.
 */
 
+/*
+ * Deduplication routines shared by the FD and the SD: the hash of
+ *  the chunks, the references written in the volumes in place of
+ *  the chunks, and the content defined chunking of the FD.
+ */
+
 #include "bacula.h"
+#include "blake3.h"
 
 int bhash_info(int hash_id, const char **hash_name)
 {
-   *hash_name = "N/A";
-   return 0;
+   const char *name = "N/A";
+   int size = 0;
+
+   if (hash_id == DEDUP_DEFAULT_HASH_ID) {
+      name = "BLAKE3";
+      size = DEDUP_HASH_SIZE;
+   }
+   if (hash_name) {
+      *hash_name = name;
+   }
+   return size;
+}
+
+/* Compute the hash of a chunk, hash must hold DEDUP_HASH_SIZE bytes */
+void dedup_hash(const char *buf, uint32_t len, unsigned char *hash)
+{
+   BLAKE3_CTX ctx;
+
+   BLAKE3_init(&ctx, false);
+   BLAKE3_update(&ctx, (const uint8_t *)buf, len);
+   BLAKE3_final(&ctx, hash);
+   BLAKE3_free(&ctx);
+}
+
+/*
+ * A reference is what is written in the volume in place of a chunk:
+ *
+ *   <size:uint32><addr:uint64><hash>
+ *
+ *  The address is not used by the community engine, the chunks are
+ *  found with their hash, it is always 0.
+ */
+int dedup_encode_ref(char *ref, uint32_t size, const unsigned char *hash)
+{
+   ser_declare;
+
+   ser_begin(ref, DEDUP_REF_SIZE);
+   ser_uint32(size);
+   ser_uint64((blockaddr)0);
+   ser_bytes(hash, DEDUP_HASH_SIZE);
+   ser_end(ref, DEDUP_REF_SIZE);
+   return DEDUP_REF_SIZE;
+}
+
+bool dedup_decode_ref(const char *ref, int32_t len, uint32_t *size,
+                      unsigned char *hash)
+{
+   unser_declare;
+
+   if (len != DEDUP_REF_SIZE) {
+      return false;
+   }
+   unser_begin(ref, DEDUP_REF_SIZE);
+   unser_uint32(*size);
+   ser_ptr += sizeof(blockaddr);      /* the address is not used */
+   unser_bytes(hash, DEDUP_HASH_SIZE);
+   unser_end(ref, DEDUP_REF_SIZE);
+   return *size > 0 && *size <= DEDUP_MAX_BLOCK_SIZE;
 }
 
+/* Only the plain data is deduplicated, compressed or encrypted data
+ *  would never match */
 bool is_deduplicable_stream(int stream)
 {
+   switch (stream & STREAMMASK_TYPE) {
+   case STREAM_FILE_DATA:
+   case STREAM_WIN32_DATA:
+   case STREAM_SPARSE_DATA:
+      return true;
+   }
    return false;
 }
 
+/* The SD always does the rehydration */
 bool is_client_rehydration_friendly_stream(int stream)
 {
    return false;
 }
+
+/*
+ * The gear table maps each byte to a random 64 bit value. It must
+ *  never change, the chunks of the next backups must be cut at the
+ *  same places, so it is built with a fixed seed.
+ */
+static uint64_t gear[256];
+static bool gear_ready = false;
+static pthread_mutex_t gear_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void init_gear()
+{
+   uint64_t seed = 0x426163756c614344ULL;   /* "BaculaCD" */
+
+   P(gear_mutex);
+   if (!gear_ready) {
+      for (int i = 0; i < 256; i++) {
+         /* splitmix64 */
+         uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+         z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+         z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+         gear[i] = z ^ (z >> 31);
+      }
+      gear_ready = true;
+   }
+   V(gear_mutex);
+}
+
+/* The top bits of the gear hash depend on the last 64 bytes */
+static uint64_t top_mask(int bits)
+{
+   return ~(uint64_t)0 << (64 - bits);
+}
+
+cdc_chunker::cdc_chunker(uint32_t min, uint32_t avg, uint32_t max)
+{
+   int bits = 0;
+
+   init_gear();
+   m_min = min;
+   m_avg = MAX(avg, min);
+   m_max = MAX(max, m_avg);
+   while (((uint32_t)1 << (bits + 1)) <= m_avg) {
+      bits++;
+   }
+   /* Normalized chunking, two bits more then two bits less */
+   m_mask_s = top_mask(bits + 2);
+   m_mask_l = top_mask(MAX(bits - 2, 1));
+}
+
+uint32_t cdc_chunker::cut(const uint8_t *buf, uint32_t len) const
+{
+   uint64_t fp = 0;
+   uint32_t i, normal;
+
+   if (len <= m_min) {
+      return len;
+   }
+   if (len > m_max) {
+      len = m_max;
+   }
+   normal = MIN(m_avg, len);
+   for (i = m_min; i < normal; i++) {
+      fp = (fp << 1) + gear[buf[i]];
+      if (!(fp & m_mask_s)) {
+         return i + 1;
+      }
+   }
+   for ( ; i < len; i++) {
+      fp = (fp << 1) + gear[buf[i]];
+      if (!(fp & m_mask_l)) {
+         return i + 1;
+      }
+   }
+   return len;
+}
+
+#ifndef TEST_PROGRAM
+#define TEST_PROGRAM_A
+#endif
+
+#ifdef TEST_PROGRAM
+#include "unittests.h"
+
+struct test_hash_item {
+   hlink link;
+   unsigned char hash[DEDUP_HASH_SIZE];
+};
+
+static void random_buf(uint8_t *buf, uint32_t len, uint32_t seed)
+{
+   for (uint32_t i = 0; i < len; i++) {
+      seed = seed * 1103515245 + 12345;
+      buf[i] = (seed >> 16) & 0xFF;
+   }
+}
+
+/* Cut the buffer the way the FD does, return the number of chunks */
+static int chunk_buf(cdc_chunker &cdc, const uint8_t *buf, uint32_t len,
+                     htable *hashes, int *nb_known, uint32_t *min, uint32_t *max)
+{
+   uint32_t pos = 0, n;
+   int nb = 0;
+   uint64_t key;
+
+   while (pos < len) {
+      n = cdc.cut(buf + pos, len - pos);
+      if (pos + n < len) {
+         *min = MIN(*min, n);
+      }
+      *max = MAX(*max, n);
+      test_hash_item *it = (test_hash_item *)hashes->hash_malloc(sizeof(test_hash_item));
+      dedup_hash((const char *)buf + pos, n, it->hash);
+      memcpy(&key, it->hash, sizeof(key));
+      if (hashes->lookup(key)) {
+         (*nb_known)++;
+      } else {
+         hashes->insert(key, it);
+      }
+      pos += n;
+      nb++;
+   }
+   return nb;
+}
+
+int main(int argc, char **argv)
+{
+   Unittests dedup_test("dedup_test");
+   const char *name = NULL;
+   unsigned char hash[DEDUP_HASH_SIZE], hash2[DEDUP_HASH_SIZE];
+   char ref[DEDUP_REF_SIZE];
+   uint32_t size;
+   char buf[100];
+   int i;
+
+   ok(bhash_info(DEDUP_DEFAULT_HASH_ID, &name) == DEDUP_HASH_SIZE, "Size of the hash");
+   ok(strcmp(name, "BLAKE3") == 0, "Name of the hash");
+   ok(bhash_info(DEDUP_DEFAULT_HASH_ID, NULL) == DEDUP_HASH_SIZE, "No name asked");
+   ok(bhash_info(99, &name) == 0 && strcmp(name, "N/A") == 0, "Unknown hash");
+
+   dedup_hash("", 0, hash);
+   for (i = 0; i < 8; i++) {
+      bsnprintf(buf + 2 * i, sizeof(buf) - 2 * i, "%02x", hash[i]);
+   }
+   ok(strcmp(buf, "af1349b9f5f9a1a6") == 0, "Hash of the empty chunk");
+
+   dedup_hash("abc", 3, hash);
+   ok(dedup_encode_ref(ref, 1234, hash) == DEDUP_REF_SIZE, "Encode a ref");
+   ok(DEDUP_REF_SIZE == 44, "Size of a ref");
+   ok(dedup_decode_ref(ref, DEDUP_REF_SIZE, &size, hash2), "Decode a ref");
+   ok(size == 1234 && memcmp(hash, hash2, DEDUP_HASH_SIZE) == 0, "Same ref");
+   nok(dedup_decode_ref(ref, DEDUP_REF_SIZE - 1, &size, hash2), "Ref too short");
+
+   ok(is_deduplicable_stream(STREAM_FILE_DATA), "File data");
+   ok(is_deduplicable_stream(STREAM_SPARSE_DATA | STREAM_BIT_OFFSETS), "Sparse data");
+   nok(is_deduplicable_stream(STREAM_GZIP_DATA), "Compressed data");
+   nok(is_deduplicable_stream(STREAM_ENCRYPTED_FILE_DATA), "Encrypted data");
+
+   /* The chunks of random data */
+   uint32_t len = 8 * 1024 * 1024;
+   uint8_t *data = (uint8_t *)malloc(len + 1000);
+   cdc_chunker cdc;
+   test_hash_item it;
+   htable *hashes = New(htable(&it, &it.link, 1000));
+   uint32_t min = len, max = 0;
+   int known = 0;
+
+   random_buf(data, len, 1);
+   int nb = chunk_buf(cdc, data, len, hashes, &known, &min, &max);
+   Pmsg4(0, "%d chunks of %d bytes, min=%d max=%d\n", nb, len / nb, min, max);
+   ok(min >= DEDUP_CDC_MIN_SIZE && max <= DEDUP_CDC_MAX_SIZE, "Size of the chunks");
+   ok(len / nb > DEDUP_CDC_AVG_SIZE / 2 && len / nb < DEDUP_CDC_AVG_SIZE * 2, "Average size");
+   ok(known == 0, "No duplicate chunk in random data");
+
+   /* Insert some bytes in the middle, only the chunks around change */
+   memmove(data + len / 2 + 100, data + len / 2, len / 2);
+   random_buf(data + len / 2, 100, 2);
+   int nb2 = chunk_buf(cdc, data, len + 100, hashes, &known, &min, &max);
+   Pmsg3(0, "After the insert: %d chunks, %d known, %d new\n", nb2, known, nb2 - known);
+   ok(nb2 - known <= 3, "Insert changes only the chunks around it");
+
+   /* The same data gives the same chunks */
+   known = 0;
+   int nb3 = chunk_buf(cdc, data, len + 100, hashes, &known, &min, &max);
+   ok(nb3 == nb2 && known == nb3, "Same cut points");
+
+   /* A buffer of zeros is cut at the maximum */
+   memset(data, 0, len);
+   min = len; max = 0;
+   chunk_buf(cdc, data, 1024 * 1024, hashes, &known, &min, &max);
+   ok(min >= DEDUP_CDC_MIN_SIZE && max <= DEDUP_CDC_MAX_SIZE, "Chunks of zeros");
+   ok(cdc.cut(data, 100) == 100, "Small end of data");
+
+   delete hashes;
+   free(data);
+   return report();
+}
+#endif /* TEST_PROGRAM */
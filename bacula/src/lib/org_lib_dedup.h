@@ -61,10 +61,52 @@
 /* access first bytes of any data block as an int, used to display short hash * in Dmsg()*/
 inline int hash2int(const void *p) { return htonl(*(int *)p); }
 
+/* the hash of the community dedupengine is a BLAKE3 digest */
+#define DEDUP_HASH_SIZE         32
+/* a ref is the size, an address that is not used and the hash */
+#define DEDUP_REF_SIZE          (DEDUP_BASIC_REF_SIZE+DEDUP_HASH_SIZE)
+
+/*
+ * Content defined chunking, see cdc_chunker. The maximum must stay
+ *  below DEDUP_MAX_BLOCK_SIZE.
+ */
+#define DEDUP_CDC_MIN_SIZE      (4*1024)
+#define DEDUP_CDC_AVG_SIZE      (16*1024)
+#define DEDUP_CDC_MAX_SIZE      (60*1024)
+
 int bhash_info(int hash_id, const char **hash_name);
+void dedup_hash(const char *buf, uint32_t len, unsigned char *hash);
+int dedup_encode_ref(char *ref, uint32_t size, const unsigned char *hash);
+bool dedup_decode_ref(const char *ref, int32_t len, uint32_t *size,
+                      unsigned char *hash);
 
 bool is_deduplicable_stream(int stream);
 bool is_client_rehydration_friendly_stream(int stream);
 void dedup_get_limits(int64_t *nofile, int64_t *memlock);
 
+/*
+ * FastCDC chunker, the cut points are found with a gear rolling hash,
+ *  so they depend only on the data: an insert in a file changes the
+ *  chunks around it, the following ones keep their boundaries and
+ *  their hash. The chunks are between min and max bytes, a mask with
+ *  more bits before avg and with less bits after avg keeps them close
+ *  to avg.
+ */
+class cdc_chunker: public SMARTALLOC {
+   uint32_t m_min;
+   uint32_t m_avg;
+   uint32_t m_max;
+   uint64_t m_mask_s;                 /* used before avg, harder to match */
+   uint64_t m_mask_l;                 /* used after avg, easier to match */
+public:
+   cdc_chunker(uint32_t min=DEDUP_CDC_MIN_SIZE, uint32_t avg=DEDUP_CDC_AVG_SIZE,
+               uint32_t max=DEDUP_CDC_MAX_SIZE);
+   ~cdc_chunker() {};
+   uint32_t max_size() const { return m_max; };
+
+   /* Length of the first chunk of buf. Unless this is the end of
+    *  the data, len must be at least max_size() */
+   uint32_t cut(const uint8_t *buf, uint32_t len) const;
+};
+
 #endif  /* ORG_LIB_DEDUP_H */
@@ -201,6 +201,9 @@ CIPHER_CONTEXT *   crypto_cipher_new           (CRYPTO_SESSION *cs, bool encrypt
 bool               crypto_cipher_update        (CIPHER_CONTEXT *cipher_ctx, const uint8_t *data, uint32_t length, const uint8_t *dest, uint32_t *written);
 bool               crypto_cipher_finalize      (CIPHER_CONTEXT *cipher_ctx, uint8_t *dest, uint32_t *written);
 void               crypto_cipher_free          (CIPHER_CONTEXT *cipher_ctx);
+bool               crypto_session_aead         (CRYPTO_SESSION *cs);
+bool               crypto_cipher_seal          (CIPHER_CONTEXT *cipher_ctx, uint64_t recno, const uint8_t *data, uint32_t length, uint8_t *dest, uint32_t *written);
+bool               crypto_cipher_open          (CIPHER_CONTEXT *cipher_ctx, const uint8_t *data, uint32_t length, uint8_t *dest, uint32_t *written);
 X509_KEYPAIR *     crypto_keypair_new          (void);
 X509_KEYPAIR *     crypto_keypair_dup          (X509_KEYPAIR *keypair);
 int                crypto_keypair_load_cert    (X509_KEYPAIR *keypair, const char *file);
@@ -26,6 +26,10 @@
 #include "jcr.h"
 #include "findlib/find.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 /*
  * Various Bacula Utility subroutines
  *
@@ -36,29 +40,44 @@ bool is_null(const void *ptr)
    return ptr == NULL;
 }
 
-/* Return true of buffer has all zero bytes */
+/*
+ * Return true of buffer has all zero bytes
+ *
+ * The buffer is scanned 64 bytes at a time, with SSE2 on x86, else
+ *  with 64 bit words that the compiler can vectorize. We stop at the
+ *  first chunk with a non zero byte.
+ */
 bool is_buf_zero(const char *buf, int len)
 {
-   uint64_t *ip;
-   const char *p;
-   int i, len64, done, rem;
+   const char *p = buf;
+   const char *end = buf + len;
 
    if (buf[0] != 0) {
       return false;
    }
-   ip = (uint64_t *)buf;
-   /* Optimize by checking uint64_t for zero */
-   len64 = len / sizeof(uint64_t);
-   for (i=0; i < len64; i++) {
-      if (ip[i] != 0) {
+#ifdef __SSE2__
+   const __m128i zero = _mm_setzero_si128();
+   for ( ; end - p >= 64; p += 64) {
+      __m128i v = _mm_or_si128(
+         _mm_or_si128(_mm_loadu_si128((const __m128i *)p),
+                      _mm_loadu_si128((const __m128i *)(p + 16))),
+         _mm_or_si128(_mm_loadu_si128((const __m128i *)(p + 32)),
+                      _mm_loadu_si128((const __m128i *)(p + 48))));
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) != 0xFFFF) {
          return false;
       }
    }
-   done = len64 * sizeof(uint64_t);  /* bytes already checked */
-   p = buf + done;
-   rem = len - done;
-   for (i = 0; i < rem; i++) {
-      if (p[i] != 0) {
+#else
+   for ( ; end - p >= 64; p += 64) {
+      uint64_t v[8];
+      memcpy(v, p, sizeof(v));    /* no alignment needed */
+      if ((v[0] | v[1] | v[2] | v[3] | v[4] | v[5] | v[6] | v[7]) != 0) {
+         return false;
+      }
+   }
+#endif
+   for ( ; p < end; p++) {
+      if (*p != 0) {
          return false;
       }
    }
@@ -0,0 +1,552 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+*/
+/*
+ *  XXH3 128 bit hash
+ *
+ *  Streaming implementation of the XXH3-128 algorithm of xxHash
+ *   (Yann Collet, https://github.com/Cyan4973/xxHash) with the
+ *   default secret and a seed of 0. It is not a cryptographic hash,
+ *   it is used for the Signature=XXH128 FileSet option to detect the
+ *   changes of the files at memory speed.
+ *
+ *  The digest is returned in the canonical form of xxHash (the high
+ *   64 bits first, both big endian), so it matches xxh128sum.
+ *
+ *  The accumulation loop uses SSE2 when the compiler targets it (all
+ *   x86_64 CPUs), else the portable code.
+ */
+
+#include "bacula.h"
+#include "xxh3.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define STRIPE_LEN          64
+#define SECRET_SIZE         192
+#define SECRET_CONSUME_RATE 8
+#define STRIPES_PER_BLOCK   ((SECRET_SIZE - STRIPE_LEN) / SECRET_CONSUME_RATE)
+#define SECRET_LASTACC      7
+#define SECRET_MERGEACCS    11
+#define MIDSIZE_MAX         240
+
+static const uint32_t PRIME32_1 = 0x9E3779B1U;
+static const uint32_t PRIME32_2 = 0x85EBCA77U;
+static const uint32_t PRIME32_3 = 0xC2B2AE3DU;
+static const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+static const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+static const uint64_t PRIME_MX1 = 0x165667919E3779F9ULL;
+static const uint64_t PRIME_MX2 = 0x9FB21C651E98DF25ULL;
+
+static const uint8_t secret[SECRET_SIZE] = {
+   0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+   0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+   0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+   0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+   0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+   0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+   0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+   0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+   0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+   0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+   0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+   0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+typedef struct {
+   uint64_t low;
+   uint64_t high;
+} u128;
+
+/* The hash is defined on little endian words */
+static inline uint32_t read32(const uint8_t *p)
+{
+   return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+      ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t read64(const uint8_t *p)
+{
+   return (uint64_t)read32(p) | ((uint64_t)read32(p + 4) << 32);
+}
+
+static inline void write64_be(uint8_t *p, uint64_t v)
+{
+   for (int i = 7; i >= 0; i--) {
+      p[i] = (uint8_t)v;
+      v >>= 8;
+   }
+}
+
+static inline uint32_t swap32(uint32_t x)
+{
+   return ((x << 24) & 0xff000000) | ((x << 8) & 0x00ff0000) |
+      ((x >> 8) & 0x0000ff00) | ((x >> 24) & 0x000000ff);
+}
+
+static inline uint64_t swap64(uint64_t x)
+{
+   return ((uint64_t)swap32((uint32_t)x) << 32) | swap32((uint32_t)(x >> 32));
+}
+
+static inline uint32_t rotl32(uint32_t x, int r)
+{
+   return (x << r) | (x >> (32 - r));
+}
+
+static inline u128 mult64to128(uint64_t a, uint64_t b)
+{
+   u128 r;
+#ifdef __SIZEOF_INT128__
+   unsigned __int128 p = (unsigned __int128)a * b;
+   r.low = (uint64_t)p;
+   r.high = (uint64_t)(p >> 64);
+#else
+   uint64_t lo_lo = (a & 0xFFFFFFFF) * (b & 0xFFFFFFFF);
+   uint64_t hi_lo = (a >> 32) * (b & 0xFFFFFFFF);
+   uint64_t lo_hi = (a & 0xFFFFFFFF) * (b >> 32);
+   uint64_t hi_hi = (a >> 32) * (b >> 32);
+   uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+   r.high = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+   r.low = (cross << 32) | (lo_lo & 0xFFFFFFFF);
+#endif
+   return r;
+}
+
+static inline uint64_t mul128_fold64(uint64_t a, uint64_t b)
+{
+   u128 r = mult64to128(a, b);
+   return r.low ^ r.high;
+}
+
+static inline uint64_t xorshift64(uint64_t v, int shift)
+{
+   return v ^ (v >> shift);
+}
+
+static inline uint64_t avalanche(uint64_t h)
+{
+   h = xorshift64(h, 37);
+   h *= PRIME_MX1;
+   return xorshift64(h, 32);
+}
+
+static inline uint64_t xxh64_avalanche(uint64_t h)
+{
+   h ^= h >> 33;
+   h *= PRIME64_2;
+   h ^= h >> 29;
+   h *= PRIME64_3;
+   h ^= h >> 32;
+   return h;
+}
+
+/*
+ * Short inputs, hashed in one shot
+ */
+static u128 hash_1to3(const uint8_t *in, size_t len)
+{
+   u128 h;
+   uint8_t c1 = in[0];
+   uint8_t c2 = in[len >> 1];
+   uint8_t c3 = in[len - 1];
+   uint32_t combinedl = ((uint32_t)c1 << 16) | ((uint32_t)c2 << 24) |
+      ((uint32_t)c3 << 0) | ((uint32_t)len << 8);
+   uint32_t combinedh = rotl32(swap32(combinedl), 13);
+   uint64_t bitflipl = read32(secret) ^ read32(secret + 4);
+   uint64_t bitfliph = read32(secret + 8) ^ read32(secret + 12);
+   h.low = xxh64_avalanche((uint64_t)combinedl ^ bitflipl);
+   h.high = xxh64_avalanche((uint64_t)combinedh ^ bitfliph);
+   return h;
+}
+
+static u128 hash_4to8(const uint8_t *in, size_t len)
+{
+   uint32_t input_lo = read32(in);
+   uint32_t input_hi = read32(in + len - 4);
+   uint64_t input_64 = input_lo + ((uint64_t)input_hi << 32);
+   uint64_t bitflip = read64(secret + 16) ^ read64(secret + 24);
+   uint64_t keyed = input_64 ^ bitflip;
+   u128 m = mult64to128(keyed, PRIME64_1 + (len << 2));
+   m.high += m.low << 1;
+   m.low ^= m.high >> 3;
+   m.low = xorshift64(m.low, 35);
+   m.low *= PRIME_MX2;
+   m.low = xorshift64(m.low, 28);
+   m.high = avalanche(m.high);
+   return m;
+}
+
+static u128 hash_9to16(const uint8_t *in, size_t len)
+{
+   uint64_t bitflipl = read64(secret + 32) ^ read64(secret + 40);
+   uint64_t bitfliph = read64(secret + 48) ^ read64(secret + 56);
+   uint64_t input_lo = read64(in);
+   uint64_t input_hi = read64(in + len - 8);
+   u128 m = mult64to128(input_lo ^ input_hi ^ bitflipl, PRIME64_1);
+   m.low += (uint64_t)(len - 1) << 54;
+   input_hi ^= bitfliph;
+   m.high += input_hi + (uint64_t)(uint32_t)input_hi * (PRIME32_2 - 1);
+   m.low ^= swap64(m.high);
+   u128 h = mult64to128(m.low, PRIME64_2);
+   h.high += m.high * PRIME64_2;
+   h.low = avalanche(h.low);
+   h.high = avalanche(h.high);
+   return h;
+}
+
+static u128 hash_0to16(const uint8_t *in, size_t len)
+{
+   if (len > 8) {
+      return hash_9to16(in, len);
+   }
+   if (len >= 4) {
+      return hash_4to8(in, len);
+   }
+   if (len > 0) {
+      return hash_1to3(in, len);
+   }
+   u128 h;
+   h.low = xxh64_avalanche(read64(secret + 64) ^ read64(secret + 72));
+   h.high = xxh64_avalanche(read64(secret + 80) ^ read64(secret + 88));
+   return h;
+}
+
+static inline uint64_t mix16B(const uint8_t *in, const uint8_t *sec)
+{
+   return mul128_fold64(read64(in) ^ read64(sec),
+                        read64(in + 8) ^ read64(sec + 8));
+}
+
+static inline void mix32B(u128 *acc, const uint8_t *in1, const uint8_t *in2,
+                          const uint8_t *sec)
+{
+   acc->low += mix16B(in1, sec);
+   acc->low ^= read64(in2) + read64(in2 + 8);
+   acc->high += mix16B(in2, sec + 16);
+   acc->high ^= read64(in1) + read64(in1 + 8);
+}
+
+static u128 finish_mid(u128 acc, size_t len)
+{
+   u128 h;
+   h.low = acc.low + acc.high;
+   h.high = acc.low * PRIME64_1 + acc.high * PRIME64_4 + len * PRIME64_2;
+   h.low = avalanche(h.low);
+   h.high = 0 - avalanche(h.high);
+   return h;
+}
+
+static u128 hash_17to128(const uint8_t *in, size_t len)
+{
+   u128 acc;
+   acc.low = len * PRIME64_1;
+   acc.high = 0;
+   if (len > 32) {
+      if (len > 64) {
+         if (len > 96) {
+            mix32B(&acc, in + 48, in + len - 64, secret + 96);
+         }
+         mix32B(&acc, in + 32, in + len - 48, secret + 64);
+      }
+      mix32B(&acc, in + 16, in + len - 32, secret + 32);
+   }
+   mix32B(&acc, in, in + len - 16, secret);
+   return finish_mid(acc, len);
+}
+
+static u128 hash_129to240(const uint8_t *in, size_t len)
+{
+   int nb_rounds = (int)len / 32;
+   int i;
+   u128 acc;
+   acc.low = len * PRIME64_1;
+   acc.high = 0;
+   for (i = 0; i < 4; i++) {
+      mix32B(&acc, in + 32 * i, in + 32 * i + 16, secret + 32 * i);
+   }
+   acc.low = avalanche(acc.low);
+   acc.high = avalanche(acc.high);
+   for (i = 4; i < nb_rounds; i++) {
+      mix32B(&acc, in + 32 * i, in + 32 * i + 16, secret + 3 + 32 * (i - 4));
+   }
+   mix32B(&acc, in + len - 16, in + len - 32, secret + 136 - 17 - 16);
+   return finish_mid(acc, len);
+}
+
+/*
+ * Long inputs, consumed by stripes of 64 bytes
+ */
+static void accumulate(uint64_t *acc, const uint8_t *in, const uint8_t *sec,
+                       size_t nb_stripes)
+{
+#ifdef __SSE2__
+   __m128i a[4];
+   for (int i = 0; i < 4; i++) {
+      a[i] = _mm_loadu_si128((const __m128i *)(acc + 2 * i));
+   }
+   for (size_t n = 0; n < nb_stripes; n++) {
+      const uint8_t *p = in + n * STRIPE_LEN;
+      const uint8_t *s = sec + n * SECRET_CONSUME_RATE;
+      for (int i = 0; i < 4; i++) {
+         __m128i data = _mm_loadu_si128((const __m128i *)(p + 16 * i));
+         __m128i key = _mm_loadu_si128((const __m128i *)(s + 16 * i));
+         __m128i data_key = _mm_xor_si128(data, key);
+         __m128i data_key_lo = _mm_shuffle_epi32(data_key, _MM_SHUFFLE(0, 3, 0, 1));
+         __m128i product = _mm_mul_epu32(data_key, data_key_lo);
+         __m128i data_swap = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+         a[i] = _mm_add_epi64(a[i], _mm_add_epi64(product, data_swap));
+      }
+   }
+   for (int i = 0; i < 4; i++) {
+      _mm_storeu_si128((__m128i *)(acc + 2 * i), a[i]);
+   }
+#else
+   for (size_t n = 0; n < nb_stripes; n++) {
+      const uint8_t *p = in + n * STRIPE_LEN;
+      const uint8_t *s = sec + n * SECRET_CONSUME_RATE;
+      for (int i = 0; i < 8; i++) {
+         uint64_t data = read64(p + 8 * i);
+         uint64_t data_key = data ^ read64(s + 8 * i);
+         acc[i ^ 1] += data;
+         acc[i] += (data_key & 0xFFFFFFFF) * (data_key >> 32);
+      }
+   }
+#endif
+}
+
+static void scramble(uint64_t *acc, const uint8_t *sec)
+{
+   for (int i = 0; i < 8; i++) {
+      uint64_t a = acc[i];
+      a = xorshift64(a, 47);
+      a ^= read64(sec + 8 * i);
+      acc[i] = a * PRIME32_1;
+   }
+}
+
+/* Consume nb_stripes stripes, scramble the accumulators after each block */
+static const uint8_t *consume_stripes(uint64_t *acc, uint32_t *stripes_so_far,
+                                      const uint8_t *in, size_t nb_stripes)
+{
+   const uint8_t *sec = secret + *stripes_so_far * SECRET_CONSUME_RATE;
+   if (nb_stripes >= STRIPES_PER_BLOCK - *stripes_so_far) {
+      size_t n = STRIPES_PER_BLOCK - *stripes_so_far;
+      do {
+         accumulate(acc, in, sec, n);
+         scramble(acc, secret + SECRET_SIZE - STRIPE_LEN);
+         in += n * STRIPE_LEN;
+         nb_stripes -= n;
+         n = STRIPES_PER_BLOCK;
+         sec = secret;
+      } while (nb_stripes >= STRIPES_PER_BLOCK);
+      *stripes_so_far = 0;
+   }
+   if (nb_stripes > 0) {
+      accumulate(acc, in, sec, nb_stripes);
+      in += nb_stripes * STRIPE_LEN;
+      *stripes_so_far += nb_stripes;
+   }
+   return in;
+}
+
+static uint64_t merge_accs(const uint64_t *acc, const uint8_t *sec, uint64_t start)
+{
+   uint64_t result = start;
+   for (int i = 0; i < 4; i++) {
+      result += mul128_fold64(acc[2 * i] ^ read64(sec + 16 * i),
+                              acc[2 * i + 1] ^ read64(sec + 16 * i + 8));
+   }
+   return avalanche(result);
+}
+
+void XXH3_128_init(XXH3_CTX *ctx)
+{
+   ctx->acc[0] = PRIME32_3;
+   ctx->acc[1] = PRIME64_1;
+   ctx->acc[2] = PRIME64_2;
+   ctx->acc[3] = PRIME64_3;
+   ctx->acc[4] = PRIME64_4;
+   ctx->acc[5] = PRIME32_2;
+   ctx->acc[6] = PRIME64_5;
+   ctx->acc[7] = PRIME32_1;
+   ctx->buffered = 0;
+   ctx->nb_stripes = 0;
+   ctx->total_len = 0;
+}
+
+void XXH3_128_update(XXH3_CTX *ctx, const uint8_t *data, size_t len)
+{
+   const uint8_t *end = data + len;
+
+   ctx->total_len += len;
+   if (len <= XXH3_BUFFER_SIZE - ctx->buffered) {
+      memcpy(ctx->buffer + ctx->buffered, data, len);
+      ctx->buffered += len;
+      return;
+   }
+
+   /* Complete and consume the buffer */
+   if (ctx->buffered) {
+      size_t load = XXH3_BUFFER_SIZE - ctx->buffered;
+      memcpy(ctx->buffer + ctx->buffered, data, load);
+      data += load;
+      consume_stripes(ctx->acc, &ctx->nb_stripes, ctx->buffer,
+                      XXH3_BUFFER_SIZE / STRIPE_LEN);
+      ctx->buffered = 0;
+   }
+
+   /*
+    * Consume the input directly, always keep at least one byte for the
+    *  end, the last stripe consumed is kept at the end of the buffer in
+    *  case the final stripe needs it.
+    */
+   if (end - data > XXH3_BUFFER_SIZE) {
+      size_t nb_stripes = (size_t)(end - 1 - data) / STRIPE_LEN;
+      data = consume_stripes(ctx->acc, &ctx->nb_stripes, data, nb_stripes);
+      memcpy(ctx->buffer + XXH3_BUFFER_SIZE - STRIPE_LEN, data - STRIPE_LEN, STRIPE_LEN);
+   }
+   memcpy(ctx->buffer, data, end - data);
+   ctx->buffered = end - data;
+}
+
+void XXH3_128_final(XXH3_CTX *ctx, uint8_t digest[XXH3_128_DIGEST_SIZE])
+{
+   u128 h;
+   uint64_t len = ctx->total_len;
+
+   if (len <= 16) {
+      h = hash_0to16(ctx->buffer, len);
+
+   } else if (len <= 128) {
+      h = hash_17to128(ctx->buffer, len);
+
+   } else if (len <= MIDSIZE_MAX) {
+      h = hash_129to240(ctx->buffer, len);
+
+   } else {
+      uint8_t last_stripe[STRIPE_LEN];
+      const uint8_t *last;
+      uint32_t nb_stripes = ctx->nb_stripes;
+
+      if (ctx->buffered >= STRIPE_LEN) {
+         consume_stripes(ctx->acc, &nb_stripes, ctx->buffer,
+                         (ctx->buffered - 1) / STRIPE_LEN);
+         last = ctx->buffer + ctx->buffered - STRIPE_LEN;
+      } else {
+         /* Take the end of the previous stripe */
+         size_t catchup = STRIPE_LEN - ctx->buffered;
+         memcpy(last_stripe, ctx->buffer + XXH3_BUFFER_SIZE - catchup, catchup);
+         memcpy(last_stripe + catchup, ctx->buffer, ctx->buffered);
+         last = last_stripe;
+      }
+      accumulate(ctx->acc, last, secret + SECRET_SIZE - STRIPE_LEN - SECRET_LASTACC, 1);
+      h.low = merge_accs(ctx->acc, secret + SECRET_MERGEACCS, len * PRIME64_1);
+      h.high = merge_accs(ctx->acc, secret + SECRET_SIZE - STRIPE_LEN - SECRET_MERGEACCS,
+                          ~(len * PRIME64_2));
+   }
+   write64_be(digest, h.high);
+   write64_be(digest + 8, h.low);
+}
+
+#ifdef TEST_PROGRAM
+#include "unittests.h"
+
+static void make_data(uint8_t *buf, size_t len)
+{
+   for (size_t i = 0; i < len; i++) {
+      buf[i] = (uint8_t)(i * 7 + 3);
+   }
+}
+
+static const char *to_hex(uint8_t *digest, char *buf)
+{
+   for (int i = 0; i < XXH3_128_DIGEST_SIZE; i++) {
+      sprintf(buf + 2 * i, "%02x", digest[i]);
+   }
+   return buf;
+}
+
+/* Reference values from xxh128sum, one for each code path */
+static struct {
+   size_t len;
+   const char *digest;
+} tests[] = {
+   {0,       "99aa06d3014798d86001c324468d497f"},
+   {1,       "22bbb76b211a39ba13e608bc156defed"},
+   {3,       "ce31763cbf8245a5a9088dda485b481c"},
+   {4,       "47197970590746b1788a609154b0fe20"},
+   {8,       "e3bc8a5f461715553cd024e3d63a1588"},
+   {9,       "c72c88247a9a56d7eafab1c7f123109f"},
+   {16,      "ce0b9647ab24f88460d75c5e47d40a24"},
+   {17,      "bfd327edcc2fbd12eeed7654312a26d7"},
+   {128,     "1b1962a096bac78bc580008b6c92ac53"},
+   {129,     "293e4968c4619023bd91ce7ace4d385b"},
+   {240,     "ad46c1021b076bc704e0b5f034bee80b"},
+   {241,     "ac6c3492c3d6b45d8beadd3a8874fe17"},
+   {1024,    "18bc0eaca9a336369b81661c641c72b1"},
+   {1025,    "bf447251cfa98d7c806c2072ed713576"},
+   {65536,   "6a2504ac37f3b3b35d03b43b14c75500"},
+   {1000003, "dbe0cd4f15fc27026fb4080543f32e5b"},
+   {3145733, "0f003f3d0e4c7cab20e27ad19d0cb411"},
+   {0, NULL}
+};
+
+/* Sizes of the updates, to cross the buffer and the stripe boundaries */
+static size_t steps[] = { 1, 63, 64, 100, 255, 256, 257, 65536 };
+
+int main(int argc, char *argv[])
+{
+   Unittests xxh3_test("xxh3_test");
+   XXH3_CTX ctx;
+   uint8_t digest[XXH3_128_DIGEST_SIZE];
+   char hex[2 * XXH3_128_DIGEST_SIZE + 1];
+   char label[100];
+   size_t max = 3145733;
+   uint8_t *data = (uint8_t *)malloc(max);
+
+   make_data(data, max);
+   for (int i = 0; tests[i].digest; i++) {
+      XXH3_128_init(&ctx);
+      XXH3_128_update(&ctx, data, tests[i].len);
+      XXH3_128_final(&ctx, digest);
+      bsnprintf(label, sizeof(label), "Checking XXH3-128 of %lld bytes",
+                (long long)tests[i].len);
+      is(to_hex(digest, hex), tests[i].digest, label);
+
+      for (int j = 0; j < (int)(sizeof(steps)/sizeof(steps[0])); j++) {
+         size_t len = tests[i].len;
+         XXH3_128_init(&ctx);
+         for (size_t pos = 0; pos < len; pos += steps[j]) {
+            XXH3_128_update(&ctx, data + pos, MIN(steps[j], len - pos));
+         }
+         XXH3_128_final(&ctx, digest);
+         bsnprintf(label, sizeof(label), "Checking XXH3-128 of %lld bytes by %lld",
+                   (long long)len, (long long)steps[j]);
+         is(to_hex(digest, hex), tests[i].digest, label);
+      }
+   }
+   free(data);
+   return report();
+}
+#endif /* TEST_PROGRAM */
@@ -0,0 +1,41 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+*/
+/*
+ * XXH3 128 bit non cryptographic hash, see xxh3.c
+ */
+
+#ifndef __XXH3_H
+#define __XXH3_H
+
+#define XXH3_128_DIGEST_SIZE  16
+#define XXH3_BUFFER_SIZE      256
+
+typedef struct {
+   uint64_t acc[8];                    /* accumulators of the long hash */
+   uint8_t  buffer[XXH3_BUFFER_SIZE];  /* input not yet consumed */
+   uint32_t buffered;                  /* bytes in buffer */
+   uint32_t nb_stripes;                /* stripes done in the current block */
+   uint64_t total_len;                 /* bytes hashed so far */
+} XXH3_CTX;
+
+void XXH3_128_init(XXH3_CTX *ctx);
+void XXH3_128_update(XXH3_CTX *ctx, const uint8_t *data, size_t len);
+void XXH3_128_final(XXH3_CTX *ctx, uint8_t digest[XXH3_128_DIGEST_SIZE]);
+
+#endif /* __XXH3_H */
@@ -146,7 +146,8 @@ public:
         setClients(dir->clients);
 
         QStringList replaceOptions;
-        replaceOptions << "Never" << "Always" << "IfNewer" << "IfOlder";
+        replaceOptions << "Never" << "Always" << "IfNewer" << "IfOlder"
+                       << "IfChanged" << "IfDifferent";
         setReplaceOptions(replaceOptions);
     }
 
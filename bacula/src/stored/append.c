@@ -144,6 +144,10 @@ bool do_append_data(JCR *jcr)
     *   So we get the (stream header, data, EOD) three time for each
     *   file. 1. for the Attributes, 2. for the file data if any,
     *   and 3. for the MD5 if any.
+    *
+    *   The FD may pack these small messages of many files in one
+    *   network message (SmallFilePackSize), BSOCK::recv() returns
+    *   them one by one, so nothing changes here.
     */
    dcr->VolFirstIndex = dcr->VolLastIndex = 0;
    jcr->run_time = time(NULL);              /* start counting time for rates */
@@ -28,11 +28,16 @@
 #include "stored.h"
 #include "ch.h"
 #include "findlib/find.h"
+#include "lib/lz4.h"
 
 #ifdef HAVE_LZO
 #include <lzo/lzoconf.h>
 #include <lzo/lzo1x.h>
 #endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#include <zstd_errors.h>
+#endif
 
 extern bool parse_sd_config(CONFIG *config, const char *configfile, int exit_code);
 
@@ -56,6 +61,9 @@ static uint64_t num_records = 0;
 static uint32_t num_files = 0;
 static uint32_t compress_buf_size = 70000;
 static POOLMEM *compress_buf;
+#ifdef HAVE_ZSTD
+static ZSTD_DCtx *zstd_dctx = NULL;
+#endif
 static int prog_name_msg = 0;
 static int win32_data_msg = 0;
 static char *VolumeName = NULL;
@@ -298,6 +306,12 @@ static void do_extract(char *devname)
    free_jcr(jcr);
    dev->term(NULL);
    free_pool_memory(curr_fname);
+#ifdef HAVE_ZSTD
+   if (zstd_dctx) {
+      ZSTD_freeDCtx(zstd_dctx);
+      zstd_dctx = NULL;
+   }
+#endif
 
    printf(_("%u files restored.\n"), num_files);
    if (num_errors) {
@@ -655,6 +669,79 @@ static bool record_cb(DCR *dcr, DEV_RECORD *rec)
                Dmsg2(100, "Compress len=%d uncompressed=%d\n", rec->data_len, compress_len);
                break;
 #endif
+#ifdef HAVE_ZSTD
+            case COMPRESS_ZSTD:
+            {
+               const char *zbuf = wbuf + sizeof(comp_stream_header);
+               size_t zlen = wsize - sizeof(comp_stream_header);
+               unsigned long long size = ZSTD_getFrameContentSize(zbuf, zlen);
+               size_t zret;
+
+               if (!zstd_dctx && (zstd_dctx = ZSTD_createDCtx()) == NULL) {
+                  Emsg0(M_ERROR, 0, _("ZSTD decompression context allocation failed\n"));
+                  extract = false;
+                  goto bail_out;
+               }
+               if (size != ZSTD_CONTENTSIZE_ERROR && size != ZSTD_CONTENTSIZE_UNKNOWN &&
+                   size > compress_buf_size && size < 10000000) {
+                  compress_buf_size = size;
+                  compress_buf = check_pool_memory_size(compress_buf, compress_buf_size);
+               }
+               while (ZSTD_isError(zret = ZSTD_decompressDCtx(zstd_dctx, compress_buf,
+                                              compress_buf_size, zbuf, zlen)) &&
+                      ZSTD_getErrorCode(zret) == ZSTD_error_dstSize_tooSmall &&
+                      compress_buf_size < 10000000)
+               {
+                  /* The buffer size is too small, try with a bigger one */
+                  compress_buf_size = 2 * compress_buf_size;
+                  compress_buf = check_pool_memory_size(compress_buf,
+                                                  compress_buf_size);
+               }
+               if (ZSTD_isError(zret)) {
+                  Emsg1(M_ERROR, 0, _("ZSTD uncompression error. ERR=%s\n"), ZSTD_getErrorName(zret));
+                  extract = false;
+                  goto bail_out;
+               }
+               Dmsg2(100, "Write uncompressed %d bytes, total before write=%d\n", (int)zret, total);
+               store_data(&bfd, compress_buf, zret);
+               total += zret;
+               fileAddr += zret;
+               Dmsg2(100, "Compress len=%d uncompressed=%d\n", rec->data_len, (int)zret);
+               break;
+            }
+#endif
+            case COMPRESS_LZ4:
+            {
+               const char *lbuf = wbuf + sizeof(comp_stream_header) + sizeof(uint32_t);
+               int llen = wsize - sizeof(comp_stream_header) - sizeof(uint32_t);
+               uint32_t size;
+               int lret;
+
+               /* The uncompressed length is stored after the header */
+               unser_begin(wbuf + sizeof(comp_stream_header), sizeof(uint32_t));
+               unser_uint32(size);
+               if (llen < 0 || size > 0x7e000000) {
+                  Emsg1(M_ERROR, 0, _("LZ4 uncompression error. Invalid size=%u\n"), size);
+                  extract = false;
+                  goto bail_out;
+               }
+               if (size > compress_buf_size) {
+                  compress_buf_size = size;
+                  compress_buf = check_pool_memory_size(compress_buf, compress_buf_size);
+               }
+               lret = LZ4_decompress_safe(lbuf, compress_buf, llen, size);
+               if (lret < 0 || (uint32_t)lret != size) {
+                  Emsg1(M_ERROR, 0, _("LZ4 uncompression error. ERR=%d\n"), lret);
+                  extract = false;
+                  goto bail_out;
+               }
+               Dmsg2(100, "Write uncompressed %d bytes, total before write=%d\n", lret, total);
+               store_data(&bfd, compress_buf, lret);
+               total += lret;
+               fileAddr += lret;
+               Dmsg2(100, "Compress len=%d uncompressed=%d\n", rec->data_len, lret);
+               break;
+            }
             default:
                Emsg1(M_ERROR, 0, _("Compression algorithm 0x%x found, but not supported!\n"), comp_magic);
                extract = false;
@@ -668,6 +755,8 @@ static bool record_cb(DCR *dcr, DEV_RECORD *rec)
    case STREAM_SHA1_DIGEST:
    case STREAM_SHA256_DIGEST:
    case STREAM_SHA512_DIGEST:
+   case STREAM_XXH128_DIGEST:
+   case STREAM_BLAKE3_DIGEST:
       break;
 
    case STREAM_SIGNED_DIGEST:
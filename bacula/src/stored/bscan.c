@@ -836,6 +836,22 @@ static bool record_cb(DCR *dcr, DEV_RECORD *rec)
       update_digest_record(db, digest, rec, CRYPTO_DIGEST_SHA512);
       break;
 
+   case STREAM_XXH128_DIGEST:
+      bin_to_base64(digest, sizeof(digest), (char *)rec->data, CRYPTO_DIGEST_XXH128_SIZE, true);
+      if (verbose > 1) {
+         Pmsg1(000, _("Got XXH128 record: %s\n"), digest);
+      }
+      update_digest_record(db, digest, rec, CRYPTO_DIGEST_XXH128);
+      break;
+
+   case STREAM_BLAKE3_DIGEST:
+      bin_to_base64(digest, sizeof(digest), (char *)rec->data, CRYPTO_DIGEST_BLAKE3_SIZE, true);
+      if (verbose > 1) {
+         Pmsg1(000, _("Got BLAKE3 record: %s\n"), digest);
+      }
+      update_digest_record(db, digest, rec, CRYPTO_DIGEST_BLAKE3);
+      break;
+
    case STREAM_ENCRYPTED_SESSION_DATA:
       // TODO landonf: Investigate crypto support in bscan
       if (verbose > 1) {
@@ -0,0 +1,555 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+*/
+/*
+ * Dedup device
+ *
+ * The backup data of a Dedup device is cut in chunks, the chunks are
+ *  stored in the Dedupengine and the volume gets a reference in place
+ *  of each chunk. The chunks are cut by the FD and the SD asks only
+ *  for the chunks that it does not know (Dedup = bothsides), or the
+ *  SD stores the data records as chunks (Dedup = storage).
+ *
+ * The SD always rehydrates the references for the restore.
+ */
+
+#include "bacula.h"
+#include "stored.h"
+#include "dedupengine.h"
+
+static const int dbglvl = DT_DEDUP|100;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+DEVICE *BaculaSDdriver(JCR *jcr, DEVRES *device)
+{
+   if (!device->dedup) {
+      Jmsg0(jcr, M_FATAL, 0, _("A Dedupengine resource is required for the Dedup driver, but is missing.\n"));
+      return NULL;
+   }
+   return New(dedup_dev(jcr, device));
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+/*
+ * Queue of the messages of a backup on a Dedup device. The commands
+ *  sent by the FD are handled here, the append loop sees only the
+ *  headers and the data.
+ */
+class DedupGetMsg: public GetMsg
+{
+   /* A chunk asked to the FD and not yet received */
+   struct pending_chunk {
+      dlink link;
+      unsigned char hash[DEDUP_HASH_SIZE];
+   };
+
+   DedupEngine *m_engine;
+   bool m_header;                     /* next message is a header */
+   int32_t m_stream;                  /* of the current data */
+   dlist *m_pending;                  /* in the order of the requests */
+   POOLMEM *m_cmd;                    /* reply sent to the FD */
+   uint64_t m_nb_refs, m_ref_bytes;   /* references from the FD */
+   uint64_t m_nb_asked, m_asked_bytes;
+   uint64_t m_nb_chunks, m_chunk_bytes; /* chunks of the SD */
+   uint64_t m_jobbytes;               /* chunks received, not yet counted */
+
+   pending_chunk *find_pending(const unsigned char *hash);
+   bool send_cmd(int32_t cmd, const unsigned char *hash);
+   bool handle_command(bmessage *bm);
+   bool handle_ref(bmessage *bm);
+
+public:
+   DedupGetMsg(JCR *jcr, BSOCK *sock, DedupEngine *engine, int32_t bufsize);
+   ~DedupGetMsg();
+
+   int bget_msg(bmessage **pbmsg=NULL);
+   int commit(POOLMEM *&errmsg, uint32_t jobid);
+   bool dedup_store_chunk(DEV_RECORD *rec, const char *rbuf, int rbuflen,
+                          char *dedup_ref_buf, char *wdedup_ref_buf, POOLMEM *&errmsg);
+};
+
+DedupGetMsg::DedupGetMsg(JCR *jcr, BSOCK *sock, DedupEngine *engine, int32_t bufsize):
+   GetMsg(jcr, sock, NULL, bufsize),
+   m_engine(engine),
+   m_header(true),
+   m_stream(0),
+   m_nb_refs(0), m_ref_bytes(0),
+   m_nb_asked(0), m_asked_bytes(0),
+   m_nb_chunks(0), m_chunk_bytes(0),
+   m_jobbytes(0)
+{
+   pending_chunk *item = NULL;
+   m_pending = New(dlist(item, &item->link));
+   m_cmd = get_pool_memory(PM_BSOCK);
+   m_engine->inc_writers();
+}
+
+DedupGetMsg::~DedupGetMsg()
+{
+   m_engine->dec_writers();
+   m_pending->destroy();
+   delete m_pending;
+   free_pool_memory(m_cmd);
+}
+
+DedupGetMsg::pending_chunk *DedupGetMsg::find_pending(const unsigned char *hash)
+{
+   pending_chunk *p;
+
+   foreach_dlist(p, m_pending) {
+      if (memcmp(p->hash, hash, DEDUP_HASH_SIZE) == 0) {
+         return p;
+      }
+   }
+   return NULL;
+}
+
+/* Send <cmd><hash> to the FD */
+bool DedupGetMsg::send_cmd(int32_t cmd, const unsigned char *hash)
+{
+   POOLMEM *save = bsock->msg;
+   int32_t save_len = bsock->msglen;
+   bool ok;
+   ser_declare;
+
+   m_cmd = check_pool_memory_size(m_cmd, BNET_CMD_SIZE + DEDUP_HASH_SIZE);
+   ser_begin(m_cmd, BNET_CMD_SIZE + DEDUP_HASH_SIZE);
+   ser_int32(cmd);
+   ser_bytes(hash, DEDUP_HASH_SIZE);
+   bsock->msg = m_cmd;
+   bsock->msglen = ser_length(m_cmd);
+   ok = bsock->send(BNET_IS_CMD);
+   m_cmd = bsock->msg;
+   bsock->msg = save;
+   bsock->msglen = save_len;
+   return ok;
+}
+
+/* A chunk asked to the FD, <cmd><hash><data> */
+bool DedupGetMsg::handle_command(bmessage *bm)
+{
+   unsigned char hash[DEDUP_HASH_SIZE];
+   int32_t cmd, size;
+   pending_chunk *p;
+   bool is_new;
+   POOLMEM *errmsg;
+   unser_declare;
+
+   if (bm->msglen < (int32_t)(BNET_CMD_SIZE + DEDUP_HASH_SIZE)) {
+      Jmsg1(jcr, M_FATAL, 0, _("Malformed dedup command from FD, len=%d\n"), bm->msglen);
+      return false;
+   }
+   unser_begin(bm->msg, bm->msglen);
+   unser_int32(cmd);
+   if (cmd != BNET_CMD_STO_BLOCK) {
+      Jmsg1(jcr, M_FATAL, 0, _("Unexpected dedup command %d from FD\n"), cmd);
+      return false;
+   }
+   size = bm->msglen - BNET_CMD_SIZE - DEDUP_HASH_SIZE;
+   p = (pending_chunk *)m_pending->first();
+   if (!p || memcmp(p->hash, bm->msg + BNET_CMD_SIZE, DEDUP_HASH_SIZE) != 0) {
+      Jmsg1(jcr, M_FATAL, 0, _("Dedup chunk #%08x from FD was not asked\n"),
+            hash2int(bm->msg + BNET_CMD_SIZE));
+      return false;
+   }
+   dedup_hash(bm->msg + BNET_CMD_SIZE + DEDUP_HASH_SIZE, size, hash);
+   if (memcmp(p->hash, hash, DEDUP_HASH_SIZE) != 0) {
+      Jmsg1(jcr, M_FATAL, 0, _("Dedup chunk #%08x from FD has a bad hash\n"),
+            hash2int(p->hash));
+      return false;
+   }
+   errmsg = get_pool_memory(PM_MESSAGE);
+   if (!m_engine->store_chunk(hash, bm->msg + BNET_CMD_SIZE + DEDUP_HASH_SIZE,
+                              size, &is_new, errmsg)) {
+      Jmsg1(jcr, M_FATAL, 0, "%s", errmsg);
+      free_pool_memory(errmsg);
+      return false;
+   }
+   free_pool_memory(errmsg);
+   m_pending->remove(p);
+   free(p);
+   m_nb_asked++;
+   m_asked_bytes += size;
+   m_jobbytes += size;
+   return true;
+}
+
+/* A reference from the FD, ask the chunk if it is unknown */
+bool DedupGetMsg::handle_ref(bmessage *bm)
+{
+   unsigned char hash[DEDUP_HASH_SIZE];
+   uint32_t size;
+   char *ref = bm->msg;
+   int32_t len = bm->msglen;
+
+   if (is_offset_stream(m_stream)) {
+      ref += OFFSET_FADDR_SIZE;
+      len -= OFFSET_FADDR_SIZE;
+   }
+   if (!dedup_decode_ref(ref, len, &size, hash)) {
+      Jmsg1(jcr, M_FATAL, 0, _("Malformed dedup reference from FD, len=%d\n"), bm->msglen);
+      return false;
+   }
+   bm->is_dedup = true;
+   bm->dedup_size = size;
+   m_nb_refs++;
+   m_ref_bytes += size;
+   if (m_engine->is_known(hash) || find_pending(hash)) {
+      return send_cmd(BNET_CMD_ACK_HASH, hash);
+   }
+   pending_chunk *p = (pending_chunk *)malloc(sizeof(pending_chunk));
+   memcpy(p->hash, hash, DEDUP_HASH_SIZE);
+   m_pending->append(p);
+   return send_cmd(BNET_CMD_GET_HASH, hash);
+}
+
+int DedupGetMsg::bget_msg(bmessage **pbmsg)
+{
+   bmessage *bm = pbmsg ? *pbmsg : bmsg_aux;
+   int n;
+
+   bm->jobbytes = 0;
+   for ( ;; ) {
+      bm->is_dedup = false;
+      bm->dedup_size = 0;
+      n = GetMsg::bget_msg(pbmsg);
+      if (n != BNET_COMMAND) {
+         break;
+      }
+      if (!handle_command(bm)) {
+         m_is_error = true;
+         return BNET_ERROR;
+      }
+   }
+   if (n == BNET_SIGNAL && bm->msglen == BNET_EOD) {
+      m_header = true;
+
+   } else if (n > 0 && m_header) {
+      int32_t file_index;
+      int64_t stream_len;
+      m_header = false;
+      if (sscanf(bm->msg, "%ld %ld %lld", &file_index, &m_stream, &stream_len) != 3) {
+         m_stream = 0;                /* reported by the append loop */
+      }
+
+   } else if (n > 0) {
+      /* The chunks are counted with the data records */
+      bm->jobbytes = m_jobbytes;
+      m_jobbytes = 0;
+      if ((m_stream & STREAM_BIT_DEDUPLICATION_DATA) && !handle_ref(bm)) {
+         m_is_error = true;
+         return BNET_ERROR;
+      }
+   }
+   return n;
+}
+
+/*
+ * Dedup = storage, the data of the record is stored in the
+ *  Dedupengine and the record gets the reference of the chunk
+ */
+bool DedupGetMsg::dedup_store_chunk(DEV_RECORD *rec, const char *rbuf, int rbuflen,
+                                    char *dedup_ref_buf, char *wdedup_ref_buf,
+                                    POOLMEM *&errmsg)
+{
+   unsigned char hash[DEDUP_HASH_SIZE];
+   bool is_new;
+
+   if (rbuflen <= 0 || rbuflen > DEDUP_MAX_BLOCK_SIZE) {
+      /* Keep the data in the volume */
+      rec->Stream &= ~STREAM_BIT_DEDUPLICATION_DATA;
+      return true;
+   }
+   dedup_hash(rbuf, rbuflen, hash);
+   if (!m_engine->store_chunk(hash, rbuf, rbuflen, &is_new, errmsg)) {
+      return false;
+   }
+   m_nb_chunks++;
+   m_chunk_bytes += rbuflen;
+   rec->data_len = dedup_encode_ref(wdedup_ref_buf, rbuflen, hash) +
+      (wdedup_ref_buf - dedup_ref_buf);
+   rec->data = dedup_ref_buf;
+   rec->extra_bytes = rbuflen;
+   return true;
+}
+
+/* End of the backup, all the chunks must be safe in the Dedupengine */
+int DedupGetMsg::commit(POOLMEM *&errmsg, uint32_t jobid)
+{
+   char ed1[50], ed2[50], ed3[50], ed4[50];
+
+   if (!m_pending->empty()) {
+      Mmsg(errmsg, _("%d dedup chunks asked to the FD were not received.\n"),
+           m_pending->size());
+      return -1;
+   }
+   if (!m_engine->sync(errmsg)) {
+      return -1;
+   }
+   jcr->JobBytes += m_jobbytes;
+   m_jobbytes = 0;
+   if (m_nb_refs > 0) {
+      Jmsg(jcr, M_INFO, 0, _("Dedup: %s references (%s) from the FD, %s chunks (%s) sent to \"%s\".\n"),
+           edit_uint64_with_commas(m_nb_refs, ed1), edit_uint64_with_suffix(m_ref_bytes, ed2),
+           edit_uint64_with_commas(m_nb_asked, ed3), edit_uint64_with_suffix(m_asked_bytes, ed4),
+           m_engine->name());
+   }
+   if (m_nb_chunks > 0) {
+      Jmsg(jcr, M_INFO, 0, _("Dedup: %s chunks (%s) stored by the SD in \"%s\".\n"),
+           edit_uint64_with_commas(m_nb_chunks, ed1), edit_uint64_with_suffix(m_chunk_bytes, ed2),
+           m_engine->name());
+   }
+   Dmsg2(dbglvl, "Dedup commit of JobId=%d on \"%s\"\n", jobid, m_engine->name());
+   return 0;
+}
+
+/*
+ * Rehydration of the references read in a Dedup volume
+ */
+class DedupStoredInterface: public SMARTALLOC, public DedupStoredInterfaceBase
+{
+   DedupEngine *m_engine;
+   POOLMEM *m_msgbuf;
+
+public:
+   DedupStoredInterface(JCR *jcr, DedupEngine *engine):
+      DedupStoredInterfaceBase(jcr, engine), m_engine(engine)
+   {
+      m_msgbuf = get_pool_memory(PM_BSOCK);
+      m_msgbuf = check_pool_memory_size(m_msgbuf, OFFSET_FADDR_SIZE + DEDUP_MAX_BLOCK_SIZE + 1);
+   };
+   ~DedupStoredInterface() { free_pool_memory(m_msgbuf); };
+
+   bool do_flowcontrol_rehydration(int free_rec_count, int retry_timeoutms=250) { return true; };
+   POOLMEM *get_msgbuf() { return m_msgbuf; };
+   bool is_rehydration_srvside() { return true; };
+   int record_rehydration(DCR *dcr, DEV_RECORD *rec, char *buf, POOLMEM *&errmsg,
+                          bool despite_of_error, int *chunk_size);
+};
+
+/*
+ * Replace the reference of the record by the chunk, the offset of
+ *  the sparse data is kept. Returns 0 if OK, -1 on error.
+ */
+int DedupStoredInterface::record_rehydration(DCR *dcr, DEV_RECORD *rec, char *buf,
+                                             POOLMEM *&errmsg, bool despite_of_error,
+                                             int *chunk_size)
+{
+   unsigned char hash[DEDUP_HASH_SIZE];
+   uint32_t size;
+   char *ref = rec->data;
+   int32_t len = rec->data_len;
+   int32_t prefix = 0;
+   int n;
+
+   *chunk_size = 0;
+   if (is_offset_stream(rec->Stream)) {
+      prefix = OFFSET_FADDR_SIZE;
+      ref += prefix;
+      len -= prefix;
+   }
+   if (!dedup_decode_ref(ref, len, &size, hash)) {
+      Mmsg(errmsg, _("Malformed dedup reference in the volume, len=%d\n"), rec->data_len);
+      return -1;
+   }
+   memcpy(buf, rec->data, prefix);
+   n = m_engine->read_chunk(hash, buf + prefix, errmsg);
+   if (n < 0) {
+      return -1;
+   }
+   if ((uint32_t)n != size) {
+      Mmsg(errmsg, _("Dedup chunk #%08x has %d bytes instead of %d\n"),
+           hash2int(hash), n, size);
+      return -1;
+   }
+   rec->Stream &= ~STREAM_BIT_DEDUPLICATION_DATA;
+   rec->maskedStream = rec->Stream & STREAMMASK_TYPE;
+   *chunk_size = prefix + n;
+   return 0;
+}
+
+dedup_dev::dedup_dev(JCR *jcr, DEVRES *device)
+{
+   m_dedupengine = NULL;
+   m_refs = get_pool_memory(PM_BSOCK);
+}
+
+dedup_dev::~dedup_dev()
+{
+   free_pool_memory(m_refs);
+}
+
+int dedup_dev::device_specific_init(JCR *jcr, DEVRES *device)
+{
+   POOL_MEM errmsg(PM_MESSAGE);
+   int ret;
+
+   if ((ret = file_dev::device_specific_init(jcr, device)) != 0) {
+      return ret;
+   }
+   m_dedupengine = ::get_dedupengine(device->dedup,
+                                     device_default_open_mode == omd_rdonly,
+                                     errmsg.addr());
+   if (!m_dedupengine) {
+      Jmsg2(jcr, M_FATAL, 0, _("Unable to open the Dedupengine of the device %s. ERR=%s"),
+            device->hdr.name, errmsg.c_str());
+      return -1;
+   }
+   m_dedupengine->register_device(this);
+   return 0;
+}
+
+const char *dedup_dev::print_type()
+{
+   return "Dedup";
+}
+
+const char *dedup_dev::dedup_get_dedupengine_name()
+{
+   return m_dedupengine ? m_dedupengine->name() : "not_a_dedupengine";
+}
+
+/*
+ * Keep the hashes of the references written in the block, the
+ *  vacuum must not drop their chunks.
+ */
+ssize_t dedup_dev::d_write(int fd, const void *buffer, size_t count)
+{
+   const char *buf = (const char *)buffer;
+   const char *VolumeName;
+   int32_t FileIndex, Stream;
+   uint32_t data_len, pos, size;
+   unsigned char hash[DEDUP_HASH_SIZE];
+   int nb = 0;
+   unser_declare;
+
+   if (count > WRITE_BLKHDR_LENGTH &&
+       memcmp(buf + 3 * sizeof(uint32_t), WRITE_BLKHDR_ID, BLKHDR_ID_LENGTH) == 0) {
+      for (pos = WRITE_BLKHDR_LENGTH; pos + WRITE_RECHDR_LENGTH <= count; ) {
+         unser_begin(buf + pos, WRITE_RECHDR_LENGTH);
+         unser_int32(FileIndex);
+         unser_int32(Stream);
+         unser_uint32(data_len);
+         pos += WRITE_RECHDR_LENGTH;
+         if (data_len > count - pos) {
+            break;                    /* continued in the next block */
+         }
+         if (FileIndex > 0 && Stream > 0 && (Stream & STREAM_BIT_DEDUPLICATION_DATA)) {
+            const char *ref = buf + pos;
+            uint32_t len = data_len;
+            if (is_offset_stream(Stream) && len > OFFSET_FADDR_SIZE) {
+               ref += OFFSET_FADDR_SIZE;
+               len -= OFFSET_FADDR_SIZE;
+            }
+            if (dedup_decode_ref(ref, len, &size, hash)) {
+               m_refs = check_pool_memory_size(m_refs, (nb + 1) * DEDUP_HASH_SIZE);
+               memcpy(m_refs + nb * DEDUP_HASH_SIZE, hash, DEDUP_HASH_SIZE);
+               nb++;
+            }
+         }
+         pos += data_len;
+      }
+   }
+   if (nb > 0 && m_dedupengine) {
+      VolumeName = VolHdr.VolumeName[0] ? VolHdr.VolumeName : getVolCatName();
+      if (!m_dedupengine->add_refs(VolumeName, m_refs, nb, errmsg)) {
+         Dmsg1(dbglvl, "%s", errmsg);
+         errno = EIO;
+         return -1;
+      }
+   }
+   return file_dev::d_write(fd, buffer, count);
+}
+
+/* The references of the volume are gone, the vacuum can drop the chunks */
+bool dedup_dev::truncate(DCR *dcr)
+{
+   if (!DEVICE::truncate(dcr)) {
+      return false;
+   }
+   if (m_dedupengine) {
+      m_dedupengine->remove_refs(VolHdr.VolumeName);
+      if (dcr && strcmp(dcr->VolumeName, VolHdr.VolumeName) != 0) {
+         m_dedupengine->remove_refs(dcr->VolumeName);
+      }
+   }
+   return true;
+}
+
+bool dedup_dev::close(DCR *dcr)
+{
+   bool ok = DEVICE::close(dcr);
+
+   if (m_dedupengine && num_writers == 0) {
+      m_dedupengine->vacuum(dcr ? dcr->jcr : NULL);
+   }
+   return ok;
+}
+
+void dedup_dev::term(DCR *dcr)
+{
+   if (m_dedupengine) {
+      m_dedupengine->unregister_device(this);
+      release_dedupengine(device->dedup);
+      m_dedupengine = NULL;
+   }
+   DEVICE::term(dcr);
+}
+
+GetMsg *dedup_dev::get_msg_queue(JCR *jcr, BSOCK *sock, int32_t bufsize)
+{
+   if (!m_dedupengine || m_dedupengine->is_readonly()) {
+      return DEVICE::get_msg_queue(jcr, sock, bufsize);
+   }
+   return New(DedupGetMsg(jcr, sock, m_dedupengine, bufsize));
+}
+
+bool dedup_dev::setup_dedup_rehydration_interface(DCR *dcr)
+{
+   JCR *jcr = dcr->jcr;
+
+   if (jcr->dedup) {
+      return true;
+   }
+   if (!m_dedupengine) {
+      return false;
+   }
+   jcr->dedup = New(DedupStoredInterface(jcr, m_dedupengine));
+   return true;
+}
+
+void dedup_dev::free_dedup_rehydration_interface(DCR *dcr)
+{
+   JCR *jcr = dcr->jcr;
+
+   if (jcr->dedup) {
+      delete jcr->dedup;
+      jcr->dedup = NULL;
+   }
+}
+
+int dedup_dev::dedup_edit_status(POOLMEM *&msg)
+{
+   return m_dedupengine ? m_dedupengine->get_status(msg) : 0;
+}
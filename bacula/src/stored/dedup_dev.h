@@ -0,0 +1,61 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+*/
+/*
+ * Dedup device, the volumes are file volumes where the data
+ *  records hold the references of the chunks, and the chunks
+ *  are in the containers of the Dedupengine.
+ */
+
+#ifndef _DEDUP_DEV_H_
+#define _DEDUP_DEV_H_
+
+/* Dedupengine drivers, see "Driver" in the Dedupengine resource */
+enum {
+   D_LEGACY_DRIVER = 1
+};
+
+class DedupEngine;
+
+class dedup_dev : public file_dev {
+   DedupEngine *m_dedupengine;
+   POOLMEM *m_refs;                   /* hashes of the refs of a block */
+
+public:
+   dedup_dev(JCR *jcr, DEVRES *device);
+   ~dedup_dev();
+
+   DedupEngine *get_dedupengine() { return m_dedupengine; };
+
+   /* DEVICE virtual functions that we redefine */
+   int device_specific_init(JCR *jcr, DEVRES *device);
+   ssize_t d_write(int fd, const void *buffer, size_t count);
+   bool truncate(DCR *dcr);
+   bool close(DCR *dcr);
+   void term(DCR *dcr);
+   const char *print_type();
+
+   bool setup_dedup_rehydration_interface(DCR *dcr);
+   void free_dedup_rehydration_interface(DCR *dcr);
+   GetMsg *get_msg_queue(JCR *jcr, BSOCK *sock, int32_t bufsize);
+   void *dedup_get_dedupengine() { return m_dedupengine; };
+   int dedup_edit_status(POOLMEM *&msg);
+   const char *dedup_get_dedupengine_name();
+};
+
+#endif /* _DEDUP_DEV_H_ */
@@ -0,0 +1,996 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+*/
+/*
+ * Dedupengine of the Dedup devices, see dedupengine.h for the
+ *  format of the files.
+ */
+
+#include "bacula.h"
+#include "stored.h"
+#include "dedupengine.h"
+
+static const int dbglvl = DT_DEDUP|100;
+
+/* The engines are shared by the devices of a Dedupengine resource */
+static pthread_mutex_t engine_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Statistics of the containers, used by the vacuum */
+struct dedup_container {
+   hlink link;
+   uint32_t container;
+   uint64_t size;                     /* of the file */
+   uint64_t live;                     /* bytes still referenced */
+   bool compact;                      /* copy the live chunks then delete */
+};
+
+static uint64_t hash_key(const unsigned char *hash)
+{
+   uint64_t key;
+   memcpy(&key, hash, sizeof(key));
+   return key;
+}
+
+DedupEngine::DedupEngine(DEDUPRES *res, bool readonly)
+{
+   pthread_mutex_init(&m_mutex, NULL);
+   m_name = bstrdup(res->hdr.name);
+   m_dir = get_pool_memory(PM_FNAME);
+   pm_strcpy(m_dir, res->dedup_dir);
+   m_index_dir = get_pool_memory(PM_FNAME);
+   pm_strcpy(m_index_dir, res->dedup_index_dir ? res->dedup_index_dir : res->dedup_dir);
+   m_max_container_size = res->max_container_size > 0 ?
+      res->max_container_size : DEDUP_DEFAULT_CONTAINER_SIZE;
+   m_check_hash = res->dedup_check_hash;
+   m_readonly = readonly;
+   m_index = NULL;
+   m_index_fd = m_container_fd = m_read_fd = -1;
+   m_container = m_read_container = 0;
+   m_container_size = 0;
+   m_devices = New(alist(5, not_owned_by_alist));
+   m_writers = 0;
+   m_need_vacuum = false;
+   m_buf = get_pool_memory(PM_BSOCK);
+   m_nb_chunks = m_chunk_bytes = 0;
+   m_nb_new = m_new_bytes = m_nb_dup = m_dup_bytes = m_nb_read = 0;
+   m_last_vacuum = 0;
+}
+
+DedupEngine::~DedupEngine()
+{
+   close();
+   delete m_devices;
+   free_pool_memory(m_dir);
+   free_pool_memory(m_index_dir);
+   free_pool_memory(m_buf);
+   free(m_name);
+   pthread_mutex_destroy(&m_mutex);
+}
+
+void DedupEngine::index_fname(POOLMEM *&fname, const char *ext)
+{
+   Mmsg(fname, "%s/bacula-dedup.%s", m_index_dir, ext);
+}
+
+void DedupEngine::container_fname(POOLMEM *&fname, uint32_t container)
+{
+   Mmsg(fname, "%s/bacula-dedup-%06u.bdc", m_dir, container);
+}
+
+void DedupEngine::refs_fname(POOLMEM *&fname, const char *VolumeName)
+{
+   Mmsg(fname, "%s/refs/%s.ref", m_dir, VolumeName);
+}
+
+void DedupEngine::vacuum_fname(POOLMEM *&fname)
+{
+   Mmsg(fname, "%s/refs/vacuum-needed", m_dir);
+}
+
+dedup_entry *DedupEngine::lookup(const unsigned char *hash)
+{
+   dedup_entry *entry = (dedup_entry *)m_index->lookup(hash_key(hash));
+
+   for ( ; entry; entry = entry->next) {
+      if (memcmp(entry->hash, hash, DEDUP_HASH_SIZE) == 0) {
+         return entry;
+      }
+   }
+   return NULL;
+}
+
+/* Add an entry, or update it if the chunk is already in the index */
+dedup_entry *DedupEngine::add_entry(const unsigned char *hash, uint32_t container,
+                                    uint32_t size, uint64_t offset)
+{
+   dedup_entry *entry = lookup(hash);
+
+   if (!entry) {
+      entry = (dedup_entry *)m_index->hash_malloc(sizeof(dedup_entry));
+      memset(entry, 0, sizeof(dedup_entry));
+      memcpy(entry->hash, hash, DEDUP_HASH_SIZE);
+      dedup_entry *first = (dedup_entry *)m_index->lookup(hash_key(hash));
+      if (first) {
+         /* Same 64 bit key, chain it after the first one */
+         entry->next = first->next;
+         first->next = entry;
+      } else {
+         m_index->insert(hash_key(hash), entry);
+      }
+      m_nb_chunks++;
+   } else {
+      m_chunk_bytes -= entry->size;
+   }
+   entry->container = container;
+   entry->size = size;
+   entry->offset = offset;
+   m_chunk_bytes += size;
+   return entry;
+}
+
+/*
+ * Load the index in memory, cut a partial entry at the end, and
+ *  find where the next chunk goes.
+ */
+bool DedupEngine::load_index(POOLMEM *&errmsg)
+{
+   POOL_MEM fname(PM_FNAME);
+   char hdr[DEDUP_INDEX_HDR_SIZE];
+   const int bufsize = DEDUP_INDEX_ENTRY_SIZE * 1024;
+   char *buf;
+   uint32_t magic, version;
+   uint64_t pos;
+   int n, len;
+   bool ok = false;
+   unser_declare;
+
+   dedup_entry *item = NULL;
+   m_index = New(htable(item, &item->link, 64 * 1024));
+   m_container = 1;
+   m_container_size = 0;
+
+   index_fname(fname.addr(), "idx");
+   m_index_fd = ::open(fname.c_str(),
+                       (m_readonly ? O_RDONLY : O_RDWR|O_CREAT)|O_BINARY|O_CLOEXEC, 0640);
+   if (m_index_fd < 0) {
+      berrno be;
+      if (m_readonly && errno == ENOENT) {
+         return true;                 /* nothing stored yet */
+      }
+      Mmsg(errmsg, _("Unable to open the dedup index %s. ERR=%s\n"),
+           fname.c_str(), be.bstrerror());
+      return false;
+   }
+   n = read(m_index_fd, hdr, sizeof(hdr));
+   if (n == 0 && !m_readonly) {
+      ser_declare;
+      ser_begin(hdr, sizeof(hdr));
+      ser_uint32((uint32_t)DEDUP_INDEX_MAGIC);
+      ser_uint32((uint32_t)1);
+      if (write(m_index_fd, hdr, sizeof(hdr)) != (ssize_t)sizeof(hdr)) {
+         berrno be;
+         Mmsg(errmsg, _("Unable to write the dedup index %s. ERR=%s\n"),
+              fname.c_str(), be.bstrerror());
+         return false;
+      }
+      return true;
+   }
+   if (n == 0) {
+      return true;
+   }
+   unser_begin(hdr, sizeof(hdr));
+   unser_uint32(magic);
+   unser_uint32(version);
+   if (n != (int)sizeof(hdr) || magic != DEDUP_INDEX_MAGIC || version != 1) {
+      Mmsg(errmsg, _("%s is not a dedup index.\n"), fname.c_str());
+      return false;
+   }
+
+   buf = (char *)malloc(bufsize);
+   pos = sizeof(hdr);
+   len = 0;
+   while ((n = read(m_index_fd, buf + len, bufsize - len)) > 0) {
+      len += n;
+      int i;
+      for (i = 0; i + (int)DEDUP_INDEX_ENTRY_SIZE <= len; i += DEDUP_INDEX_ENTRY_SIZE) {
+         unsigned char hash[DEDUP_HASH_SIZE];
+         uint32_t container, size;
+         uint64_t offset;
+         unser_begin(buf + i, DEDUP_INDEX_ENTRY_SIZE);
+         unser_bytes(hash, DEDUP_HASH_SIZE);
+         unser_uint32(container);
+         unser_uint32(size);
+         unser_uint64(offset);
+         add_entry(hash, container, size, offset);
+         if (container > m_container) {
+            m_container = container;
+            m_container_size = 0;
+         }
+         if (container == m_container) {
+            m_container_size = MAX(m_container_size, offset + DEDUP_CHUNK_HDR_SIZE + size);
+         }
+         pos += DEDUP_INDEX_ENTRY_SIZE;
+      }
+      /* Keep the partial entry for the next read */
+      memmove(buf, buf + i, len - i);
+      len -= i;
+   }
+   if (n < 0) {
+      berrno be;
+      Mmsg(errmsg, _("Read error on the dedup index %s. ERR=%s\n"),
+           fname.c_str(), be.bstrerror());
+      goto bail_out;
+   }
+   if (len > 0 && !m_readonly) {
+      /* The last entry was not fully written */
+      Dmsg2(dbglvl, "Cut %d bytes at the end of %s\n", len, fname.c_str());
+      if (ftruncate(m_index_fd, pos) != 0) {
+         berrno be;
+         Mmsg(errmsg, _("Unable to truncate the dedup index %s. ERR=%s\n"),
+              fname.c_str(), be.bstrerror());
+         goto bail_out;
+      }
+   }
+   if (lseek(m_index_fd, pos, SEEK_SET) < 0) {
+      berrno be;
+      Mmsg(errmsg, _("Unable to seek in the dedup index %s. ERR=%s\n"),
+           fname.c_str(), be.bstrerror());
+      goto bail_out;
+   }
+   ok = true;
+
+bail_out:
+   free(buf);
+   return ok;
+}
+
+/*
+ * Open the container where the new chunks go. The chunks after the
+ *  size known by the index have no entry, they are cut.
+ */
+bool DedupEngine::open_container(uint32_t container, uint64_t size, POOLMEM *&errmsg)
+{
+   POOL_MEM fname(PM_FNAME);
+   struct stat statp;
+
+   if (m_container_fd >= 0) {
+      ::close(m_container_fd);
+   }
+   container_fname(fname.addr(), container);
+   m_container_fd = ::open(fname.c_str(), O_RDWR|O_CREAT|O_BINARY|O_CLOEXEC, 0640);
+   if (m_container_fd < 0) {
+      berrno be;
+      Mmsg(errmsg, _("Unable to open the dedup container %s. ERR=%s\n"),
+           fname.c_str(), be.bstrerror());
+      return false;
+   }
+   if (fstat(m_container_fd, &statp) != 0) {
+      berrno be;
+      Mmsg(errmsg, _("Unable to stat the dedup container %s. ERR=%s\n"),
+           fname.c_str(), be.bstrerror());
+      return false;
+   }
+   if ((uint64_t)statp.st_size < size) {
+      Mmsg(errmsg, _("The dedup container %s is shorter than its index, %lld bytes instead of %lld.\n"),
+           fname.c_str(), (int64_t)statp.st_size, size);
+      return false;
+   }
+   if ((uint64_t)statp.st_size > size) {
+      Dmsg3(dbglvl, "Cut %s from %lld to %lld bytes\n", fname.c_str(),
+            (int64_t)statp.st_size, size);
+      if (ftruncate(m_container_fd, size) != 0) {
+         berrno be;
+         Mmsg(errmsg, _("Unable to truncate the dedup container %s. ERR=%s\n"),
+              fname.c_str(), be.bstrerror());
+         return false;
+      }
+   }
+   m_container = container;
+   m_container_size = size;
+   return true;
+}
+
+bool DedupEngine::open(POOLMEM *&errmsg)
+{
+   POOL_MEM fname(PM_FNAME);
+   struct stat statp;
+
+   if (!m_readonly) {
+      Mmsg(fname, "%s/refs", m_dir);
+      if (mkdir(fname.c_str(), 0750) != 0 && errno != EEXIST) {
+         berrno be;
+         Mmsg(errmsg, _("Unable to create the directory %s. ERR=%s\n"),
+              fname.c_str(), be.bstrerror());
+         return false;
+      }
+   }
+   if (!load_index(errmsg)) {
+      return false;
+   }
+   if (!m_readonly && !open_container(m_container, m_container_size, errmsg)) {
+      return false;
+   }
+   vacuum_fname(fname.addr());
+   m_need_vacuum = stat(fname.c_str(), &statp) == 0;
+   Dmsg4(dbglvl, "Dedupengine %s opened readonly=%d chunks=%lld container=%d\n",
+         m_name, m_readonly, m_nb_chunks, m_container);
+   return true;
+}
+
+void DedupEngine::close()
+{
+   POOLMEM *errmsg;
+
+   if (m_container_fd >= 0 || m_index_fd >= 0) {
+      errmsg = get_pool_memory(PM_MESSAGE);
+      if (!m_readonly && !sync(errmsg)) {
+         Qmsg(NULL, M_ERROR, 0, "%s", errmsg);
+      }
+      free_pool_memory(errmsg);
+   }
+   if (m_container_fd >= 0) {
+      ::close(m_container_fd);
+      m_container_fd = -1;
+   }
+   if (m_read_fd >= 0) {
+      ::close(m_read_fd);
+      m_read_fd = -1;
+   }
+   if (m_index_fd >= 0) {
+      ::close(m_index_fd);
+      m_index_fd = -1;
+   }
+   if (m_index) {
+      delete m_index;
+      m_index = NULL;
+   }
+}
+
+/* Append a chunk to the current container, start a new one if full */
+bool DedupEngine::write_chunk(const unsigned char *hash, const char *buf, uint32_t size,
+                              uint32_t *container, uint64_t *offset, POOLMEM *&errmsg)
+{
+   uint32_t len = DEDUP_CHUNK_HDR_SIZE + size;
+   ser_declare;
+
+   if (m_container_size > 0 && m_container_size + len > m_max_container_size) {
+      if (!open_container(m_container + 1, 0, errmsg)) {
+         return false;
+      }
+   }
+   m_buf = check_pool_memory_size(m_buf, len);
+   ser_begin(m_buf, DEDUP_CHUNK_HDR_SIZE);
+   ser_uint32((uint32_t)DEDUP_CONTAINER_MAGIC);
+   ser_uint32(size);
+   ser_bytes(hash, DEDUP_HASH_SIZE);
+   memcpy(m_buf + DEDUP_CHUNK_HDR_SIZE, buf, size);
+   if (pwrite(m_container_fd, m_buf, len, m_container_size) != (ssize_t)len) {
+      berrno be;
+      Mmsg(errmsg, _("Write error on the dedup container %d of \"%s\". ERR=%s\n"),
+           m_container, m_name, be.bstrerror());
+      return false;
+   }
+   *container = m_container;
+   *offset = m_container_size;
+   m_container_size += len;
+   return true;
+}
+
+bool DedupEngine::write_entry(int fd, dedup_entry *entry, POOLMEM *&errmsg)
+{
+   char buf[DEDUP_INDEX_ENTRY_SIZE];
+   ser_declare;
+
+   ser_begin(buf, DEDUP_INDEX_ENTRY_SIZE);
+   ser_bytes(entry->hash, DEDUP_HASH_SIZE);
+   ser_uint32(entry->container);
+   ser_uint32(entry->size);
+   ser_uint64(entry->offset);
+   if (write(fd, buf, DEDUP_INDEX_ENTRY_SIZE) != DEDUP_INDEX_ENTRY_SIZE) {
+      berrno be;
+      Mmsg(errmsg, _("Write error on the dedup index of \"%s\". ERR=%s\n"),
+           m_name, be.bstrerror());
+      return false;
+   }
+   return true;
+}
+
+/* Read the chunk of an entry, returns its size or -1 */
+int DedupEngine::read_at(dedup_entry *entry, char *buf, POOLMEM *&errmsg)
+{
+   POOL_MEM fname(PM_FNAME);
+   char hdr[DEDUP_CHUNK_HDR_SIZE];
+   unsigned char hash[DEDUP_HASH_SIZE];
+   uint32_t magic, size;
+   unser_declare;
+
+   container_fname(fname.addr(), entry->container);
+   if (m_read_fd < 0 || m_read_container != entry->container) {
+      if (m_read_fd >= 0) {
+         ::close(m_read_fd);
+      }
+      m_read_fd = ::open(fname.c_str(), O_RDONLY|O_BINARY|O_CLOEXEC);
+      if (m_read_fd < 0) {
+         berrno be;
+         Mmsg(errmsg, _("Unable to open the dedup container %s. ERR=%s\n"),
+              fname.c_str(), be.bstrerror());
+         return -1;
+      }
+      m_read_container = entry->container;
+   }
+   if (pread(m_read_fd, hdr, sizeof(hdr), entry->offset) != (ssize_t)sizeof(hdr) ||
+       pread(m_read_fd, buf, entry->size, entry->offset + sizeof(hdr)) != (ssize_t)entry->size) {
+      berrno be;
+      Mmsg(errmsg, _("Read error on the dedup container %s at %lld. ERR=%s\n"),
+           fname.c_str(), entry->offset, be.bstrerror());
+      return -1;
+   }
+   unser_begin(hdr, sizeof(hdr));
+   unser_uint32(magic);
+   unser_uint32(size);
+   unser_bytes(hash, DEDUP_HASH_SIZE);
+   if (magic != DEDUP_CONTAINER_MAGIC || size != entry->size ||
+       memcmp(hash, entry->hash, DEDUP_HASH_SIZE) != 0) {
+      Mmsg(errmsg, _("Bad chunk header in the dedup container %s at %lld.\n"),
+           fname.c_str(), entry->offset);
+      return -1;
+   }
+   return size;
+}
+
+void DedupEngine::inc_writers()
+{
+   P(m_mutex);
+   m_writers++;
+   V(m_mutex);
+}
+
+void DedupEngine::dec_writers()
+{
+   P(m_mutex);
+   m_writers--;
+   V(m_mutex);
+}
+
+bool DedupEngine::is_known(const unsigned char *hash)
+{
+   bool known;
+
+   P(m_mutex);
+   known = lookup(hash) != NULL;
+   V(m_mutex);
+   return known;
+}
+
+/* Store a chunk if it is not already known */
+bool DedupEngine::store_chunk(const unsigned char *hash, const char *buf, uint32_t size,
+                              bool *is_new, POOLMEM *&errmsg)
+{
+   uint32_t container;
+   uint64_t offset;
+   bool ok = false;
+
+   P(m_mutex);
+   if (m_readonly) {
+      Mmsg(errmsg, _("Dedupengine \"%s\" is opened read only.\n"), m_name);
+      goto bail_out;
+   }
+   if (lookup(hash)) {
+      m_nb_dup++;
+      m_dup_bytes += size;
+      *is_new = false;
+      ok = true;
+      goto bail_out;
+   }
+   if (!write_chunk(hash, buf, size, &container, &offset, errmsg)) {
+      goto bail_out;
+   }
+   if (!write_entry(m_index_fd, add_entry(hash, container, size, offset), errmsg)) {
+      goto bail_out;
+   }
+   m_nb_new++;
+   m_new_bytes += size;
+   *is_new = true;
+   ok = true;
+
+bail_out:
+   V(m_mutex);
+   return ok;
+}
+
+/* Flush the containers and the index, done at the end of a backup */
+bool DedupEngine::sync(POOLMEM *&errmsg)
+{
+   bool ok = true;
+
+   P(m_mutex);
+   if (m_container_fd >= 0 && fsync(m_container_fd) != 0) {
+      berrno be;
+      Mmsg(errmsg, _("Unable to sync the dedup container of \"%s\". ERR=%s\n"),
+           m_name, be.bstrerror());
+      ok = false;
+   }
+   if (ok && m_index_fd >= 0 && !m_readonly && fsync(m_index_fd) != 0) {
+      berrno be;
+      Mmsg(errmsg, _("Unable to sync the dedup index of \"%s\". ERR=%s\n"),
+           m_name, be.bstrerror());
+      ok = false;
+   }
+   V(m_mutex);
+   return ok;
+}
+
+/* Read a chunk into buf, returns its size or -1 */
+int DedupEngine::read_chunk(const unsigned char *hash, char *buf, POOLMEM *&errmsg)
+{
+   dedup_entry *entry;
+   int size = -1;
+
+   P(m_mutex);
+   entry = lookup(hash);
+   if (!entry) {
+      Mmsg(errmsg, _("Chunk #%08x not found in the Dedupengine \"%s\".\n"),
+           hash2int(hash), m_name);
+      goto bail_out;
+   }
+   size = read_at(entry, buf, errmsg);
+   if (size > 0 && m_check_hash) {
+      unsigned char hash2[DEDUP_HASH_SIZE];
+      dedup_hash(buf, size, hash2);
+      if (memcmp(hash, hash2, DEDUP_HASH_SIZE) != 0) {
+         Mmsg(errmsg, _("Bad hash for the chunk at %lld in the container %d of \"%s\".\n"),
+              entry->offset, entry->container, m_name);
+         size = -1;
+      }
+   }
+   if (size > 0) {
+      m_nb_read++;
+   }
+
+bail_out:
+   V(m_mutex);
+   return size;
+}
+
+/* Remember the hashes of the references written in a volume */
+bool DedupEngine::add_refs(const char *VolumeName, const char *hashes, int nb,
+                           POOLMEM *&errmsg)
+{
+   POOL_MEM fname(PM_FNAME);
+   int fd;
+   bool ok = true;
+   ssize_t len = nb * DEDUP_HASH_SIZE;
+
+   refs_fname(fname.addr(), VolumeName);
+   fd = ::open(fname.c_str(), O_WRONLY|O_APPEND|O_CREAT|O_BINARY|O_CLOEXEC, 0640);
+   if (fd < 0 || write(fd, hashes, len) != len) {
+      berrno be;
+      Mmsg(errmsg, _("Unable to write the dedup references %s. ERR=%s\n"),
+           fname.c_str(), be.bstrerror());
+      ok = false;
+   }
+   if (fd >= 0) {
+      ::close(fd);
+   }
+   return ok;
+}
+
+/* The volume is truncated, its chunks may be dropped by the vacuum */
+void DedupEngine::remove_refs(const char *VolumeName)
+{
+   POOL_MEM fname(PM_FNAME);
+   int fd;
+
+   if (!VolumeName || !*VolumeName) {
+      return;
+   }
+   refs_fname(fname.addr(), VolumeName);
+   if (unlink(fname.c_str()) != 0) {
+      return;                         /* no reference in this volume */
+   }
+   Dmsg2(dbglvl, "Removed the references of %s in \"%s\"\n", VolumeName, m_name);
+   P(m_mutex);
+   m_need_vacuum = true;
+   vacuum_fname(fname.addr());
+   if ((fd = ::open(fname.c_str(), O_WRONLY|O_CREAT|O_CLOEXEC, 0640)) >= 0) {
+      ::close(fd);
+   }
+   V(m_mutex);
+}
+
+void DedupEngine::register_device(DEVICE *dev)
+{
+   P(m_mutex);
+   m_devices->append(dev);
+   V(m_mutex);
+}
+
+void DedupEngine::unregister_device(DEVICE *dev)
+{
+   P(m_mutex);
+   for (int i = 0; i < m_devices->size(); i++) {
+      if (m_devices->get(i) == dev) {
+         m_devices->remove(i);
+         break;
+      }
+   }
+   V(m_mutex);
+}
+
+/*
+ * A backup in progress may have references to chunks that are not
+ *  yet in a volume, the vacuum must wait.
+ */
+bool DedupEngine::is_busy()
+{
+   DEVICE *dev;
+
+   if (m_writers > 0) {
+      return true;
+   }
+   foreach_alist(dev, m_devices) {
+      if (dev->num_writers > 0) {
+         return true;
+      }
+   }
+   return false;
+}
+
+/* Mark the chunks referenced by the volumes */
+bool DedupEngine::mark_refs(POOLMEM *&errmsg)
+{
+   POOL_MEM dname(PM_FNAME), fname(PM_FNAME);
+   const int bufsize = DEDUP_HASH_SIZE * 1024;
+   char *buf;
+   DIR *dp;
+   int fd, n, len, status;
+   uint64_t unknown = 0;
+   bool ok = false;
+
+   Mmsg(dname, "%s/refs", m_dir);
+   if ((dp = opendir(dname.c_str())) == NULL) {
+      berrno be;
+      Mmsg(errmsg, _("Unable to open the directory %s. ERR=%s\n"),
+           dname.c_str(), be.bstrerror());
+      return false;
+   }
+   buf = (char *)malloc(bufsize);
+   for ( ;; ) {
+      status = breaddir(dp, fname.addr());
+      if (status == -1) {
+         break;
+      } else if (status > 0) {
+         berrno be;
+         Mmsg(errmsg, _("Unable to read the directory %s. ERR=%s\n"),
+              dname.c_str(), be.bstrerror(status));
+         goto bail_out;
+      }
+      len = strlen(fname.c_str());
+      if (len < 5 || strcmp(fname.c_str() + len - 4, ".ref") != 0) {
+         continue;
+      }
+      Mmsg(dname, "%s/refs/%s", m_dir, fname.c_str());
+      if ((fd = ::open(dname.c_str(), O_RDONLY|O_BINARY|O_CLOEXEC)) < 0) {
+         berrno be;
+         Mmsg(errmsg, _("Unable to open the dedup references %s. ERR=%s\n"),
+              dname.c_str(), be.bstrerror());
+         goto bail_out;
+      }
+      fsync(fd);                      /* must survive a crash after the vacuum */
+      len = 0;
+      while ((n = read(fd, buf + len, bufsize - len)) > 0) {
+         len += n;
+         int i;
+         for (i = 0; i + DEDUP_HASH_SIZE <= len; i += DEDUP_HASH_SIZE) {
+            dedup_entry *entry = lookup((unsigned char *)buf + i);
+            if (entry) {
+               entry->mark = true;
+            } else {
+               unknown++;
+            }
+         }
+         memmove(buf, buf + i, len - i);
+         len -= i;
+      }
+      ::close(fd);
+      if (n < 0) {
+         berrno be;
+         Mmsg(errmsg, _("Unable to read the dedup references %s. ERR=%s\n"),
+              dname.c_str(), be.bstrerror());
+         goto bail_out;
+      }
+      Mmsg(dname, "%s/refs", m_dir);
+   }
+   if (unknown > 0) {
+      char ed1[50];
+      Qmsg(NULL, M_WARNING, 0, _("Dedupengine \"%s\": %s references to unknown chunks.\n"),
+           m_name, edit_uint64(unknown, ed1));
+   }
+   ok = true;
+
+bail_out:
+   closedir(dp);
+   free(buf);
+   return ok;
+}
+
+/*
+ * Drop the chunks that are no longer referenced. A container without
+ *  any live chunk is deleted, a container with less than half of live
+ *  data is compacted by copying its live chunks at the end of the
+ *  current container. The new index is written in a new file that
+ *  replaces the old one, then the old containers are removed.
+ */
+bool DedupEngine::do_vacuum(JCR *jcr, POOLMEM *&errmsg)
+{
+   POOL_MEM fname(PM_FNAME), tname(PM_FNAME);
+   char hdr[DEDUP_INDEX_HDR_SIZE];
+   dedup_entry *entry, *e, *item = NULL;
+   dedup_container *cont, *citem = NULL;
+   htable *containers, *old;
+   struct stat statp;
+   uint64_t nb_dead = 0, dead_bytes = 0, nb_moved = 0;
+   int nb_deleted = 0, nb_compacted = 0, fd = -1;
+   bool ok = false;
+   char ed1[50], ed2[50];
+   ser_declare;
+
+   Jmsg(jcr, M_INFO, 0, _("Dedupengine \"%s\": start the vacuum of %s chunks.\n"),
+        m_name, edit_uint64_with_commas(m_nb_chunks, ed1));
+
+   /* Mark the live chunks */
+   foreach_htable(entry, m_index) {
+      for (e = entry; e; e = e->next) {
+         e->mark = false;
+      }
+   }
+   if (!mark_refs(errmsg)) {
+      return false;
+   }
+
+   /* Live bytes by container */
+   containers = New(htable(citem, &citem->link, 1024));
+   foreach_htable(entry, m_index) {
+      for (e = entry; e; e = e->next) {
+         cont = (dedup_container *)containers->lookup((uint64_t)e->container);
+         if (!cont) {
+            cont = (dedup_container *)containers->hash_malloc(sizeof(dedup_container));
+            memset(cont, 0, sizeof(dedup_container));
+            cont->container = e->container;
+            container_fname(fname.addr(), e->container);
+            cont->size = stat(fname.c_str(), &statp) == 0 ? statp.st_size : 0;
+            containers->insert((uint64_t)e->container, cont);
+         }
+         if (e->mark) {
+            cont->live += DEDUP_CHUNK_HDR_SIZE + e->size;
+         } else {
+            nb_dead++;
+            dead_bytes += e->size;
+         }
+      }
+   }
+   foreach_htable(cont, containers) {
+      cont->compact = cont->container != m_container && cont->live > 0 &&
+                      cont->live < cont->size / 2;
+      if (cont->compact) {
+         nb_compacted++;
+      }
+   }
+
+   /* Copy the live chunks of the containers to compact */
+   foreach_htable(entry, m_index) {
+      for (e = entry; e; e = e->next) {
+         if (!e->mark) {
+            continue;
+         }
+         cont = (dedup_container *)containers->lookup((uint64_t)e->container);
+         if (!cont || !cont->compact) {
+            continue;
+         }
+         m_buf = check_pool_memory_size(m_buf, e->size + DEDUP_CHUNK_HDR_SIZE);
+         POOLMEM *data = get_pool_memory(PM_BSOCK);
+         data = check_pool_memory_size(data, e->size);
+         bool copied = read_at(e, data, errmsg) >= 0 &&
+                       write_chunk(e->hash, data, e->size, &e->container, &e->offset, errmsg);
+         free_pool_memory(data);
+         if (!copied) {
+            goto bail_out;
+         }
+         nb_moved++;
+      }
+   }
+   if (m_container_fd >= 0 && fsync(m_container_fd) != 0) {
+      berrno be;
+      Mmsg(errmsg, _("Unable to sync the dedup container of \"%s\". ERR=%s\n"),
+           m_name, be.bstrerror());
+      goto bail_out;
+   }
+
+   /* Write the new index with the live chunks */
+   index_fname(tname.addr(), "idx.new");
+   fd = ::open(tname.c_str(), O_WRONLY|O_CREAT|O_TRUNC|O_BINARY|O_CLOEXEC, 0640);
+   if (fd < 0) {
+      berrno be;
+      Mmsg(errmsg, _("Unable to create the dedup index %s. ERR=%s\n"),
+           tname.c_str(), be.bstrerror());
+      goto bail_out;
+   }
+   ser_begin(hdr, sizeof(hdr));
+   ser_uint32((uint32_t)DEDUP_INDEX_MAGIC);
+   ser_uint32((uint32_t)1);
+   if (write(fd, hdr, sizeof(hdr)) != (ssize_t)sizeof(hdr)) {
+      berrno be;
+      Mmsg(errmsg, _("Unable to write the dedup index %s. ERR=%s\n"),
+           tname.c_str(), be.bstrerror());
+      goto bail_out;
+   }
+   foreach_htable(entry, m_index) {
+      for (e = entry; e; e = e->next) {
+         if (e->mark && !write_entry(fd, e, errmsg)) {
+            goto bail_out;
+         }
+      }
+   }
+   if (fsync(fd) != 0) {
+      berrno be;
+      Mmsg(errmsg, _("Unable to sync the dedup index %s. ERR=%s\n"),
+           tname.c_str(), be.bstrerror());
+      goto bail_out;
+   }
+   index_fname(fname.addr(), "idx");
+   if (rename(tname.c_str(), fname.c_str()) != 0) {
+      berrno be;
+      Mmsg(errmsg, _("Unable to rename the dedup index %s. ERR=%s\n"),
+           tname.c_str(), be.bstrerror());
+      goto bail_out;
+   }
+   ::close(m_index_fd);
+   m_index_fd = fd;
+   fd = -1;
+
+   /* Keep only the live chunks in memory */
+   old = m_index;
+   m_index = New(htable(item, &item->link, 64 * 1024));
+   m_nb_chunks = m_chunk_bytes = 0;
+   foreach_htable(entry, old) {
+      for (e = entry; e; e = e->next) {
+         if (e->mark) {
+            add_entry(e->hash, e->container, e->size, e->offset);
+         }
+      }
+   }
+   delete old;
+
+   /* A current container without live chunks is replaced by a new one */
+   cont = (dedup_container *)containers->lookup((uint64_t)m_container);
+   if (cont && cont->live == 0 && nb_moved == 0 &&
+       !open_container(m_container + 1, 0, errmsg)) {
+      goto bail_out;
+   }
+
+   /* Now the old containers can go */
+   if (m_read_fd >= 0) {
+      ::close(m_read_fd);
+      m_read_fd = -1;
+   }
+   foreach_htable(cont, containers) {
+      if (cont->container != m_container && (cont->live == 0 || cont->compact)) {
+         container_fname(fname.addr(), cont->container);
+         unlink(fname.c_str());
+         if (cont->live == 0) {
+            nb_deleted++;
+         }
+      }
+   }
+   vacuum_fname(fname.addr());
+   unlink(fname.c_str());
+   m_need_vacuum = false;
+   m_last_vacuum = time(NULL);
+   Jmsg(jcr, M_INFO, 0, _("Dedupengine \"%s\": vacuum dropped %s chunks (%s bytes), "
+        "deleted %d containers, compacted %d containers (%s chunks moved).\n"),
+        m_name, edit_uint64_with_commas(nb_dead, ed1),
+        edit_uint64_with_suffix(dead_bytes, ed2), nb_deleted, nb_compacted,
+        edit_uint64_with_commas(nb_moved, fname.c_str()));
+   ok = true;
+
+bail_out:
+   if (fd >= 0) {
+      ::close(fd);
+      unlink(tname.c_str());
+   }
+   delete containers;
+   return ok;
+}
+
+/* Run the vacuum if a volume was truncated and no backup is running */
+void DedupEngine::vacuum(JCR *jcr)
+{
+   POOLMEM *errmsg;
+
+   P(m_mutex);
+   if (!m_need_vacuum || m_readonly || is_busy()) {
+      V(m_mutex);
+      return;
+   }
+   errmsg = get_pool_memory(PM_MESSAGE);
+   if (!do_vacuum(jcr, errmsg)) {
+      Jmsg(jcr, M_ERROR, 0, _("Dedupengine \"%s\": vacuum failed. ERR=%s"),
+           m_name, errmsg);
+   }
+   free_pool_memory(errmsg);
+   V(m_mutex);
+}
+
+int DedupEngine::get_status(POOLMEM *&msg)
+{
+   char ed1[50], ed2[50], ed3[50], ed4[50], ed5[50], ed6[50], dt[50];
+   int len;
+
+   P(m_mutex);
+   if (m_last_vacuum) {
+      bstrftimes(dt, sizeof(dt), m_last_vacuum);
+   } else {
+      bstrncpy(dt, _("never"), sizeof(dt));
+   }
+   len = Mmsg(msg, _("Dedupengine \"%s\": Directory=%s Containers=%d\n"
+                     "   Chunks=%s Size=%s NeedVacuum=%d LastVacuum=%s\n"
+                     "   Stored=%s (%s) Deduplicated=%s (%s) Read=%s\n"),
+              m_name, m_dir, m_container,
+              edit_uint64_with_commas(m_nb_chunks, ed1),
+              edit_uint64_with_suffix(m_chunk_bytes, ed2), m_need_vacuum, dt,
+              edit_uint64_with_commas(m_nb_new, ed3),
+              edit_uint64_with_suffix(m_new_bytes, ed4),
+              edit_uint64_with_commas(m_nb_dup, ed5),
+              edit_uint64_with_suffix(m_dup_bytes, ed6),
+              edit_uint64_with_commas(m_nb_read, dt));
+   V(m_mutex);
+   return len;
+}
+
+/* Get the engine of a Dedupengine resource, opened at the first use */
+DedupEngine *get_dedupengine(DEDUPRES *res, bool readonly, POOLMEM *&errmsg)
+{
+   DedupEngine *engine;
+
+   P(engine_mutex);
+   if (!res->dedupengine) {
+      engine = New(DedupEngine(res, readonly));
+      if (!engine->open(errmsg)) {
+         delete engine;
+         V(engine_mutex);
+         return NULL;
+      }
+      res->dedupengine = engine;
+      res->dedupengine_use_count = 0;
+   }
+   res->dedupengine_use_count++;
+   engine = res->dedupengine;
+   V(engine_mutex);
+   return engine;
+}
+
+void release_dedupengine(DEDUPRES *res)
+{
+   P(engine_mutex);
+   if (res->dedupengine && --res->dedupengine_use_count <= 0) {
+      delete res->dedupengine;
+      res->dedupengine = NULL;
+      res->dedupengine_use_count = 0;
+   }
+   V(engine_mutex);
+}
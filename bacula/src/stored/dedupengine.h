@@ -0,0 +1,143 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+*/
+/*
+ * Dedupengine of the Dedup devices
+ *
+ * The chunks are appended to container files, a chunk is
+ *
+ *   <magic:uint32><size:uint32><hash><data>
+ *
+ *  and the index file gives the place of each chunk
+ *
+ *   <hash><container:uint32><size:uint32><offset:uint64>
+ *
+ *  The index is loaded in memory when the engine is opened. The
+ *  chunk is written before its index entry, so a crash can only
+ *  leave a chunk without entry, that is cut at the next open.
+ *
+ *  The hashes of the references written in a volume are kept in
+ *  <DedupDirectory>/refs/<volume>.ref. When a volume is truncated,
+ *  its file is removed and the vacuum drops the chunks that are no
+ *  longer referenced by any volume.
+ */
+
+#ifndef _DEDUPENGINE_H_
+#define _DEDUPENGINE_H_
+
+#define DEDUP_CONTAINER_MAGIC   0x42444331      /* "BDC1" */
+#define DEDUP_INDEX_MAGIC       0x42444931      /* "BDI1" */
+#define DEDUP_CHUNK_HDR_SIZE    (2*sizeof(uint32_t)+DEDUP_HASH_SIZE)
+#define DEDUP_INDEX_HDR_SIZE    (2*sizeof(uint32_t))
+#define DEDUP_INDEX_ENTRY_SIZE  (DEDUP_HASH_SIZE+2*sizeof(uint32_t)+sizeof(uint64_t))
+#define DEDUP_DEFAULT_CONTAINER_SIZE (1024*1024*1024LL)
+
+/* The place of a chunk, entries with the same key are chained */
+struct dedup_entry {
+   hlink link;
+   dedup_entry *next;                 /* same 64 bit key */
+   unsigned char hash[DEDUP_HASH_SIZE];
+   uint32_t container;
+   uint32_t size;
+   uint64_t offset;                   /* of the chunk header */
+   bool mark;                         /* referenced, see vacuum() */
+};
+
+class DedupEngine: public SMARTALLOC {
+   pthread_mutex_t m_mutex;
+   char *m_name;
+   POOLMEM *m_dir;                    /* containers and refs */
+   POOLMEM *m_index_dir;              /* index file */
+   uint64_t m_max_container_size;
+   bool m_check_hash;                 /* check the chunks read */
+   bool m_readonly;                   /* bls, bextract, ... */
+   htable *m_index;
+   int m_index_fd;
+   uint32_t m_container;              /* container of the new chunks */
+   int m_container_fd;
+   uint64_t m_container_size;
+   uint32_t m_read_container;         /* last container read */
+   int m_read_fd;
+   alist *m_devices;                  /* devices using the engine */
+   int m_writers;                     /* backups sending chunks */
+   bool m_need_vacuum;
+   POOLMEM *m_buf;                    /* header and data of a chunk */
+
+   /* Statistics */
+   uint64_t m_nb_chunks;              /* in the index */
+   uint64_t m_chunk_bytes;
+   uint64_t m_nb_new;                 /* since the start */
+   uint64_t m_new_bytes;
+   uint64_t m_nb_dup;
+   uint64_t m_dup_bytes;
+   uint64_t m_nb_read;
+   time_t m_last_vacuum;
+
+   void index_fname(POOLMEM *&fname, const char *ext);
+   void container_fname(POOLMEM *&fname, uint32_t container);
+   void refs_fname(POOLMEM *&fname, const char *VolumeName);
+   void vacuum_fname(POOLMEM *&fname);
+   dedup_entry *lookup(const unsigned char *hash);
+   dedup_entry *add_entry(const unsigned char *hash, uint32_t container,
+                          uint32_t size, uint64_t offset);
+   bool load_index(POOLMEM *&errmsg);
+   bool open_container(uint32_t container, uint64_t size, POOLMEM *&errmsg);
+   bool write_chunk(const unsigned char *hash, const char *buf, uint32_t size,
+                    uint32_t *container, uint64_t *offset, POOLMEM *&errmsg);
+   bool write_entry(int fd, dedup_entry *entry, POOLMEM *&errmsg);
+   int read_at(dedup_entry *entry, char *buf, POOLMEM *&errmsg);
+   bool mark_refs(POOLMEM *&errmsg);
+   bool is_busy();
+   bool do_vacuum(JCR *jcr, POOLMEM *&errmsg);
+
+public:
+   DedupEngine(DEDUPRES *res, bool readonly);
+   ~DedupEngine();
+
+   bool open(POOLMEM *&errmsg);
+   void close();
+   const char *name() { return m_name; };
+   bool is_readonly() { return m_readonly; };
+   bool check_hash() { return m_check_hash; };
+
+   /* Backup */
+   void inc_writers();
+   void dec_writers();
+   bool is_known(const unsigned char *hash);
+   bool store_chunk(const unsigned char *hash, const char *buf, uint32_t size,
+                    bool *is_new, POOLMEM *&errmsg);
+   bool sync(POOLMEM *&errmsg);
+
+   /* Restore */
+   int read_chunk(const unsigned char *hash, char *buf, POOLMEM *&errmsg);
+
+   /* References in the volumes */
+   bool add_refs(const char *VolumeName, const char *hashes, int nb,
+                 POOLMEM *&errmsg);
+   void remove_refs(const char *VolumeName);
+   void register_device(DEVICE *dev);
+   void unregister_device(DEVICE *dev);
+   void vacuum(JCR *jcr);
+
+   int get_status(POOLMEM *&msg);
+};
+
+DedupEngine *get_dedupengine(DEDUPRES *res, bool readonly, POOLMEM *&errmsg);
+void release_dedupengine(DEDUPRES *res);
+
+#endif /* _DEDUPENGINE_H_ */
@@ -702,6 +702,7 @@ public:
          { return New(GetMsg(jcr, sock, NULL, bufsize)); };
    virtual void *dedup_get_dedupengine() { return NULL; };
    virtual void dedup_get_status(STATUS_PKT *sp, int options) { };
+   virtual int dedup_edit_status(POOLMEM *&msg) { return 0; };
    virtual bool dedup_cmd(JCR *jcr) { return false; };
    virtual const char *dedup_get_dedupengine_name() { return "not_a_dedupengine"; };
 private:
@@ -37,7 +37,7 @@ const int dbglvl = 50;
 static char hello_sd[]  = "Hello Bacula SD: Start Job %s %d %d tlspsk=%d\n";
 
 static char Sorry[]     = "3999 No go\n";
-static char OK_hello[]  = "3000 OK Hello %d\n";
+static char OK_hello[]  = "3000 OK Hello %d comm=%d\n";
 
 /* We store caps in a special structure to update JCR
  * only after the auth phase
@@ -353,7 +353,7 @@ bool read_client_hello(JCR *jcr)
  */
 bool send_hello_ok(BSOCK *bs)
 {
-   return bs->fsend(OK_hello, SD_VERSION);
+   return bs->fsend(OK_hello, SD_VERSION, comm_stream_capabilities());
 }
 
 bool send_sorry(BSOCK *bs)
@@ -399,7 +399,8 @@ bool send_hello_client(JCR *jcr, char *Job)
    bash_spaces(Job);
    // This is a "dummy" hello, just to connect to the waiting FD job
    // No need of a TLS-PSK field here, the FD will send the "real" TLS-PSK field
-   rtn = cl->fsend("Hello FD: Bacula Storage calling Start Job %s %d\n", Job, SD_VERSION);
+   rtn = cl->fsend("Hello FD: Bacula Storage calling Start Job %s %d comm=%d\n", Job, SD_VERSION,
+                   comm_stream_capabilities());
    unbash_spaces(Job);
    if (!rtn) {
       return false;
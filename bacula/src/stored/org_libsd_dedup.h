@@ -0,0 +1,93 @@
+/*
+   Bacula(R) - The Network Backup Solution
+
+   Copyright (C) 2000-2020 Kern Sibbald
+
+   The original author of Bacula is Kern Sibbald, with contributions
+   from many others, a complete list can be found in the file AUTHORS.
+
+   You may use this file and others of this release according to the
+   license defined in the LICENSE file, which includes the Affero General
+   Public License, v3.0 ("AGPLv3") and some additional permissions and
+   terms pursuant to its AGPLv3 Section 7.
+
+   This notice must be preserved when any source code is
+   conveyed and/or propagated.
+
+   Bacula(R) is a registered trademark of Kern Sibbald.
+*/
+/*
+ * Configuration of the Dedupengine resource, included by stored_conf.c
+ */
+
+/* Name of the Dedupengine defined by the DedupDirectory of the Storage */
+const char *default_legacy_dedupengine = "default_legacy_dedupengine";
+
+static RES_ITEM dedup_items[] = {
+   {"Name",                  store_name,   ITEM(res_dedup.hdr.name), 0, ITEM_REQUIRED, 0},
+   {"Description",           store_str,    ITEM(res_dedup.hdr.desc), 0, 0, 0},
+   {"Driver",                store_dedup_driver, ITEM(res_dedup.driver_type), 0, ITEM_REQUIRED, 0},
+   {"DedupDirectory",        store_dir,    ITEM(res_dedup.dedup_dir), 0, ITEM_REQUIRED, 0},
+   {"DedupIndexDirectory",   store_dir,    ITEM(res_dedup.dedup_index_dir), 0, 0, 0},
+   {"DedupCheckHash",        store_bool,   ITEM(res_dedup.dedup_check_hash), 0, 0, 0},
+   {"DedupScrubMaximumBandwidth", store_speed, ITEM(res_dedup.dedup_scrub_max_bandwidth), 0, ITEM_DEFAULT, 15*1024*1024},
+   {"MaximumContainerSize",  store_size64, ITEM(res_dedup.max_container_size), 0, 0, 0},
+   {NULL, NULL, {0}, 0, 0, 0}
+};
+
+/*
+ * Dedup drivers
+ *
+ *   driver          driver code
+ */
+s_kw dedup_drivers[] = {
+   {"Legacy",       D_LEGACY_DRIVER},
+   {NULL,           0}
+};
+
+/*
+ * Store Dedup driver (Legacy)
+ */
+void store_dedup_driver(LEX *lc, RES_ITEM *item, int index, int pass)
+{
+   bool found = false;
+
+   lex_get_token(lc, T_NAME);
+   for (int i=0; dedup_drivers[i].name; i++) {
+      if (strcasecmp(lc->str, dedup_drivers[i].name) == 0) {
+         *(uint32_t *)(item->value) = dedup_drivers[i].token;
+         found = true;
+         break;
+      }
+   }
+   if (!found) {
+      scan_err1(lc, _("Expected a Dedup driver keyword, got: %s"), lc->str);
+   }
+   scan_to_eol(lc);
+   set_bit(index, res_all.hdr.item_present);
+}
+
+/*
+ * The DedupDirectory of the Storage resource defines a Dedupengine
+ *  for the Dedup devices that do not have one.
+ */
+static bool dedup_check_storage_resource(CONFIG *config)
+{
+   DEDUPRES *res;
+
+   if (!res_all.res_store.dedup_dir) {
+      return true;
+   }
+   res = (DEDUPRES *)malloc(sizeof(URES));
+   memset(res, 0, sizeof(URES));
+   res->hdr.name = bstrdup(default_legacy_dedupengine);
+   res->dedup_dir = bstrdup(res_all.res_store.dedup_dir);
+   if (res_all.res_store.dedup_index_dir) {
+      res->dedup_index_dir = bstrdup(res_all.res_store.dedup_index_dir);
+   }
+   res->max_container_size = res_all.res_store.max_container_size;
+   res->dedup_check_hash = res_all.res_store.dedup_check_hash;
+   res->dedup_scrub_max_bandwidth = res_all.res_store.dedup_scrub_max_bandwidth;
+   res->driver_type = D_LEGACY_DRIVER;
+   return config->insert_res(R_DEDUP - r_first, (RES *)res);
+}
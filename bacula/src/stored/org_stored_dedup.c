@@ -20,14 +20,26 @@
 #include "bacula.h"
 #include "stored.h"
 
+/* Dedup = storage, the SD cuts the data records in chunks */
 bool is_dedup_server_side(DEVICE *dev, int32_t stream, uint64_t stream_len)
 {
-   return false;
+   return dev->is_dedup() && is_deduplicable_stream(stream) &&
+      !(stream & (STREAM_BIT_DEDUPLICATION_DATA|STREAM_BIT_NO_DEDUPLICATION)) &&
+      stream_len >= DEDUP_MIN_BLOCK_SIZE;
 }
 
+/* The references must not be split between two blocks */
 bool is_dedup_ref(DEV_RECORD *rec, bool lazy)
 {
-   return false;
+   int32_t len = DEDUP_REF_SIZE;
+
+   if (!(rec->Stream & STREAM_BIT_DEDUPLICATION_DATA)) {
+      return false;
+   }
+   if (is_offset_stream(rec->Stream)) {
+      len += OFFSET_FADDR_SIZE;
+   }
+   return (int32_t)rec->data_len == len;
 }
 
 
@@ -38,6 +50,30 @@ void dedup_get_limits(int64_t *nofile, int64_t *memlock)
 /* dump the status of all dedupengines */
 void list_dedupengines(char *cmd, STATUS_PKT *sp)
 {
+   POOL_MEM msg(PM_MESSAGE);
+   alist engines(5, not_owned_by_alist);
+   DEVRES *device;
+   void *engine, *e;
+   bool found;
+   int len;
+
+   foreach_res(device, R_DEVICE) {
+      if (!device->dev || !device->dev->is_dedup() ||
+          !(engine = device->dev->dedup_get_dedupengine())) {
+         continue;
+      }
+      found = false;
+      foreach_alist(e, &engines) {
+         found = found || e == engine;
+      }
+      if (found) {
+         continue;
+      }
+      engines.append(engine);
+      if ((len = device->dev->dedup_edit_status(msg.addr())) > 0) {
+         send_status_msg(sp, msg.c_str(), len);
+      }
+   }
 }
 
 bool dedup_parse_filter(char *fltr)
@@ -272,6 +272,7 @@ extern int reservations_lock_count;
 bool send_shstore_blocked_status(DEVICE *dev, POOLMEM **msg, int *len);
 void list_shstore(DEVICE *dev, OutputWriter *ow);
 bool list_shstore(DEVICE *dev, POOLMEM **msg, int *len);
+void send_status_msg(STATUS_PKT *sp, const char *msg, int len);
 
 void    _dbg_list_one_device(DEVICE *dev, const char *f, int l);
 #define dbg_list_one_device(x, dev) if (chk_dbglvl(x))     \
@@ -344,9 +345,11 @@ int sir_init_loop(DCR *dcr,
 
 bool sir_init(DCR *dcr);
 
+/* From org_libsd_dedup.h */
+void store_dedup_driver(LEX *lc, RES_ITEM *item, int index, int pass);
+
 /* from BEE */
 #if BEEF
-void store_dedup_driver(LEX *lc, RES_ITEM *item, int index, int pass);
 void bee_setdebug_cmd_parse_options(JCR *, char *);
 void reset_bsr(BSR *root);
 #else
@@ -129,6 +129,10 @@ const char *stream_to_ascii(char *buf, int stream, int fi)
          return "contSHA256";
       case STREAM_SHA512_DIGEST:
          return "contSHA512";
+      case STREAM_XXH128_DIGEST:
+         return "contXXH128";
+      case STREAM_BLAKE3_DIGEST:
+         return "contBLAKE3";
       case STREAM_SIGNED_DIGEST:
          return "contSIGNED-DIGEST";
       case STREAM_ENCRYPTED_SESSION_DATA:
@@ -203,6 +207,10 @@ const char *stream_to_ascii(char *buf, int stream, int fi)
       return "SHA256";
    case STREAM_SHA512_DIGEST:
       return "SHA512";
+   case STREAM_XXH128_DIGEST:
+      return "XXH128";
+   case STREAM_BLAKE3_DIGEST:
+      return "BLAKE3";
    case STREAM_SIGNED_DIGEST:
       return "SIGNED-DIGEST";
    case STREAM_ENCRYPTED_SESSION_DATA:
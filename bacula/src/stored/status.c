@@ -1073,6 +1073,12 @@ static void sendit(POOL_MEM &msg, int len, STATUS_PKT *sp)
    }
 }
 
+/* Used by the status functions outside of this file */
+void send_status_msg(STATUS_PKT *sp, const char *msg, int len)
+{
+   sendit(msg, len, (void *)sp);
+}
+
 static void dbg_sendit(const char *msg, int len, void *sp)
 {
    if (len > 0) {
@@ -41,8 +41,9 @@ const int sd_dbglvl = 300;
 const int sd_dbglvl = 300;
 #endif
 
-#ifdef COMMUNITY
-#undef SD_DEDUP_SUPPORT
+/* The community Dedupengine, see dedupengine.h */
+#ifndef SD_DEDUP_SUPPORT
+#define SD_DEDUP_SUPPORT 1
 #endif
 
 #ifdef HAVE_WIN32
@@ -42,7 +42,11 @@ URES res_all;
 int32_t res_all_size = sizeof(res_all);
 
 #ifdef SD_DEDUP_SUPPORT
-# include "bee_libsd_dedup.h"
+# if BEEF
+#  include "bee_libsd_dedup.h"
+# else
+#  include "org_libsd_dedup.h"
+# endif
 #else
 #define dedup_check_storage_resource(a) true
 #endif
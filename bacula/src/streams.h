@@ -59,6 +59,8 @@
  *   STREAM_SHA1_DIGEST
  *   STREAM_SHA256_DIGEST
  *   STREAM_SHA512_DIGEST
+ *   STREAM_XXH128_DIGEST
+ *   STREAM_BLAKE3_DIGEST
  */
 #define STREAM_NONE                         0    /* Reserved Non-Stream */
 #define STREAM_UNIX_ATTRIBUTES              1    /* Generic Unix attributes */
@@ -101,6 +103,8 @@
 #define STREAM_WIN32_COMPRESSED_DATA           31    /* Compressed Win32 BackupRead data */
 #define STREAM_ENCRYPTED_FILE_COMPRESSED_DATA  32    /* Encrypted, compressed data */
 #define STREAM_ENCRYPTED_WIN32_COMPRESSED_DATA 33    /* Encrypted, compressed Win32 BackupRead data */
+#define STREAM_XXH128_DIGEST                   34    /* XXH3 128 bit digest for the file */
+#define STREAM_BLAKE3_DIGEST                   35    /* BLAKE3 digest for the file */
 
 #define STREAM_ADATA_BLOCK_HEADER             200    /* Adata block header */
 #define STREAM_ADATA_RECORD_HEADER            201    /* Adata record header */
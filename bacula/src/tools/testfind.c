@@ -44,6 +44,8 @@ static int max_path_len = 0;
 static int trunc_fname = 0;
 static int trunc_path = 0;
 static int attrs = 0;
+static int bench_loops = 0;
+static int bench_files = 0;
 static CONFIG *config;
 
 static JCR *jcr;
@@ -52,6 +54,8 @@ static int print_file(JCR *jcr, FF_PKT *ff, bool);
 static void count_files(FF_PKT *ff);
 static bool copy_fileset(FF_PKT *ff, JCR *jcr);
 static void set_options(findFOPTS *fo, const char *opts);
+static void add_regex(findFOPTS *fo, const char *item, int type);
+static void bench_walk(FF_PKT *ff, bool legacy);
 
 static void usage()
 {
@@ -59,6 +63,8 @@ static void usage()
 "\n"
 "Usage: testfind [-d debug_level] [-] [pattern1 ...]\n"
 "       -a          print extended attributes (Win32 debug)\n"
+"       -b <nn>     walk <nn> more times with the patterns matched one by one\n"
+"                   and with the compiled patterns, print the times\n"
 "       -d <nn>     set debug level to <nn>\n"
 "       -dt         print timestamp in debug output\n"
 "       -c          specify config file containing FileSet resources\n"
@@ -83,7 +89,7 @@ main (int argc, char *const *argv)
    FF_PKT *ff;
    const char *configfile = "bacula-dir.conf";
    const char *fileset_name = "Windows-Full-Set";
-   int ch, hard_links;
+   int ch, hard_links = 0;
 
    OSDependentInit();
 
@@ -92,12 +98,16 @@ main (int argc, char *const *argv)
    textdomain("bacula");
    lmgr_init_thread();
 
-   while ((ch = getopt(argc, argv, "ac:d:f:?")) != -1) {
+   while ((ch = getopt(argc, argv, "ab:c:d:f:?")) != -1) {
       switch (ch) {
          case 'a':                    /* print extended attributes *debug* */
             attrs = 1;
             break;
 
+         case 'b':                    /* benchmark the FileSet matching */
+            bench_loops = atoi(optarg);
+            break;
+
          case 'c':                    /* set debug level */
             configfile = optarg;
             break;
@@ -160,6 +170,15 @@ main (int argc, char *const *argv)
 
    find_files(jcr, ff, print_file, NULL);
 
+   if (bench_loops > 0) {
+      /* The tree is in the cache, only the matching differs */
+      hard_links = term_find_one(ff);
+      for (int i = 0; i < bench_loops; i++) {
+         bench_walk(ff, true);
+         bench_walk(ff, false);
+      }
+   }
+
    free_jcr(jcr);
    if (config) {
       delete config;
@@ -178,9 +197,16 @@ main (int argc, char *const *argv)
          findINCEXE *incexe = (findINCEXE *)fileset->include_list.get(i);
          for (j=0; j<incexe->opts_list.size(); j++) {
             findFOPTS *fo = (findFOPTS *)incexe->opts_list.get(j);
+            free_fopts_matcher(fo);
             for (k=0; k<fo->regex.size(); k++) {
                regfree((regex_t *)fo->regex.get(k));
             }
+            for (k=0; k<fo->regexdir.size(); k++) {
+               regfree((regex_t *)fo->regexdir.get(k));
+            }
+            for (k=0; k<fo->regexfile.size(); k++) {
+               regfree((regex_t *)fo->regexfile.get(k));
+            }
             fo->regex.destroy();
             fo->regexdir.destroy();
             fo->regexfile.destroy();
@@ -193,6 +219,7 @@ main (int argc, char *const *argv)
          }
          incexe->opts_list.destroy();
          incexe->name_list.destroy();
+         delete incexe->name_set;
       }
       fileset->include_list.destroy();
 
@@ -201,6 +228,7 @@ main (int argc, char *const *argv)
          findINCEXE *incexe = (findINCEXE *)fileset->exclude_list.get(i);
          for (j=0; j<incexe->opts_list.size(); j++) {
             findFOPTS *fo = (findFOPTS *)incexe->opts_list.get(j);
+            free_fopts_matcher(fo);
             fo->regex.destroy();
             fo->regexdir.destroy();
             fo->regexfile.destroy();
@@ -213,12 +241,13 @@ main (int argc, char *const *argv)
          }
          incexe->opts_list.destroy();
          incexe->name_list.destroy();
+         delete incexe->name_set;
       }
       fileset->exclude_list.destroy();
       free(fileset);
    }
    ff->fileset = NULL;
-   hard_links = term_find_files(ff);
+   hard_links += term_find_files(ff);
 
    printf(_("\n"
 "Total files    : %d\n"
@@ -410,6 +439,57 @@ static void count_files(FF_PKT *ar)
 
 bool python_set_prog(JCR*, char const*) { return false; }
 
+static int bench_file(JCR *jcr, FF_PKT *ff, bool top_level)
+{
+   if (ff->type != FT_DIRBEGIN) {
+      bench_files++;
+   }
+   return 1;
+}
+
+/* Walk the FileSet again and print the time */
+static void bench_walk(FF_PKT *ff, bool legacy)
+{
+   btime_t start = get_current_btime();
+
+   bench_files = 0;
+   ff->legacy_match = legacy;
+   find_files(jcr, ff, bench_file, NULL);
+   term_find_one(ff);                 /* the hard links are counted once */
+   printf(_("%-20s: %d files in %lld ms\n"),
+          legacy ? _("Pattern by pattern") : _("Compiled patterns"),
+          bench_files, (long long)((get_current_btime() - start) / 1000));
+}
+
+/* Compile a regex like the File Daemon does */
+static void add_regex(findFOPTS *fo, const char *item, int type)
+{
+   regex_t *preg = (regex_t *)malloc(sizeof(regex_t));
+   int cflags = REG_EXTENDED;
+   int rc;
+   char prbuf[500];
+
+   if (fo->flags & FO_IGNORECASE) {
+      cflags |= REG_ICASE;
+   }
+   rc = regcomp(preg, item, cflags);
+   if (rc != 0) {
+      regerror(rc, preg, prbuf, sizeof(prbuf));
+      regfree(preg);
+      free(preg);
+      fprintf(stderr, _("REGEX %s compile error. ERR=%s\n"), item, prbuf);
+      return;
+   }
+   if (type == 'D') {
+      fo->regexdir.append(preg);
+   } else if (type == 'F') {
+      fo->regexfile.append(preg);
+   } else {
+      fo->regex.append(preg);
+   }
+   add_regex_to_matcher(fo, type, item, cflags, preg);
+}
+
 static bool copy_fileset(FF_PKT *ff, JCR *jcr)
 {
    FILESET *jcr_fileset = jcr->fileset;
@@ -442,7 +522,7 @@ static bool copy_fileset(FF_PKT *ff, JCR *jcr)
             /* New include */
             fileset->incexe = (findINCEXE *)bmalloc(sizeof(findINCEXE));
             fileset->incexe->opts_list.init(1, true);
-            fileset->incexe->name_list.init(0, 0);
+            fileset->incexe->name_list.init();
             fileset->include_list.append(fileset->incexe);
          } else {
             ie = jcr_fileset->exclude_items[i];
@@ -450,7 +530,7 @@ static bool copy_fileset(FF_PKT *ff, JCR *jcr)
             /* New exclude */
             fileset->incexe = (findINCEXE *)bmalloc(sizeof(findINCEXE));
             fileset->incexe->opts_list.init(1, true);
-            fileset->incexe->name_list.init(0, 0);
+            fileset->incexe->name_list.init();
             fileset->exclude_list.append(fileset->incexe);
          }
 
@@ -475,15 +555,15 @@ static bool copy_fileset(FF_PKT *ff, JCR *jcr)
 
             for (k=0; k<fo->regex.size(); k++) {
                // fd->fsend("R %s\n", fo->regex.get(k));
-               current_opts->regex.append(bstrdup((const char *)fo->regex.get(k)));
+               add_regex(current_opts, (const char *)fo->regex.get(k), ' ');
             }
             for (k=0; k<fo->regexdir.size(); k++) {
                // fd->fsend("RD %s\n", fo->regexdir.get(k));
-               current_opts->regexdir.append(bstrdup((const char *)fo->regexdir.get(k)));
+               add_regex(current_opts, (const char *)fo->regexdir.get(k), 'D');
             }
             for (k=0; k<fo->regexfile.size(); k++) {
                // fd->fsend("RF %s\n", fo->regexfile.get(k));
-               current_opts->regexfile.append(bstrdup((const char *)fo->regexfile.get(k)));
+               add_regex(current_opts, (const char *)fo->regexfile.get(k), 'F');
             }
             for (k=0; k<fo->wild.size(); k++) {
                current_opts->wild.append(bstrdup((const char *)fo->wild.get(k)));
@@ -506,7 +586,7 @@ static bool copy_fileset(FF_PKT *ff, JCR *jcr)
          }
 
          for (j=0; j<ie->name_list.size(); j++) {
-            fileset->incexe->name_list.append(bstrdup((const char *)ie->name_list.get(j)));
+            fileset->incexe->name_list.append(new_dlistString((const char *)ie->name_list.get(j)));
          }
       }
 
@@ -579,6 +659,14 @@ static void set_options(findFOPTS *fo, const char *opts)
             p++;
             break;
 #endif
+         case '4':
+            fo->flags |= FO_XXH128;
+            p++;
+            break;
+         case '5':
+            fo->flags |= FO_BLAKE3;
+            p++;
+            break;
          default:
             /* Automatically downgrade to SHA-1 if an unsupported
              * SHA variant is specified */
@@ -609,6 +697,30 @@ static void set_options(findFOPTS *fo, const char *opts)
          }
          fo->VerifyOpts[j] = 0;
          break;
+      case 'T':                  /* walker threads */
+         fo->walker_threads = atoi(++p);
+         while (*p && *p != ':') {
+            p++;
+         }
+         break;
+      case 'Q':                  /* read ahead depth */
+         fo->read_ahead_depth = atoi(++p);
+         while (*p && *p != ':') {
+            p++;
+         }
+         break;
+      case 'G':                  /* read ahead size */
+         fo->read_ahead_size = atoi(++p);
+         while (*p && *p != ':') {
+            p++;
+         }
+         break;
+      case 'F':                  /* files to prefetch */
+         fo->prefetch_files = atoi(++p);
+         while (*p && *p != ':') {
+            p++;
+         }
+         break;
       case 'w':
          fo->flags |= FO_IF_NEWER;
          break;
@@ -627,11 +739,39 @@ static void set_options(findFOPTS *fo, const char *opts)
             fo->Compress_algo = COMPRESS_LZO1X;
             fo->Compress_level = 1; /* not used with LZO */
          }
+         else if (*p == 'l') {  /* Zl<acceleration>: lz4 */
+            p++;                /* skip l */
+            fo->flags |= FO_COMPRESS;
+            fo->Compress_algo = COMPRESS_LZ4;
+            fo->Compress_level = atoi(p);
+            while (*p && *p != ':') {
+               p++;
+            }
+         }
+         else if (*p == 's') {  /* Zs[l]<level>: zstd, l=long mode */
+            p++;                /* skip s */
+            if (*p == 'l') {
+               fo->flags |= FO_COMPRESS_LONG;
+               p++;
+            }
+            fo->flags |= FO_COMPRESS;
+            fo->Compress_algo = COMPRESS_ZSTD;
+            fo->Compress_level = atoi(p);
+            while (*p && *p != ':') {
+               p++;
+            }
+         }
          Dmsg2(200, "Compression alg=%d level=%d\n", fo->Compress_algo, fo->Compress_level);
          break;
       case 'X':
          fo->flags |= FO_XATTR;
          break;
+      case 'I':
+         fo->flags |= FO_INODE_ORDER;
+         break;
+      case 'D':
+         fo->flags |= FO_DIRECTIO;
+         break;
       default:
          Emsg1(M_ERROR, 0, _("Unknown include/exclude option: %c\n"), *p);
          break;
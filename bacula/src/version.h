@@ -171,20 +171,27 @@
  *  30005 04Jun15 - Added JobMedia queueing
  *  30006 11Apr17 - Added PoolBytes, MaxPoolBytes and Recycle
  *  30007 06Feb20 - Added can_create to the Find media request
+ *  30008 18Oct26 - Added packed messages from the FD
+ *  30009 18Oct26 - Added comm line compression streams (comm= in Hello)
  *
  * Community:
  *    305 04Jun15 - Added JobMedia queueing
  *    306 20Mar15 - Added comm line compression
  *    307 06Feb20 - Added can_create to the Find media request
  *  30007 02Dec20 - Sync with Enterprise
+ *  30008 18Oct26 - Added packed messages from the FD
+ *  30009 18Oct26 - Added comm line compression streams (comm= in Hello)
  */
 
 #ifdef COMMUNITY
-#define SD_VERSION 30007   /* Community SD version */
+#define SD_VERSION 30009   /* Community SD version */
 #else
-#define SD_VERSION 30007   /* Enterprise SD version */
+#define SD_VERSION 30009   /* Enterprise SD version */
 #endif
 
+/* First SD version that unpacks the messages packed by the FD */
+#define SD_VERSION_PACKED 30008
+
 /* FD_VERSION history Enterprise
  *   None prior to 10Mar08
  *   1 10Mar08
@@ -206,12 +213,14 @@
  * 213 04Feb15 - added snapshot protocol with the DIR
  * 214 20Mar17 - added comm line compression
  *  14 02Dec20 - Sync with Enterprise
+ *  15 18Oct26 - added accurate file list cache
+ *  16 18Oct26 - added batched accurate file list
  */
 
 #ifdef COMMUNITY
-#define FD_VERSION 14  /* make same as community Linux FD */
+#define FD_VERSION 16  /* make same as community Linux FD */
 #else
-#define FD_VERSION 14 /* Enterprise FD version */
+#define FD_VERSION 16 /* Enterprise FD version */
 #endif
 
 /*